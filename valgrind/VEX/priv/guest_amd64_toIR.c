@@ -20617,7 +20617,8 @@ Long dis_ESC_NONE (
       t2 = newTemp(Ity_I64);
       assign(t2, mkU64((Addr64)d64));
       make_redzone_AbiHint(vbi, t1, t2/*nia*/, "call-d32");
-      if (resteerOkFn( callback_opaque, (Addr64)d64) ) {
+      if (!vbi->guest_amd64_calls_end_blocks
+          && resteerOkFn( callback_opaque, (Addr64)d64) ) {
          /* follow into the call target. */
          dres->whatNext   = Dis_ResteerU;
          dres->continueAt = d64;
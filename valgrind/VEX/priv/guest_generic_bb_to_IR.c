@@ -101,6 +101,83 @@ static Bool const_False ( void* callback_opaque, Addr64 a ) {
    return False; 
 }
 
+static Bool const_to_Addr64 ( /*OUT*/Addr64* a, IRConst* con )
+{
+   switch (con->tag) {
+      case Ico_U32: *a = (Addr64)con->Ico.U32; return True;
+      case Ico_U64: *a = con->Ico.U64;         return True;
+      default:      return False;
+   }
+}
+
+/* For trace formation.  The insn whose IR starts at
+   irsb->stmts[first_stmt_idx] has ended the block with a boring
+   transfer.  If it did so with a two-way branch -- a boring exit to
+   a constant address, followed only by putting another constant
+   address in the guest IP -- ask trace_successor which way to go.
+   If it picks a side which we are able and willing to continue
+   along, rearrange the last two statements, if necessary, so that
+   the other side is the exit, and return the address to continue
+   at.  Otherwise return zero, and leave the IR alone.
+
+   We don't continue into code already in the block, since that
+   would just make a copy of it; in particular, a loop whose head is
+   the start of the block is best left to chain to itself. */
+static
+Addr64 pick_trace_successor ( IRSB* irsb, Int first_stmt_idx,
+                              VexGuestExtents* vge,
+                              Addr64 guest_IP_bbstart,
+                              Int offB_GUEST_IP,
+                              void* callback_opaque,
+                              Addr64 (*trace_successor)(void*,Addr64,Addr64),
+                              Bool (*chase_into_ok)(void*,Addr64) )
+{
+   IRStmt* ex;
+   IRStmt* put;
+   IRConst* con;
+   Addr64  taken, not_taken, next, end;
+   Int     i;
+
+   if (irsb->stmts_used - 2 <= first_stmt_idx)
+      return 0;
+   ex  = irsb->stmts[irsb->stmts_used - 2];
+   put = irsb->stmts[irsb->stmts_used - 1];
+   vassert(put->tag == Ist_Put && put->Ist.Put.offset == offB_GUEST_IP);
+   if (ex->tag != Ist_Exit
+       || ex->Ist.Exit.jk != Ijk_Boring
+       || ex->Ist.Exit.offsIP != offB_GUEST_IP
+       || put->Ist.Put.data->tag != Iex_Const
+       || !const_to_Addr64(&taken, ex->Ist.Exit.dst)
+       || !const_to_Addr64(&not_taken, put->Ist.Put.data->Iex.Const.con)
+       || taken == not_taken)
+      return 0;
+
+   next = trace_successor(callback_opaque, taken, not_taken);
+   if (next == 0)
+      return 0;
+   vassert(next == taken || next == not_taken);
+
+   if (next == guest_IP_bbstart)
+      return 0;
+   for (i = 0; i < vge->n_used; i++)
+      if (next >= vge->base[i] && next < vge->base[i] + vge->len[i])
+         return 0;
+   /* Carrying straight on doesn't need a new extent. */
+   end = vge->base[vge->n_used-1] + vge->len[vge->n_used-1];
+   if (next != end && vge->n_used >= 3)
+      return 0;
+   if (!chase_into_ok(callback_opaque, next))
+      return 0;
+
+   if (next == taken) {
+      con = ex->Ist.Exit.dst;
+      ex->Ist.Exit.guard = IRExpr_Unop(Iop_Not1, ex->Ist.Exit.guard);
+      ex->Ist.Exit.dst   = put->Ist.Put.data->Iex.Const.con;
+      put->Ist.Put.data  = IRExpr_Const(con);
+   }
+   return next;
+}
+
 /* Disassemble a complete basic block, starting at guest_IP_start, 
    returning a new IRSB.  The disassembler may chase across basic
    block boundaries if it wishes and if chase_into_ok allows it.
@@ -135,6 +212,13 @@ static Bool const_False ( void* callback_opaque, Addr64 a ) {
    guest_TILEN.  Since this routine has to work for any guest state,
    without knowing what it is, those offsets have to passed in.
 
+   trace_successor, if not NULL, is a callback which is asked which
+   side of a conditional branch to continue along, so as to form a
+   trace through the hot path.  See pick_trace_successor.  If it is
+   supplied, dis_instr_fn is never allowed to chase conditional
+   branches itself.  The number of branches continued along is put
+   in n_trace_steps, for stats purposes.
+
    callback_opaque is a caller-supplied pointer to data which the
    callbacks may want to see.  Vex has no idea what it is.
    (In fact it's a VgInstrumentClosure.)
@@ -181,11 +265,13 @@ IRSB* bb_to_IR (
          /*OUT*/VexGuestExtents* vge,
          /*OUT*/UInt*            n_sc_extents,
          /*OUT*/UInt*            n_guest_instrs, /* stats only */
+         /*OUT*/UInt*            n_trace_steps,  /* stats only */
          /*IN*/ void*            callback_opaque,
          /*IN*/ DisOneInstrFn    dis_instr_fn,
          /*IN*/ UChar*           guest_code,
          /*IN*/ Addr64           guest_IP_bbstart,
          /*IN*/ Bool             (*chase_into_ok)(void*,Addr64),
+         /*IN*/ Addr64           (*trace_successor)(void*,Addr64,Addr64),
          /*IN*/ Bool             host_bigendian,
          /*IN*/ Bool             sigill_diag,
          /*IN*/ VexArch          arch_guest,
@@ -212,7 +298,8 @@ IRSB* bb_to_IR (
    IRSB*      irsb;
    Addr64     guest_IP_curr_instr;
    IRConst*   guest_IP_bbstart_IRConst = NULL;
-   Int        n_cond_resteers_allowed = 2;
+   Int        n_cond_resteers_allowed = trace_successor ? 0 : 2;
+   Addr64     next;
 
    Bool (*resteerOKfn)(void*,Addr64) = NULL;
 
@@ -248,6 +335,7 @@ IRSB* bb_to_IR (
    delta    = 0;
    n_instrs = 0;
    *n_guest_instrs = 0;
+   *n_trace_steps  = 0;
 
    /* Guest addresses as IRConsts.  Used in self-checks to specify the
       restart-after-discard point. */
@@ -302,7 +390,8 @@ IRSB* bb_to_IR (
          tells us it has chased a conditional branch.  We then
          decrement it, and use it to tell later calls to dis_instr_fn
          whether or not it is allowed to chase conditional
-         branches. */
+         branches.  When forming traces it starts at zero, since
+         then we make those decisions here instead. */
       vassert(n_cond_resteers_allowed >= 0 && n_cond_resteers_allowed <= 2);
 
       /* This is the IP of the instruction we're just about to deal
@@ -446,6 +535,32 @@ IRSB* bb_to_IR (
          case Dis_StopHere:
             vassert(dres.continueAt == 0);
             vassert(dres.jk_StopHere != Ijk_INVALID);
+            /* If we're forming a trace, maybe keep going along one
+               side of a conditional branch. */
+            if (trace_successor
+                && dres.jk_StopHere == Ijk_Boring
+                && n_instrs < vex_control.guest_chase_thresh) {
+               next = pick_trace_successor( irsb, first_stmt_idx, vge,
+                                            guest_IP_bbstart, offB_GUEST_IP,
+                                            callback_opaque,
+                                            trace_successor,
+                                            chase_into_ok );
+               if (next != 0) {
+                  (*n_trace_steps)++;
+                  if (next != vge->base[vge->n_used-1]
+                              + vge->len[vge->n_used-1]) {
+                     vge->n_used++;
+                     vassert(vge->n_used <= 3);
+                     vge->base[vge->n_used-1] = next;
+                     vge->len[vge->n_used-1]  = 0;
+                  }
+                  delta = next - guest_IP_bbstart;
+                  if (debug_print)
+                     vex_printf("\n              trace continues at 0x%llx\n",
+                                next);
+                  break;
+               }
+            }
             /* See comment above re irsb field settings here. */
             irsb->next = IRExpr_Get(offB_GUEST_IP, guest_word_type);
             irsb->jumpkind = dres.jk_StopHere;
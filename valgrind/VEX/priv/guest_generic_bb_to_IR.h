@@ -171,11 +171,13 @@ IRSB* bb_to_IR (
          /*OUT*/VexGuestExtents* vge,
          /*OUT*/UInt*            n_sc_extents,
          /*OUT*/UInt*            n_guest_instrs, /* stats only */
+         /*OUT*/UInt*            n_trace_steps,  /* stats only */
          /*IN*/ void*            callback_opaque,
          /*IN*/ DisOneInstrFn    dis_instr_fn,
          /*IN*/ UChar*           guest_code,
          /*IN*/ Addr64           guest_IP_bbstart,
          /*IN*/ Bool             (*chase_into_ok)(void*,Addr64),
+         /*IN*/ Addr64           (*trace_successor)(void*,Addr64,Addr64),
          /*IN*/ Bool             host_bigendian,
          /*IN*/ Bool             sigill_diag,
          /*IN*/ VexArch          arch_guest,
@@ -36,11 +36,17 @@
 #include "libvex_basictypes.h"
 #include "libvex.h"
 #include "libvex_trc_values.h"
+#include "libvex_guest_amd64.h"
 
 #include "main_util.h"
 #include "host_generic_regs.h"
 #include "host_amd64_defs.h"
 
+/* KLUDGE: as with s390_host_hwcaps, emit_AMD64Instr needs to know
+   the host's hwcaps but is not passed them.  This is set as a side
+   effect of iselSB_AMD64, which always runs before emission. */
+UInt amd64_host_hwcaps = 0;
+
 
 /* --------- Registers. --------- */
 
@@ -72,6 +78,11 @@ void ppHRegAMD64 ( HReg reg )
          vassert(r >= 0 && r < 16);
          vex_printf("%%xmm%d", r);
          return;
+      case HRcVec256:
+         r = hregNumber(reg);
+         vassert(r >= 0 && r < 16);
+         vex_printf("%%ymm%d", r);
+         return;
       default:
          vpanic("ppHRegAMD64");
    }
@@ -131,9 +142,17 @@ HReg hregAMD64_XMM10 ( void ) { return mkHReg(10, HRcVec128, False); }
 HReg hregAMD64_XMM11 ( void ) { return mkHReg(11, HRcVec128, False); }
 HReg hregAMD64_XMM12 ( void ) { return mkHReg(12, HRcVec128, False); }
 
+HReg hregAMD64_YMM2  ( void ) { return mkHReg( 2, HRcVec256, False); }
+HReg hregAMD64_YMM13 ( void ) { return mkHReg(13, HRcVec256, False); }
+HReg hregAMD64_YMM14 ( void ) { return mkHReg(14, HRcVec256, False); }
+HReg hregAMD64_YMM15 ( void ) { return mkHReg(15, HRcVec256, False); }
 
-void getAllocableRegs_AMD64 ( Int* nregs, HReg** arr )
+
+void getAllocableRegs_AMD64 ( Int* nregs, HReg** arr, UInt hwcaps )
 {
+   /* The ymm regs are only offered on AVX2 hosts, since only then
+      does the instruction selector generate Vec256 vregs. */
+   Bool avx2 = toBool(hwcaps & VEX_HWCAPS_AMD64_AVX2);
 #if 0
    *nregs = 6;
    *arr = LibVEX_Alloc(*nregs * sizeof(HReg));
@@ -146,7 +165,7 @@ void getAllocableRegs_AMD64 ( Int* nregs, HReg** arr )
    (*arr)[ 5] = hregAMD64_XMM9();
 #endif
 #if 1
-   *nregs = 20;
+   *nregs = avx2 ? 24 : 20;
    *arr = LibVEX_Alloc(*nregs * sizeof(HReg));
    (*arr)[ 0] = hregAMD64_RSI();
    (*arr)[ 1] = hregAMD64_RDI();
@@ -169,6 +188,13 @@ void getAllocableRegs_AMD64 ( Int* nregs, HReg** arr )
    (*arr)[17] = hregAMD64_XMM11();
    (*arr)[18] = hregAMD64_XMM12();
    (*arr)[19] = hregAMD64_R10();
+
+   if (avx2) {
+      (*arr)[20] = hregAMD64_YMM2();
+      (*arr)[21] = hregAMD64_YMM13();
+      (*arr)[22] = hregAMD64_YMM14();
+      (*arr)[23] = hregAMD64_YMM15();
+   }
 #endif
 }
 
@@ -582,6 +608,18 @@ const HChar* showAMD64SseOp ( AMD64SseOp op ) {
       case Asse_CMPGT8S:  return "pcmpgtb";
       case Asse_CMPGT16S: return "pcmpgtw";
       case Asse_CMPGT32S: return "pcmpgtd";
+      case Asse_MUL32:    return "pmulld";
+      case Asse_MAX32S:   return "pmaxsd";
+      case Asse_MAX32U:   return "pmaxud";
+      case Asse_MAX16U:   return "pmaxuw";
+      case Asse_MAX8S:    return "pmaxsb";
+      case Asse_MIN32S:   return "pminsd";
+      case Asse_MIN32U:   return "pminud";
+      case Asse_MIN16U:   return "pminuw";
+      case Asse_MIN8S:    return "pminsb";
+      case Asse_CMPEQ64:  return "pcmpeqq";
+      case Asse_CMPGT64S: return "pcmpgtq";
+      case Asse_PERM32:   return "permd";
       case Asse_SHL16:    return "psllw";
       case Asse_SHL32:    return "pslld";
       case Asse_SHL64:    return "psllq";
@@ -593,6 +631,7 @@ const HChar* showAMD64SseOp ( AMD64SseOp op ) {
       case Asse_PACKSSD:  return "packssdw";
       case Asse_PACKSSW:  return "packsswb";
       case Asse_PACKUSW:  return "packuswb";
+      case Asse_PACKUSD:  return "packusdw";
       case Asse_UNPCKHB:  return "punpckhb";
       case Asse_UNPCKHW:  return "punpckhw";
       case Asse_UNPCKHD:  return "punpckhd";
@@ -736,6 +775,27 @@ AMD64Instr* AMD64Instr_XAssisted ( HReg dstGA, AMD64AMode* amRIP,
    return i;
 }
 
+AMD64Instr* AMD64Instr_RetPush ( Addr64 ra, AMD64AMode* amRetStack,
+                                 AMD64AMode* amRSP ) {
+   AMD64Instr* i              = LibVEX_Alloc(sizeof(AMD64Instr));
+   i->tag                     = Ain_RetPush;
+   i->Ain.RetPush.ra          = ra;
+   i->Ain.RetPush.amRetStack  = amRetStack;
+   i->Ain.RetPush.amRSP       = amRSP;
+   return i;
+}
+AMD64Instr* AMD64Instr_RetPop ( HReg dstGA, AMD64AMode* amRIP,
+                                AMD64AMode* amRetStack,
+                                AMD64AMode* amRSP ) {
+   AMD64Instr* i             = LibVEX_Alloc(sizeof(AMD64Instr));
+   i->tag                    = Ain_RetPop;
+   i->Ain.RetPop.dstGA       = dstGA;
+   i->Ain.RetPop.amRIP       = amRIP;
+   i->Ain.RetPop.amRetStack  = amRetStack;
+   i->Ain.RetPop.amRSP       = amRSP;
+   return i;
+}
+
 AMD64Instr* AMD64Instr_CMov64 ( AMD64CondCode cond, AMD64RM* src, HReg dst ) {
    AMD64Instr* i      = LibVEX_Alloc(sizeof(AMD64Instr));
    i->tag             = Ain_CMov64;
@@ -979,23 +1039,62 @@ AMD64Instr* AMD64Instr_SseShuf ( Int order, HReg src, HReg dst ) {
    vassert(order >= 0 && order <= 0xFF);
    return i;
 }
-//uu AMD64Instr* AMD64Instr_AvxLdSt ( Bool isLoad,
-//uu                                  HReg reg, AMD64AMode* addr ) {
-//uu    AMD64Instr* i         = LibVEX_Alloc(sizeof(AMD64Instr));
-//uu    i->tag                = Ain_AvxLdSt;
-//uu    i->Ain.AvxLdSt.isLoad = isLoad;
-//uu    i->Ain.AvxLdSt.reg    = reg;
-//uu    i->Ain.AvxLdSt.addr   = addr;
-//uu    return i;
-//uu }
-//uu AMD64Instr* AMD64Instr_AvxReRg ( AMD64SseOp op, HReg re, HReg rg ) {
-//uu    AMD64Instr* i      = LibVEX_Alloc(sizeof(AMD64Instr));
-//uu    i->tag             = Ain_AvxReRg;
-//uu    i->Ain.AvxReRg.op  = op;
-//uu    i->Ain.AvxReRg.src = re;
-//uu    i->Ain.AvxReRg.dst = rg;
-//uu    return i;
-//uu }
+AMD64Instr* AMD64Instr_AvxLdSt ( Bool isLoad,
+                                 HReg reg, AMD64AMode* addr ) {
+   AMD64Instr* i         = LibVEX_Alloc(sizeof(AMD64Instr));
+   i->tag                = Ain_AvxLdSt;
+   i->Ain.AvxLdSt.isLoad = isLoad;
+   i->Ain.AvxLdSt.reg    = reg;
+   i->Ain.AvxLdSt.addr   = addr;
+   return i;
+}
+AMD64Instr* AMD64Instr_Avx32Fx8 ( AMD64SseOp op, HReg src, HReg dst ) {
+   AMD64Instr* i       = LibVEX_Alloc(sizeof(AMD64Instr));
+   i->tag              = Ain_Avx32Fx8;
+   i->Ain.Avx32Fx8.op  = op;
+   i->Ain.Avx32Fx8.src = src;
+   i->Ain.Avx32Fx8.dst = dst;
+   vassert(op != Asse_MOV);
+   return i;
+}
+AMD64Instr* AMD64Instr_Avx64Fx4 ( AMD64SseOp op, HReg src, HReg dst ) {
+   AMD64Instr* i       = LibVEX_Alloc(sizeof(AMD64Instr));
+   i->tag              = Ain_Avx64Fx4;
+   i->Ain.Avx64Fx4.op  = op;
+   i->Ain.Avx64Fx4.src = src;
+   i->Ain.Avx64Fx4.dst = dst;
+   vassert(op != Asse_MOV);
+   return i;
+}
+AMD64Instr* AMD64Instr_AvxReRg ( AMD64SseOp op, HReg re, HReg rg ) {
+   AMD64Instr* i      = LibVEX_Alloc(sizeof(AMD64Instr));
+   i->tag             = Ain_AvxReRg;
+   i->Ain.AvxReRg.op  = op;
+   i->Ain.AvxReRg.src = re;
+   i->Ain.AvxReRg.dst = rg;
+   return i;
+}
+AMD64Instr* AMD64Instr_AvxExtract ( Bool hi, HReg src, HReg dst ) {
+   AMD64Instr* i         = LibVEX_Alloc(sizeof(AMD64Instr));
+   i->tag                = Ain_AvxExtract;
+   i->Ain.AvxExtract.hi  = hi;
+   i->Ain.AvxExtract.src = src;
+   i->Ain.AvxExtract.dst = dst;
+   return i;
+}
+AMD64Instr* AMD64Instr_AvxConcat ( HReg hi, HReg lo, HReg dst ) {
+   AMD64Instr* i        = LibVEX_Alloc(sizeof(AMD64Instr));
+   i->tag               = Ain_AvxConcat;
+   i->Ain.AvxConcat.hi  = hi;
+   i->Ain.AvxConcat.lo  = lo;
+   i->Ain.AvxConcat.dst = dst;
+   return i;
+}
+AMD64Instr* AMD64Instr_VZeroUpper ( void ) {
+   AMD64Instr* i = LibVEX_Alloc(sizeof(AMD64Instr));
+   i->tag        = Ain_VZeroUpper;
+   return i;
+}
 AMD64Instr* AMD64Instr_EvCheck ( AMD64AMode* amCounter,
                                  AMD64AMode* amFailAddr ) {
    AMD64Instr* i             = LibVEX_Alloc(sizeof(AMD64Instr));
@@ -1114,6 +1213,24 @@ void ppAMD64Instr ( AMD64Instr* i, Bool mode64 )
                     (Int)i->Ain.XAssisted.jk);
          vex_printf("; movabsq $disp_assisted,%%r11; jmp *%%r11 }");
          return;
+      case Ain_RetPush:
+         vex_printf("(retPush) { push 0x%llx,", i->Ain.RetPush.ra);
+         ppAMD64AMode(i->Ain.RetPush.amRSP);
+         vex_printf(",$disp_ret_fill on *");
+         ppAMD64AMode(i->Ain.RetPush.amRetStack);
+         vex_printf(" }");
+         return;
+      case Ain_RetPop:
+         vex_printf("(retPop) { movq ");
+         ppHRegAMD64(i->Ain.RetPop.dstGA);
+         vex_printf(",");
+         ppAMD64AMode(i->Ain.RetPop.amRIP);
+         vex_printf("; if (top of *");
+         ppAMD64AMode(i->Ain.RetPop.amRetStack);
+         vex_printf(" is for ");
+         ppHRegAMD64(i->Ain.RetPop.dstGA);
+         vex_printf(") pop it and go there; else if stale pop it }");
+         return;
 
       case Ain_CMov64:
          vex_printf("cmov%s ", showAMD64CondCode(i->Ain.CMov64.cond));
@@ -1292,24 +1409,56 @@ void ppAMD64Instr ( AMD64Instr* i, Bool mode64 )
          vex_printf(",");
          ppHRegAMD64(i->Ain.SseShuf.dst);
          return;
-      //uu case Ain_AvxLdSt:
-      //uu    vex_printf("vmovups ");
-      //uu    if (i->Ain.AvxLdSt.isLoad) {
-      //uu       ppAMD64AMode(i->Ain.AvxLdSt.addr);
-      //uu       vex_printf(",");
-      //uu       ppHRegAMD64(i->Ain.AvxLdSt.reg);
-      //uu    } else {
-      //uu       ppHRegAMD64(i->Ain.AvxLdSt.reg);
-      //uu       vex_printf(",");
-      //uu       ppAMD64AMode(i->Ain.AvxLdSt.addr);
-      //uu    }
-      //uu    return;
-      //uu case Ain_AvxReRg:
-      //uu    vex_printf("v%s ", showAMD64SseOp(i->Ain.SseReRg.op));
-      //uu    ppHRegAMD64(i->Ain.AvxReRg.src);
-      //uu    vex_printf(",");
-      //uu    ppHRegAMD64(i->Ain.AvxReRg.dst);
-      //uu    return;
+      case Ain_AvxLdSt:
+         vex_printf("vmovups ");
+         if (i->Ain.AvxLdSt.isLoad) {
+            ppAMD64AMode(i->Ain.AvxLdSt.addr);
+            vex_printf(",");
+            ppHRegAMD64(i->Ain.AvxLdSt.reg);
+         } else {
+            ppHRegAMD64(i->Ain.AvxLdSt.reg);
+            vex_printf(",");
+            ppAMD64AMode(i->Ain.AvxLdSt.addr);
+         }
+         return;
+      case Ain_Avx32Fx8:
+         vex_printf("v%sps ", showAMD64SseOp(i->Ain.Avx32Fx8.op));
+         ppHRegAMD64(i->Ain.Avx32Fx8.src);
+         vex_printf(",");
+         ppHRegAMD64(i->Ain.Avx32Fx8.dst);
+         return;
+      case Ain_Avx64Fx4:
+         vex_printf("v%spd ", showAMD64SseOp(i->Ain.Avx64Fx4.op));
+         ppHRegAMD64(i->Ain.Avx64Fx4.src);
+         vex_printf(",");
+         ppHRegAMD64(i->Ain.Avx64Fx4.dst);
+         return;
+      case Ain_AvxReRg:
+         vex_printf("v%s ", showAMD64SseOp(i->Ain.AvxReRg.op));
+         ppHRegAMD64(i->Ain.AvxReRg.src);
+         vex_printf(",");
+         ppHRegAMD64(i->Ain.AvxReRg.dst);
+         return;
+      case Ain_AvxExtract:
+         if (i->Ain.AvxExtract.hi)
+            vex_printf("vextractf128 $1,");
+         else
+            vex_printf("vmovaps(lo) ");
+         ppHRegAMD64(i->Ain.AvxExtract.src);
+         vex_printf(",");
+         ppHRegAMD64(i->Ain.AvxExtract.dst);
+         return;
+      case Ain_AvxConcat:
+         vex_printf("vinsertf128 $1,");
+         ppHRegAMD64(i->Ain.AvxConcat.hi);
+         vex_printf(",");
+         ppHRegAMD64(i->Ain.AvxConcat.lo);
+         vex_printf(",");
+         ppHRegAMD64(i->Ain.AvxConcat.dst);
+         return;
+      case Ain_VZeroUpper:
+         vex_printf("vzeroupper");
+         return;
       case Ain_EvCheck:
          vex_printf("(evCheck) decl ");
          ppAMD64AMode(i->Ain.EvCheck.amCounter);
@@ -1395,7 +1544,7 @@ void getRegUsage_AMD64Instr ( HRegUsage* u, AMD64Instr* i, Bool mode64 )
          /* First off, claim it trashes all the caller-saved regs
             which fall within the register allocator's jurisdiction.
             These I believe to be: rax rcx rdx rsi rdi r8 r9 r10 r11 
-            and all the xmm registers.
+            and all the xmm (and hence ymm) registers.
          */
          addHRegUse(u, HRmWrite, hregAMD64_RAX());
          addHRegUse(u, HRmWrite, hregAMD64_RCX());
@@ -1418,6 +1567,10 @@ void getRegUsage_AMD64Instr ( HRegUsage* u, AMD64Instr* i, Bool mode64 )
          addHRegUse(u, HRmWrite, hregAMD64_XMM10());
          addHRegUse(u, HRmWrite, hregAMD64_XMM11());
          addHRegUse(u, HRmWrite, hregAMD64_XMM12());
+         addHRegUse(u, HRmWrite, hregAMD64_YMM2());
+         addHRegUse(u, HRmWrite, hregAMD64_YMM13());
+         addHRegUse(u, HRmWrite, hregAMD64_YMM14());
+         addHRegUse(u, HRmWrite, hregAMD64_YMM15());
 
          /* Now we have to state any parameter-carrying registers
             which might be read.  This depends on the regparmness. */
@@ -1459,6 +1612,23 @@ void getRegUsage_AMD64Instr ( HRegUsage* u, AMD64Instr* i, Bool mode64 )
          addHRegUse(u, HRmRead, i->Ain.XAssisted.dstGA);
          addRegUsage_AMD64AMode(u, i->Ain.XAssisted.amRIP);
          return;
+      case Ain_RetPush:
+         addRegUsage_AMD64AMode(u, i->Ain.RetPush.amRetStack);
+         addRegUsage_AMD64AMode(u, i->Ain.RetPush.amRSP);
+         addHRegUse(u, HRmWrite, hregAMD64_RAX());
+         addHRegUse(u, HRmWrite, hregAMD64_RCX());
+         addHRegUse(u, HRmWrite, hregAMD64_R11());
+         return;
+      case Ain_RetPop:
+         addHRegUse(u, HRmRead, i->Ain.RetPop.dstGA);
+         addRegUsage_AMD64AMode(u, i->Ain.RetPop.amRIP);
+         addRegUsage_AMD64AMode(u, i->Ain.RetPop.amRetStack);
+         addRegUsage_AMD64AMode(u, i->Ain.RetPop.amRSP);
+         addHRegUse(u, HRmWrite, hregAMD64_RAX());
+         addHRegUse(u, HRmWrite, hregAMD64_RCX());
+         addHRegUse(u, HRmWrite, hregAMD64_RDX());
+         addHRegUse(u, HRmWrite, hregAMD64_R11());
+         return;
       case Ain_CMov64:
          addRegUsage_AMD64RM(u, i->Ain.CMov64.src, HRmRead);
          addHRegUse(u, HRmModify, i->Ain.CMov64.dst);
@@ -1598,24 +1768,58 @@ void getRegUsage_AMD64Instr ( HRegUsage* u, AMD64Instr* i, Bool mode64 )
          addHRegUse(u, HRmRead,  i->Ain.SseShuf.src);
          addHRegUse(u, HRmWrite, i->Ain.SseShuf.dst);
          return;
-      //uu case Ain_AvxLdSt:
-      //uu addRegUsage_AMD64AMode(u, i->Ain.AvxLdSt.addr);
-      //uu addHRegUse(u, i->Ain.AvxLdSt.isLoad ? HRmWrite : HRmRead,
-      //uu               i->Ain.AvxLdSt.reg);
-      //uu return;
-      //uu case Ain_AvxReRg:
-      //uu    if ( (i->Ain.AvxReRg.op == Asse_XOR
-      //uu          || i->Ain.AvxReRg.op == Asse_CMPEQ32)
-      //uu         && i->Ain.AvxReRg.src == i->Ain.AvxReRg.dst) {
-      //uu       /* See comments on the case for Ain_SseReRg. */
-      //uu       addHRegUse(u, HRmWrite, i->Ain.AvxReRg.dst);
-      //uu    } else {
-      //uu       addHRegUse(u, HRmRead, i->Ain.AvxReRg.src);
-      //uu       addHRegUse(u, i->Ain.AvxReRg.op == Asse_MOV 
-      //uu                        ? HRmWrite : HRmModify, 
-      //uu                     i->Ain.AvxReRg.dst);
-      //uu    }
-      //uu    return;
+      case Ain_AvxLdSt:
+         addRegUsage_AMD64AMode(u, i->Ain.AvxLdSt.addr);
+         addHRegUse(u, i->Ain.AvxLdSt.isLoad ? HRmWrite : HRmRead,
+                       i->Ain.AvxLdSt.reg);
+         return;
+      case Ain_Avx32Fx8:
+         vassert(i->Ain.Avx32Fx8.op != Asse_MOV);
+         unary = toBool( i->Ain.Avx32Fx8.op == Asse_RCPF
+                         || i->Ain.Avx32Fx8.op == Asse_RSQRTF
+                         || i->Ain.Avx32Fx8.op == Asse_SQRTF );
+         addHRegUse(u, HRmRead, i->Ain.Avx32Fx8.src);
+         addHRegUse(u, unary ? HRmWrite : HRmModify, 
+                       i->Ain.Avx32Fx8.dst);
+         return;
+      case Ain_Avx64Fx4:
+         vassert(i->Ain.Avx64Fx4.op != Asse_MOV);
+         unary = toBool( i->Ain.Avx64Fx4.op == Asse_SQRTF );
+         addHRegUse(u, HRmRead, i->Ain.Avx64Fx4.src);
+         addHRegUse(u, unary ? HRmWrite : HRmModify, 
+                       i->Ain.Avx64Fx4.dst);
+         return;
+      case Ain_AvxReRg:
+         if ( (i->Ain.AvxReRg.op == Asse_XOR
+               || i->Ain.AvxReRg.op == Asse_CMPEQ32)
+              && sameHReg(i->Ain.AvxReRg.src, i->Ain.AvxReRg.dst)) {
+            /* See comments on the case for Ain_SseReRg. */
+            addHRegUse(u, HRmWrite, i->Ain.AvxReRg.dst);
+         } else {
+            addHRegUse(u, HRmRead, i->Ain.AvxReRg.src);
+            addHRegUse(u, i->Ain.AvxReRg.op == Asse_MOV 
+                             ? HRmWrite : HRmModify, 
+                          i->Ain.AvxReRg.dst);
+         }
+         return;
+      case Ain_AvxExtract:
+         addHRegUse(u, HRmRead,  i->Ain.AvxExtract.src);
+         addHRegUse(u, HRmWrite, i->Ain.AvxExtract.dst);
+         return;
+      case Ain_AvxConcat:
+         addHRegUse(u, HRmRead,  i->Ain.AvxConcat.hi);
+         addHRegUse(u, HRmRead,  i->Ain.AvxConcat.lo);
+         addHRegUse(u, HRmWrite, i->Ain.AvxConcat.dst);
+         return;
+      case Ain_VZeroUpper:
+         /* Only the upper halves are zeroed, but no Vec256 value
+            survives that, so claim the allocatable ymm regs are
+            trashed. */
+         addHRegUse(u, HRmWrite, hregAMD64_YMM2());
+         addHRegUse(u, HRmWrite, hregAMD64_YMM13());
+         addHRegUse(u, HRmWrite, hregAMD64_YMM14());
+         addHRegUse(u, HRmWrite, hregAMD64_YMM15());
+         return;
       case Ain_EvCheck:
          /* We expect both amodes only to mention %rbp, so this is in
             fact pointless, since %rbp isn't allocatable, but anyway.. */
@@ -1691,6 +1895,16 @@ void mapRegs_AMD64Instr ( HRegRemap* m, AMD64Instr* i, Bool mode64 )
          mapReg(m, &i->Ain.XAssisted.dstGA);
          mapRegs_AMD64AMode(m, i->Ain.XAssisted.amRIP);
          return;
+      case Ain_RetPush:
+         mapRegs_AMD64AMode(m, i->Ain.RetPush.amRetStack);
+         mapRegs_AMD64AMode(m, i->Ain.RetPush.amRSP);
+         return;
+      case Ain_RetPop:
+         mapReg(m, &i->Ain.RetPop.dstGA);
+         mapRegs_AMD64AMode(m, i->Ain.RetPop.amRIP);
+         mapRegs_AMD64AMode(m, i->Ain.RetPop.amRetStack);
+         mapRegs_AMD64AMode(m, i->Ain.RetPop.amRSP);
+         return;
       case Ain_CMov64:
          mapRegs_AMD64RM(m, i->Ain.CMov64.src);
          mapReg(m, &i->Ain.CMov64.dst);
@@ -1791,14 +2005,33 @@ void mapRegs_AMD64Instr ( HRegRemap* m, AMD64Instr* i, Bool mode64 )
          mapReg(m, &i->Ain.SseShuf.src);
          mapReg(m, &i->Ain.SseShuf.dst);
          return;
-      //uu case Ain_AvxLdSt:
-      //uu    mapReg(m, &i->Ain.AvxLdSt.reg);
-      //uu    mapRegs_AMD64AMode(m, i->Ain.AvxLdSt.addr);
-      //uu    break;
-      //uu case Ain_AvxReRg:
-      //uu    mapReg(m, &i->Ain.AvxReRg.src);
-      //uu    mapReg(m, &i->Ain.AvxReRg.dst);
-      //uu    return;
+      case Ain_AvxLdSt:
+         mapReg(m, &i->Ain.AvxLdSt.reg);
+         mapRegs_AMD64AMode(m, i->Ain.AvxLdSt.addr);
+         return;
+      case Ain_Avx32Fx8:
+         mapReg(m, &i->Ain.Avx32Fx8.src);
+         mapReg(m, &i->Ain.Avx32Fx8.dst);
+         return;
+      case Ain_Avx64Fx4:
+         mapReg(m, &i->Ain.Avx64Fx4.src);
+         mapReg(m, &i->Ain.Avx64Fx4.dst);
+         return;
+      case Ain_AvxReRg:
+         mapReg(m, &i->Ain.AvxReRg.src);
+         mapReg(m, &i->Ain.AvxReRg.dst);
+         return;
+      case Ain_AvxExtract:
+         mapReg(m, &i->Ain.AvxExtract.src);
+         mapReg(m, &i->Ain.AvxExtract.dst);
+         return;
+      case Ain_AvxConcat:
+         mapReg(m, &i->Ain.AvxConcat.hi);
+         mapReg(m, &i->Ain.AvxConcat.lo);
+         mapReg(m, &i->Ain.AvxConcat.dst);
+         return;
+      case Ain_VZeroUpper:
+         return;
       case Ain_EvCheck:
          /* We expect both amodes only to mention %rbp, so this is in
             fact pointless, since %rbp isn't allocatable, but anyway.. */
@@ -1837,13 +2070,13 @@ Bool isMove_AMD64Instr ( AMD64Instr* i, HReg* src, HReg* dst )
          *src = i->Ain.SseReRg.src;
          *dst = i->Ain.SseReRg.dst;
          return True;
-      //uu case Ain_AvxReRg:
-      //uu    /* Moves between AVX regs */
-      //uu    if (i->Ain.AvxReRg.op != Asse_MOV)
-      //uu       return False;
-      //uu    *src = i->Ain.AvxReRg.src;
-      //uu    *dst = i->Ain.AvxReRg.dst;
-      //uu    return True;
+      case Ain_AvxReRg:
+         /* Moves between AVX regs */
+         if (i->Ain.AvxReRg.op != Asse_MOV)
+            return False;
+         *src = i->Ain.AvxReRg.src;
+         *dst = i->Ain.AvxReRg.dst;
+         return True;
       default:
          return False;
    }
@@ -1871,6 +2104,9 @@ void genSpill_AMD64 ( /*OUT*/HInstr** i1, /*OUT*/HInstr** i2,
       case HRcVec128:
          *i1 = AMD64Instr_SseLdSt ( False/*store*/, 16, rreg, am );
          return;
+      case HRcVec256:
+         *i1 = AMD64Instr_AvxLdSt ( False/*store*/, rreg, am );
+         return;
       default: 
          ppHRegClass(hregClass(rreg));
          vpanic("genSpill_AMD64: unimplemented regclass");
@@ -1893,12 +2129,34 @@ void genReload_AMD64 ( /*OUT*/HInstr** i1, /*OUT*/HInstr** i2,
       case HRcVec128:
          *i1 = AMD64Instr_SseLdSt ( True/*load*/, 16, rreg, am );
          return;
+      case HRcVec256:
+         *i1 = AMD64Instr_AvxLdSt ( True/*load*/, rreg, am );
+         return;
       default: 
          ppHRegClass(hregClass(rreg));
          vpanic("genReload_AMD64: unimplemented regclass");
    }
 }
 
+/* Generate a reg-reg move, for the register allocator to use when
+   splitting a live range. */
+
+AMD64Instr* genMove_AMD64 ( HReg from, HReg to, Bool mode64 )
+{
+   vassert(mode64 == True);
+   vassert(hregClass(from) == hregClass(to));
+   switch (hregClass(from)) {
+      case HRcInt64:
+         return AMD64Instr_Alu64R ( Aalu_MOV, AMD64RMI_Reg(from), to );
+      case HRcVec128:
+         return AMD64Instr_SseReRg ( Asse_MOV, from, to );
+      case HRcVec256:
+         return AMD64Instr_AvxReRg ( Asse_MOV, from, to );
+      default:
+         return NULL;
+   }
+}
+
 
 /* --------- The amd64 assembler (bleh.) --------- */
 
@@ -1950,16 +2208,16 @@ static HReg vreg2ireg ( HReg r )
    return mkHReg(n, HRcInt64, False);
 }
 
-//uu /* Ditto for ymm regs. */
-//uu static HReg dvreg2ireg ( HReg r )
-//uu {
-//uu    UInt n;
-//uu    vassert(hregClass(r) == HRcVec256);
-//uu    vassert(!hregIsVirtual(r));
-//uu    n = hregNumber(r);
-//uu    vassert(n <= 15);
-//uu    return mkHReg(n, HRcInt64, False);
-//uu }
+/* Ditto for ymm regs. */
+static HReg dvreg2ireg ( HReg r )
+{
+   UInt n;
+   vassert(hregClass(r) == HRcVec256);
+   vassert(!hregIsVirtual(r));
+   n = hregNumber(r);
+   vassert(n <= 15);
+   return mkHReg(n, HRcInt64, False);
+}
 
 static UChar mkModRegRM ( UInt mod, UInt reg, UInt regmem )
 {
@@ -2167,85 +2425,177 @@ static UChar rexAMode_R ( HReg greg, HReg ereg )
 }
 
 
-//uu /* May 2012: this VEX prefix stuff is currently unused, but has
-//uu    verified correct (I reckon).  Certainly it has been known to
-//uu    produce correct VEX prefixes during testing. */
-//uu 
-//uu /* Assemble a 2 or 3 byte VEX prefix from parts.  rexR, rexX, rexB and
-//uu    notVvvvv need to be not-ed before packing.  mmmmm, rexW, L and pp go
-//uu    in verbatim.  There's no range checking on the bits. */
-//uu static UInt packVexPrefix ( UInt rexR, UInt rexX, UInt rexB,
-//uu                             UInt mmmmm, UInt rexW, UInt notVvvv,
-//uu                             UInt L, UInt pp )
-//uu {
-//uu    UChar byte0 = 0;
-//uu    UChar byte1 = 0;
-//uu    UChar byte2 = 0;
-//uu    if (rexX == 0 && rexB == 0 && mmmmm == 1 && rexW == 0) {
-//uu       /* 2 byte encoding is possible. */
-//uu       byte0 = 0xC5;
-//uu       byte1 = ((rexR ^ 1) << 7) | ((notVvvv ^ 0xF) << 3) 
-//uu               | (L << 2) | pp;
-//uu    } else {
-//uu       /* 3 byte encoding is needed. */
-//uu       byte0 = 0xC4;
-//uu       byte1 = ((rexR ^ 1) << 7) | ((rexX ^ 1) << 6)
-//uu               | ((rexB ^ 1) << 5) | mmmmm;
-//uu       byte2 = (rexW << 7) | ((notVvvv ^ 0xF) << 3) | (L << 2) | pp;
-//uu    }
-//uu    return (((UInt)byte2) << 16) | (((UInt)byte1) << 8) | ((UInt)byte0);
-//uu }
-//uu 
-//uu /* Make up a VEX prefix for a (greg,amode) pair.  First byte in bits
-//uu    7:0 of result, second in 15:8, third (for a 3 byte prefix) in
-//uu    23:16.  Has m-mmmm set to indicate a prefix of 0F, pp set to
-//uu    indicate no SIMD prefix, W=0 (ignore), L=1 (size=256), and
-//uu    vvvv=1111 (unused 3rd reg). */
-//uu static UInt vexAMode_M ( HReg greg, AMD64AMode* am )
-//uu {
-//uu    UChar L       = 1; /* size = 256 */
-//uu    UChar pp      = 0; /* no SIMD prefix */
-//uu    UChar mmmmm   = 1; /* 0F */
-//uu    UChar notVvvv = 0; /* unused */
-//uu    UChar rexW    = 0;
-//uu    UChar rexR    = 0;
-//uu    UChar rexX    = 0;
-//uu    UChar rexB    = 0;
-//uu    /* Same logic as in rexAMode_M. */
-//uu    if (am->tag == Aam_IR) {
-//uu       rexR = iregBit3(greg);
-//uu       rexX = 0; /* not relevant */
-//uu       rexB = iregBit3(am->Aam.IR.reg);
-//uu    }
-//uu    else if (am->tag == Aam_IRRS) {
-//uu       rexR = iregBit3(greg);
-//uu       rexX = iregBit3(am->Aam.IRRS.index);
-//uu       rexB = iregBit3(am->Aam.IRRS.base);
-//uu    } else {
-//uu       vassert(0);
-//uu    }
-//uu    return packVexPrefix( rexR, rexX, rexB, mmmmm, rexW, notVvvv, L, pp );
-//uu }
-//uu 
-//uu static UChar* emitVexPrefix ( UChar* p, UInt vex )
-//uu {
-//uu    switch (vex & 0xFF) {
-//uu       case 0xC5:
-//uu          *p++ = 0xC5;
-//uu          *p++ = (vex >> 8) & 0xFF;
-//uu          vassert(0 == (vex >> 16));
-//uu          break;
-//uu       case 0xC4:
-//uu          *p++ = 0xC4;
-//uu          *p++ = (vex >> 8) & 0xFF;
-//uu          *p++ = (vex >> 16) & 0xFF;
-//uu          vassert(0 == (vex >> 24));
-//uu          break;
-//uu       default:
-//uu          vassert(0);
-//uu    }
-//uu    return p;
-//uu }
+/* Assemble a 2 or 3 byte VEX prefix from parts.  rexR, rexX, rexB and
+   vvvv are not-ed before packing.  mmmmm, rexW, L and pp go in
+   verbatim.  There's no range checking on the bits. */
+static UInt packVexPrefix ( UInt rexR, UInt rexX, UInt rexB,
+                            UInt mmmmm, UInt rexW, UInt vvvv,
+                            UInt L, UInt pp )
+{
+   UChar byte0 = 0;
+   UChar byte1 = 0;
+   UChar byte2 = 0;
+   if (rexX == 0 && rexB == 0 && mmmmm == 1 && rexW == 0) {
+      /* 2 byte encoding is possible. */
+      byte0 = 0xC5;
+      byte1 = ((rexR ^ 1) << 7) | ((vvvv ^ 0xF) << 3) 
+              | (L << 2) | pp;
+   } else {
+      /* 3 byte encoding is needed. */
+      byte0 = 0xC4;
+      byte1 = ((rexR ^ 1) << 7) | ((rexX ^ 1) << 6)
+              | ((rexB ^ 1) << 5) | mmmmm;
+      byte2 = (rexW << 7) | ((vvvv ^ 0xF) << 3) | (L << 2) | pp;
+   }
+   return (((UInt)byte2) << 16) | (((UInt)byte1) << 8) | ((UInt)byte0);
+}
+
+/* Make up a VEX prefix for a (greg,amode) pair.  First byte in bits
+   7:0 of result, second in 15:8, third (for a 3 byte prefix) in
+   23:16.  Has m-mmmm set to indicate a prefix of 0F, pp set to
+   indicate no SIMD prefix, W=0 (ignore), L=1 (size=256), and
+   vvvv=1111 (unused 3rd reg). */
+static UInt vexAMode_M ( HReg greg, AMD64AMode* am )
+{
+   UChar L       = 1; /* size = 256 */
+   UChar pp      = 0; /* no SIMD prefix */
+   UChar mmmmm   = 1; /* 0F */
+   UChar vvvv    = 0; /* unused */
+   UChar rexW    = 0;
+   UChar rexR    = 0;
+   UChar rexX    = 0;
+   UChar rexB    = 0;
+   /* Same logic as in rexAMode_M. */
+   if (am->tag == Aam_IR) {
+      rexR = iregBit3(greg);
+      rexX = 0; /* not relevant */
+      rexB = iregBit3(am->Aam.IR.reg);
+   }
+   else if (am->tag == Aam_IRRS) {
+      rexR = iregBit3(greg);
+      rexX = iregBit3(am->Aam.IRRS.index);
+      rexB = iregBit3(am->Aam.IRRS.base);
+   } else {
+      vassert(0);
+   }
+   return packVexPrefix( rexR, rexX, rexB, mmmmm, rexW, vvvv, L, pp );
+}
+
+static UChar* emitVexPrefix ( UChar* p, UInt vex )
+{
+   switch (vex & 0xFF) {
+      case 0xC5:
+         *p++ = 0xC5;
+         *p++ = (vex >> 8) & 0xFF;
+         vassert(0 == (vex >> 16));
+         break;
+      case 0xC4:
+         *p++ = 0xC4;
+         *p++ = (vex >> 8) & 0xFF;
+         *p++ = (vex >> 16) & 0xFF;
+         vassert(0 == (vex >> 24));
+         break;
+      default:
+         vassert(0);
+   }
+   return p;
+}
+
+/* Emit a VEX-encoded reg-reg instruction: prefix, opcode byte and
+   ModRM byte.  greg and ereg are the (faked-up integer) registers for
+   the ModRM reg and r/m fields, vvvv is the register number for the
+   VEX.vvvv field (0 if unused), and pp, mmmmm and L are as for
+   packVexPrefix. */
+static UChar* emitVexRR ( UChar* p, UInt pp, UInt mmmmm, UInt L,
+                          UInt opc, UInt vvvv, HReg greg, HReg ereg )
+{
+   UInt vex = packVexPrefix( iregBit3(greg), 0, iregBit3(ereg),
+                             mmmmm, 0/*W*/, vvvv, L, pp );
+   p = emitVexPrefix(p, vex);
+   *p++ = toUChar(opc);
+   return doAMode_R(p, greg, ereg);
+}
+
+
+/* On AVX hosts, SSE instructions are emitted in their VEX.128
+   forms rather than the legacy ones.  Executing a legacy SSE
+   instruction while the upper halves of the ymm registers are in use
+   incurs an SSE/AVX transition penalty, or a false dependency on
+   those upper halves, on most Intel cores; the VEX forms avoid both.
+
+   Rewrite, in place, the legacy-encoded instruction at [start, end)
+   into the equivalent VEX.128 encoding, and return the new end.  The
+   VEX prefix is at most one byte longer than the legacy prefixes and
+   escape bytes it replaces.  If nds is True then VEX.vvvv names the ModRM.reg register, which
+   for the two-operand legacy forms is both the destination and the
+   first source, so that the result is the same as the legacy form;
+   otherwise vvvv is unused. */
+static UChar* vexify_SSE ( UChar* start, UChar* end, Bool nds )
+{
+   UChar* q     = start;
+   UInt   pp    = 0;
+   UInt   mmmmm = 1;
+   UInt   rex   = 0;
+   UInt   vvvv  = 0;
+   UInt   vex;
+   UChar  pfx[3];
+   Int    n, k, pfx_len;
+   switch (*q) {
+      case 0x66: pp = 1; q++; break;
+      case 0xF3: pp = 2; q++; break;
+      case 0xF2: pp = 3; q++; break;
+      default: break;
+   }
+   if ((*q & 0xF0) == 0x40)
+      rex = *q++;
+   vassert(*q == 0x0F);
+   q++;
+   if (*q == 0x38) {
+      mmmmm = 2; q++;
+   } else if (*q == 0x3A) {
+      mmmmm = 3; q++;
+   }
+   /* q now points at the opcode byte, which is followed by ModRM. */
+   if (nds)
+      vvvv = (((rex >> 2) & 1) << 3) | ((q[1] >> 3) & 7);
+   vex = packVexPrefix( (rex >> 2) & 1, (rex >> 1) & 1, rex & 1,
+                        mmmmm, (rex >> 3) & 1, vvvv, 0/*L*/, pp );
+   pfx_len = emitVexPrefix(&pfx[0], vex) - &pfx[0];
+   n = end - q;
+   if (start + pfx_len <= q) {
+      for (k = 0; k < n; k++)
+         start[pfx_len + k] = q[k];
+   } else {
+      for (k = n-1; k >= 0; k--)
+         start[pfx_len + k] = q[k];
+   }
+   for (k = 0; k < pfx_len; k++)
+      start[k] = pfx[k];
+   return start + pfx_len + n;
+}
+
+/* Does the VEX form of this SSE instruction need VEX.vvvv to name
+   its destination?  See vexify_SSE. */
+static Bool sseInsnIsNDS ( AMD64Instr* i )
+{
+   switch (i->tag) {
+      case Ain_SseSI2SF:
+      case Ain_SseSDSS:
+      case Ain_Sse32FLo:
+      case Ain_Sse64FLo:
+         return True;
+      case Ain_Sse32Fx4:
+         return toBool(i->Ain.Sse32Fx4.op != Asse_RCPF
+                       && i->Ain.Sse32Fx4.op != Asse_RSQRTF
+                       && i->Ain.Sse32Fx4.op != Asse_SQRTF);
+      case Ain_Sse64Fx2:
+         return toBool(i->Ain.Sse64Fx2.op != Asse_SQRTF);
+      case Ain_SseReRg:
+         return toBool(i->Ain.SseReRg.op != Asse_MOV);
+      default:
+         return False;
+   }
+}
 
 
 /* Emit ffree %st(N) */
@@ -2257,6 +2607,13 @@ static UChar* do_ffree_st ( UChar* p, Int n )
    return p;
 }
 
+/* The layout of VexAMD64RetStack, as used by Ain_RetPush and
+   Ain_RetPop: the offset of .ents, the size of an entry, and the
+   mask which keeps .top within the ring. */
+#define RS_ENTS   16
+#define RS_ENTSZB 32
+#define RS_MASK   ((VEX_AMD64_RETSTACK_N - 1) * RS_ENTSZB)
+
 /* Emit an instruction into buf and return the number of bytes used.
    Note that buf is not the insn's final place, and therefore it is
    imperative to emit position-independent code.  If the emitted
@@ -2269,6 +2626,8 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
                       void* disp_cp_chain_me_to_slowEP,
                       void* disp_cp_chain_me_to_fastEP,
                       void* disp_cp_xindir,
+                      void* disp_cp_xindir_icfill,
+                      void* disp_cp_ret_fill,
                       void* disp_cp_xassisted )
 {
    UInt /*irno,*/ opc, opc_rr, subopc_imm, opc_imma, opc_cl, opc_imm, subopc;
@@ -2278,7 +2637,7 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
    UChar* p = &buf[0];
    UChar* ptmp;
    Int    j;
-   vassert(nbuf >= 32);
+   vassert(nbuf >= 96);
    vassert(mode64 == True);
 
    /* Wrap an integer as a int register, for use assembling
@@ -2674,12 +3033,18 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
       if (i->Ain.Call.cond != Acc_ALWAYS
           && i->Ain.Call.rloc.pri != RLPri_None) {
          /* The call might not happen (it isn't unconditional) and it
-            returns a result.  In this case we will need to generate a
-            control flow diamond to put 0x555..555 in the return
-            register(s) in the case where the call doesn't happen.  If
-            this ever becomes necessary, maybe copy code from the ARM
-            equivalent.  Until that day, just give up. */
-         goto bad;
+            returns a result.  In that case the result must read as
+            0x555..555.  For an integer result, simply put that in
+            %rax before the conditional jump; it is overwritten if the
+            call does happen, and %rax is trashed by the call as far
+            as the register allocator is concerned anyway.  Vector
+            results, which are returned in memory, are not handled. */
+         if (i->Ain.Call.rloc.pri != RLPri_Int)
+            goto bad;
+         /* 10 bytes: movabsq $0x5555555555555555, %rax */
+         *p++ = 0x48;
+         *p++ = 0xB8;
+         p = emit64(p, 0x5555555555555555ULL);
       }
       /* As per detailed comment for Ain_Call in
          getRegUsage_AMD64Instr above, %r11 is used as an address
@@ -2807,6 +3172,59 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
       *p++ = 0x89;
       p = doAMode_M(p, i->Ain.XIndir.dstGA, i->Ain.XIndir.amRIP);
 
+      if (disp_cp_xindir_icfill != NULL) {
+         /* Emit an inline cache, which patchXIndirIC_AMD64 and
+            unpatchXIndirIC_AMD64 below fill in and empty again.
+            Initially it is
+
+               movabsq $1, %r11              -- guest address
+               cmpq    %r11, dstGA
+               jnz     1f
+               movabsq $disp_cp_xindir, %r11 -- host address
+               jmpq    *%r11
+            1: movabsq $disp_cp_xindir_icfill, %r11
+               callq   *%r11
+
+            1 is never a guest code address, and if it were, going to
+            disp_cp_xindir would still be correct.  Once filled, the
+            two movabsqs at the top carry the guest address and the
+            host code it was seen going to, and the last two insns
+            are
+               movabsq $disp_cp_xindir, %r11
+               jmpq    *%r11
+            so that other targets take the ordinary route.  Always use
+            the long forms, so the layout is fixed. */
+         HReg r11 = hregAMD64_R11();
+         /* movabsq $1, %r11 */
+         *p++ = 0x49;
+         *p++ = 0xBB;
+         p = emit64(p, 1);
+         /* cmpq %r11, dstGA */
+         *p++ = rexAMode_R(r11, i->Ain.XIndir.dstGA);
+         *p++ = 0x39;
+         p = doAMode_R(p, r11, i->Ain.XIndir.dstGA);
+         /* jnz 1f */
+         *p++ = 0x75;
+         *p++ = 10+3;
+         /* movabsq $disp_cp_xindir, %r11 */
+         *p++ = 0x49;
+         *p++ = 0xBB;
+         p = emit64(p, Ptr_to_ULong(disp_cp_xindir));
+         /* jmp *%r11 */
+         *p++ = 0x41;
+         *p++ = 0xFF;
+         *p++ = 0xE3;
+         /* 1: movabsq $disp_cp_xindir_icfill, %r11 */
+         *p++ = 0x49;
+         *p++ = 0xBB;
+         p = emit64(p, Ptr_to_ULong(disp_cp_xindir_icfill));
+         /* call *%r11 */
+         *p++ = 0x41;
+         *p++ = 0xFF;
+         *p++ = 0xD3;
+         goto xindir_done;
+      }
+
       /* get $disp_cp_xindir into %r11 */
       if (fitsIn32Bits(Ptr_to_ULong(disp_cp_xindir))) {
          /* use a shorter encoding */
@@ -2827,10 +3245,11 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
       *p++ = 0xFF;
       *p++ = 0xE3;
 
+     xindir_done:
       /* Fix up the conditional jump, if there was one. */
       if (i->Ain.XIndir.cond != Acc_ALWAYS) {
          Int delta = p - ptmp;
-         vassert(delta > 0 && delta < 40);
+         vassert(delta > 0 && delta < 64);
          *ptmp = toUChar(delta-1);
       }
       goto done;
@@ -2899,6 +3318,214 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
       goto done;
    }
 
+   case Ain_RetPush: {
+      /* NB: the patchable word here has to be closely coordinated
+         with patchRetSite_AMD64 below.  Generates
+
+            movq    amRetStack, %rcx
+            movq    (%rcx), %rax           -- top
+            addq    $RS_ENTSZB, %rax
+            andq    $RS_MASK, %rax
+            movq    %rax, (%rcx)
+            leaq    RS_ENTS(%rcx,%rax), %rcx
+            movabsq $ra, %r11
+            movq    %r11, 0(%rcx)          -- .ra
+            movq    amRSP, %r11
+            movq    %r11, 8(%rcx)          -- .sp
+            movabsq $disp_cp_ret_fill, %r11 -- the patchable word
+            movq    %r11, 16(%rcx)         -- .host
+            leaq    <the patchable word>(%rip), %r11
+            movq    %r11, 24(%rcx)         -- .site
+      */
+      HReg        rax = hregAMD64_RAX();
+      HReg        rcx = hregAMD64_RCX();
+      HReg        r11 = hregAMD64_R11();
+      AMD64AMode* am;
+      UChar*      site;
+      vassert(disp_cp_ret_fill != NULL);
+      vassert(offsetof(VexAMD64RetStack, ents) == RS_ENTS);
+      vassert(sizeof(VexAMD64RetStack) == RS_ENTS + VEX_AMD64_RETSTACK_N
+                                                    * RS_ENTSZB);
+
+      /* movq amRetStack, %rcx */
+      *p++ = rexAMode_M(rcx, i->Ain.RetPush.amRetStack);
+      *p++ = 0x8B;
+      p = doAMode_M(p, rcx, i->Ain.RetPush.amRetStack);
+      /* movq (%rcx), %rax */
+      am = AMD64AMode_IR(0, rcx);
+      *p++ = rexAMode_M(rax, am);
+      *p++ = 0x8B;
+      p = doAMode_M(p, rax, am);
+      /* addq $RS_ENTSZB, %rax */
+      *p++ = 0x48;
+      *p++ = 0x83;
+      *p++ = 0xC0;
+      *p++ = RS_ENTSZB;
+      /* andq $RS_MASK, %rax */
+      *p++ = 0x48;
+      *p++ = 0x25;
+      p = emit32(p, RS_MASK);
+      /* movq %rax, (%rcx) */
+      *p++ = rexAMode_M(rax, am);
+      *p++ = 0x89;
+      p = doAMode_M(p, rax, am);
+      /* leaq RS_ENTS(%rcx,%rax), %rcx */
+      am = AMD64AMode_IRRS(RS_ENTS, rcx, rax, 0);
+      *p++ = rexAMode_M(rcx, am);
+      *p++ = 0x8D;
+      p = doAMode_M(p, rcx, am);
+      /* movabsq $ra, %r11 */
+      *p++ = 0x49;
+      *p++ = 0xBB;
+      p = emit64(p, i->Ain.RetPush.ra);
+      /* movq %r11, 0(%rcx) */
+      am = AMD64AMode_IR(0, rcx);
+      *p++ = rexAMode_M(r11, am);
+      *p++ = 0x89;
+      p = doAMode_M(p, r11, am);
+      /* movq amRSP, %r11 */
+      *p++ = rexAMode_M(r11, i->Ain.RetPush.amRSP);
+      *p++ = 0x8B;
+      p = doAMode_M(p, r11, i->Ain.RetPush.amRSP);
+      /* movq %r11, 8(%rcx) */
+      am = AMD64AMode_IR(8, rcx);
+      *p++ = rexAMode_M(r11, am);
+      *p++ = 0x89;
+      p = doAMode_M(p, r11, am);
+      /* movabsq $disp_cp_ret_fill, %r11 */
+      *p++ = 0x49;
+      *p++ = 0xBB;
+      site = p;
+      p = emit64(p, Ptr_to_ULong(disp_cp_ret_fill));
+      /* movq %r11, 16(%rcx) */
+      am = AMD64AMode_IR(16, rcx);
+      *p++ = rexAMode_M(r11, am);
+      *p++ = 0x89;
+      p = doAMode_M(p, r11, am);
+      /* leaq site(%rip), %r11 */
+      *p++ = 0x4C;
+      *p++ = 0x8D;
+      *p++ = 0x1D;
+      p = emit32(p, (UInt)(Int)(site - (p + 4)));
+      /* movq %r11, 24(%rcx) */
+      am = AMD64AMode_IR(24, rcx);
+      *p++ = rexAMode_M(r11, am);
+      *p++ = 0x89;
+      p = doAMode_M(p, r11, am);
+      goto done;
+   }
+
+   case Ain_RetPop: {
+      /* Generates
+
+            movq    dstGA, amRIP
+            movq    amRetStack, %rcx
+            movq    (%rcx), %rax           -- top
+            cmpq    dstGA, RS_ENTS+0(%rcx,%rax)
+            jnz     1f
+            leaq    -RS_ENTSZB(%rax), %rdx
+            andq    $RS_MASK, %rdx
+            movq    %rdx, (%rcx)
+            movq    RS_ENTS+24(%rcx,%rax), %r11
+            jmpq    *RS_ENTS+16(%rcx,%rax)
+         1: movq    amRSP, %r11
+            cmpq    RS_ENTS+8(%rcx,%rax), %r11
+            jbe     2f
+            leaq    -RS_ENTSZB(%rax), %rdx
+            andq    $RS_MASK, %rdx
+            movq    %rdx, (%rcx)
+         2:
+
+         The host code is entered with the site it was read from in
+         %r11, which disp_cp_ret_fill needs.  The entry on top is
+         stale, and dropped, if the stack has been unwound past the
+         frame of its call without returning through it, eg by
+         longjmp. */
+      HReg        rax = hregAMD64_RAX();
+      HReg        rcx = hregAMD64_RCX();
+      HReg        rdx = hregAMD64_RDX();
+      HReg        r11 = hregAMD64_R11();
+      HReg        dstGA = i->Ain.RetPop.dstGA;
+      AMD64AMode* am;
+      Int         k;
+      vassert(disp_cp_ret_fill != NULL);
+      vassert(!sameHReg(dstGA, rax) && !sameHReg(dstGA, rcx)
+              && !sameHReg(dstGA, rdx) && !sameHReg(dstGA, r11));
+
+      /* movq dstGA, amRIP */
+      *p++ = rexAMode_M(dstGA, i->Ain.RetPop.amRIP);
+      *p++ = 0x89;
+      p = doAMode_M(p, dstGA, i->Ain.RetPop.amRIP);
+      /* movq amRetStack, %rcx */
+      *p++ = rexAMode_M(rcx, i->Ain.RetPop.amRetStack);
+      *p++ = 0x8B;
+      p = doAMode_M(p, rcx, i->Ain.RetPop.amRetStack);
+      /* movq (%rcx), %rax */
+      am = AMD64AMode_IR(0, rcx);
+      *p++ = rexAMode_M(rax, am);
+      *p++ = 0x8B;
+      p = doAMode_M(p, rax, am);
+      /* cmpq dstGA, RS_ENTS+0(%rcx,%rax) */
+      am = AMD64AMode_IRRS(RS_ENTS+0, rcx, rax, 0);
+      *p++ = rexAMode_M(dstGA, am);
+      *p++ = 0x39;
+      p = doAMode_M(p, dstGA, am);
+      /* jnz 1f */
+      *p++ = 0x75;
+      ptmp = p;
+      *p++ = 0;
+      /* The pop, done twice over. */
+      for (k = 0; k < 2; k++) {
+         if (k == 1) {
+            /* 1: */
+            *ptmp = toUChar(p - ptmp - 1);
+            /* movq amRSP, %r11 */
+            *p++ = rexAMode_M(r11, i->Ain.RetPop.amRSP);
+            *p++ = 0x8B;
+            p = doAMode_M(p, r11, i->Ain.RetPop.amRSP);
+            /* cmpq RS_ENTS+8(%rcx,%rax), %r11 */
+            am = AMD64AMode_IRRS(RS_ENTS+8, rcx, rax, 0);
+            *p++ = rexAMode_M(r11, am);
+            *p++ = 0x3B;
+            p = doAMode_M(p, r11, am);
+            /* jbe 2f */
+            *p++ = 0x76;
+            ptmp = p;
+            *p++ = 0;
+         }
+         /* leaq -RS_ENTSZB(%rax), %rdx */
+         am = AMD64AMode_IR(-RS_ENTSZB, rax);
+         *p++ = rexAMode_M(rdx, am);
+         *p++ = 0x8D;
+         p = doAMode_M(p, rdx, am);
+         /* andq $RS_MASK, %rdx */
+         *p++ = 0x48;
+         *p++ = 0x81;
+         *p++ = 0xE2;
+         p = emit32(p, RS_MASK);
+         /* movq %rdx, (%rcx) */
+         am = AMD64AMode_IR(0, rcx);
+         *p++ = rexAMode_M(rdx, am);
+         *p++ = 0x89;
+         p = doAMode_M(p, rdx, am);
+         if (k == 0) {
+            /* movq RS_ENTS+24(%rcx,%rax), %r11 */
+            am = AMD64AMode_IRRS(RS_ENTS+24, rcx, rax, 0);
+            *p++ = rexAMode_M(r11, am);
+            *p++ = 0x8B;
+            p = doAMode_M(p, r11, am);
+            /* jmp *RS_ENTS+16(%rcx,%rax) */
+            am = AMD64AMode_IRRS(RS_ENTS+16, rcx, rax, 0);
+            *p++ = rexAMode_M(fake(4), am);
+            *p++ = 0xFF;
+            p = doAMode_M(p, fake(4), am);
+         }
+      }
+      /* 2: */
+      *ptmp = toUChar(p - ptmp - 1);
+      goto done;
+   }
+
    case Ain_CMov64:
       vassert(i->Ain.CMov64.cond != Acc_ALWAYS);
       if (i->Ain.CMov64.src->tag == Arm_Reg) {
@@ -3148,6 +3775,8 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
       *p++ = 0x2E;
       p = doAMode_R(p, vreg2ireg(i->Ain.SseUComIS.srcL),
                        vreg2ireg(i->Ain.SseUComIS.srcR) );
+      if (amd64_host_hwcaps & VEX_HWCAPS_AMD64_AVX)
+         p = vexify_SSE(&buf[0], p, False/*!nds*/);
       /* pushfq */
       *p++ = 0x9C;
       /* popq %dst */
@@ -3165,7 +3794,7 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
       *p++ = 0x2A;
       p = doAMode_R( p, vreg2ireg(i->Ain.SseSI2SF.dst),
                         i->Ain.SseSI2SF.src );
-      goto done;
+      goto done_sse;
 
    case Ain_SseSF2SI:
       /* cvss[sd]2si %src, %dst */
@@ -3177,7 +3806,7 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
       *p++ = 0x2D;
       p = doAMode_R( p, i->Ain.SseSF2SI.dst,
                         vreg2ireg(i->Ain.SseSF2SI.src) );
-      goto done;
+      goto done_sse;
 
    case Ain_SseSDSS:
       /* cvtsd2ss/cvtss2sd %src, %dst */
@@ -3189,7 +3818,7 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
       *p++ = 0x5A;
       p = doAMode_R( p, vreg2ireg(i->Ain.SseSDSS.dst),
                         vreg2ireg(i->Ain.SseSDSS.src) );
-      goto done;
+      goto done_sse;
 
    case Ain_SseLdSt:
       if (i->Ain.SseLdSt.sz == 8) {
@@ -3206,7 +3835,7 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
       *p++ = 0x0F; 
       *p++ = toUChar(i->Ain.SseLdSt.isLoad ? 0x10 : 0x11);
       p = doAMode_M(p, vreg2ireg(i->Ain.SseLdSt.reg), i->Ain.SseLdSt.addr);
-      goto done;
+      goto done_sse;
 
    case Ain_SseLdzLO:
       vassert(i->Ain.SseLdzLO.sz == 4 || i->Ain.SseLdzLO.sz == 8);
@@ -3219,7 +3848,7 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
       *p++ = 0x10; 
       p = doAMode_M(p, vreg2ireg(i->Ain.SseLdzLO.reg), 
                        i->Ain.SseLdzLO.addr);
-      goto done;
+      goto done_sse;
 
    case Ain_Sse32Fx4:
       xtra = 0;
@@ -3247,7 +3876,7 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
                        vreg2ireg(i->Ain.Sse32Fx4.src) );
       if (xtra & 0x100)
          *p++ = toUChar(xtra & 0xFF);
-      goto done;
+      goto done_sse;
 
    case Ain_Sse64Fx2:
       xtra = 0;
@@ -3274,7 +3903,7 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
                        vreg2ireg(i->Ain.Sse64Fx2.src) );
       if (xtra & 0x100)
          *p++ = toUChar(xtra & 0xFF);
-      goto done;
+      goto done_sse;
 
    case Ain_Sse32FLo:
       xtra = 0;
@@ -3303,7 +3932,7 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
                        vreg2ireg(i->Ain.Sse32FLo.src) );
       if (xtra & 0x100)
          *p++ = toUChar(xtra & 0xFF);
-      goto done;
+      goto done_sse;
 
    case Ain_Sse64FLo:
       xtra = 0;
@@ -3330,7 +3959,7 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
                        vreg2ireg(i->Ain.Sse64FLo.src) );
       if (xtra & 0x100)
          *p++ = toUChar(xtra & 0xFF);
-      goto done;
+      goto done_sse;
 
    case Ain_SseReRg:
 #     define XX(_n) *p++ = (_n)
@@ -3348,6 +3977,7 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
          case Asse_PACKSSD:  XX(0x66); XX(rex); XX(0x0F); XX(0x6B); break;
          case Asse_PACKSSW:  XX(0x66); XX(rex); XX(0x0F); XX(0x63); break;
          case Asse_PACKUSW:  XX(0x66); XX(rex); XX(0x0F); XX(0x67); break;
+         case Asse_PACKUSD:  XX(0x66); XX(rex); XX(0x0F); XX(0x38); XX(0x2B); break;
          case Asse_ADD8:     XX(0x66); XX(rex); XX(0x0F); XX(0xFC); break;
          case Asse_ADD16:    XX(0x66); XX(rex); XX(0x0F); XX(0xFD); break;
          case Asse_ADD32:    XX(0x66); XX(rex); XX(0x0F); XX(0xFE); break;
@@ -3395,12 +4025,24 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
          case Asse_UNPCKLW:  XX(0x66); XX(rex); XX(0x0F); XX(0x61); break;
          case Asse_UNPCKLD:  XX(0x66); XX(rex); XX(0x0F); XX(0x62); break;
          case Asse_UNPCKLQ:  XX(0x66); XX(rex); XX(0x0F); XX(0x6C); break;
+         /* SSE4.1 and SSE4.2 */
+         case Asse_MUL32:    XX(0x66); XX(rex); XX(0x0F); XX(0x38); XX(0x40); break;
+         case Asse_MAX32S:   XX(0x66); XX(rex); XX(0x0F); XX(0x38); XX(0x3D); break;
+         case Asse_MAX32U:   XX(0x66); XX(rex); XX(0x0F); XX(0x38); XX(0x3F); break;
+         case Asse_MAX16U:   XX(0x66); XX(rex); XX(0x0F); XX(0x38); XX(0x3E); break;
+         case Asse_MAX8S:    XX(0x66); XX(rex); XX(0x0F); XX(0x38); XX(0x3C); break;
+         case Asse_MIN32S:   XX(0x66); XX(rex); XX(0x0F); XX(0x38); XX(0x39); break;
+         case Asse_MIN32U:   XX(0x66); XX(rex); XX(0x0F); XX(0x38); XX(0x3B); break;
+         case Asse_MIN16U:   XX(0x66); XX(rex); XX(0x0F); XX(0x38); XX(0x3A); break;
+         case Asse_MIN8S:    XX(0x66); XX(rex); XX(0x0F); XX(0x38); XX(0x38); break;
+         case Asse_CMPEQ64:  XX(0x66); XX(rex); XX(0x0F); XX(0x38); XX(0x29); break;
+         case Asse_CMPGT64S: XX(0x66); XX(rex); XX(0x0F); XX(0x38); XX(0x37); break;
          default: goto bad;
       }
       p = doAMode_R(p, vreg2ireg(i->Ain.SseReRg.dst),
                        vreg2ireg(i->Ain.SseReRg.src) );
 #     undef XX
-      goto done;
+      goto done_sse;
 
    case Ain_SseCMov:
       /* jmp fwds if !condition */
@@ -3417,6 +4059,9 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
       p = doAMode_R(p, vreg2ireg(i->Ain.SseCMov.dst),
                        vreg2ireg(i->Ain.SseCMov.src) );
 
+      if (amd64_host_hwcaps & VEX_HWCAPS_AMD64_AVX)
+         p = vexify_SSE(ptmp, p, False/*!nds*/);
+
       /* Fill in the jump offset. */
       *(ptmp-1) = toUChar(p - ptmp);
       goto done;
@@ -3431,16 +4076,147 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
       p = doAMode_R(p, vreg2ireg(i->Ain.SseShuf.dst),
                        vreg2ireg(i->Ain.SseShuf.src) );
       *p++ = (UChar)(i->Ain.SseShuf.order);
+      goto done_sse;
+
+   case Ain_AvxLdSt: {
+      UInt vex = vexAMode_M( dvreg2ireg(i->Ain.AvxLdSt.reg),
+                             i->Ain.AvxLdSt.addr );
+      p = emitVexPrefix(p, vex);
+      *p++ = toUChar(i->Ain.AvxLdSt.isLoad ? 0x10 : 0x11);
+      p = doAMode_M(p, dvreg2ireg(i->Ain.AvxLdSt.reg), i->Ain.AvxLdSt.addr);
       goto done;
+   }
 
-   //uu case Ain_AvxLdSt: {
-   //uu    UInt vex = vexAMode_M( dvreg2ireg(i->Ain.AvxLdSt.reg),
-   //uu                           i->Ain.AvxLdSt.addr );
-   //uu    p = emitVexPrefix(p, vex);
-   //uu    *p++ = toUChar(i->Ain.AvxLdSt.isLoad ? 0x10 : 0x11);
-   //uu    p = doAMode_M(p, dvreg2ireg(i->Ain.AvxLdSt.reg), i->Ain.AvxLdSt.addr);
-   //uu      goto done;
-   //uu }
+   case Ain_Avx32Fx8:
+   case Ain_Avx64Fx4: {
+      /* v<op>ps/pd %ymm-src, %ymm-dst, %ymm-dst, or for the unary
+         ops, v<op>ps/pd %ymm-src, %ymm-dst. */
+      Bool       is64 = i->tag == Ain_Avx64Fx4;
+      AMD64SseOp op   = is64 ? i->Ain.Avx64Fx4.op  : i->Ain.Avx32Fx8.op;
+      HReg       src  = is64 ? i->Ain.Avx64Fx4.src : i->Ain.Avx32Fx8.src;
+      HReg       dst  = is64 ? i->Ain.Avx64Fx4.dst : i->Ain.Avx32Fx8.dst;
+      UInt       vvvv = hregNumber(dst);
+      switch (op) {
+         case Asse_ADDF:   opc = 0x58; break;
+         case Asse_DIVF:   opc = 0x5E; break;
+         case Asse_MAXF:   opc = 0x5F; break;
+         case Asse_MINF:   opc = 0x5D; break;
+         case Asse_MULF:   opc = 0x59; break;
+         case Asse_SUBF:   opc = 0x5C; break;
+         case Asse_SQRTF:  opc = 0x51; vvvv = 0; break;
+         case Asse_RCPF:   if (is64) goto bad; opc = 0x53; vvvv = 0; break;
+         case Asse_RSQRTF: if (is64) goto bad; opc = 0x52; vvvv = 0; break;
+         default: goto bad;
+      }
+      p = emitVexRR(p, is64 ? 1 : 0, 1/*0F*/, 1/*256*/, opc, vvvv,
+                    dvreg2ireg(dst), dvreg2ireg(src));
+      goto done;
+   }
+
+   case Ain_AvxReRg: {
+      /* The VEX.256 forms of the SseReRg instructions, with the
+         destination also supplied as the first source through
+         VEX.vvvv.  pp is 1 (66) or 0 (none); mmmmm is 1 (0F) or
+         2 (0F38). */
+      UInt pp = 1, mmmmm = 1;
+      UInt vvvv = hregNumber(i->Ain.AvxReRg.dst);
+      HReg src  = i->Ain.AvxReRg.src;
+      switch (i->Ain.AvxReRg.op) {
+         case Asse_MOV:  /*vmovups*/ pp = 0; opc = 0x10; vvvv = 0; break;
+         case Asse_OR:               pp = 0; opc = 0x56; break;
+         case Asse_XOR:              pp = 0; opc = 0x57; break;
+         case Asse_AND:              pp = 0; opc = 0x54; break;
+         case Asse_ANDN:             pp = 0; opc = 0x55; break;
+         case Asse_ADD8:     opc = 0xFC; break;
+         case Asse_ADD16:    opc = 0xFD; break;
+         case Asse_ADD32:    opc = 0xFE; break;
+         case Asse_ADD64:    opc = 0xD4; break;
+         case Asse_QADD8S:   opc = 0xEC; break;
+         case Asse_QADD16S:  opc = 0xED; break;
+         case Asse_QADD8U:   opc = 0xDC; break;
+         case Asse_QADD16U:  opc = 0xDD; break;
+         case Asse_AVG8U:    opc = 0xE0; break;
+         case Asse_AVG16U:   opc = 0xE3; break;
+         case Asse_CMPEQ8:   opc = 0x74; break;
+         case Asse_CMPEQ16:  opc = 0x75; break;
+         case Asse_CMPEQ32:  opc = 0x76; break;
+         case Asse_CMPGT8S:  opc = 0x64; break;
+         case Asse_CMPGT16S: opc = 0x65; break;
+         case Asse_CMPGT32S: opc = 0x66; break;
+         case Asse_MAX16S:   opc = 0xEE; break;
+         case Asse_MAX8U:    opc = 0xDE; break;
+         case Asse_MIN16S:   opc = 0xEA; break;
+         case Asse_MIN8U:    opc = 0xDA; break;
+         case Asse_MULHI16U: opc = 0xE4; break;
+         case Asse_MULHI16S: opc = 0xE5; break;
+         case Asse_MUL16:    opc = 0xD5; break;
+         case Asse_SHL16:    opc = 0xF1; break;
+         case Asse_SHL32:    opc = 0xF2; break;
+         case Asse_SHL64:    opc = 0xF3; break;
+         case Asse_SAR16:    opc = 0xE1; break;
+         case Asse_SAR32:    opc = 0xE2; break;
+         case Asse_SHR16:    opc = 0xD1; break;
+         case Asse_SHR32:    opc = 0xD2; break;
+         case Asse_SHR64:    opc = 0xD3; break;
+         case Asse_SUB8:     opc = 0xF8; break;
+         case Asse_SUB16:    opc = 0xF9; break;
+         case Asse_SUB32:    opc = 0xFA; break;
+         case Asse_SUB64:    opc = 0xFB; break;
+         case Asse_QSUB8S:   opc = 0xE8; break;
+         case Asse_QSUB16S:  opc = 0xE9; break;
+         case Asse_QSUB8U:   opc = 0xD8; break;
+         case Asse_QSUB16U:  opc = 0xD9; break;
+         case Asse_MUL32:    mmmmm = 2; opc = 0x40; break;
+         case Asse_MAX32S:   mmmmm = 2; opc = 0x3D; break;
+         case Asse_MAX32U:   mmmmm = 2; opc = 0x3F; break;
+         case Asse_MAX16U:   mmmmm = 2; opc = 0x3E; break;
+         case Asse_MAX8S:    mmmmm = 2; opc = 0x3C; break;
+         case Asse_MIN32S:   mmmmm = 2; opc = 0x39; break;
+         case Asse_MIN32U:   mmmmm = 2; opc = 0x3B; break;
+         case Asse_MIN16U:   mmmmm = 2; opc = 0x3A; break;
+         case Asse_MIN8S:    mmmmm = 2; opc = 0x38; break;
+         case Asse_CMPEQ64:  mmmmm = 2; opc = 0x29; break;
+         case Asse_CMPGT64S: mmmmm = 2; opc = 0x37; break;
+         case Asse_PERM32:   mmmmm = 2; opc = 0x36; break;
+         default: goto bad;
+      }
+      p = emitVexRR(p, pp, mmmmm, 1/*256*/, opc, vvvv,
+                    dvreg2ireg(i->Ain.AvxReRg.dst),
+                    hregClass(src) == HRcVec128 ? vreg2ireg(src)
+                                                : dvreg2ireg(src));
+      goto done;
+   }
+
+   case Ain_AvxExtract:
+      if (i->Ain.AvxExtract.hi) {
+         /* vextractf128 $1, %ymm-src, %xmm-dst */
+         p = emitVexRR(p, 1/*66*/, 3/*0F3A*/, 1/*256*/, 0x19, 0,
+                       dvreg2ireg(i->Ain.AvxExtract.src),
+                       vreg2ireg(i->Ain.AvxExtract.dst));
+         *p++ = 0x01;
+      } else {
+         /* vmovaps %xmm-src, %xmm-dst; the VEX.128 form clears
+            bits 255:128 of the destination */
+         p = emitVexRR(p, 0, 1/*0F*/, 0/*128*/, 0x28, 0,
+                       vreg2ireg(i->Ain.AvxExtract.dst),
+                       dvreg2ireg(i->Ain.AvxExtract.src));
+      }
+      goto done;
+
+   case Ain_AvxConcat:
+      /* vinsertf128 $1, %xmm-hi, %ymm-lo, %ymm-dst */
+      p = emitVexRR(p, 1/*66*/, 3/*0F3A*/, 1/*256*/, 0x18,
+                    hregNumber(i->Ain.AvxConcat.lo),
+                    dvreg2ireg(i->Ain.AvxConcat.dst),
+                    vreg2ireg(i->Ain.AvxConcat.hi));
+      *p++ = 0x01;
+      goto done;
+
+   case Ain_VZeroUpper:
+      *p++ = 0xC5;
+      *p++ = 0xF8;
+      *p++ = 0x77;
+      goto done;
 
    case Ain_EvCheck: {
       /* We generate:
@@ -3514,9 +4290,14 @@ Int emit_AMD64Instr ( /*MB_MOD*/Bool* is_profInc,
    ppAMD64Instr(i, mode64);
    vpanic("emit_AMD64Instr");
    /*NOTREACHED*/
-   
+
+  done_sse:
+   if (amd64_host_hwcaps & VEX_HWCAPS_AMD64_AVX)
+      p = vexify_SSE(&buf[0], p, sseInsnIsNDS(i));
+   /* fall through */
+
   done:
-   vassert(p - &buf[0] <= 32);
+   vassert(p - &buf[0] <= 96);
    return p - &buf[0];
 
 #  undef fake
@@ -3682,6 +4463,92 @@ VexInvalRange unchainXDirect_AMD64 ( void* place_to_unchain,
 }
 
 
+/* NB: what goes on here has to be very closely coordinated with the
+   emitInstr case for XIndir, above.  PLACE is the start of the inline
+   cache, which follows the write of the new guest address to the
+   guest state.  TAIL is the expected value of the last movabsq, and
+   TAIL_OPC the expected final byte of the call/jmp that follows it. */
+static void checkXIndirIC_AMD64 ( UChar* p, ULong guest, ULong host,
+                                  void* tail, UChar tail_opc )
+{
+   vassert(p[0] == 0x49);
+   vassert(p[1] == 0xBB);
+   vassert(*(ULong*)(&p[2]) == guest);
+   /* p[10 .. 12] is cmpq %r11, dstGA, which varies */
+   vassert(p[13] == 0x75);
+   vassert(p[14] == 10+3);
+   vassert(p[15] == 0x49);
+   vassert(p[16] == 0xBB);
+   vassert(*(ULong*)(&p[17]) == host);
+   vassert(p[25] == 0x41);
+   vassert(p[26] == 0xFF);
+   vassert(p[27] == 0xE3);
+   vassert(p[28] == 0x49);
+   vassert(p[29] == 0xBB);
+   vassert(*(ULong*)(&p[30]) == Ptr_to_ULong(tail));
+   vassert(p[38] == 0x41);
+   vassert(p[39] == 0xFF);
+   vassert(p[40] == tail_opc);
+}
+
+VexInvalRange patchXIndirIC_AMD64 ( void*  place_to_patch,
+                                    Addr64 guest_addr,
+                                    void*  host_addr,
+                                    void*  disp_cp_xindir_icfill_EXPECTED,
+                                    void*  disp_cp_xindir )
+{
+   /* What we're expecting to see is an empty cache, which calls
+      disp_cp_xindir_icfill_EXPECTED; see the emitter.  Fill in the
+      guest and host addresses, and change the call into a jump to
+      disp_cp_xindir, so that the cache is filled only once. */
+   UChar* p = (UChar*)place_to_patch;
+   checkXIndirIC_AMD64(p, 1ULL, Ptr_to_ULong(disp_cp_xindir),
+                       disp_cp_xindir_icfill_EXPECTED, 0xD3);
+   vassert(guest_addr != 1ULL);
+   *(ULong*)(&p[2])  = guest_addr;
+   *(ULong*)(&p[17]) = Ptr_to_ULong(host_addr);
+   *(ULong*)(&p[30]) = Ptr_to_ULong(disp_cp_xindir);
+   p[40] = 0xE3;
+   VexInvalRange vir = { (HWord)place_to_patch, 41 };
+   return vir;
+}
+
+VexInvalRange unpatchXIndirIC_AMD64 ( void*  place_to_unpatch,
+                                      Addr64 guest_addr_EXPECTED,
+                                      void*  host_addr_EXPECTED,
+                                      void*  disp_cp_xindir_icfill,
+                                      void*  disp_cp_xindir )
+{
+   /* Undo patchXIndirIC_AMD64. */
+   UChar* p = (UChar*)place_to_unpatch;
+   checkXIndirIC_AMD64(p, guest_addr_EXPECTED,
+                       Ptr_to_ULong(host_addr_EXPECTED),
+                       disp_cp_xindir, 0xE3);
+   *(ULong*)(&p[2])  = 1ULL;
+   *(ULong*)(&p[17]) = Ptr_to_ULong(disp_cp_xindir);
+   *(ULong*)(&p[30]) = Ptr_to_ULong(disp_cp_xindir_icfill);
+   p[40] = 0xD3;
+   VexInvalRange vir = { (HWord)place_to_unpatch, 41 };
+   return vir;
+}
+
+
+/* Change the host code recorded by an Ain_RetPush, as created by
+   emit_AMD64Instr above. */
+VexInvalRange patchRetSite_AMD64 ( void* place_to_patch,
+                                   void* host_addr_EXPECTED,
+                                   void* host_addr )
+{
+   UChar* p = (UChar*)place_to_patch;
+   vassert(p[-2] == 0x49);
+   vassert(p[-1] == 0xBB);
+   vassert(*(ULong*)p == Ptr_to_ULong(host_addr_EXPECTED));
+   *(ULong*)p = Ptr_to_ULong(host_addr);
+   VexInvalRange vir = { (HWord)place_to_patch, 8 };
+   return vir;
+}
+
+
 /* Patch the counter address into a profile inc point, as previously
    created by the Ain_ProfInc case for emit_AMD64Instr. */
 VexInvalRange patchProfInc_AMD64 ( void*  place_to_patch,
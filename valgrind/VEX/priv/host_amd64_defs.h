@@ -43,7 +43,11 @@
 /* --------- Registers. --------- */
 
 /* The usual HReg abstraction.  There are 16 real int regs, 6 real
-   float regs, and 16 real vector regs.
+   float regs, and 16 real vector regs.  The vector regs may be named
+   either as 128-bit xmm regs or, on AVX2 hosts, as 256-bit ymm regs.
+   The two sets handed to the register allocator are disjoint: xmm3
+   .. xmm12 for Vec128 values and ymm2, ymm13 .. ymm15 for Vec256
+   values.
 */
 
 extern void ppHRegAMD64 ( HReg );
@@ -85,6 +89,11 @@ extern HReg hregAMD64_XMM10 ( void );
 extern HReg hregAMD64_XMM11 ( void );
 extern HReg hregAMD64_XMM12 ( void );
 
+extern HReg hregAMD64_YMM2  ( void );
+extern HReg hregAMD64_YMM13 ( void );
+extern HReg hregAMD64_YMM14 ( void );
+extern HReg hregAMD64_YMM15 ( void );
+
 
 /* --------- Condition codes, AMD encoding. --------- */
 
@@ -337,10 +346,18 @@ typedef
       Asse_MIN8U,
       Asse_CMPEQ8, Asse_CMPEQ16, Asse_CMPEQ32,
       Asse_CMPGT8S, Asse_CMPGT16S, Asse_CMPGT32S,
+      /* SSE4.1/4.2 forms are only selected on AVX hosts, VEX.256
+         forms only on AVX2 hosts */
+      Asse_MUL32,
+      Asse_MAX32S, Asse_MAX32U, Asse_MAX16U, Asse_MAX8S,
+      Asse_MIN32S, Asse_MIN32U, Asse_MIN16U, Asse_MIN8S,
+      Asse_CMPEQ64, Asse_CMPGT64S,
+      /* AVX2 only */
+      Asse_PERM32,
       Asse_SHL16, Asse_SHL32, Asse_SHL64,
       Asse_SHR16, Asse_SHR32, Asse_SHR64,
       Asse_SAR16, Asse_SAR32, 
-      Asse_PACKSSD, Asse_PACKSSW, Asse_PACKUSW,
+      Asse_PACKSSD, Asse_PACKSSW, Asse_PACKUSW, Asse_PACKUSD,
       Asse_UNPCKHB, Asse_UNPCKHW, Asse_UNPCKHD, Asse_UNPCKHQ,
       Asse_UNPCKLB, Asse_UNPCKLW, Asse_UNPCKLD, Asse_UNPCKLQ
    }
@@ -367,6 +384,8 @@ typedef
       Ain_XDirect,     /* direct transfer to GA */
       Ain_XIndir,      /* indirect transfer to GA */
       Ain_XAssisted,   /* assisted transfer to GA */
+      Ain_RetPush,     /* push on the return-address shadow stack */
+      Ain_RetPop,      /* return via the return-address shadow stack */
       Ain_CMov64,      /* conditional move */
       Ain_MovxLQ,      /* reg-reg move, zx-ing/sx-ing top half */
       Ain_LoadEX,      /* mov{s,z}{b,w,l}q from mem to reg */
@@ -398,9 +417,15 @@ typedef
       Ain_SseReRg,     /* SSE binary general reg-reg, Re, Rg */
       Ain_SseCMov,     /* SSE conditional move */
       Ain_SseShuf,     /* SSE2 shuffle (pshufd) */
-      //uu Ain_AvxLdSt,     /* AVX load/store 256 bits,
-      //uu                     no alignment constraints */
-      //uu Ain_AvxReRg,     /* AVX binary general reg-reg, Re, Rg */
+      Ain_AvxLdSt,     /* AVX load/store 256 bits,
+                          no alignment constraints */
+      Ain_Avx32Fx8,    /* AVX binary, 32Fx8 */
+      Ain_Avx64Fx4,    /* AVX binary, 64Fx4 */
+      Ain_AvxReRg,     /* AVX binary general reg-reg, Re, Rg */
+      Ain_AvxExtract,  /* copy lo or hi 128 bits of a ymm reg to an
+                          xmm reg */
+      Ain_AvxConcat,   /* build a ymm reg from two xmm regs */
+      Ain_VZeroUpper,  /* zero the upper halves of all ymm regs */
       Ain_EvCheck,     /* Event check */
       Ain_ProfInc      /* 64-bit profile counter increment */
    }
@@ -498,6 +523,29 @@ typedef
             AMD64CondCode cond; /* can be Acc_ALWAYS */
             IRJumpKind    jk;
          } XAssisted;
+         /* Push an entry for a call returning to guest address ra on
+            the return-address shadow stack, whose address is at
+            amRetStack in the guest state.  The host code recorded for
+            ra is a patchable word in this instruction, initially
+            disp_cp_ret_fill.  Trashes %rax, %rcx, %r11 and the
+            flags. */
+         struct {
+            Addr64        ra;
+            AMD64AMode*   amRetStack;
+            AMD64AMode*   amRSP;    /* amode in guest state for RSP */
+         } RetPush;
+         /* Update the guest RIP value to dstGA, then, if it matches
+            the top entry of the return-address shadow stack, pop the
+            entry and jump to the host code it records.  Otherwise
+            fall through, having popped the entry anyway if amRSP
+            shows it is for a frame that no longer exists.  Trashes
+            %rax, %rcx, %rdx, %r11 and the flags. */
+         struct {
+            HReg          dstGA;
+            AMD64AMode*   amRIP;
+            AMD64AMode*   amRetStack;
+            AMD64AMode*   amRSP;
+         } RetPop;
          /* Mov src to dst on the given condition, which may not
             be the bogus Acc_ALWAYS. */
          struct {
@@ -667,16 +715,41 @@ typedef
             HReg   src;
             HReg   dst;
          } SseShuf;
-         //uu struct {
-         //uu    Bool        isLoad;
-         //uu    HReg        reg;
-         //uu    AMD64AMode* addr;
-         //uu } AvxLdSt;
-         //uu struct {
-         //uu    AMD64SseOp op;
-         //uu    HReg       src;
-         //uu    HReg       dst;
-         //uu } AvxReRg;
+         struct {
+            Bool        isLoad;
+            HReg        reg;
+            AMD64AMode* addr;
+         } AvxLdSt;
+         struct {
+            AMD64SseOp op;
+            HReg       src;
+            HReg       dst;
+         } Avx32Fx8;
+         struct {
+            AMD64SseOp op;
+            HReg       src;
+            HReg       dst;
+         } Avx64Fx4;
+         /* For the shifts, src is an xmm reg holding the shift
+            count; otherwise it is a ymm reg. */
+         struct {
+            AMD64SseOp op;
+            HReg       src;
+            HReg       dst;
+         } AvxReRg;
+         struct {
+            Bool hi;   /* True: bits 255:128, False: bits 127:0 */
+            HReg src;  /* ymm */
+            HReg dst;  /* xmm */
+         } AvxExtract;
+         struct {
+            HReg hi;   /* xmm */
+            HReg lo;   /* xmm */
+            HReg dst;  /* ymm */
+         } AvxConcat;
+         struct {
+            /* No fields. */
+         } VZeroUpper;
          struct {
             AMD64AMode* amCounter;
             AMD64AMode* amFailAddr;
@@ -709,6 +782,11 @@ extern AMD64Instr* AMD64Instr_XIndir     ( HReg dstGA, AMD64AMode* amRIP,
                                            AMD64CondCode cond );
 extern AMD64Instr* AMD64Instr_XAssisted  ( HReg dstGA, AMD64AMode* amRIP,
                                            AMD64CondCode cond, IRJumpKind jk );
+extern AMD64Instr* AMD64Instr_RetPush    ( Addr64 ra, AMD64AMode* amRetStack,
+                                           AMD64AMode* amRSP );
+extern AMD64Instr* AMD64Instr_RetPop     ( HReg dstGA, AMD64AMode* amRIP,
+                                           AMD64AMode* amRetStack,
+                                           AMD64AMode* amRSP );
 extern AMD64Instr* AMD64Instr_CMov64     ( AMD64CondCode, AMD64RM* src, HReg dst );
 extern AMD64Instr* AMD64Instr_MovxLQ     ( Bool syned, HReg src, HReg dst );
 extern AMD64Instr* AMD64Instr_LoadEX     ( UChar szSmall, Bool syned,
@@ -739,8 +817,13 @@ extern AMD64Instr* AMD64Instr_Sse64FLo   ( AMD64SseOp, HReg, HReg );
 extern AMD64Instr* AMD64Instr_SseReRg    ( AMD64SseOp, HReg, HReg );
 extern AMD64Instr* AMD64Instr_SseCMov    ( AMD64CondCode, HReg src, HReg dst );
 extern AMD64Instr* AMD64Instr_SseShuf    ( Int order, HReg src, HReg dst );
-//uu extern AMD64Instr* AMD64Instr_AvxLdSt    ( Bool isLoad, HReg, AMD64AMode* );
-//uu extern AMD64Instr* AMD64Instr_AvxReRg    ( AMD64SseOp, HReg, HReg );
+extern AMD64Instr* AMD64Instr_AvxLdSt    ( Bool isLoad, HReg, AMD64AMode* );
+extern AMD64Instr* AMD64Instr_Avx32Fx8   ( AMD64SseOp, HReg, HReg );
+extern AMD64Instr* AMD64Instr_Avx64Fx4   ( AMD64SseOp, HReg, HReg );
+extern AMD64Instr* AMD64Instr_AvxReRg    ( AMD64SseOp, HReg, HReg );
+extern AMD64Instr* AMD64Instr_AvxExtract ( Bool hi, HReg src, HReg dst );
+extern AMD64Instr* AMD64Instr_AvxConcat  ( HReg hi, HReg lo, HReg dst );
+extern AMD64Instr* AMD64Instr_VZeroUpper ( void );
 extern AMD64Instr* AMD64Instr_EvCheck    ( AMD64AMode* amCounter,
                                            AMD64AMode* amFailAddr );
 extern AMD64Instr* AMD64Instr_ProfInc    ( void );
@@ -759,20 +842,28 @@ extern Int          emit_AMD64Instr        ( /*MB_MOD*/Bool* is_profInc,
                                              void* disp_cp_chain_me_to_slowEP,
                                              void* disp_cp_chain_me_to_fastEP,
                                              void* disp_cp_xindir,
+                                             void* disp_cp_xindir_icfill,
+                                             void* disp_cp_ret_fill,
                                              void* disp_cp_xassisted );
 
 extern void genSpill_AMD64  ( /*OUT*/HInstr** i1, /*OUT*/HInstr** i2,
                               HReg rreg, Int offset, Bool );
 extern void genReload_AMD64 ( /*OUT*/HInstr** i1, /*OUT*/HInstr** i2,
                               HReg rreg, Int offset, Bool );
+extern AMD64Instr* genMove_AMD64 ( HReg from, HReg to, Bool );
+
+extern void         getAllocableRegs_AMD64 ( Int*, HReg**, UInt hwcaps );
 
-extern void         getAllocableRegs_AMD64 ( Int*, HReg** );
+/* See comment in host_amd64_defs.c. */
+extern UInt amd64_host_hwcaps;
 extern HInstrArray* iselSB_AMD64           ( IRSB*, 
                                              VexArch,
                                              VexArchInfo*,
                                              VexAbiInfo*,
                                              Int offs_Host_EvC_Counter,
                                              Int offs_Host_EvC_FailAddr,
+                                             Int offs_Host_RetStack,
+                                             Int offs_Guest_SP,
                                              Bool chainingAllowed,
                                              Bool addProfInc,
                                              Addr64 max_ga );
@@ -793,6 +884,25 @@ extern VexInvalRange unchainXDirect_AMD64 ( void* place_to_unchain,
                                             void* place_to_jump_to_EXPECTED,
                                             void* disp_cp_chain_me );
 
+/* Fill in and empty the inline cache of an XIndir. */
+extern VexInvalRange patchXIndirIC_AMD64 ( void*  place_to_patch,
+                                           Addr64 guest_addr,
+                                           void*  host_addr,
+                                           void*  disp_cp_xindir_icfill_EXPECTED,
+                                           void*  disp_cp_xindir );
+
+extern VexInvalRange unpatchXIndirIC_AMD64 ( void*  place_to_unpatch,
+                                             Addr64 guest_addr_EXPECTED,
+                                             void*  host_addr_EXPECTED,
+                                             void*  disp_cp_xindir_icfill,
+                                             void*  disp_cp_xindir );
+
+/* Change the host code recorded by an Ain_RetPush, at
+   place_to_patch, from host_addr_EXPECTED to host_addr. */
+extern VexInvalRange patchRetSite_AMD64 ( void* place_to_patch,
+                                          void* host_addr_EXPECTED,
+                                          void* host_addr );
+
 /* Patch the counter location into an existing ProfInc point. */
 extern VexInvalRange patchProfInc_AMD64 ( void*  place_to_patch,
                                           ULong* location_of_counter );
@@ -117,9 +117,10 @@ static Bool isZeroU8 ( IRExpr* e )
 
         - vregmap   holds the primary register for the IRTemp.
         - vregmapHI is only used for 128-bit integer-typed
-             IRTemps.  It holds the identity of a second
-             64-bit virtual HReg, which holds the high half
-             of the value.
+             IRTemps, and for 256-bit vector-typed IRTemps when
+             those are not kept in ymm registers.  It holds the
+             identity of a second 64/128-bit virtual HReg, which
+             holds the high half of the value.
 
    - The host subarchitecture we are selecting insns for.  
      This is set at the start and does not change.
@@ -140,6 +141,19 @@ static Bool isZeroU8 ( IRExpr* e )
      point of the destination, thereby avoiding the destination's
      event check.
 
+   - The guest state offsets of the host_RetStack pointer, or -1 if
+     calls and returns are not to use the return-address shadow
+     stack, and of the guest stack pointer.
+
+   - The guest address just after the last guest insn seen so far,
+     which when the block ends in a call is its return address.
+
+   - Whether any Vec256 (ymm) virtual register has been created so
+     far.  If so, the upper halves of the ymm registers are cleared
+     with vzeroupper before helper calls and at the end of the
+     block, so as to avoid AVX-SSE transition penalties in compiled
+     code, which uses legacy SSE encodings.
+
    Note, this is all host-independent.  (JRS 20050201: well, kinda
    ... not completely.  Compare with ISelEnv for X86.)
 */
@@ -158,9 +172,14 @@ typedef
       Bool         chainingAllowed;
       Addr64       max_ga;
 
+      Int          offs_Host_RetStack;
+      Int          offs_Guest_SP;
+
       /* These are modified as we go along. */
       HInstrArray* code;
       Int          vreg_ctr;
+      Addr64       last_imark_end;
+      Bool         ymm_used;
    }
    ISelEnv;
 
@@ -184,6 +203,8 @@ static void lookupIRTempPair ( HReg* vrHI, HReg* vrLO,
 
 static void addInstr ( ISelEnv* env, AMD64Instr* instr )
 {
+   if (env->ymm_used && instr->tag == Ain_Call)
+      addInstr(env, AMD64Instr_VZeroUpper());
    addHInstr(env->code, instr);
    if (vex_traceflags & VEX_TRACE_VCODE) {
       ppAMD64Instr(instr, True);
@@ -205,6 +226,22 @@ static HReg newVRegV ( ISelEnv* env )
    return reg;
 }
 
+static HReg newVRegY ( ISelEnv* env )
+{
+   HReg reg = mkHReg(env->vreg_ctr, HRcVec256, True/*virtual reg*/);
+   vassert(env->hwcaps & VEX_HWCAPS_AMD64_AVX2);
+   env->vreg_ctr++;
+   env->ymm_used = True;
+   return reg;
+}
+
+/* There is no hwcaps bit for SSE4.1/4.2, but every AVX-capable CPU
+   has them, so use that as a proxy. */
+static Bool have_SSE4 ( ISelEnv* env )
+{
+   return toBool(env->hwcaps & VEX_HWCAPS_AMD64_AVX);
+}
+
 
 /*---------------------------------------------------------*/
 /*--- ISEL: Forward declarations                        ---*/
@@ -253,6 +290,11 @@ static void          iselDVecExpr_wrk ( /*OUT*/HReg* rHi, HReg* rLo,
 static void          iselDVecExpr     ( /*OUT*/HReg* rHi, HReg* rLo, 
                                         ISelEnv* env, IRExpr* e );
 
+static HReg          iselYVecExpr_wrk ( ISelEnv* env, IRExpr* e );
+static HReg          iselYVecExpr     ( ISelEnv* env, IRExpr* e );
+
+static HReg          iselV256HalfExpr ( ISelEnv* env, IRExpr* e, Bool hi );
+
 
 /*---------------------------------------------------------*/
 /*--- ISEL: Misc helpers                                ---*/
@@ -324,6 +366,15 @@ static AMD64Instr* mk_vMOVsd_RR ( HReg src, HReg dst )
    return AMD64Instr_SseReRg(Asse_MOV, src, dst);
 }
 
+/* Make a vector (256 bit) reg-reg move. */
+
+static AMD64Instr* mk_yMOVsd_RR ( HReg src, HReg dst )
+{
+   vassert(hregClass(src) == HRcVec256);
+   vassert(hregClass(dst) == HRcVec256);
+   return AMD64Instr_AvxReRg(Asse_MOV, src, dst);
+}
+
 /* Advance/retreat %rsp by n. */
 
 static void add_to_rsp ( ISelEnv* env, Int n )
@@ -864,6 +915,30 @@ static HReg do_sse_NotV128 ( ISelEnv* env, HReg src )
 }
 
 
+/* The same three, for 256-bit ymm registers.
+*/
+static HReg generate_zeroes_V256 ( ISelEnv* env )
+{
+   HReg dst = newVRegY(env);
+   addInstr(env, AMD64Instr_AvxReRg(Asse_XOR, dst, dst));
+   return dst;
+}
+
+static HReg generate_ones_V256 ( ISelEnv* env )
+{
+   HReg dst = newVRegY(env);
+   addInstr(env, AMD64Instr_AvxReRg(Asse_CMPEQ32, dst, dst));
+   return dst;
+}
+
+static HReg do_avx_NotV256 ( ISelEnv* env, HReg src )
+{
+   HReg dst = generate_ones_V256(env);
+   addInstr(env, AMD64Instr_AvxReRg(Asse_XOR, src, dst));
+   return dst;
+}
+
+
 /* Expand the given byte into a 64-bit word, by cloning each bit
    8 times. */
 static ULong bitmask8_to_bytemask64 ( UShort w8 )
@@ -1627,17 +1702,20 @@ static HReg iselIntExpr_R_wrk ( ISelEnv* env, IRExpr* e )
 
          case Iop_V256to64_0: case Iop_V256to64_1:
          case Iop_V256to64_2: case Iop_V256to64_3: {
-            HReg vHi, vLo, vec;
-            iselDVecExpr(&vHi, &vLo, env, e->Iex.Unop.arg);
+            HReg vec;
             /* Do the first part of the selection by deciding which of
-               the 128 bit registers do look at, and second part using
+               the 128 bit halves to look at, and second part using
                the same scheme as for V128{HI}to64 above. */
             Int off = 0;
             switch (e->Iex.Unop.op) {
-               case Iop_V256to64_0: vec = vLo; off = -16; break;
-               case Iop_V256to64_1: vec = vLo; off =  -8; break;
-               case Iop_V256to64_2: vec = vHi; off = -16; break;
-               case Iop_V256to64_3: vec = vHi; off =  -8; break;
+               case Iop_V256to64_0: vec = iselV256HalfExpr(env, e->Iex.Unop.arg, False);
+                                    off = -16; break;
+               case Iop_V256to64_1: vec = iselV256HalfExpr(env, e->Iex.Unop.arg, False);
+                                    off =  -8; break;
+               case Iop_V256to64_2: vec = iselV256HalfExpr(env, e->Iex.Unop.arg, True);
+                                    off = -16; break;
+               case Iop_V256to64_3: vec = iselV256HalfExpr(env, e->Iex.Unop.arg, True);
+                                    off =  -8; break;
                default: vassert(0);
             }
             HReg        dst     = newVRegI(env);
@@ -1744,29 +1822,47 @@ static HReg iselIntExpr_R_wrk ( ISelEnv* env, IRExpr* e )
             break;
       }
 
-      /* Deal with unary 64-bit SIMD ops. */
-      switch (e->Iex.Unop.op) {
-         case Iop_CmpNEZ32x2:
-            fn = (HWord)h_generic_calc_CmpNEZ32x2; break;
-         case Iop_CmpNEZ16x4:
-            fn = (HWord)h_generic_calc_CmpNEZ16x4; break;
-         case Iop_CmpNEZ8x8:
-            fn = (HWord)h_generic_calc_CmpNEZ8x8; break;
-         default:
-            fn = (HWord)0; break;
-      }
-      if (fn != (HWord)0) {
-         /* Note: the following assumes all helpers are of
-            signature 
-               ULong fn ( ULong ), and they are
-            not marked as regparm functions. 
-         */
-         HReg dst = newVRegI(env);
-         HReg arg = iselIntExpr_R(env, e->Iex.Unop.arg);
-         addInstr(env, mk_iMOVsd_RR(arg, hregAMD64_RDI()) );
-         addInstr(env, AMD64Instr_Call( Acc_ALWAYS, (ULong)fn, 1,
-                                        mk_RetLoc_simple(RLPri_Int) ));
-         addInstr(env, mk_iMOVsd_RR(hregAMD64_RAX(), dst));
+      /* Lane-wise CmpNEZ on 64-bit SIMD values.  Memcheck uses these
+         to pessimise the shadows of MMX-sized and Perm8x8 operations,
+         so do them in integer registers rather than calling out.
+         With L having all but the top bit of each lane set and H
+         being ~L:
+            t = x | ((x & L) + L)   -- lane top bit set iff lane != 0
+            m = t & H
+            r = m | (m - (m >> (lane_bits - 1)))
+         The addition cannot carry between lanes, and nor can the
+         subtraction borrow, since each lane of m is either 0 or just
+         its top bit. */
+      if (e->Iex.Unop.op == Iop_CmpNEZ32x2
+          || e->Iex.Unop.op == Iop_CmpNEZ16x4
+          || e->Iex.Unop.op == Iop_CmpNEZ8x8) {
+         ULong lomask;
+         UInt  shift;
+         switch (e->Iex.Unop.op) {
+            case Iop_CmpNEZ32x2:
+               lomask = 0x7FFFFFFF7FFFFFFFULL; shift = 31; break;
+            case Iop_CmpNEZ16x4:
+               lomask = 0x7FFF7FFF7FFF7FFFULL; shift = 15; break;
+            default:
+               lomask = 0x7F7F7F7F7F7F7F7FULL; shift = 7;  break;
+         }
+         HReg arg  = iselIntExpr_R(env, e->Iex.Unop.arg);
+         HReg mask = newVRegI(env);
+         HReg tmp  = newVRegI(env);
+         HReg top  = newVRegI(env);
+         HReg dst  = newVRegI(env);
+         addInstr(env, AMD64Instr_Imm64(lomask, mask));
+         addInstr(env, mk_iMOVsd_RR(arg, tmp));
+         addInstr(env, AMD64Instr_Alu64R(Aalu_AND, AMD64RMI_Reg(mask), tmp));
+         addInstr(env, AMD64Instr_Alu64R(Aalu_ADD, AMD64RMI_Reg(mask), tmp));
+         addInstr(env, AMD64Instr_Alu64R(Aalu_OR,  AMD64RMI_Reg(arg),  tmp));
+         addInstr(env, AMD64Instr_Unary64(Aun_NOT, mask));
+         addInstr(env, AMD64Instr_Alu64R(Aalu_AND, AMD64RMI_Reg(mask), tmp));
+         addInstr(env, mk_iMOVsd_RR(tmp, top));
+         addInstr(env, AMD64Instr_Sh64(Ash_SHR, shift, top));
+         addInstr(env, mk_iMOVsd_RR(tmp, dst));
+         addInstr(env, AMD64Instr_Alu64R(Aalu_SUB, AMD64RMI_Reg(top), dst));
+         addInstr(env, AMD64Instr_Alu64R(Aalu_OR,  AMD64RMI_Reg(tmp), dst));
          return dst;
       }
 
@@ -3203,6 +3299,11 @@ static HReg iselVecExpr_wrk ( ISelEnv* env, IRExpr* e )
          HReg arg  = iselVecExpr(env, e->Iex.Unop.arg);
          HReg tmp  = generate_zeroes_V128(env);
          HReg dst  = newVRegV(env);
+         if (have_SSE4(env)) {
+            /* pcmpeqq does the 64-bit lane comparison directly. */
+            addInstr(env, AMD64Instr_SseReRg(Asse_CMPEQ64, arg, tmp));
+            return do_sse_NotV128(env, tmp);
+         }
          addInstr(env, AMD64Instr_SseReRg(Asse_CMPEQ32, arg, tmp));
          tmp = do_sse_NotV128(env, tmp);
          addInstr(env, AMD64Instr_SseShuf(0xB1, tmp, dst));
@@ -3215,14 +3316,12 @@ static HReg iselVecExpr_wrk ( ISelEnv* env, IRExpr* e )
       case Iop_CmpNEZ8x16: op = Asse_CMPEQ8;  goto do_CmpNEZ_vector;
       do_CmpNEZ_vector:
       {
+         /* The comparison is symmetric, so compare into the zeroed
+            register rather than into a copy of the argument. */
          HReg arg  = iselVecExpr(env, e->Iex.Unop.arg);
-         HReg tmp  = newVRegV(env);
-         HReg zero = generate_zeroes_V128(env);
-         HReg dst;
-         addInstr(env, mk_vMOVsd_RR(arg, tmp));
-         addInstr(env, AMD64Instr_SseReRg(op, zero, tmp));
-         dst = do_sse_NotV128(env, tmp);
-         return dst;
+         HReg tmp  = generate_zeroes_V128(env);
+         addInstr(env, AMD64Instr_SseReRg(op, arg, tmp));
+         return do_sse_NotV128(env, tmp);
       }
 
       case Iop_Recip32Fx4: op = Asse_RCPF;   goto do_32Fx4_unary;
@@ -3299,11 +3398,9 @@ static HReg iselVecExpr_wrk ( ISelEnv* env, IRExpr* e )
       }
 
       case Iop_V256toV128_0:
-      case Iop_V256toV128_1: {
-         HReg vHi, vLo;
-         iselDVecExpr(&vHi, &vLo, env, e->Iex.Unop.arg);
-         return (e->Iex.Unop.op == Iop_V256toV128_1) ? vHi : vLo;
-      }
+      case Iop_V256toV128_1:
+         return iselV256HalfExpr(env, e->Iex.Unop.arg,
+                                 e->Iex.Unop.op == Iop_V256toV128_1);
 
       default:
          break;
@@ -3525,31 +3622,68 @@ static HReg iselVecExpr_wrk ( ISelEnv* env, IRExpr* e )
          return dst;
       }
 
-      case Iop_Mul32x4:    fn = (HWord)h_generic_calc_Mul32x4;
+      case Iop_Mul32x4:    if (have_SSE4(env)) {
+                              op = Asse_MUL32; goto do_SseReRg;
+                           }
+                           fn = (HWord)h_generic_calc_Mul32x4;
                            goto do_SseAssistedBinary;
-      case Iop_Max32Sx4:   fn = (HWord)h_generic_calc_Max32Sx4;
+      case Iop_Max32Sx4:   if (have_SSE4(env)) {
+                              op = Asse_MAX32S; goto do_SseReRg;
+                           }
+                           fn = (HWord)h_generic_calc_Max32Sx4;
                            goto do_SseAssistedBinary;
-      case Iop_Min32Sx4:   fn = (HWord)h_generic_calc_Min32Sx4;
+      case Iop_Min32Sx4:   if (have_SSE4(env)) {
+                              op = Asse_MIN32S; goto do_SseReRg;
+                           }
+                           fn = (HWord)h_generic_calc_Min32Sx4;
                            goto do_SseAssistedBinary;
-      case Iop_Max32Ux4:   fn = (HWord)h_generic_calc_Max32Ux4;
+      case Iop_Max32Ux4:   if (have_SSE4(env)) {
+                              op = Asse_MAX32U; goto do_SseReRg;
+                           }
+                           fn = (HWord)h_generic_calc_Max32Ux4;
                            goto do_SseAssistedBinary;
-      case Iop_Min32Ux4:   fn = (HWord)h_generic_calc_Min32Ux4;
+      case Iop_Min32Ux4:   if (have_SSE4(env)) {
+                              op = Asse_MIN32U; goto do_SseReRg;
+                           }
+                           fn = (HWord)h_generic_calc_Min32Ux4;
                            goto do_SseAssistedBinary;
-      case Iop_Max16Ux8:   fn = (HWord)h_generic_calc_Max16Ux8;
+      case Iop_Max16Ux8:   if (have_SSE4(env)) {
+                              op = Asse_MAX16U; goto do_SseReRg;
+                           }
+                           fn = (HWord)h_generic_calc_Max16Ux8;
                            goto do_SseAssistedBinary;
-      case Iop_Min16Ux8:   fn = (HWord)h_generic_calc_Min16Ux8;
+      case Iop_Min16Ux8:   if (have_SSE4(env)) {
+                              op = Asse_MIN16U; goto do_SseReRg;
+                           }
+                           fn = (HWord)h_generic_calc_Min16Ux8;
                            goto do_SseAssistedBinary;
-      case Iop_Max8Sx16:   fn = (HWord)h_generic_calc_Max8Sx16;
+      case Iop_Max8Sx16:   if (have_SSE4(env)) {
+                              op = Asse_MAX8S; goto do_SseReRg;
+                           }
+                           fn = (HWord)h_generic_calc_Max8Sx16;
                            goto do_SseAssistedBinary;
-      case Iop_Min8Sx16:   fn = (HWord)h_generic_calc_Min8Sx16;
+      case Iop_Min8Sx16:   if (have_SSE4(env)) {
+                              op = Asse_MIN8S; goto do_SseReRg;
+                           }
+                           fn = (HWord)h_generic_calc_Min8Sx16;
                            goto do_SseAssistedBinary;
-      case Iop_CmpEQ64x2:  fn = (HWord)h_generic_calc_CmpEQ64x2;
+      case Iop_CmpEQ64x2:  if (have_SSE4(env)) {
+                              op = Asse_CMPEQ64; goto do_SseReRg;
+                           }
+                           fn = (HWord)h_generic_calc_CmpEQ64x2;
                            goto do_SseAssistedBinary;
-      case Iop_CmpGT64Sx2: fn = (HWord)h_generic_calc_CmpGT64Sx2;
+      case Iop_CmpGT64Sx2: if (have_SSE4(env)) {
+                              op = Asse_CMPGT64S; goto do_SseReRg;
+                           }
+                           fn = (HWord)h_generic_calc_CmpGT64Sx2;
                            goto do_SseAssistedBinary;
       case Iop_Perm32x4:   fn = (HWord)h_generic_calc_Perm32x4;
                            goto do_SseAssistedBinary;
       case Iop_QNarrowBin32Sto16Ux8:
+                           if (have_SSE4(env)) {
+                              op = Asse_PACKUSD; arg1isEReg = True;
+                              goto do_SseReRg;
+                           }
                            fn = (HWord)h_generic_calc_QNarrowBin32Sto16Ux8;
                            goto do_SseAssistedBinary;
       case Iop_NarrowBin16to8x16:
@@ -3709,6 +3843,15 @@ static void iselDVecExpr_wrk ( /*OUT*/HReg* rHi, /*OUT*/HReg* rLo,
 
    /* read 256-bit IRTemp */
    if (e->tag == Iex_RdTmp) {
+      HReg r = lookupIRTemp(env, e->Iex.RdTmp.tmp);
+      if (hregClass(r) == HRcVec256) {
+         /* It lives in a ymm reg; split it. */
+         *rHi = newVRegV(env);
+         *rLo = newVRegV(env);
+         addInstr(env, AMD64Instr_AvxExtract(True/*hi*/,  r, *rHi));
+         addInstr(env, AMD64Instr_AvxExtract(False/*lo*/, r, *rLo));
+         return;
+      }
       lookupIRTempPair( rHi, rLo, env, e->Iex.RdTmp.tmp);
       return;
    }
@@ -4194,6 +4337,279 @@ static void iselDVecExpr_wrk ( /*OUT*/HReg* rHi, /*OUT*/HReg* rLo,
 }
 
 
+/*---------------------------------------------------------*/
+/*--- ISEL: SIMD (V256) expressions, into 1 YMM reg.     --*/
+/*---------------------------------------------------------*/
+
+/* On AVX2 hosts, V256 temporaries live in single Vec256 registers,
+   and the commonly occurring operations are selected directly into
+   256-bit AVX instructions.  Anything else is done in two halves by
+   iselDVecExpr and the halves joined afterwards. */
+
+static HReg iselYVecExpr ( ISelEnv* env, IRExpr* e )
+{
+   HReg r = iselYVecExpr_wrk( env, e );
+#  if 0
+   vex_printf("\n"); ppIRExpr(e); vex_printf("\n");
+#  endif
+   vassert(hregClass(r) == HRcVec256);
+   vassert(hregIsVirtual(r));
+   return r;
+}
+
+
+/* DO NOT CALL THIS DIRECTLY */
+static HReg iselYVecExpr_wrk ( ISelEnv* env, IRExpr* e )
+{
+   vassert(e);
+   IRType ty = typeOfIRExpr(env->type_env,e);
+   vassert(ty == Ity_V256);
+   vassert(env->hwcaps & VEX_HWCAPS_AMD64_AVX2);
+
+   AMD64SseOp op = Asse_INVALID;
+
+   if (e->tag == Iex_RdTmp) {
+      return lookupIRTemp(env, e->Iex.RdTmp.tmp);
+   }
+
+   if (e->tag == Iex_Get) {
+      HReg        dst = newVRegY(env);
+      AMD64AMode* am  = AMD64AMode_IR(e->Iex.Get.offset, hregAMD64_RBP());
+      addInstr(env, AMD64Instr_AvxLdSt(True/*load*/, dst, am));
+      return dst;
+   }
+
+   if (e->tag == Iex_Load) {
+      HReg        dst = newVRegY(env);
+      AMD64AMode* am  = iselIntExpr_AMode(env, e->Iex.Load.addr);
+      addInstr(env, AMD64Instr_AvxLdSt(True/*load*/, dst, am));
+      return dst;
+   }
+
+   if (e->tag == Iex_Const) {
+      vassert(e->Iex.Const.con->tag == Ico_V256);
+      switch (e->Iex.Const.con->Ico.V256) {
+         case 0x00000000:
+            return generate_zeroes_V256(env);
+         case 0xFFFFFFFF:
+            return generate_ones_V256(env);
+         default:
+            break; /* use the two-halves scheme */
+      }
+   }
+
+   if (e->tag == Iex_Unop) {
+   switch (e->Iex.Unop.op) {
+
+      case Iop_NotV256: {
+         HReg arg = iselYVecExpr(env, e->Iex.Unop.arg);
+         return do_avx_NotV256(env, arg);
+      }
+
+      case Iop_Recip32Fx8: op = Asse_RCPF;   goto do_32Fx8_unary;
+      case Iop_Sqrt32Fx8:  op = Asse_SQRTF;  goto do_32Fx8_unary;
+      case Iop_RSqrt32Fx8: op = Asse_RSQRTF; goto do_32Fx8_unary;
+      do_32Fx8_unary:
+      {
+         HReg arg = iselYVecExpr(env, e->Iex.Unop.arg);
+         HReg dst = newVRegY(env);
+         addInstr(env, AMD64Instr_Avx32Fx8(op, arg, dst));
+         return dst;
+      }
+
+      case Iop_Sqrt64Fx4:  op = Asse_SQRTF;  goto do_64Fx4_unary;
+      do_64Fx4_unary:
+      {
+         HReg arg = iselYVecExpr(env, e->Iex.Unop.arg);
+         HReg dst = newVRegY(env);
+         addInstr(env, AMD64Instr_Avx64Fx4(op, arg, dst));
+         return dst;
+      }
+
+      case Iop_CmpNEZ64x4: op = Asse_CMPEQ64; goto do_CmpNEZ_vector;
+      case Iop_CmpNEZ32x8: op = Asse_CMPEQ32; goto do_CmpNEZ_vector;
+      case Iop_CmpNEZ16x16: op = Asse_CMPEQ16; goto do_CmpNEZ_vector;
+      case Iop_CmpNEZ8x32: op = Asse_CMPEQ8;  goto do_CmpNEZ_vector;
+      do_CmpNEZ_vector:
+      {
+         HReg arg = iselYVecExpr(env, e->Iex.Unop.arg);
+         HReg tmp = generate_zeroes_V256(env);
+         addInstr(env, AMD64Instr_AvxReRg(op, arg, tmp));
+         return do_avx_NotV256(env, tmp);
+      }
+
+      default:
+         break;
+   } /* switch (e->Iex.Unop.op) */
+   } /* if (e->tag == Iex_Unop) */
+
+   if (e->tag == Iex_Binop) {
+   switch (e->Iex.Binop.op) {
+
+      case Iop_Add64Fx4:   op = Asse_ADDF;   goto do_64Fx4;
+      case Iop_Sub64Fx4:   op = Asse_SUBF;   goto do_64Fx4;
+      case Iop_Mul64Fx4:   op = Asse_MULF;   goto do_64Fx4;
+      case Iop_Div64Fx4:   op = Asse_DIVF;   goto do_64Fx4;
+      case Iop_Max64Fx4:   op = Asse_MAXF;   goto do_64Fx4;
+      case Iop_Min64Fx4:   op = Asse_MINF;   goto do_64Fx4;
+      do_64Fx4:
+      {
+         HReg argL = iselYVecExpr(env, e->Iex.Binop.arg1);
+         HReg argR = iselYVecExpr(env, e->Iex.Binop.arg2);
+         HReg dst  = newVRegY(env);
+         addInstr(env, mk_yMOVsd_RR(argL, dst));
+         addInstr(env, AMD64Instr_Avx64Fx4(op, argR, dst));
+         return dst;
+      }
+
+      case Iop_Add32Fx8:   op = Asse_ADDF;   goto do_32Fx8;
+      case Iop_Sub32Fx8:   op = Asse_SUBF;   goto do_32Fx8;
+      case Iop_Mul32Fx8:   op = Asse_MULF;   goto do_32Fx8;
+      case Iop_Div32Fx8:   op = Asse_DIVF;   goto do_32Fx8;
+      case Iop_Max32Fx8:   op = Asse_MAXF;   goto do_32Fx8;
+      case Iop_Min32Fx8:   op = Asse_MINF;   goto do_32Fx8;
+      do_32Fx8:
+      {
+         HReg argL = iselYVecExpr(env, e->Iex.Binop.arg1);
+         HReg argR = iselYVecExpr(env, e->Iex.Binop.arg2);
+         HReg dst  = newVRegY(env);
+         addInstr(env, mk_yMOVsd_RR(argL, dst));
+         addInstr(env, AMD64Instr_Avx32Fx8(op, argR, dst));
+         return dst;
+      }
+
+      case Iop_AndV256:    op = Asse_AND;      goto do_AvxReRg;
+      case Iop_OrV256:     op = Asse_OR;       goto do_AvxReRg;
+      case Iop_XorV256:    op = Asse_XOR;      goto do_AvxReRg;
+      case Iop_Add8x32:    op = Asse_ADD8;     goto do_AvxReRg;
+      case Iop_Add16x16:   op = Asse_ADD16;    goto do_AvxReRg;
+      case Iop_Add32x8:    op = Asse_ADD32;    goto do_AvxReRg;
+      case Iop_Add64x4:    op = Asse_ADD64;    goto do_AvxReRg;
+      case Iop_QAdd8Sx32:  op = Asse_QADD8S;   goto do_AvxReRg;
+      case Iop_QAdd16Sx16: op = Asse_QADD16S;  goto do_AvxReRg;
+      case Iop_QAdd8Ux32:  op = Asse_QADD8U;   goto do_AvxReRg;
+      case Iop_QAdd16Ux16: op = Asse_QADD16U;  goto do_AvxReRg;
+      case Iop_Avg8Ux32:   op = Asse_AVG8U;    goto do_AvxReRg;
+      case Iop_Avg16Ux16:  op = Asse_AVG16U;   goto do_AvxReRg;
+      case Iop_CmpEQ8x32:  op = Asse_CMPEQ8;   goto do_AvxReRg;
+      case Iop_CmpEQ16x16: op = Asse_CMPEQ16;  goto do_AvxReRg;
+      case Iop_CmpEQ32x8:  op = Asse_CMPEQ32;  goto do_AvxReRg;
+      case Iop_CmpEQ64x4:  op = Asse_CMPEQ64;  goto do_AvxReRg;
+      case Iop_CmpGT8Sx32: op = Asse_CMPGT8S;  goto do_AvxReRg;
+      case Iop_CmpGT16Sx16: op = Asse_CMPGT16S; goto do_AvxReRg;
+      case Iop_CmpGT32Sx8: op = Asse_CMPGT32S; goto do_AvxReRg;
+      case Iop_CmpGT64Sx4: op = Asse_CMPGT64S; goto do_AvxReRg;
+      case Iop_Max8Sx32:   op = Asse_MAX8S;    goto do_AvxReRg;
+      case Iop_Max16Sx16:  op = Asse_MAX16S;   goto do_AvxReRg;
+      case Iop_Max32Sx8:   op = Asse_MAX32S;   goto do_AvxReRg;
+      case Iop_Max8Ux32:   op = Asse_MAX8U;    goto do_AvxReRg;
+      case Iop_Max16Ux16:  op = Asse_MAX16U;   goto do_AvxReRg;
+      case Iop_Max32Ux8:   op = Asse_MAX32U;   goto do_AvxReRg;
+      case Iop_Min8Sx32:   op = Asse_MIN8S;    goto do_AvxReRg;
+      case Iop_Min16Sx16:  op = Asse_MIN16S;   goto do_AvxReRg;
+      case Iop_Min32Sx8:   op = Asse_MIN32S;   goto do_AvxReRg;
+      case Iop_Min8Ux32:   op = Asse_MIN8U;    goto do_AvxReRg;
+      case Iop_Min16Ux16:  op = Asse_MIN16U;   goto do_AvxReRg;
+      case Iop_Min32Ux8:   op = Asse_MIN32U;   goto do_AvxReRg;
+      case Iop_MulHi16Ux16: op = Asse_MULHI16U; goto do_AvxReRg;
+      case Iop_MulHi16Sx16: op = Asse_MULHI16S; goto do_AvxReRg;
+      case Iop_Mul16x16:   op = Asse_MUL16;    goto do_AvxReRg;
+      case Iop_Mul32x8:    op = Asse_MUL32;    goto do_AvxReRg;
+      case Iop_Sub8x32:    op = Asse_SUB8;     goto do_AvxReRg;
+      case Iop_Sub16x16:   op = Asse_SUB16;    goto do_AvxReRg;
+      case Iop_Sub32x8:    op = Asse_SUB32;    goto do_AvxReRg;
+      case Iop_Sub64x4:    op = Asse_SUB64;    goto do_AvxReRg;
+      case Iop_QSub8Sx32:  op = Asse_QSUB8S;   goto do_AvxReRg;
+      case Iop_QSub16Sx16: op = Asse_QSUB16S;  goto do_AvxReRg;
+      case Iop_QSub8Ux32:  op = Asse_QSUB8U;   goto do_AvxReRg;
+      case Iop_QSub16Ux16: op = Asse_QSUB16U;  goto do_AvxReRg;
+      do_AvxReRg:
+      {
+         HReg argL = iselYVecExpr(env, e->Iex.Binop.arg1);
+         HReg argR = iselYVecExpr(env, e->Iex.Binop.arg2);
+         HReg dst  = newVRegY(env);
+         addInstr(env, mk_yMOVsd_RR(argL, dst));
+         addInstr(env, AMD64Instr_AvxReRg(op, argR, dst));
+         return dst;
+      }
+
+      case Iop_Perm32x8: {
+         /* vpermd takes the indices in the vvvv operand, which is
+            also the destination here. */
+         HReg argL = iselYVecExpr(env, e->Iex.Binop.arg1);
+         HReg argR = iselYVecExpr(env, e->Iex.Binop.arg2);
+         HReg dst  = newVRegY(env);
+         addInstr(env, mk_yMOVsd_RR(argR, dst));
+         addInstr(env, AMD64Instr_AvxReRg(Asse_PERM32, argL, dst));
+         return dst;
+      }
+
+      case Iop_ShlN16x16: op = Asse_SHL16; goto do_AvxShift;
+      case Iop_ShlN32x8:  op = Asse_SHL32; goto do_AvxShift;
+      case Iop_ShlN64x4:  op = Asse_SHL64; goto do_AvxShift;
+      case Iop_SarN16x16: op = Asse_SAR16; goto do_AvxShift;
+      case Iop_SarN32x8:  op = Asse_SAR32; goto do_AvxShift;
+      case Iop_ShrN16x16: op = Asse_SHR16; goto do_AvxShift;
+      case Iop_ShrN32x8:  op = Asse_SHR32; goto do_AvxShift;
+      case Iop_ShrN64x4:  op = Asse_SHR64; goto do_AvxShift;
+      do_AvxShift: {
+         HReg        greg = iselYVecExpr(env, e->Iex.Binop.arg1);
+         AMD64RMI*   rmi  = iselIntExpr_RMI(env, e->Iex.Binop.arg2);
+         AMD64AMode* rsp0 = AMD64AMode_IR(0, hregAMD64_RSP());
+         HReg        ereg = newVRegV(env);
+         HReg        dst  = newVRegY(env);
+         addInstr(env, AMD64Instr_Push(AMD64RMI_Imm(0)));
+         addInstr(env, AMD64Instr_Push(rmi));
+         addInstr(env, AMD64Instr_SseLdSt(True/*load*/, 16, ereg, rsp0));
+         addInstr(env, mk_yMOVsd_RR(greg, dst));
+         addInstr(env, AMD64Instr_AvxReRg(op, ereg, dst));
+         add_to_rsp(env, 16);
+         return dst;
+      }
+
+      case Iop_V128HLtoV256: {
+         HReg vHi = iselVecExpr(env, e->Iex.Binop.arg1);
+         HReg vLo = iselVecExpr(env, e->Iex.Binop.arg2);
+         HReg dst = newVRegY(env);
+         addInstr(env, AMD64Instr_AvxConcat(vHi, vLo, dst));
+         return dst;
+      }
+
+      default:
+         break;
+   } /* switch (e->Iex.Binop.op) */
+   } /* if (e->tag == Iex_Binop) */
+
+   /* Everything else: do it in two halves, then join them. */
+   {
+      HReg vHi, vLo;
+      HReg dst = newVRegY(env);
+      iselDVecExpr(&vHi, &vLo, env, e);
+      addInstr(env, AMD64Instr_AvxConcat(vHi, vLo, dst));
+      return dst;
+   }
+}
+
+
+/* Compute the upper (hi == True) or lower half of a V256 expression
+   into a V128 register.  If the expression is a temporary living in
+   a ymm reg, only the requested half is extracted. */
+static HReg iselV256HalfExpr ( ISelEnv* env, IRExpr* e, Bool hi )
+{
+   HReg vHi, vLo;
+   if (e->tag == Iex_RdTmp) {
+      HReg r = lookupIRTemp(env, e->Iex.RdTmp.tmp);
+      if (hregClass(r) == HRcVec256) {
+         HReg dst = newVRegV(env);
+         addInstr(env, AMD64Instr_AvxExtract(hi, r, dst));
+         return dst;
+      }
+   }
+   iselDVecExpr(&vHi, &vLo, env, e);
+   return hi ? vHi : vLo;
+}
+
+
 /*---------------------------------------------------------*/
 /*--- ISEL: Statements                                  ---*/
 /*---------------------------------------------------------*/
@@ -4249,6 +4665,12 @@ static void iselStmt ( ISelEnv* env, IRStmt* stmt )
          addInstr(env, AMD64Instr_SseLdSt(False/*store*/, 16, r, am));
          return;
       }
+      if (tyd == Ity_V256 && (env->hwcaps & VEX_HWCAPS_AMD64_AVX2)) {
+         AMD64AMode* am = iselIntExpr_AMode(env, stmt->Ist.Store.addr);
+         HReg r = iselYVecExpr(env, stmt->Ist.Store.data);
+         addInstr(env, AMD64Instr_AvxLdSt(False/*store*/, r, am));
+         return;
+      }
       if (tyd == Ity_V256) {
          HReg        rA   = iselIntExpr_R(env, stmt->Ist.Store.addr);
          AMD64AMode* am0  = AMD64AMode_IR(0,  rA);
@@ -4308,6 +4730,13 @@ static void iselStmt ( ISelEnv* env, IRStmt* stmt )
          addInstr(env, AMD64Instr_SseLdSt(False/*store*/, 16, vec, am));
          return;
       }
+      if (ty == Ity_V256 && (env->hwcaps & VEX_HWCAPS_AMD64_AVX2)) {
+         HReg        vec = iselYVecExpr(env, stmt->Ist.Put.data);
+         AMD64AMode* am  = AMD64AMode_IR(stmt->Ist.Put.offset, 
+                                         hregAMD64_RBP());
+         addInstr(env, AMD64Instr_AvxLdSt(False/*store*/, vec, am));
+         return;
+      }
       if (ty == Ity_V256) {
          HReg vHi, vLo;
          iselDVecExpr(&vHi, &vLo, env, stmt->Ist.Put.data);
@@ -4416,6 +4845,12 @@ static void iselStmt ( ISelEnv* env, IRStmt* stmt )
          addInstr(env, mk_vMOVsd_RR(src, dst));
          return;
       }
+      if (ty == Ity_V256 && hregClass(lookupIRTemp(env, tmp)) == HRcVec256) {
+         HReg dst = lookupIRTemp(env, tmp);
+         HReg src = iselYVecExpr(env, stmt->Ist.WrTmp.data);
+         addInstr(env, mk_yMOVsd_RR(src, dst));
+         return;
+      }
       if (ty == Ity_V256) {
          HReg rHi, rLo, dstHi, dstLo;
          iselDVecExpr(&rHi,&rLo, env, stmt->Ist.WrTmp.data);
@@ -4492,6 +4927,13 @@ static void iselStmt ( ISelEnv* env, IRStmt* stmt )
             /* See comments for Ity_V128. */
             vassert(rloc.pri == RLPri_V256SpRel);
             vassert(addToSp >= 32);
+            if (hregClass(lookupIRTemp(env, d->tmp)) == HRcVec256) {
+               HReg        dst = lookupIRTemp(env, d->tmp);
+               AMD64AMode* am  = AMD64AMode_IR(rloc.spOff, hregAMD64_RSP());
+               addInstr(env, AMD64Instr_AvxLdSt( True/*load*/, dst, am ));
+               add_to_rsp(env, addToSp);
+               return;
+            }
             HReg        dstLo, dstHi;
             lookupIRTempPair(&dstHi, &dstLo, env, d->tmp);
             AMD64AMode* amLo  = AMD64AMode_IR(rloc.spOff, hregAMD64_RSP());
@@ -4597,6 +5039,8 @@ static void iselStmt ( ISelEnv* env, IRStmt* stmt )
    /* --------- INSTR MARK --------- */
    /* Doesn't generate any executable code ... */
    case Ist_IMark:
+       env->last_imark_end = stmt->Ist.IMark.addr + stmt->Ist.IMark.len
+                             + stmt->Ist.IMark.delta;
        return;
 
    /* --------- ABI HINT --------- */
@@ -4614,6 +5058,13 @@ static void iselStmt ( ISelEnv* env, IRStmt* stmt )
       if (stmt->Ist.Exit.dst->tag != Ico_U64)
          vpanic("iselStmt(amd64): Ist_Exit: dst is not a 64-bit value");
 
+      /* No vzeroupper here: side exits are rarely taken, and it
+         would force any ymm values live across the exit to be
+         spilled.  Translations are VEX encoded throughout on AVX
+         hosts (see vexify_SSE), so the only cost of leaving the
+         upper halves dirty is a possible transition penalty when
+         the exit leads back to the scheduler. */
+
       AMD64CondCode cc    = iselCondCode(env, stmt->Ist.Exit.guard);
       AMD64AMode*   amRIP = AMD64AMode_IR(stmt->Ist.Exit.offsIP,
                                           hregAMD64_RBP());
@@ -4687,6 +5138,20 @@ static void iselNext ( ISelEnv* env,
       vex_printf( "\n");
    }
 
+   if (env->ymm_used)
+      addInstr(env, AMD64Instr_VZeroUpper());
+
+   /* Case: a call, with a return-address shadow stack; push its
+      return address.  The transfer itself is then done as usual. */
+   if (jk == Ijk_Call && env->offs_Host_RetStack >= 0) {
+      vassert(env->chainingAllowed);
+      addInstr(env, AMD64Instr_RetPush(
+                       env->last_imark_end,
+                       AMD64AMode_IR(env->offs_Host_RetStack,
+                                     hregAMD64_RBP()),
+                       AMD64AMode_IR(env->offs_Guest_SP, hregAMD64_RBP())));
+   }
+
    /* Case: boring transfer to known address */
    if (next->tag == Iex_Const) {
       IRConst* cdst = next->Iex.Const.con;
@@ -4722,6 +5187,16 @@ static void iselNext ( ISelEnv* env,
       case Ijk_Boring: case Ijk_Ret: case Ijk_Call: {
          HReg        r     = iselIntExpr_R(env, next);
          AMD64AMode* amRIP = AMD64AMode_IR(offsIP, hregAMD64_RBP());
+         if (jk == Ijk_Ret && env->offs_Host_RetStack >= 0) {
+            /* Go straight to where the matching call said to, if
+               there is one, else carry on as below. */
+            addInstr(env, AMD64Instr_RetPop(
+                             r, amRIP,
+                             AMD64AMode_IR(env->offs_Host_RetStack,
+                                           hregAMD64_RBP()),
+                             AMD64AMode_IR(env->offs_Guest_SP,
+                                           hregAMD64_RBP())));
+         }
          if (env->chainingAllowed) {
             addInstr(env, AMD64Instr_XIndir(r, amRIP, Acc_ALWAYS));
          } else {
@@ -4776,6 +5251,8 @@ HInstrArray* iselSB_AMD64 ( IRSB* bb,
                             VexAbiInfo*  vbi/*UNUSED*/,
                             Int offs_Host_EvC_Counter,
                             Int offs_Host_EvC_FailAddr,
+                            Int offs_Host_RetStack,
+                            Int offs_Guest_SP,
                             Bool chainingAllowed,
                             Bool addProfInc,
                             Addr64 max_ga )
@@ -4814,9 +5291,14 @@ HInstrArray* iselSB_AMD64 ( IRSB* bb,
    env->vregmapHI = LibVEX_Alloc(env->n_vregmap * sizeof(HReg));
 
    /* and finally ... */
-   env->chainingAllowed = chainingAllowed;
-   env->hwcaps          = hwcaps_host;
-   env->max_ga          = max_ga;
+   env->chainingAllowed    = chainingAllowed;
+   env->hwcaps             = hwcaps_host;
+   amd64_host_hwcaps       = hwcaps_host;
+   env->max_ga             = max_ga;
+   env->offs_Host_RetStack = chainingAllowed ? offs_Host_RetStack : -1;
+   env->offs_Guest_SP      = offs_Guest_SP;
+   env->last_imark_end     = 0;
+   env->ymm_used           = False;
 
    /* For each IR temporary, allocate a suitably-kinded virtual
       register. */
@@ -4838,6 +5320,11 @@ HInstrArray* iselSB_AMD64 ( IRSB* bb,
             hreg = mkHReg(j++, HRcVec128, True);
             break;
          case Ity_V256:
+            if (hwcaps_host & VEX_HWCAPS_AMD64_AVX2) {
+               hreg = mkHReg(j++, HRcVec256, True);
+               env->ymm_used = True;
+               break;
+            }
             hreg   = mkHReg(j++, HRcVec128, True);
             hregHI = mkHReg(j++, HRcVec128, True);
             break;
@@ -2974,6 +2974,8 @@ Int emit_ARMInstr ( /*MB_MOD*/Bool* is_profInc,
                     void* disp_cp_chain_me_to_slowEP,
                     void* disp_cp_chain_me_to_fastEP,
                     void* disp_cp_xindir,
+                    void* disp_cp_xindir_icfill,
+                    void* disp_cp_ret_fill,
                     void* disp_cp_xassisted )
 {
    UInt* p = (UInt*)buf;
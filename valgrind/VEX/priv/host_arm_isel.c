@@ -6343,6 +6343,8 @@ HInstrArray* iselSB_ARM ( IRSB* bb,
                           VexAbiInfo*  vbi/*UNUSED*/,
                           Int offs_Host_EvC_Counter,
                           Int offs_Host_EvC_FailAddr,
+                          Int offs_Host_RetStack/*UNUSED*/,
+                          Int offs_Guest_SP/*UNUSED*/,
                           Bool chainingAllowed,
                           Bool addProfInc,
                           Addr64 max_ga )
@@ -208,7 +208,7 @@ Int findMostDistantlyMentionedVReg (
 static inline void sanity_check_spill_offset ( VRegLR* vreg )
 {
    switch (vreg->reg_class) {
-      case HRcVec128: case HRcFlt64:
+      case HRcVec256: case HRcVec128: case HRcFlt64:
          vassert(0 == ((UShort)vreg->spill_offset % 16)); break;
       default:
          vassert(0 == ((UShort)vreg->spill_offset % 8)); break;
@@ -341,7 +341,10 @@ HInstrArray* doRegisterAllocation (
    void (*ppReg) ( HReg ),
 
    /* 32/64bit mode */
-   Bool mode64
+   Bool mode64,
+
+   /* OUT: what was done */
+   HRegAllocStats* stats
 )
 {
 #  define N_SPILL64S  (LibVEX_N_SPILL_BYTES / 8)
@@ -408,6 +411,11 @@ HInstrArray* doRegisterAllocation (
       overflowing 32k. */
    vassert(instrs_in->arr_used <= 15000);
 
+   stats->n_spills    = 0;
+   stats->n_reloads   = 0;
+   stats->n_moves     = 0;
+   stats->n_coalesced = 0;
+
 #  define INVALID_INSTRNO (-2)
 
 #  define EMIT_INSTR(_instr)                  \
@@ -855,6 +863,26 @@ HInstrArray* doRegisterAllocation (
             ss_busy_until_before[k+1] = vreg_lrs[j].dead_before;
             break;
 
+         case HRcVec256:
+            /* Find four adjacent free slots, starting at a multiple
+               of four, which between them provide 256 bits in which
+               to spill the vreg. */
+            for (k = 0; k < N_SPILL64S-3; k += 4)
+               if (ss_busy_until_before[k+0] <= vreg_lrs[j].live_after
+                   && ss_busy_until_before[k+1] <= vreg_lrs[j].live_after
+                   && ss_busy_until_before[k+2] <= vreg_lrs[j].live_after
+                   && ss_busy_until_before[k+3] <= vreg_lrs[j].live_after)
+                  break;
+            if (k >= N_SPILL64S-3) {
+               vpanic("LibVEX_N_SPILL_BYTES is too low.  " 
+                      "Increase and recompile.");
+            }
+            ss_busy_until_before[k+0] = vreg_lrs[j].dead_before;
+            ss_busy_until_before[k+1] = vreg_lrs[j].dead_before;
+            ss_busy_until_before[k+2] = vreg_lrs[j].dead_before;
+            ss_busy_until_before[k+3] = vreg_lrs[j].dead_before;
+            break;
+
          default:
             /* The ordinary case -- just find a single spill slot. */
             /* Find the lowest-numbered spill slot which is available
@@ -1072,6 +1100,7 @@ HInstrArray* doRegisterAllocation (
          /* This rreg has become associated with a different vreg and
             hence with a different spill slot.  Play safe. */
          rreg_state[m].eq_spill_slot = False;
+         stats->n_coalesced++;
 
          /* Move on to the next insn.  We skip the post-insn stuff for
             fixed registers, since this move should not interact with
@@ -1166,6 +1195,7 @@ HInstrArray* doRegisterAllocation (
                      EMIT_INSTR(spill1);
                   if (spill2)
                      EMIT_INSTR(spill2);
+                  stats->n_spills++;
                }
                rreg_state[k].eq_spill_slot = True;
             }
@@ -1255,6 +1285,7 @@ HInstrArray* doRegisterAllocation (
                   been in this form all along. */
                instrs_in->arr[ii] = reloaded;
                (*getRegUsage)( &reg_usage, instrs_in->arr[ii], mode64 );
+               stats->n_reloads++;
                if (debug_direct_reload && !reloaded) {
                   vex_printf("  -->  ");
                   ppInstr(reloaded, mode64);
@@ -1347,6 +1378,7 @@ HInstrArray* doRegisterAllocation (
                   EMIT_INSTR(reload1);
                if (reload2)
                   EMIT_INSTR(reload2);
+               stats->n_reloads++;
                /* This rreg is read or modified by the instruction.
                   If it's merely read we can claim it now equals the
                   spill slot, but not so if it is modified. */
@@ -1430,6 +1462,7 @@ HInstrArray* doRegisterAllocation (
                EMIT_INSTR(spill1);
             if (spill2)
                EMIT_INSTR(spill2);
+            stats->n_spills++;
          }
 
          /* Update the rreg_state to reflect the new assignment for this
@@ -1456,6 +1489,7 @@ HInstrArray* doRegisterAllocation (
                EMIT_INSTR(reload1);
             if (reload2)
                EMIT_INSTR(reload2);
+            stats->n_reloads++;
             /* This rreg is read or modified by the instruction.
                If it's merely read we can claim it now equals the
                spill slot, but not so if it is modified. */
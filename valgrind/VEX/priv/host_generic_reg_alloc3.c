@@ -0,0 +1,1379 @@
+
+/*---------------------------------------------------------------*/
+/*--- begin                                 host_reg_alloc3.c ---*/
+/*---------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   Copyright (C) 2004-2013 OpenWorks LLP
+      info@open-works.net
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+
+   Neither the names of the U.S. Department of Energy nor the
+   University of California nor the names of its contributors may be
+   used to endorse or promote products derived from this software
+   without prior written permission.
+*/
+
+#include "libvex_basictypes.h"
+#include "libvex.h"
+
+#include "main_util.h"
+#include "host_generic_regs.h"
+
+/* Set to 1 for lots of debugging output. */
+#define DEBUG_REGALLOC 0
+
+
+/* This is the allocator used when vex_control.regalloc_version is 3.
+   It works in the same way as the one in host_generic_reg_alloc2.c
+   -- one forward pass over the instructions, each vreg having a
+   single live range and a single home spill slot -- and has the same
+   interface, but makes better decisions in several places:
+
+   - The instructions at which each vreg is mentioned are listed in
+     advance.  So choosing a vreg to spill (the one next mentioned
+     furthest ahead) doesn't need repeated calls to getRegUsage.
+
+   - The hard live ranges (HLRs) of each real reg are also listed in
+     advance.  A vreg needing a register is given a free rreg which
+     won't be needed for an HLR before the vreg dies, if there is
+     one, or else the one which will be needed last.
+
+   - When an rreg holding a live vreg is about to enter an HLR, the
+     vreg is moved to a free rreg which isn't needed until after the
+     vreg's next use, if there is one, rather than being spilled.
+     That is, its live range is split.  This needs genMove.
+
+   - More reg-reg moves are coalesced.  As well as V <- V where the
+     source is in a register, there are
+        V <- V  where the source is spilled.  Spill slots are shared
+                across such moves, so there is nothing to do.
+        V <- R  where the end of an HLR for R is the move, as for the
+                result of a helper call.  V is simply given R.
+        R <- V  where the start of an HLR for R is the move and V dies
+                there, as for helper call args.  V is put in R in the
+                first place, if it can be, and the move dropped.
+*/
+
+
+/* Records information on virtual register live ranges.  Computed once
+   and remains unchanged after that, except for .uses_next. */
+typedef
+   struct {
+      /* Becomes live for the first time after this insn ... */
+      Short live_after;
+      /* Becomes dead for the last time before this insn ... */
+      Short dead_before;
+      /* The "home" spill slot, if needed.  Never changes. */
+      Short spill_offset;
+      /* What kind of register this is. */
+      HRegClass reg_class;
+      /* The insns which mention this vreg, in increasing order, are
+         uses[.uses_first .. .uses_first + .n_uses - 1].  .uses_next
+         is a cursor for nextUse. */
+      Int uses_first;
+      Int n_uses;
+      Int uses_next;
+      /* If this vreg is first written by a move from another vreg
+         which dies there, that vreg's number, else -1.  The two
+         share a spill slot if they can. */
+      Int move_src;
+      /* If this vreg's last use is a move into an allocatable rreg,
+         that rreg's index in the running state, else -1. */
+      Int hint;
+   }
+   VRegLR;
+
+
+/* Records information on real-register live ranges.  Computed once
+   and remains unchanged after that. */
+typedef
+   struct {
+      HReg rreg;
+      /* Becomes live after this insn ... */
+      Short live_after;
+      /* Becomes dead before this insn ... */
+      Short dead_before;
+   }
+   RRegLR;
+
+
+/* An array of the following structs (rreg_state) comprises the
+   running state of the allocator.  It indicates what the current
+   disposition of each allocatable real register is.  The array gets
+   updated as the allocator processes instructions. */
+typedef
+   struct {
+      /* ------ FIELDS WHICH DO NOT CHANGE ------ */
+      /* Which rreg is this for? */
+      HReg rreg;
+      /* Start points (.live_after) of its HLRs, in increasing order:
+         hlr_starts[0 .. n_hlrs-1]. */
+      Short* hlr_starts;
+      Int    n_hlrs;
+      /* ------ FIELDS WHICH DO CHANGE ------ */
+      /* Cursor for nextHLRStart. */
+      Int hlr_next;
+      /* Used when .disp == Bound and we are looking for vregs to
+         spill. */
+      Bool is_spill_cand;
+      /* Optimisation: used when .disp == Bound.  Indicates when the
+         rreg has the same value as the spill slot for the associated
+         vreg.  Is safely left at False, and becomes True after a
+         spill store or reload for this rreg. */
+      Bool eq_spill_slot;
+      /* What's it's current disposition? */
+      enum { Free,     /* available for use */
+             Unavail,  /* in a real-reg live range */
+             Bound     /* in use (holding value of some vreg) */
+           }
+           disp;
+      /* If .disp == Bound, what vreg is it bound to? */
+      HReg vreg;
+   }
+   RRegState;
+
+
+/* As in host_generic_reg_alloc2.c, vreg_state is a redundant map
+   from vreg numbers back to entries in rreg_state. */
+
+#define INVALID_RREG_NO ((Short)(-1))
+
+#define IS_VALID_VREGNO(_zz) ((_zz) >= 0 && (_zz) < n_vregs)
+#define IS_VALID_RREGNO(_zz) ((_zz) >= 0 && (_zz) < n_rregs)
+
+/* Later than any insn. */
+#define INFINITE_INSTRNO 0x7FFFFFFF
+
+
+/* The first insn at or after FROM which mentions the vreg described
+   by LR, or INFINITE_INSTRNO if none does.  For any one vreg, FROM
+   must not decrease from one call to the next. */
+static inline Int nextUse ( VRegLR* lr, Short* uses, Int from )
+{
+   Int end = lr->uses_first + lr->n_uses;
+   vassert(lr->uses_next == lr->uses_first
+           || uses[lr->uses_next - 1] < from);
+   while (lr->uses_next < end && uses[lr->uses_next] < from)
+      lr->uses_next++;
+   return lr->uses_next < end ? uses[lr->uses_next] : INFINITE_INSTRNO;
+}
+
+
+/* The first insn at or after FROM at which an HLR of the rreg
+   described by ST starts, or INFINITE_INSTRNO if there are no more.
+   FROM must not decrease from one call to the next. */
+static inline Int nextHLRStart ( RRegState* st, Int from )
+{
+   vassert(st->hlr_next == 0 || st->hlr_starts[st->hlr_next - 1] < from);
+   while (st->hlr_next < st->n_hlrs && st->hlr_starts[st->hlr_next] < from)
+      st->hlr_next++;
+   return st->hlr_next < st->n_hlrs
+             ? st->hlr_starts[st->hlr_next] : INFINITE_INSTRNO;
+}
+
+
+/* Check that this vreg has been assigned a sane spill offset. */
+static inline void sanity_check_spill_offset ( VRegLR* vreg )
+{
+   switch (vreg->reg_class) {
+      case HRcVec256: case HRcVec128: case HRcFlt64:
+         vassert(0 == ((UShort)vreg->spill_offset % 16)); break;
+      default:
+         vassert(0 == ((UShort)vreg->spill_offset % 8)); break;
+   }
+}
+
+
+/* Double the size of the real-reg live-range array, if needed. */
+static void ensureRRLRspace ( RRegLR** info, Int* size, Int used )
+{
+   Int     k;
+   RRegLR* arr2;
+   if (used < *size) return;
+   vassert(used == *size);
+   arr2 = LibVEX_Alloc(2 * *size * sizeof(RRegLR));
+   for (k = 0; k < *size; k++)
+      arr2[k] = (*info)[k];
+   *size *= 2;
+   *info = arr2;
+}
+
+
+/* Double the size of the vreg mention arrays, if needed. */
+static void ensureMentionSpace ( Short** insns, Int** vregs,
+                                 Int* size, Int used )
+{
+   Int    k;
+   Short* insns2;
+   Int*   vregs2;
+   if (used < *size) return;
+   vassert(used == *size);
+   insns2 = LibVEX_Alloc(2 * *size * sizeof(Short));
+   vregs2 = LibVEX_Alloc(2 * *size * sizeof(Int));
+   for (k = 0; k < *size; k++) {
+      insns2[k] = (*insns)[k];
+      vregs2[k] = (*vregs)[k];
+   }
+   *size *= 2;
+   *insns = insns2;
+   *vregs = vregs2;
+}
+
+
+/* Sort an array of RRegLR entries by either the .live_after or
+   .dead_before fields. */
+static void sortRRLRarray ( RRegLR* arr,
+                            Int size, Bool by_live_after )
+{
+   Int    incs[14] = { 1, 4, 13, 40, 121, 364, 1093, 3280,
+                       9841, 29524, 88573, 265720,
+                       797161, 2391484 };
+   Int    lo = 0;
+   Int    hi = size-1;
+   Int    i, j, h, bigN, hp;
+   RRegLR v;
+
+   vassert(size >= 0);
+   if (size == 0)
+      return;
+
+   bigN = hi - lo + 1; if (bigN < 2) return;
+   hp = 0; while (hp < 14 && incs[hp] < bigN) hp++; hp--;
+
+   for ( ; hp >= 0; hp--) {
+      h = incs[hp];
+      for (i = lo + h; i <= hi; i++) {
+         v = arr[i];
+         j = i;
+         while (by_live_after ? arr[j-h].live_after > v.live_after
+                              : arr[j-h].dead_before > v.dead_before) {
+            arr[j] = arr[j-h];
+            j = j - h;
+            if (j <= (lo + h - 1)) break;
+         }
+         arr[j] = v;
+      }
+   }
+}
+
+
+/* See the comment on doRegisterAllocation in
+   host_generic_reg_alloc2.c; this has the same contract, plus
+   genMove, which may be NULL. */
+HInstrArray* doRegisterAllocation_v3 (
+   HInstrArray* instrs_in,
+   HReg* available_real_regs,
+   Int   n_available_real_regs,
+   Bool (*isMove) ( HInstr*, HReg*, HReg* ),
+   void (*getRegUsage) ( HRegUsage*, HInstr*, Bool ),
+   void (*mapRegs) ( HRegRemap*, HInstr*, Bool ),
+   void    (*genSpill)  ( HInstr**, HInstr**, HReg, Int, Bool ),
+   void    (*genReload) ( HInstr**, HInstr**, HReg, Int, Bool ),
+   HInstr* (*directReload) ( HInstr*, HReg, Short ),
+   HInstr* (*genMove) ( HReg, HReg, Bool ),
+   Int     guest_sizeB,
+   void (*ppInstr) ( HInstr*, Bool ),
+   void (*ppReg) ( HReg ),
+   Bool mode64,
+   HRegAllocStats* stats
+)
+{
+#  define N_SPILL64S  (LibVEX_N_SPILL_BYTES / 8)
+
+   /* Iterators and temporaries. */
+   Int       ii, j, k, m, n, spillee, furthest;
+   HReg      rreg, vreg, vregS, vregD;
+   HRegUsage reg_usage;
+
+   /* Info on vregs and rregs. */
+   Int     n_vregs;
+   VRegLR* vreg_lrs; /* [0 .. n_vregs-1] */
+
+   /* The insns mentioning each vreg, indexed via vreg_lrs, and the
+      (insn, vreg) pairs from which they are built. */
+   Short* uses;
+   Short* mention_insns;
+   Int*   mention_vregs;
+   Int    mentions_size;
+   Int    mentions_used;
+
+   /* As in host_generic_reg_alloc2.c: the real-reg live ranges,
+      sorted by .live_after and by .dead_before, and cursors into
+      them. */
+   RRegLR* rreg_lrs_la;
+   RRegLR* rreg_lrs_db;
+   Int     rreg_lrs_size;
+   Int     rreg_lrs_used;
+   Int     rreg_lrs_la_next;
+   Int     rreg_lrs_db_next;
+
+   /* Used when allocating spill slots. */
+   Int  ss_busy_until_before[N_SPILL64S];
+   Int* vreg_ss;     /* [0 .. n_vregs-1]: first spill slot number */
+   Int* vreg_order;  /* [0 .. n_vregs-1]: vregs by .live_after */
+   Int* n_starting;  /* [0 .. n_insns]: vregs live after each insn */
+
+   /* Used when constructing rreg_lrs. */
+   Int* rreg_live_after;
+   Int* rreg_dead_before;
+
+   /* Running state of the core allocation algorithm. */
+   RRegState* rreg_state;  /* [0 .. n_rregs-1] */
+   Int        n_rregs;
+   Short*     vreg_state;  /* [0 .. n_vregs-1] */
+
+   /* The vreg -> rreg map constructed and then applied to each
+      instr. */
+   HRegRemap remap;
+
+   /* The output array of instructions. */
+   HInstrArray* instrs_out;
+
+   /* Sanity checks are expensive.  They are only done periodically,
+      not at each insn processed. */
+   Bool do_sanity_check;
+
+   /* Per-insn coalescing state: is the insn a reg-reg move, and if
+      so between which regs; is it to be dropped; and, for V <- R,
+      which rreg to give V once R's HLR has ended. */
+   Bool is_move;
+   Bool skip_insn;
+   Int  bind_after;
+
+   Int n_insns = instrs_in->arr_used;
+
+   vassert(0 == (guest_sizeB % 32));
+   vassert(0 == (LibVEX_N_SPILL_BYTES % 32));
+   vassert(0 == (N_SPILL64S % 4));
+
+   /* The live range numbers are signed shorts, and so limiting the
+      number of insns to 15000 comfortably guards against them
+      overflowing 32k. */
+   vassert(n_insns <= 15000);
+
+   stats->n_spills    = 0;
+   stats->n_reloads   = 0;
+   stats->n_moves     = 0;
+   stats->n_coalesced = 0;
+
+#  define INVALID_INSTRNO (-2)
+
+#  define EMIT_INSTR(_instr)                  \
+      do {                                    \
+        HInstr* _tmp = (_instr);              \
+        if (DEBUG_REGALLOC) {                 \
+           vex_printf("**  ");                \
+           (*ppInstr)(_tmp, mode64);          \
+           vex_printf("\n\n");                \
+        }                                     \
+        addHInstr ( instrs_out, _tmp );       \
+      } while (0)
+
+#  define EMIT_SPILL(_k, _vregno)                                    \
+      do {                                                           \
+         HInstr* spill1 = NULL;                                      \
+         HInstr* spill2 = NULL;                                      \
+         vassert(vreg_lrs[(_vregno)].reg_class != HRcINVALID);       \
+         (*genSpill)( &spill1, &spill2, rreg_state[(_k)].rreg,       \
+                      vreg_lrs[(_vregno)].spill_offset, mode64 );    \
+         vassert(spill1 || spill2); /* can't both be NULL */         \
+         if (spill1)                                                 \
+            EMIT_INSTR(spill1);                                      \
+         if (spill2)                                                 \
+            EMIT_INSTR(spill2);                                      \
+         stats->n_spills++;                                          \
+      } while (0)
+
+#  define EMIT_RELOAD(_k, _vregno)                                   \
+      do {                                                           \
+         HInstr* reload1 = NULL;                                     \
+         HInstr* reload2 = NULL;                                     \
+         vassert(vreg_lrs[(_vregno)].reg_class != HRcINVALID);       \
+         (*genReload)( &reload1, &reload2, rreg_state[(_k)].rreg,    \
+                       vreg_lrs[(_vregno)].spill_offset, mode64 );   \
+         vassert(reload1 || reload2); /* can't both be NULL */       \
+         if (reload1)                                                \
+            EMIT_INSTR(reload1);                                     \
+         if (reload2)                                                \
+            EMIT_INSTR(reload2);                                     \
+         stats->n_reloads++;                                         \
+      } while (0)
+
+#  define PRINT_STATE                                              \
+      do {                                                         \
+         Int z;                                                    \
+         for (z = 0; z < n_rregs; z++) {                           \
+            vex_printf("  rreg_state[%2d] = ", z);                 \
+            (*ppReg)(rreg_state[z].rreg);                          \
+            vex_printf("  \t");                                    \
+            switch (rreg_state[z].disp) {                          \
+               case Free:    vex_printf("Free\n"); break;          \
+               case Unavail: vex_printf("Unavail\n"); break;       \
+               case Bound:   vex_printf("BoundTo ");               \
+                             (*ppReg)(rreg_state[z].vreg);         \
+                             vex_printf("\n"); break;              \
+            }                                                      \
+         }                                                         \
+      } while (0)
+
+
+   /* --------- Stage 0: set up output array --------- */
+   /* --------- and allocate/initialise running state. --------- */
+
+   instrs_out = newHInstrArray();
+
+   n_rregs = n_available_real_regs;
+   n_vregs = instrs_in->n_vregs;
+
+   /* If this is not so, vreg_state entries will overflow. */
+   vassert(n_vregs < 32767);
+
+   rreg_state = LibVEX_Alloc(n_rregs * sizeof(RRegState));
+   vreg_state = LibVEX_Alloc(n_vregs * sizeof(Short));
+
+   for (j = 0; j < n_rregs; j++) {
+      rreg_state[j].rreg          = available_real_regs[j];
+      rreg_state[j].hlr_starts    = NULL;
+      rreg_state[j].n_hlrs        = 0;
+      rreg_state[j].hlr_next      = 0;
+      rreg_state[j].disp          = Free;
+      rreg_state[j].vreg          = INVALID_HREG;
+      rreg_state[j].is_spill_cand = False;
+      rreg_state[j].eq_spill_slot = False;
+   }
+
+   for (j = 0; j < n_vregs; j++)
+      vreg_state[j] = INVALID_RREG_NO;
+
+
+   /* --------- Stage 1: compute vreg live ranges. --------- */
+   /* --------- Stage 2: compute rreg live ranges. --------- */
+
+   vreg_lrs = NULL;
+   if (n_vregs > 0)
+      vreg_lrs = LibVEX_Alloc(sizeof(VRegLR) * n_vregs);
+
+   for (j = 0; j < n_vregs; j++) {
+      vreg_lrs[j].live_after   = INVALID_INSTRNO;
+      vreg_lrs[j].dead_before  = INVALID_INSTRNO;
+      vreg_lrs[j].spill_offset = 0;
+      vreg_lrs[j].reg_class    = HRcINVALID;
+      vreg_lrs[j].uses_first   = 0;
+      vreg_lrs[j].n_uses       = 0;
+      vreg_lrs[j].uses_next    = 0;
+      vreg_lrs[j].move_src     = -1;
+      vreg_lrs[j].hint         = -1;
+   }
+
+   mentions_used = 0;
+   mentions_size = 2 * n_insns + 4;
+   mention_insns = LibVEX_Alloc(mentions_size * sizeof(Short));
+   mention_vregs = LibVEX_Alloc(mentions_size * sizeof(Int));
+
+   rreg_lrs_used = 0;
+   rreg_lrs_size = 4;
+   rreg_lrs_la = LibVEX_Alloc(rreg_lrs_size * sizeof(RRegLR));
+   rreg_lrs_db = NULL; /* we'll create this later */
+
+   vassert(n_available_real_regs > 0);
+   rreg_live_after  = LibVEX_Alloc(n_available_real_regs * sizeof(Int));
+   rreg_dead_before = LibVEX_Alloc(n_available_real_regs * sizeof(Int));
+
+   for (j = 0; j < n_available_real_regs; j++) {
+      rreg_live_after[j] =
+      rreg_dead_before[j] = INVALID_INSTRNO;
+   }
+
+   for (ii = 0; ii < n_insns; ii++) {
+
+      (*getRegUsage)( &reg_usage, instrs_in->arr[ii], mode64 );
+
+      /* ------ start of DEAL WITH VREG LIVE RANGES ------ */
+
+      for (j = 0; j < reg_usage.n_used; j++) {
+
+         vreg = reg_usage.hreg[j];
+         if (!hregIsVirtual(vreg))
+            continue;
+         k = hregNumber(vreg);
+         if (k < 0 || k >= n_vregs) {
+            vex_printf("\n");
+            (*ppInstr)(instrs_in->arr[ii], mode64);
+            vex_printf("\n");
+            vex_printf("vreg %d, n_vregs %d\n", k, n_vregs);
+            vpanic("doRegisterAllocation_v3: out-of-range vreg");
+         }
+
+         if (vreg_lrs[k].reg_class == HRcINVALID) {
+            vreg_lrs[k].reg_class = hregClass(vreg);
+         } else {
+            vassert(vreg_lrs[k].reg_class == hregClass(vreg));
+         }
+
+         switch (reg_usage.mode[j]) {
+            case HRmRead:
+            case HRmModify:
+               if (vreg_lrs[k].live_after == INVALID_INSTRNO) {
+                  vex_printf("\n\nOFFENDING VREG = %d\n", k);
+                  vpanic("doRegisterAllocation_v3: "
+                         "first event for vreg is Read or Modify");
+               }
+               break;
+            case HRmWrite:
+               if (vreg_lrs[k].live_after == INVALID_INSTRNO)
+                  vreg_lrs[k].live_after = toShort(ii);
+               break;
+            default:
+               vpanic("doRegisterAllocation_v3(1)");
+         }
+         vreg_lrs[k].dead_before = toShort(ii + 1);
+
+         ensureMentionSpace(&mention_insns, &mention_vregs,
+                            &mentions_size, mentions_used);
+         mention_insns[mentions_used] = toShort(ii);
+         mention_vregs[mentions_used] = k;
+         mentions_used++;
+         vreg_lrs[k].n_uses++;
+      }
+
+      /* ------ end of DEAL WITH VREG LIVE RANGES ------ */
+
+      /* ------ start of DEAL WITH RREG LIVE RANGES ------ */
+
+      for (j = 0; j < reg_usage.n_used; j++) {
+
+         Int  flush_la = INVALID_INSTRNO, flush_db = INVALID_INSTRNO;
+         Bool flush;
+
+         rreg = reg_usage.hreg[j];
+         if (hregIsVirtual(rreg))
+            continue;
+
+         /* Ignore rregs which aren't allocatable. */
+         for (k = 0; k < n_available_real_regs; k++)
+            if (sameHReg(available_real_regs[k], rreg))
+               break;
+         if (k == n_available_real_regs)
+            continue;
+         flush = False;
+         switch (reg_usage.mode[j]) {
+            case HRmWrite:
+               flush_la = rreg_live_after[k];
+               flush_db = rreg_dead_before[k];
+               if (flush_la != INVALID_INSTRNO
+                   && flush_db != INVALID_INSTRNO)
+                  flush = True;
+               rreg_live_after[k]  = ii;
+               rreg_dead_before[k] = ii+1;
+               break;
+            case HRmRead:
+            case HRmModify:
+               if (rreg_live_after[k] == INVALID_INSTRNO) {
+                  vex_printf("\nOFFENDING RREG = ");
+                  (*ppReg)(available_real_regs[k]);
+                  vex_printf("\n");
+                  vex_printf("\nOFFENDING instr = ");
+                  (*ppInstr)(instrs_in->arr[ii], mode64);
+                  vex_printf("\n");
+                  vpanic("doRegisterAllocation_v3: "
+                         "first event for rreg is Read or Modify");
+               }
+               rreg_dead_before[k] = ii+1;
+               break;
+            default:
+               vpanic("doRegisterAllocation_v3(2)");
+         }
+
+         if (flush) {
+            ensureRRLRspace(&rreg_lrs_la, &rreg_lrs_size, rreg_lrs_used);
+            rreg_lrs_la[rreg_lrs_used].rreg        = rreg;
+            rreg_lrs_la[rreg_lrs_used].live_after  = toShort(flush_la);
+            rreg_lrs_la[rreg_lrs_used].dead_before = toShort(flush_db);
+            rreg_lrs_used++;
+         }
+      }
+
+      /* ------ end of DEAL WITH RREG LIVE RANGES ------ */
+
+      /* ------ start of NOTE MOVES ------ */
+
+      /* Record V <- V moves where the source dies, for sharing spill
+         slots, and R <- V moves, as hints.  Only the hint for V's
+         last use is any good, which is checked below, once V's live
+         range is known. */
+      if ((*isMove)( instrs_in->arr[ii], &vregS, &vregD )) {
+         if (hregIsVirtual(vregS) && hregIsVirtual(vregD)) {
+            k = hregNumber(vregS);
+            m = hregNumber(vregD);
+            if (vreg_lrs[m].live_after == ii && !sameHReg(vregS, vregD))
+               vreg_lrs[m].move_src = k;
+         }
+         else if (hregIsVirtual(vregS)) {
+            k = hregNumber(vregS);
+            vreg_lrs[k].hint = -1;
+            for (m = 0; m < n_rregs; m++)
+               if (sameHReg(rreg_state[m].rreg, vregD))
+                  vreg_lrs[k].hint = m;
+         }
+      }
+
+      /* ------ end of NOTE MOVES ------ */
+
+   } /* iterate over insns */
+
+   /* Discard move sources which live on after the move. */
+   for (j = 0; j < n_vregs; j++) {
+      k = vreg_lrs[j].move_src;
+      if (k != -1 && vreg_lrs[k].dead_before != vreg_lrs[j].live_after + 1)
+         vreg_lrs[j].move_src = -1;
+   }
+
+   /* Lay out the per-vreg lists of mentioning insns.  The mentions
+      were recorded in insn order, so each list comes out sorted. */
+   uses = LibVEX_Alloc((mentions_used + 1) * sizeof(Short));
+   n = 0;
+   for (j = 0; j < n_vregs; j++) {
+      vreg_lrs[j].uses_first = n;
+      vreg_lrs[j].uses_next  = n;
+      n += vreg_lrs[j].n_uses;
+   }
+   vassert(n == mentions_used);
+   for (j = 0; j < mentions_used; j++) {
+      k = mention_vregs[j];
+      uses[vreg_lrs[k].uses_next++] = mention_insns[j];
+   }
+   for (j = 0; j < n_vregs; j++) {
+      vassert(vreg_lrs[j].uses_next
+              == vreg_lrs[j].uses_first + vreg_lrs[j].n_uses);
+      vreg_lrs[j].uses_next = vreg_lrs[j].uses_first;
+   }
+
+   /* Now the hints can be checked: the move must be the vreg's last
+      mention. */
+   for (j = 0; j < n_vregs; j++) {
+      if (vreg_lrs[j].hint == -1)
+         continue;
+      vassert(vreg_lrs[j].n_uses > 0);
+      ii = uses[vreg_lrs[j].uses_first + vreg_lrs[j].n_uses - 1];
+      if (!(*isMove)( instrs_in->arr[ii], &vregS, &vregD )
+          || !hregIsVirtual(vregS) || hregIsVirtual(vregD)
+          || hregNumber(vregS) != j
+          || !sameHReg(vregD, rreg_state[vreg_lrs[j].hint].rreg))
+         vreg_lrs[j].hint = -1;
+   }
+
+   /* ------ start of FINALISE RREG LIVE RANGES ------ */
+
+   for (j = 0; j < n_available_real_regs; j++) {
+      vassert( (rreg_live_after[j] == INVALID_INSTRNO
+               && rreg_dead_before[j] == INVALID_INSTRNO)
+              ||
+              (rreg_live_after[j] != INVALID_INSTRNO
+               && rreg_dead_before[j] != INVALID_INSTRNO)
+            );
+
+      if (rreg_live_after[j] == INVALID_INSTRNO)
+         continue;
+
+      ensureRRLRspace(&rreg_lrs_la, &rreg_lrs_size, rreg_lrs_used);
+      rreg_lrs_la[rreg_lrs_used].rreg        = available_real_regs[j];
+      rreg_lrs_la[rreg_lrs_used].live_after  = toShort(rreg_live_after[j]);
+      rreg_lrs_la[rreg_lrs_used].dead_before = toShort(rreg_dead_before[j]);
+      rreg_lrs_used++;
+   }
+
+   rreg_lrs_db = LibVEX_Alloc((rreg_lrs_used + 1) * sizeof(RRegLR));
+   for (j = 0; j < rreg_lrs_used; j++)
+      rreg_lrs_db[j] = rreg_lrs_la[j];
+
+   sortRRLRarray( rreg_lrs_la, rreg_lrs_used, True /* by .live_after*/  );
+   sortRRLRarray( rreg_lrs_db, rreg_lrs_used, False/* by .dead_before*/ );
+
+   rreg_lrs_la_next = 0;
+   rreg_lrs_db_next = 0;
+
+   for (j = 1; j < rreg_lrs_used; j++) {
+      vassert(rreg_lrs_la[j-1].live_after  <= rreg_lrs_la[j].live_after);
+      vassert(rreg_lrs_db[j-1].dead_before <= rreg_lrs_db[j].dead_before);
+   }
+
+   /* Make the per-rreg lists of HLR start points.  Taking them from
+      the sorted array means each list comes out sorted. */
+   for (j = 0; j < rreg_lrs_used; j++) {
+      for (k = 0; k < n_rregs; k++)
+         if (sameHReg(rreg_state[k].rreg, rreg_lrs_la[j].rreg))
+            break;
+      vassert(k < n_rregs);
+      rreg_state[k].n_hlrs++;
+   }
+   for (k = 0; k < n_rregs; k++) {
+      if (rreg_state[k].n_hlrs > 0)
+         rreg_state[k].hlr_starts
+            = LibVEX_Alloc(rreg_state[k].n_hlrs * sizeof(Short));
+   }
+   for (j = 0; j < rreg_lrs_used; j++) {
+      for (k = 0; k < n_rregs; k++)
+         if (sameHReg(rreg_state[k].rreg, rreg_lrs_la[j].rreg))
+            break;
+      rreg_state[k].hlr_starts[rreg_state[k].hlr_next++]
+         = rreg_lrs_la[j].live_after;
+   }
+   for (k = 0; k < n_rregs; k++) {
+      vassert(rreg_state[k].hlr_next == rreg_state[k].n_hlrs);
+      rreg_state[k].hlr_next = 0;
+   }
+
+   /* ------ end of FINALISE RREG LIVE RANGES ------ */
+
+#  if DEBUG_REGALLOC
+   for (j = 0; j < n_vregs; j++) {
+      vex_printf("vreg %d:  la = %d,  db = %d,  uses = %d,"
+                 "  move_src = %d,  hint = %d\n",
+                 j, vreg_lrs[j].live_after, vreg_lrs[j].dead_before,
+                 vreg_lrs[j].n_uses, vreg_lrs[j].move_src,
+                 vreg_lrs[j].hint );
+   }
+#  endif
+
+   /* --------- Stage 3: allocate spill slots. --------- */
+
+   /* As in host_generic_reg_alloc2.c, except that the vregs are
+      visited in order of .live_after, and a vreg written by a move
+      from a vreg which dies there takes over the source's slot if
+      nobody else has had it since.  Then, if the source is spilled
+      at the move, the move can be dropped. */
+
+   vreg_ss    = NULL;
+   vreg_order = NULL;
+   if (n_vregs > 0) {
+      vreg_ss    = LibVEX_Alloc(n_vregs * sizeof(Int));
+      vreg_order = LibVEX_Alloc(n_vregs * sizeof(Int));
+   }
+   n_starting = LibVEX_Alloc((n_insns + 1) * sizeof(Int));
+
+   for (j = 0; j <= n_insns; j++)
+      n_starting[j] = 0;
+   for (j = 0; j < n_vregs; j++) {
+      vreg_ss[j] = -1;
+      if (vreg_lrs[j].live_after != INVALID_INSTRNO)
+         n_starting[vreg_lrs[j].live_after + 1]++;
+   }
+   for (j = 1; j <= n_insns; j++)
+      n_starting[j] += n_starting[j-1];
+   n = 0;
+   for (j = 0; j < n_vregs; j++) {
+      if (vreg_lrs[j].live_after == INVALID_INSTRNO)
+         continue;
+      vreg_order[n_starting[vreg_lrs[j].live_after]++] = j;
+      n++;
+   }
+
+   for (j = 0; j < N_SPILL64S; j++)
+      ss_busy_until_before[j] = 0;
+
+   for (m = 0; m < n; m++) {
+      Int n_slots, i;
+
+      j = vreg_order[m];
+      vassert(vreg_lrs[j].live_after != INVALID_INSTRNO);
+      switch (vreg_lrs[j].reg_class) {
+         case HRcVec256:                 n_slots = 4; break;
+         case HRcVec128: case HRcFlt64:  n_slots = 2; break;
+         default:                        n_slots = 1; break;
+      }
+
+      /* Share the move source's slot, if possible. */
+      k = -1;
+      if (vreg_lrs[j].move_src != -1) {
+         Int s  = vreg_lrs[j].move_src;
+         Int ss = vreg_ss[s];
+         if (ss >= 0) {
+            for (i = 0; i < n_slots; i++)
+               if (ss_busy_until_before[ss+i] != vreg_lrs[s].dead_before)
+                  break;
+            if (i == n_slots)
+               k = ss;
+         }
+      }
+
+      /* Otherwise find n_slots adjacent free slots, aligned to
+         n_slots, which between them hold the vreg. */
+      if (k == -1) {
+         for (k = 0; k <= N_SPILL64S - n_slots; k += n_slots) {
+            for (i = 0; i < n_slots; i++)
+               if (ss_busy_until_before[k+i] > vreg_lrs[j].live_after)
+                  break;
+            if (i == n_slots)
+               break;
+         }
+         if (k > N_SPILL64S - n_slots) {
+            vpanic("LibVEX_N_SPILL_BYTES is too low.  "
+                   "Increase and recompile.");
+         }
+      }
+
+      for (i = 0; i < n_slots; i++)
+         ss_busy_until_before[k+i] = vreg_lrs[j].dead_before;
+      vreg_ss[j] = k;
+
+      /* This reflects LibVEX's hard-wired knowledge of the baseBlock
+         layout: the guest state, then two equal sized areas following
+         it for two sets of shadow state, and then the spill area. */
+      vreg_lrs[j].spill_offset = toShort(guest_sizeB * 3 + k * 8);
+
+      sanity_check_spill_offset( &vreg_lrs[j] );
+   }
+
+   /* --------- Stage 4: process instructions --------- */
+
+   for (ii = 0; ii < n_insns; ii++) {
+
+#     if DEBUG_REGALLOC
+      vex_printf("\n====----====---- Insn %d ----====----====\n", ii);
+      vex_printf("---- ");
+      (*ppInstr)(instrs_in->arr[ii], mode64);
+      vex_printf("\n\nInitial state:\n");
+      PRINT_STATE;
+      vex_printf("\n");
+#     endif
+
+      /* ------------ Sanity checks ------------ */
+
+      do_sanity_check
+         = toBool(
+              False  /* Set to True for sanity checking of all insns. */
+              || ii == n_insns-1
+              || (ii > 0 && (ii % 7) == 0)
+           );
+
+      if (do_sanity_check) {
+
+         /* All rregs with a hard live range crossing this insn must
+            be marked as unavailable in the running state, and vice
+            versa. */
+         for (j = 0; j < rreg_lrs_used; j++) {
+            if (rreg_lrs_la[j].live_after < ii
+                && ii < rreg_lrs_la[j].dead_before) {
+               for (k = 0; k < n_rregs; k++)
+                  if (sameHReg(rreg_state[k].rreg, rreg_lrs_la[j].rreg))
+                     break;
+               vassert(rreg_state[k].disp == Unavail);
+            }
+         }
+         for (j = 0; j < n_rregs; j++) {
+            vassert(rreg_state[j].disp == Bound
+                    || rreg_state[j].disp == Free
+                    || rreg_state[j].disp == Unavail);
+            if (rreg_state[j].disp != Unavail)
+               continue;
+            for (k = 0; k < rreg_lrs_used; k++)
+               if (sameHReg(rreg_lrs_la[k].rreg, rreg_state[j].rreg)
+                   && rreg_lrs_la[k].live_after < ii
+                   && ii < rreg_lrs_la[k].dead_before)
+                  break;
+            vassert(k < rreg_lrs_used);
+         }
+
+         /* All vreg-rreg bindings must bind registers of the same
+            class. */
+         for (j = 0; j < n_rregs; j++) {
+            if (rreg_state[j].disp != Bound) {
+               vassert(rreg_state[j].eq_spill_slot == False);
+               continue;
+            }
+            vassert(hregClass(rreg_state[j].rreg)
+                    == hregClass(rreg_state[j].vreg));
+            vassert( hregIsVirtual(rreg_state[j].vreg));
+            vassert(!hregIsVirtual(rreg_state[j].rreg));
+         }
+
+         /* The vreg_state and rreg_state mappings are consistent. */
+         for (j = 0; j < n_rregs; j++) {
+            if (rreg_state[j].disp != Bound)
+               continue;
+            k = hregNumber(rreg_state[j].vreg);
+            vassert(IS_VALID_VREGNO(k));
+            vassert(vreg_state[k] == j);
+         }
+         for (j = 0; j < n_vregs; j++) {
+            k = vreg_state[j];
+            if (k == INVALID_RREG_NO)
+               continue;
+            vassert(IS_VALID_RREGNO(k));
+            vassert(rreg_state[k].disp == Bound);
+            vassert(hregNumber(rreg_state[k].vreg) == j);
+         }
+
+      } /* if (do_sanity_check) */
+
+      /* ------------ end of Sanity checks ------------ */
+
+      /* ------ Coalescing ------ */
+
+      skip_insn  = False;
+      bind_after = -1;
+      is_move    = (*isMove)( instrs_in->arr[ii], &vregS, &vregD );
+
+      if (is_move) {
+         /* Check that *isMove is not telling us a bunch of lies ... */
+         vassert(hregClass(vregS) == hregClass(vregD));
+      }
+
+      if (is_move && hregIsVirtual(vregS) && hregIsVirtual(vregD)) {
+         /* V <- V, where the source dies and the dest is born here.
+            If the source is in a register, the dest can simply take
+            it over.  If it's spilled, and the two share a spill
+            slot, there's nothing to do at all. */
+         k = hregNumber(vregS);
+         m = hregNumber(vregD);
+         vassert(IS_VALID_VREGNO(k));
+         vassert(IS_VALID_VREGNO(m));
+         if (vreg_lrs[k].dead_before == ii + 1
+             && vreg_lrs[m].live_after == ii
+             && vreg_state[m] == INVALID_RREG_NO) {
+            Short kk = vreg_state[k];
+            if (IS_VALID_RREGNO(kk)) {
+#              if DEBUG_REGALLOC
+               vex_printf("COALESCE ");
+               (*ppReg)(vregS);
+               vex_printf(" -> ");
+               (*ppReg)(vregD);
+               vex_printf("\n\n");
+#              endif
+               vassert(rreg_state[kk].disp == Bound);
+               rreg_state[kk].vreg = vregD;
+               vreg_state[m] = kk;
+               vreg_state[k] = INVALID_RREG_NO;
+               if (vreg_lrs[k].spill_offset != vreg_lrs[m].spill_offset)
+                  rreg_state[kk].eq_spill_slot = False;
+               stats->n_coalesced++;
+               /* As with host_generic_reg_alloc2.c, skip the
+                  post-insn stuff for fixed registers, since this
+                  move cannot interact with them. */
+               continue;
+            }
+            if (vreg_lrs[k].spill_offset == vreg_lrs[m].spill_offset) {
+#              if DEBUG_REGALLOC
+               vex_printf("COALESCE (spilled) ");
+               (*ppReg)(vregS);
+               vex_printf(" -> ");
+               (*ppReg)(vregD);
+               vex_printf("\n\n");
+#              endif
+               stats->n_coalesced++;
+               continue;
+            }
+         }
+      }
+
+      if (is_move && !hregIsVirtual(vregS) && hregIsVirtual(vregD)) {
+         /* V <- R, where V is born here and R's HLR ends here.  Drop
+            the move, and give V to R after the HLR has ended. */
+         m = hregNumber(vregD);
+         vassert(IS_VALID_VREGNO(m));
+         for (k = 0; k < n_rregs; k++)
+            if (sameHReg(rreg_state[k].rreg, vregS))
+               break;
+         if (k < n_rregs && vreg_lrs[m].live_after == ii
+             && rreg_state[k].disp == Unavail) {
+            for (j = rreg_lrs_db_next;
+                 j < rreg_lrs_used && rreg_lrs_db[j].dead_before == ii + 1;
+                 j++) {
+               if (sameHReg(rreg_lrs_db[j].rreg, vregS)) {
+                  skip_insn  = True;
+                  bind_after = k;
+                  stats->n_coalesced++;
+                  break;
+               }
+            }
+         }
+      }
+
+      /* ------ Free up rregs bound to dead vregs ------ */
+
+      for (j = 0; j < n_rregs; j++) {
+         if (rreg_state[j].disp != Bound)
+            continue;
+         m = hregNumber(rreg_state[j].vreg);
+         vassert(IS_VALID_VREGNO(m));
+         if (vreg_lrs[m].dead_before <= ii) {
+            rreg_state[j].disp = Free;
+            rreg_state[j].vreg = INVALID_HREG;
+            rreg_state[j].eq_spill_slot = False;
+            vreg_state[m] = INVALID_RREG_NO;
+            if (DEBUG_REGALLOC) {
+               vex_printf("free up ");
+               (*ppReg)(rreg_state[j].rreg);
+               vex_printf("\n");
+            }
+         }
+      }
+
+      /* ------ Pre-instruction actions for fixed rreg uses ------ */
+
+      /* Rregs which are about to enter an HLR must be freed up.  If
+         one holds a live vreg, move it to a free rreg which won't be
+         needed before the vreg's next use, if there is one and we
+         can, and otherwise spill it.  As a special case, R <- V
+         where V is already in R and dies here needs no action at all,
+         and the move is dropped. */
+      while (True) {
+         vassert(rreg_lrs_la_next >= 0);
+         vassert(rreg_lrs_la_next <= rreg_lrs_used);
+         if (rreg_lrs_la_next == rreg_lrs_used)
+            break; /* no more real reg live ranges to consider */
+         if (ii < rreg_lrs_la[rreg_lrs_la_next].live_after)
+            break; /* next live range does not yet start */
+         vassert(ii == rreg_lrs_la[rreg_lrs_la_next].live_after);
+#        if DEBUG_REGALLOC
+         vex_printf("need to free up rreg: ");
+         (*ppReg)(rreg_lrs_la[rreg_lrs_la_next].rreg);
+         vex_printf("\n\n");
+#        endif
+         for (k = 0; k < n_rregs; k++)
+            if (sameHReg(rreg_state[k].rreg,
+                         rreg_lrs_la[rreg_lrs_la_next].rreg))
+               break;
+         vassert(IS_VALID_RREGNO(k));
+         if (rreg_state[k].disp == Bound) {
+            m = hregNumber(rreg_state[k].vreg);
+            vassert(IS_VALID_VREGNO(m));
+            vreg_state[m] = INVALID_RREG_NO;
+            if (vreg_lrs[m].dead_before > ii) {
+               Int next_use, k2, best_k2, best_start;
+
+               if (is_move
+                   && sameHReg(vregD, rreg_state[k].rreg)
+                   && sameHReg(vregS, rreg_state[k].vreg)
+                   && vreg_lrs[m].dead_before == ii + 1) {
+                  skip_insn = True;
+                  stats->n_coalesced++;
+                  goto rreg_freed;
+               }
+
+               best_k2 = -1;
+               if (genMove) {
+                  next_use   = nextUse(&vreg_lrs[m], uses, ii);
+                  best_start = next_use;
+                  for (k2 = 0; k2 < n_rregs; k2++) {
+                     Int start;
+                     if (rreg_state[k2].disp != Free
+                         || hregClass(rreg_state[k2].rreg)
+                            != vreg_lrs[m].reg_class)
+                        continue;
+                     start = nextHLRStart(&rreg_state[k2], ii);
+                     if (start > best_start) {
+                        best_start = start;
+                        best_k2    = k2;
+                     }
+                  }
+               }
+
+               if (best_k2 != -1) {
+                  HInstr* mv = (*genMove)( rreg_state[k].rreg,
+                                           rreg_state[best_k2].rreg,
+                                           mode64 );
+                  if (mv) {
+                     EMIT_INSTR(mv);
+                     stats->n_moves++;
+                     rreg_state[best_k2].disp = Bound;
+                     rreg_state[best_k2].vreg = rreg_state[k].vreg;
+                     rreg_state[best_k2].eq_spill_slot
+                        = rreg_state[k].eq_spill_slot;
+                     vreg_state[m] = toShort(best_k2);
+                     goto rreg_freed;
+                  }
+               }
+
+               if (!rreg_state[k].eq_spill_slot)
+                  EMIT_SPILL(k, m);
+            }
+         }
+        rreg_freed:
+         rreg_state[k].disp = Unavail;
+         rreg_state[k].vreg = INVALID_HREG;
+         rreg_state[k].eq_spill_slot = False;
+
+         rreg_lrs_la_next++;
+      }
+
+#     if DEBUG_REGALLOC
+      vex_printf("After pre-insn actions for fixed regs:\n");
+      PRINT_STATE;
+      vex_printf("\n");
+#     endif
+
+      if (skip_insn)
+         goto post_insn;
+
+      /* ------ Deal with the current instruction. ------ */
+
+      (*getRegUsage)( &reg_usage, instrs_in->arr[ii], mode64 );
+
+      initHRegRemap(&remap);
+
+      /* ------------ BEGIN directReload optimisation ----------- */
+
+      /* As in host_generic_reg_alloc2.c. */
+      if (directReload && reg_usage.n_used <= 2) {
+         HReg  cand     = INVALID_HREG;
+         Int   nreads   = 0;
+         Short spilloff = 0;
+
+         for (j = 0; j < reg_usage.n_used; j++) {
+            vreg = reg_usage.hreg[j];
+            if (!hregIsVirtual(vreg))
+               continue;
+            if (reg_usage.mode[j] == HRmRead) {
+               nreads++;
+               m = hregNumber(vreg);
+               vassert(IS_VALID_VREGNO(m));
+               k = vreg_state[m];
+               if (!IS_VALID_RREGNO(k)) {
+                  vassert(vreg_lrs[m].dead_before >= ii+1);
+                  if (vreg_lrs[m].dead_before == ii+1
+                      && hregIsInvalid(cand)) {
+                     spilloff = vreg_lrs[m].spill_offset;
+                     cand = vreg;
+                  }
+               }
+            }
+         }
+
+         if (nreads == 1 && ! hregIsInvalid(cand)) {
+            HInstr* reloaded;
+            if (reg_usage.n_used == 2)
+               vassert(! sameHReg(reg_usage.hreg[0], reg_usage.hreg[1]));
+            reloaded = directReload ( instrs_in->arr[ii], cand, spilloff );
+            if (reloaded) {
+               instrs_in->arr[ii] = reloaded;
+               (*getRegUsage)( &reg_usage, instrs_in->arr[ii], mode64 );
+               stats->n_reloads++;
+            }
+         }
+      }
+
+      /* ------------ END directReload optimisation ------------ */
+
+      for (j = 0; j < reg_usage.n_used; j++) {
+
+         vreg = reg_usage.hreg[j];
+         if (!hregIsVirtual(vreg))
+            continue;
+
+         /* Already in a register? */
+         m = hregNumber(vreg);
+         vassert(IS_VALID_VREGNO(m));
+         k = vreg_state[m];
+         if (IS_VALID_RREGNO(k)) {
+            vassert(rreg_state[k].disp == Bound);
+            addToHRegRemap(&remap, vreg, rreg_state[k].rreg);
+            if (reg_usage.mode[j] != HRmRead)
+               rreg_state[k].eq_spill_slot = False;
+            continue;
+         } else {
+            vassert(k == INVALID_RREG_NO);
+         }
+
+         /* Look for a free rreg of the right class.  Take the hinted
+            one if it's free and won't be needed before the move
+            which is the reason for the hint.  Otherwise take one
+            which won't be needed for an HLR before the vreg dies, or
+            failing that the one which will be needed last. */
+         k = -1;
+         if (vreg_lrs[m].hint != -1) {
+            Int h = vreg_lrs[m].hint;
+            if (rreg_state[h].disp == Free
+                && hregClass(rreg_state[h].rreg) == hregClass(vreg)
+                && nextHLRStart(&rreg_state[h], ii)
+                   >= vreg_lrs[m].dead_before - 1)
+               k = h;
+         }
+         if (k == -1) {
+            Int best_start = -1;
+            for (n = 0; n < n_rregs; n++) {
+               Int start;
+               if (rreg_state[n].disp != Free
+                   || hregClass(rreg_state[n].rreg) != hregClass(vreg))
+                  continue;
+               start = nextHLRStart(&rreg_state[n], ii);
+               if (start > best_start) {
+                  best_start = start;
+                  k = n;
+               }
+               if (start >= vreg_lrs[m].dead_before)
+                  break;
+            }
+         }
+
+         if (k == -1) {
+            /* No free rreg, so spill a vreg.  Choose one not needed
+               by this insn, and which is next used as far ahead as
+               possible, preferring one which needn't be stored. */
+            for (k = 0; k < n_rregs; k++) {
+               rreg_state[k].is_spill_cand = False;
+               if (rreg_state[k].disp != Bound)
+                  continue;
+               if (hregClass(rreg_state[k].rreg) != hregClass(vreg))
+                  continue;
+               rreg_state[k].is_spill_cand = True;
+               for (n = 0; n < reg_usage.n_used; n++) {
+                  if (sameHReg(rreg_state[k].vreg, reg_usage.hreg[n])) {
+                     rreg_state[k].is_spill_cand = False;
+                     break;
+                  }
+               }
+            }
+
+            spillee  = -1;
+            furthest = -1;
+            for (k = 0; k < n_rregs; k++) {
+               Int next_use;
+               if (!rreg_state[k].is_spill_cand)
+                  continue;
+               n = hregNumber(rreg_state[k].vreg);
+               vassert(IS_VALID_VREGNO(n));
+               next_use = nextUse(&vreg_lrs[n], uses, ii+1);
+               if (next_use > furthest
+                   || (next_use == furthest
+                       && rreg_state[k].eq_spill_slot
+                       && !rreg_state[spillee].eq_spill_slot)) {
+                  furthest = next_use;
+                  spillee  = k;
+               }
+            }
+
+            if (spillee == -1) {
+               vex_printf("reg_alloc: can't find a register in class: ");
+               ppHRegClass(hregClass(vreg));
+               vex_printf("\n");
+               vpanic("reg_alloc: can't create a free register.");
+            }
+
+            vassert(IS_VALID_RREGNO(spillee));
+            vassert(rreg_state[spillee].disp == Bound);
+            vassert(hregClass(rreg_state[spillee].rreg) == hregClass(vreg));
+            vassert(! sameHReg(rreg_state[spillee].vreg, vreg));
+
+            n = hregNumber(rreg_state[spillee].vreg);
+            vassert(IS_VALID_VREGNO(n));
+            vassert(vreg_lrs[n].dead_before > ii);
+            if (!rreg_state[spillee].eq_spill_slot)
+               EMIT_SPILL(spillee, n);
+            vreg_state[n] = INVALID_RREG_NO;
+            k = spillee;
+         }
+
+         /* Bind vreg to rreg_state[k], and reload it if this insn
+            doesn't merely write it.  The first event for a vreg is
+            always a write, so if this isn't one, a reload is indeed
+            needed. */
+         rreg_state[k].disp = Bound;
+         rreg_state[k].vreg = vreg;
+         vreg_state[m] = toShort(k);
+         if (reg_usage.mode[j] != HRmWrite) {
+            EMIT_RELOAD(k, m);
+            rreg_state[k].eq_spill_slot
+               = toBool(reg_usage.mode[j] == HRmRead);
+         } else {
+            rreg_state[k].eq_spill_slot = False;
+         }
+         addToHRegRemap(&remap, vreg, rreg_state[k].rreg);
+
+      } /* iterate over registers in this instruction. */
+
+      /* NOTE, DESTRUCTIVELY MODIFIES instrs_in->arr[ii]. */
+      (*mapRegs)( &remap, instrs_in->arr[ii], mode64 );
+      EMIT_INSTR( instrs_in->arr[ii] );
+
+#     if DEBUG_REGALLOC
+      vex_printf("After dealing with current insn:\n");
+      PRINT_STATE;
+      vex_printf("\n");
+#     endif
+
+     post_insn:
+
+      /* ------ Post-instruction actions for fixed rreg uses ------ */
+
+      while (True) {
+         vassert(rreg_lrs_db_next >= 0);
+         vassert(rreg_lrs_db_next <= rreg_lrs_used);
+         if (rreg_lrs_db_next == rreg_lrs_used)
+            break; /* no more real reg live ranges to consider */
+         if (ii+1 < rreg_lrs_db[rreg_lrs_db_next].dead_before)
+            break; /* next live range does not yet end */
+         vassert(ii+1 == rreg_lrs_db[rreg_lrs_db_next].dead_before);
+         for (k = 0; k < n_rregs; k++)
+            if (sameHReg(rreg_state[k].rreg,
+                         rreg_lrs_db[rreg_lrs_db_next].rreg))
+               break;
+         vassert(k < n_rregs);
+         vassert(rreg_state[k].disp == Unavail);
+         rreg_state[k].disp = Free;
+         rreg_state[k].vreg = INVALID_HREG;
+         rreg_state[k].eq_spill_slot = False;
+
+         rreg_lrs_db_next++;
+      }
+
+      /* Finish off V <- R coalescing. */
+      if (bind_after != -1) {
+         vassert(rreg_state[bind_after].disp == Free);
+         m = hregNumber(vregD);
+         vassert(vreg_state[m] == INVALID_RREG_NO);
+         rreg_state[bind_after].disp = Bound;
+         rreg_state[bind_after].vreg = vregD;
+         rreg_state[bind_after].eq_spill_slot = False;
+         vreg_state[m] = toShort(bind_after);
+      }
+
+#     if DEBUG_REGALLOC
+      vex_printf("After post-insn actions for fixed regs:\n");
+      PRINT_STATE;
+      vex_printf("\n");
+#     endif
+
+   } /* iterate over insns */
+
+   /* Paranoia */
+   for (j = 0; j < n_rregs; j++)
+      vassert(sameHReg(rreg_state[j].rreg, available_real_regs[j]));
+
+   vassert(rreg_lrs_la_next == rreg_lrs_used);
+   vassert(rreg_lrs_db_next == rreg_lrs_used);
+
+   return instrs_out;
+
+#  undef INVALID_INSTRNO
+#  undef EMIT_INSTR
+#  undef EMIT_SPILL
+#  undef EMIT_RELOAD
+#  undef PRINT_STATE
+}
+
+
+
+/*---------------------------------------------------------------*/
+/*---                                       host_reg_alloc3.c ---*/
+/*---------------------------------------------------------------*/
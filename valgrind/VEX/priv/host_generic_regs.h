@@ -91,9 +91,11 @@ typedef
                              so won't fit in a 64-bit slot)
       HRcVec64     64 bits
       HRcVec128    128 bits
+      HRcVec256    256 bits
 
    If you add another regclass, you must remember to update
-   host_generic_reg_alloc2.c accordingly.
+   host_generic_reg_alloc2.c and host_generic_reg_alloc3.c
+   accordingly.
 */
 typedef
    enum { 
@@ -103,7 +105,8 @@ typedef
       HRcFlt32=5,     /* 32-bit float */
       HRcFlt64=6,     /* 64-bit float */
       HRcVec64=7,     /* 64-bit SIMD */
-      HRcVec128=8     /* 128-bit SIMD */
+      HRcVec128=8,    /* 128-bit SIMD */
+      HRcVec256=9     /* 256-bit SIMD */
    }
    HRegClass;
 
@@ -128,7 +131,7 @@ static inline HReg mkHReg ( UInt regno, HRegClass rc, Bool virtual ) {
 static inline HRegClass hregClass ( HReg r ) {
    UInt rc = r.reg;
    rc = (rc >> 28) & 0x0F;
-   vassert(rc >= HRcInt32 && rc <= HRcVec128);
+   vassert(rc >= HRcInt32 && rc <= HRcVec256);
    return (HRegClass)rc;
 }
 
@@ -313,6 +316,18 @@ static inline Bool is_RetLoc_INVALID ( RetLoc rl ) {
 /*--- Reg alloc: TODO: move somewhere else              ---*/
 /*---------------------------------------------------------*/
 
+/* Counts of the work done by the register allocator for one block,
+   shown with the register-allocated code when tracing, and passed
+   back to the client in VexTranslateResult. */
+typedef
+   struct {
+      Int n_spills;    /* spill stores generated */
+      Int n_reloads;   /* reloads generated, including direct ones */
+      Int n_moves;     /* reg-reg moves generated to split live ranges */
+      Int n_coalesced; /* reg-reg moves removed */
+   }
+   HRegAllocStats;
+
 extern
 HInstrArray* doRegisterAllocation (
 
@@ -346,7 +361,33 @@ HInstrArray* doRegisterAllocation (
    void (*ppReg) ( HReg ),
 
    /* 32/64bit mode */
-   Bool mode64
+   Bool mode64,
+
+   /* OUT: what was done */
+   HRegAllocStats* stats
+);
+
+/* The same, but using the allocator in host_generic_reg_alloc3.c,
+   which also takes an optional function to generate a reg-reg move
+   between two real regs of the same class.  It may return NULL if it
+   can't, in which case the allocator spills instead. */
+extern
+HInstrArray* doRegisterAllocation_v3 (
+   HInstrArray* instrs_in,
+   HReg* available_real_regs,
+   Int   n_available_real_regs,
+   Bool (*isMove) (HInstr*, HReg*, HReg*),
+   void (*getRegUsage) (HRegUsage*, HInstr*, Bool),
+   void (*mapRegs) (HRegRemap*, HInstr*, Bool),
+   void    (*genSpill) (  HInstr**, HInstr**, HReg, Int, Bool ),
+   void    (*genReload) ( HInstr**, HInstr**, HReg, Int, Bool ),
+   HInstr* (*directReload) ( HInstr*, HReg, Short ),
+   HInstr* (*genMove) ( HReg, HReg, Bool ),
+   Int     guest_sizeB,
+   void (*ppInstr) ( HInstr*, Bool ),
+   void (*ppReg) ( HReg ),
+   Bool mode64,
+   HRegAllocStats* stats
 );
 
 
@@ -2835,6 +2835,8 @@ Int emit_MIPSInstr ( /*MB_MOD*/Bool* is_profInc,
                      void* disp_cp_chain_me_to_slowEP,
                      void* disp_cp_chain_me_to_fastEP,
                      void* disp_cp_xindir,
+                     void* disp_cp_xindir_icfill,
+                     void* disp_cp_ret_fill,
                      void* disp_cp_xassisted )
 {
    UChar *p = &buf[0];
@@ -705,6 +705,8 @@ extern Int        emit_MIPSInstr        (/*MB_MOD*/Bool* is_profInc,
                                          void* disp_cp_chain_me_to_slowEP,
                                          void* disp_cp_chain_me_to_fastEP,
                                          void* disp_cp_xindir,
+                                         void* disp_cp_xindir_icfill,
+                                         void* disp_cp_ret_fill,
                                          void* disp_cp_xassisted );
 
 extern void genSpill_MIPS ( /*OUT*/ HInstr ** i1, /*OUT*/ HInstr ** i2,
@@ -719,6 +721,8 @@ extern HInstrArray *iselSB_MIPS          ( IRSB*,
                                            VexAbiInfo*,
                                            Int offs_Host_EvC_Counter,
                                            Int offs_Host_EvC_FailAddr,
+                                           Int offs_Host_RetStack,
+                                           Int offs_Guest_SP,
                                            Bool chainingAllowed,
                                            Bool addProfInc,
                                            Addr64 max_ga );
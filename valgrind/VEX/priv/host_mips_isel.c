@@ -4004,6 +4004,8 @@ HInstrArray *iselSB_MIPS ( IRSB* bb,
                            VexAbiInfo* vbi,
                            Int offs_Host_EvC_Counter,
                            Int offs_Host_EvC_FailAddr,
+                           Int offs_Host_RetStack/*UNUSED*/,
+                           Int offs_Guest_SP/*UNUSED*/,
                            Bool chainingAllowed,
                            Bool addProfInc,
                            Addr64 max_ga )
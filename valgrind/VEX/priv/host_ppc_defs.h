@@ -1141,6 +1141,8 @@ extern Int          emit_PPCInstr        ( /*MB_MOD*/Bool* is_profInc,
                                            void* disp_cp_chain_me_to_slowEP,
                                            void* disp_cp_chain_me_to_fastEP,
                                            void* disp_cp_xindir,
+                                           void* disp_cp_xindir_icfill,
+                                           void* disp_cp_ret_fill,
                                            void* disp_cp_xassisted );
 
 extern void genSpill_PPC  ( /*OUT*/HInstr** i1, /*OUT*/HInstr** i2,
@@ -1155,6 +1157,8 @@ extern HInstrArray* iselSB_PPC           ( IRSB*,
                                            VexAbiInfo*,
                                            Int offs_Host_EvC_Counter,
                                            Int offs_Host_EvC_FailAddr,
+                                           Int offs_Host_RetStack,
+                                           Int offs_Guest_SP,
                                            Bool chainingAllowed,
                                            Bool addProfInc,
                                            Addr64 max_ga );
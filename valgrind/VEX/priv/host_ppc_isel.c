@@ -5877,6 +5877,8 @@ HInstrArray* iselSB_PPC ( IRSB* bb,
                           VexAbiInfo*  vbi,
                           Int offs_Host_EvC_Counter,
                           Int offs_Host_EvC_FailAddr,
+                          Int offs_Host_RetStack/*UNUSED*/,
+                          Int offs_Guest_SP/*UNUSED*/,
                           Bool chainingAllowed,
                           Bool addProfInc,
                           Addr64 max_ga )
@@ -4065,7 +4065,9 @@ iselNext(ISelEnv *env, IRExpr *next, IRJumpKind jk, Int offsIP)
 HInstrArray *
 iselSB_S390(IRSB *bb, VexArch arch_host, VexArchInfo *archinfo_host,
             VexAbiInfo *vbi, Int offset_host_evcheck_counter,
-            Int offset_host_evcheck_fail_addr, Bool chaining_allowed,
+            Int offset_host_evcheck_fail_addr,
+            Int offset_host_retstack, Int offset_guest_sp,
+            Bool chaining_allowed,
             Bool add_profinc, Addr64 max_ga)
 {
    UInt     i, j;
@@ -1753,6 +1753,24 @@ void genReload_X86 ( /*OUT*/HInstr** i1, /*OUT*/HInstr** i2,
    }
 }
 
+/* Generate a reg-reg move, for the register allocator to use when
+   splitting a live range.  x87 registers can't be moved like this,
+   so return NULL for them, and the allocator will spill instead. */
+
+X86Instr* genMove_X86 ( HReg from, HReg to, Bool mode64 )
+{
+   vassert(mode64 == False);
+   vassert(hregClass(from) == hregClass(to));
+   switch (hregClass(from)) {
+      case HRcInt32:
+         return X86Instr_Alu32R ( Xalu_MOV, X86RMI_Reg(from), to );
+      case HRcVec128:
+         return X86Instr_SseReRg ( Xsse_MOV, from, to );
+      default:
+         return NULL;
+   }
+}
+
 /* The given instruction reads the specified vreg exactly once, and
    that vreg is currently located at the given spill offset.  If
    possible, return a variant of the instruction to one which instead
@@ -2092,6 +2110,8 @@ Int emit_X86Instr ( /*MB_MOD*/Bool* is_profInc,
                     void* disp_cp_chain_me_to_slowEP,
                     void* disp_cp_chain_me_to_fastEP,
                     void* disp_cp_xindir,
+                    void* disp_cp_xindir_icfill,
+                    void* disp_cp_ret_fill,
                     void* disp_cp_xassisted )
 {
    UInt irno, opc, opc_rr, subopc_imm, opc_imma, opc_cl, opc_imm, subopc;
@@ -720,12 +720,15 @@ extern Int          emit_X86Instr        ( /*MB_MOD*/Bool* is_profInc,
                                            void* disp_cp_chain_me_to_slowEP,
                                            void* disp_cp_chain_me_to_fastEP,
                                            void* disp_cp_xindir,
+                                           void* disp_cp_xindir_icfill,
+                                           void* disp_cp_ret_fill,
                                            void* disp_cp_xassisted );
 
 extern void genSpill_X86  ( /*OUT*/HInstr** i1, /*OUT*/HInstr** i2,
                             HReg rreg, Int offset, Bool );
 extern void genReload_X86 ( /*OUT*/HInstr** i1, /*OUT*/HInstr** i2,
                             HReg rreg, Int offset, Bool );
+extern X86Instr* genMove_X86 ( HReg from, HReg to, Bool );
 
 extern X86Instr*    directReload_X86     ( X86Instr* i, 
                                            HReg vreg, Short spill_off );
@@ -736,6 +739,8 @@ extern HInstrArray* iselSB_X86           ( IRSB*,
                                            VexAbiInfo*,
                                            Int offs_Host_EvC_Counter,
                                            Int offs_Host_EvC_FailAddr,
+                                           Int offs_Host_RetStack,
+                                           Int offs_Guest_SP,
                                            Bool chainingAllowed,
                                            Bool addProfInc,
                                            Addr64 max_ga );
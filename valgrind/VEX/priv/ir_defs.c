@@ -1562,6 +1562,10 @@ void ppIRSB ( IRSB* bb )
 /*---------------------------------------------------------------*/
 
 
+/* Number of temps whose IRExpr_RdTmp is shared. */
+#define N_SHARED_RDTMPS 2048
+
+
 /* Constructors -- IRConst */
 
 IRConst* IRConst_U1 ( Bool bit )
@@ -1699,7 +1703,23 @@ IRExpr* IRExpr_GetI ( IRRegArray* descr, IRExpr* ix, Int bias ) {
    return e;
 }
 IRExpr* IRExpr_RdTmp ( IRTemp tmp ) {
-   IRExpr* e        = LibVEX_Alloc(sizeof(IRExpr));
+   /* Reads of all but the highest-numbered temps use a single static
+      closure per temp.  Nearly every statement mentions one or two,
+      and each pass which rebuilds the block makes new ones, so this
+      saves a lot of allocation.  Nothing modifies an Iex_RdTmp node
+      once built (deltaIRExpr replaces them instead), so sharing them
+      is safe. */
+   static IRExpr shared[N_SHARED_RDTMPS];
+   IRExpr* e;
+   if (LIKELY(tmp < N_SHARED_RDTMPS)) {
+      e = &shared[tmp];
+      if (UNLIKELY(e->tag != Iex_RdTmp)) {
+         e->tag           = Iex_RdTmp;
+         e->Iex.RdTmp.tmp = tmp;
+      }
+      return e;
+   }
+   e                = LibVEX_Alloc(sizeof(IRExpr));
    e->tag           = Iex_RdTmp;
    e->Iex.RdTmp.tmp = tmp;
    return e;
@@ -215,6 +215,14 @@ static Bool lookupHHW ( HashHW* h, /*OUT*/HWord* val, HWord key )
 }
 
 
+/* Remove all bindings from the map. */
+
+static void clearHHW ( HashHW* h )
+{
+   h->used = 0;
+}
+
+
 /* Add key->val to the map.  Replaces any existing binding for key. */
 
 static void addToHHW ( HashHW* h, HWord key, HWord val )
@@ -230,7 +238,26 @@ static void addToHHW ( HashHW* h, HWord key, HWord val )
       }
    }
 
-   /* Ensure a space is available. */
+   /* Ensure a space is available.  Slots freed by invalidation stay
+      in the arrays, and have to be scanned past, until they fill up.
+      If at least half of them are dead, squeeze them out in place
+      rather than growing the map, so that it stays as small as the
+      number of live bindings. */
+   if (h->used == h->size) {
+      for (i = j = 0; i < h->used; i++) {
+         if (h->inuse[i]) j++;
+      }
+      if (2 * j <= h->size) {
+         for (i = j = 0; i < h->used; i++) {
+            if (!h->inuse[i]) continue;
+            h->inuse[j] = True;
+            h->key[j] = h->key[i];
+            h->val[j] = h->val[i];
+            j++;
+         }
+         h->used = j;
+      }
+   }
    if (h->used == h->size) {
       /* Copy into arrays twice the size. */
       Bool*  inuse2 = LibVEX_Alloc(2 * h->size * sizeof(Bool));
@@ -518,11 +545,25 @@ static void flatten_Stmt ( IRSB* bb, IRStmt* st )
 }
 
 
+/* Give the (still empty) 'bb' room for 'n' statements up front, so
+   that a pass which builds its output one statement at a time does
+   not have to keep doubling and copying the array in the arena. */
+static void presize_stmts ( IRSB* bb, Int n )
+{
+   vassert(bb->stmts_used == 0);
+   if (n > bb->stmts_size) {
+      bb->stmts_size = n;
+      bb->stmts      = LibVEX_Alloc(n * sizeof(IRStmt*));
+   }
+}
+
 static IRSB* flatten_BB ( IRSB* in )
 {
    Int   i;
    IRSB* out;
    out = emptyIRSB();
+   /* Flattening typically about triples the number of stmts. */
+   presize_stmts( out, 3 * in->stmts_used + 8 );
    out->tyenv = deepCopyIRTypeEnv( in->tyenv );
    for (i = 0; i < in->stmts_used; i++)
       if (in->stmts[i])
@@ -545,9 +586,15 @@ static IRSB* flatten_BB ( IRSB* in )
    env and if it matches, replace the Get with the stored value.  If
    there is no match, add a (minoff,maxoff) :-> t binding.
 
-   On seeing 'Put (minoff,maxoff) = t or c', first remove in the env
-   any binding which fully or partially overlaps with (minoff,maxoff).
-   Then add a new (minoff,maxoff) :-> t or c binding.  */
+   On seeing 'Put (minoff,maxoff) = t or c', first look up
+   (minoff,maxoff) in the env.  If it is already bound to that same t
+   or c, the guest state holds that value already and the Put is
+   removed.  This is common in unrolled loops, where later iterations
+   write back loop-invariant values, such as the condition code
+   thunk's operation and unchanged operands.  Otherwise remove in the
+   env any binding which fully or partially overlaps with
+   (minoff,maxoff), and then add a new (minoff,maxoff) :-> t or c
+   binding.  */
 
 /* Extract the min/max offsets from a guest state array descriptor. */
 
@@ -611,12 +658,29 @@ static void invalidateOverlaps ( HashHW* h, UInt k_lo, UInt k_hi )
 }
 
 
+/* Follow a chain of tmp-to-atom copies back to its source. */
+
+static IRExpr* chase_copies ( IRExpr** copies, IRExpr* a )
+{
+   while (a->tag == Iex_RdTmp && copies[a->Iex.RdTmp.tmp] != NULL)
+      a = copies[a->Iex.RdTmp.tmp];
+   return a;
+}
+
 static void redundant_get_removal_BB ( IRSB* bb )
 {
-   HashHW* env = newHHW();
-   UInt    key = 0; /* keep gcc -O happy */
-   Int     i, j;
-   HWord   val;
+   HashHW*  env = newHHW();
+   UInt     key = 0; /* keep gcc -O happy */
+   Int      i, j;
+   HWord    val;
+   /* Tmp-to-atom copies seen so far, including the ones made here out
+      of redundant Gets, so that a Put of a copy of the value already
+      in the guest state is recognised without first running cprop. */
+   Int      n_tmps = bb->tyenv->types_used;
+   IRExpr** copies = LibVEX_Alloc(n_tmps * sizeof(IRExpr*));
+
+   for (i = 0; i < n_tmps; i++)
+      copies[i] = NULL;
 
    for (i = 0; i < bb->stmts_used; i++) {
       IRStmt* st = bb->stmts[i];
@@ -658,13 +722,28 @@ static void redundant_get_removal_BB ( IRSB* bb )
          }
       }
 
-      /* Deal with Puts: invalidate any env entries overlapped by this
-         Put */
+      /* Note copies, whether original or just made from a Get */
+      st = bb->stmts[i];
+      if (st->tag == Ist_WrTmp && isIRAtom(st->Ist.WrTmp.data))
+         copies[st->Ist.WrTmp.tmp] = st->Ist.WrTmp.data;
+
+      /* Deal with Puts: remove the Put if it writes the value already
+         there, else invalidate any env entries overlapped by it */
       if (st->tag == Ist_Put || st->tag == Ist_PutI) {
          UInt k_lo, k_hi;
          if (st->tag == Ist_Put) {
             key = mk_key_GetPut( st->Ist.Put.offset, 
                                  typeOfIRExpr(bb->tyenv,st->Ist.Put.data) );
+            if (lookupHHW(env, &val, (HWord)key)
+                && eqIRAtom(chase_copies(copies, (IRExpr*)val),
+                            chase_copies(copies, st->Ist.Put.data))) {
+               if (DEBUG_IROPT) {
+                  vex_printf("rGET: same-value "); ppIRStmt(st);
+                  vex_printf("\n");
+               }
+               bb->stmts[i] = IRStmt_NoOp();
+               continue;
+            }
          } else {
             vassert(st->tag == Ist_PutI);
             key = mk_key_GetIPutI( st->Ist.PutI.details->descr );
@@ -688,8 +767,7 @@ static void redundant_get_removal_BB ( IRSB* bb )
          }
          if (writes) {
             /* dump the entire env (not clever, but correct ...) */
-            for (j = 0; j < env->used; j++)
-               env->inuse[j] = False;
+            clearHHW(env);
             if (0) vex_printf("rGET: trash env due to dirty helper\n");
          }
       }
@@ -773,8 +851,7 @@ static void handle_gets_Stmt (
       case Ist_Dirty:
       case Ist_CAS:
       case Ist_LLSC:
-         for (j = 0; j < env->used; j++)
-            env->inuse[j] = False;
+         clearHHW(env);
          break;
 
       /* all other cases are boring. */
@@ -828,8 +905,7 @@ static void handle_gets_Stmt (
          case VexRegUpdAllregsAtMemAccess:
             /* Precise exceptions required at mem access.
                Flush all guest state. */
-            for (j = 0; j < env->used; j++)
-               env->inuse[j] = False;
+            clearHHW(env);
             break;
          case VexRegUpdSpAtMemAccess:
             /* We need to dump the stack pointer
@@ -880,7 +956,7 @@ static void redundant_put_removal_BB (
                Bool (*preciseMemExnsFn)(Int,Int)
             )
 {
-   Int     i, j;
+   Int     i;
    Bool    isPut;
    IRStmt* st;
    UInt    key = 0; /* keep gcc -O happy */
@@ -925,8 +1001,7 @@ static void redundant_put_removal_BB (
          //                    typeOfIRConst(st->Ist.Exit.dst));
          //re_add = lookupHHW(env, NULL, key);
          /* (2) */
-         for (j = 0; j < env->used; j++)
-            env->inuse[j] = False;
+         clearHHW(env);
          /* (3) */
          //if (0 && re_add) 
          //   addToHHW(env, (HWord)key, 0);
@@ -2623,6 +2698,7 @@ IRSB* cprop_BB ( IRSB* in )
    Int n_fixups = 0;
 
    out = emptyIRSB();
+   presize_stmts( out, in->stmts_used );
    out->tyenv = deepCopyIRTypeEnv( in->tyenv );
 
    /* Set up the env with which travels forward.  This holds a
@@ -4335,60 +4411,65 @@ void do_redundant_PutI_elimination ( IRSB* bb )
 /*--- Loop unrolling                                          ---*/
 /*---------------------------------------------------------------*/
 
-/* Adjust all tmp values (names) in e by delta.  e is destructively
-   modified. */
+/* Adjust all tmp values (names) in e by delta.  The interior nodes
+   of e are destructively modified, so they must not be shared with any
+   other tree; the RdTmp leaves may be, and are replaced instead. */
 
-static void deltaIRExpr ( IRExpr* e, Int delta )
+static IRExpr* deltaIRExpr ( IRExpr* e, Int delta )
 {
    Int i;
    switch (e->tag) {
       case Iex_RdTmp:
-         e->Iex.RdTmp.tmp += delta;
-         break;
+         return IRExpr_RdTmp(e->Iex.RdTmp.tmp + delta);
       case Iex_Get:
       case Iex_Const:
          break;
       case Iex_GetI:
-         deltaIRExpr(e->Iex.GetI.ix, delta);
+         e->Iex.GetI.ix = deltaIRExpr(e->Iex.GetI.ix, delta);
          break;
-      case Iex_Qop:
-         deltaIRExpr(e->Iex.Qop.details->arg1, delta);
-         deltaIRExpr(e->Iex.Qop.details->arg2, delta);
-         deltaIRExpr(e->Iex.Qop.details->arg3, delta);
-         deltaIRExpr(e->Iex.Qop.details->arg4, delta);
+      case Iex_Qop: {
+         IRQop* qop = e->Iex.Qop.details;
+         qop->arg1 = deltaIRExpr(qop->arg1, delta);
+         qop->arg2 = deltaIRExpr(qop->arg2, delta);
+         qop->arg3 = deltaIRExpr(qop->arg3, delta);
+         qop->arg4 = deltaIRExpr(qop->arg4, delta);
          break;
-      case Iex_Triop:
-         deltaIRExpr(e->Iex.Triop.details->arg1, delta);
-         deltaIRExpr(e->Iex.Triop.details->arg2, delta);
-         deltaIRExpr(e->Iex.Triop.details->arg3, delta);
+      }
+      case Iex_Triop: {
+         IRTriop* triop = e->Iex.Triop.details;
+         triop->arg1 = deltaIRExpr(triop->arg1, delta);
+         triop->arg2 = deltaIRExpr(triop->arg2, delta);
+         triop->arg3 = deltaIRExpr(triop->arg3, delta);
          break;
+      }
       case Iex_Binop:
-         deltaIRExpr(e->Iex.Binop.arg1, delta);
-         deltaIRExpr(e->Iex.Binop.arg2, delta);
+         e->Iex.Binop.arg1 = deltaIRExpr(e->Iex.Binop.arg1, delta);
+         e->Iex.Binop.arg2 = deltaIRExpr(e->Iex.Binop.arg2, delta);
          break;
       case Iex_Unop:
-         deltaIRExpr(e->Iex.Unop.arg, delta);
+         e->Iex.Unop.arg = deltaIRExpr(e->Iex.Unop.arg, delta);
          break;
       case Iex_Load:
-         deltaIRExpr(e->Iex.Load.addr, delta);
+         e->Iex.Load.addr = deltaIRExpr(e->Iex.Load.addr, delta);
          break;
       case Iex_CCall:
          for (i = 0; e->Iex.CCall.args[i]; i++)
-            deltaIRExpr(e->Iex.CCall.args[i], delta);
+            e->Iex.CCall.args[i] = deltaIRExpr(e->Iex.CCall.args[i], delta);
          break;
       case Iex_ITE:
-         deltaIRExpr(e->Iex.ITE.cond, delta);
-         deltaIRExpr(e->Iex.ITE.iftrue, delta);
-         deltaIRExpr(e->Iex.ITE.iffalse, delta);
+         e->Iex.ITE.cond    = deltaIRExpr(e->Iex.ITE.cond, delta);
+         e->Iex.ITE.iftrue  = deltaIRExpr(e->Iex.ITE.iftrue, delta);
+         e->Iex.ITE.iffalse = deltaIRExpr(e->Iex.ITE.iffalse, delta);
          break;
       default: 
          vex_printf("\n"); ppIRExpr(e); vex_printf("\n");
          vpanic("deltaIRExpr");
    }
+   return e;
 }
 
 /* Adjust all tmp values (names) in st by delta.  st is destructively
-   modified. */
+   modified, as for deltaIRExpr. */
 
 static void deltaIRStmt ( IRStmt* st, Int delta )
 {
@@ -4400,72 +4481,77 @@ static void deltaIRStmt ( IRStmt* st, Int delta )
       case Ist_MBE:
          break;
       case Ist_AbiHint:
-         deltaIRExpr(st->Ist.AbiHint.base, delta);
-         deltaIRExpr(st->Ist.AbiHint.nia, delta);
+         st->Ist.AbiHint.base = deltaIRExpr(st->Ist.AbiHint.base, delta);
+         st->Ist.AbiHint.nia  = deltaIRExpr(st->Ist.AbiHint.nia, delta);
          break;
       case Ist_Put:
-         deltaIRExpr(st->Ist.Put.data, delta);
+         st->Ist.Put.data = deltaIRExpr(st->Ist.Put.data, delta);
          break;
-      case Ist_PutI:
-         deltaIRExpr(st->Ist.PutI.details->ix, delta);
-         deltaIRExpr(st->Ist.PutI.details->data, delta);
+      case Ist_PutI: {
+         IRPutI* puti = st->Ist.PutI.details;
+         puti->ix   = deltaIRExpr(puti->ix, delta);
+         puti->data = deltaIRExpr(puti->data, delta);
          break;
+      }
       case Ist_WrTmp: 
          st->Ist.WrTmp.tmp += delta;
-         deltaIRExpr(st->Ist.WrTmp.data, delta);
+         st->Ist.WrTmp.data = deltaIRExpr(st->Ist.WrTmp.data, delta);
          break;
       case Ist_Exit:
-         deltaIRExpr(st->Ist.Exit.guard, delta);
+         st->Ist.Exit.guard = deltaIRExpr(st->Ist.Exit.guard, delta);
          break;
       case Ist_Store:
-         deltaIRExpr(st->Ist.Store.addr, delta);
-         deltaIRExpr(st->Ist.Store.data, delta);
+         st->Ist.Store.addr = deltaIRExpr(st->Ist.Store.addr, delta);
+         st->Ist.Store.data = deltaIRExpr(st->Ist.Store.data, delta);
          break;
       case Ist_StoreG: {
          IRStoreG* sg = st->Ist.StoreG.details;
-         deltaIRExpr(sg->addr, delta);
-         deltaIRExpr(sg->data, delta);
-         deltaIRExpr(sg->guard, delta);
+         sg->addr  = deltaIRExpr(sg->addr, delta);
+         sg->data  = deltaIRExpr(sg->data, delta);
+         sg->guard = deltaIRExpr(sg->guard, delta);
          break;
       }
       case Ist_LoadG: {
          IRLoadG* lg = st->Ist.LoadG.details;
          lg->dst += delta;
-         deltaIRExpr(lg->addr, delta);
-         deltaIRExpr(lg->alt, delta);
-         deltaIRExpr(lg->guard, delta);
+         lg->addr  = deltaIRExpr(lg->addr, delta);
+         lg->alt   = deltaIRExpr(lg->alt, delta);
+         lg->guard = deltaIRExpr(lg->guard, delta);
          break;
       }
-      case Ist_CAS:
-         if (st->Ist.CAS.details->oldHi != IRTemp_INVALID)
-            st->Ist.CAS.details->oldHi += delta;
-         st->Ist.CAS.details->oldLo += delta;
-         deltaIRExpr(st->Ist.CAS.details->addr, delta);
-         if (st->Ist.CAS.details->expdHi)
-            deltaIRExpr(st->Ist.CAS.details->expdHi, delta);
-         deltaIRExpr(st->Ist.CAS.details->expdLo, delta);
-         if (st->Ist.CAS.details->dataHi)
-            deltaIRExpr(st->Ist.CAS.details->dataHi, delta);
-         deltaIRExpr(st->Ist.CAS.details->dataLo, delta);
+      case Ist_CAS: {
+         IRCAS* cas = st->Ist.CAS.details;
+         if (cas->oldHi != IRTemp_INVALID)
+            cas->oldHi += delta;
+         cas->oldLo += delta;
+         cas->addr = deltaIRExpr(cas->addr, delta);
+         if (cas->expdHi)
+            cas->expdHi = deltaIRExpr(cas->expdHi, delta);
+         cas->expdLo = deltaIRExpr(cas->expdLo, delta);
+         if (cas->dataHi)
+            cas->dataHi = deltaIRExpr(cas->dataHi, delta);
+         cas->dataLo = deltaIRExpr(cas->dataLo, delta);
          break;
+      }
       case Ist_LLSC:
          st->Ist.LLSC.result += delta;
-         deltaIRExpr(st->Ist.LLSC.addr, delta);
+         st->Ist.LLSC.addr = deltaIRExpr(st->Ist.LLSC.addr, delta);
          if (st->Ist.LLSC.storedata)
-            deltaIRExpr(st->Ist.LLSC.storedata, delta);
+            st->Ist.LLSC.storedata
+               = deltaIRExpr(st->Ist.LLSC.storedata, delta);
          break;
       case Ist_Dirty:
          d = st->Ist.Dirty.details;
-         deltaIRExpr(d->guard, delta);
+         d->guard = deltaIRExpr(d->guard, delta);
          for (i = 0; d->args[i]; i++) {
             IRExpr* arg = d->args[i];
             if (LIKELY(!is_IRExpr_VECRET_or_BBPTR(arg)))
-               deltaIRExpr(arg, delta);
+               d->args[i] = deltaIRExpr(arg, delta);
          }
          if (d->tmp != IRTemp_INVALID)
             d->tmp += delta;
          if (d->mAddr)
-            deltaIRExpr(d->mAddr, delta);
+            d->mAddr = deltaIRExpr(d->mAddr, delta);
          break;
       default: 
          vex_printf("\n"); ppIRStmt(st); vex_printf("\n");
@@ -4493,14 +4579,23 @@ static void deltaIRStmt ( IRStmt* st, Int delta )
    X and Y must be literal (guest) addresses.
 */
 
+/* The unroll factor is chosen from the number of statements which
+   generate code.  IMarks, and the tmp-to-tmp copies left behind by
+   helper specialisation, cost nothing, but in a short guest loop they
+   can account for a third of the block and push it over the limit. */
+
 static Int calc_unroll_factor( IRSB* bb )
 {
    Int n_stmts, i;
 
    n_stmts = 0;
    for (i = 0; i < bb->stmts_used; i++) {
-      if (bb->stmts[i]->tag != Ist_NoOp)
-         n_stmts++;
+      IRStmt* st = bb->stmts[i];
+      if (st->tag == Ist_NoOp || st->tag == Ist_IMark)
+         continue;
+      if (st->tag == Ist_WrTmp && st->Ist.WrTmp.data->tag == Iex_RdTmp)
+         continue;
+      n_stmts++;
    }
 
    if (n_stmts <= vex_control.iropt_unroll_thresh/8) {
@@ -96,6 +96,7 @@ void LibVEX_default_VexControl ( /*OUT*/ VexControl* vcon )
    vcon->guest_max_insns            = 60;
    vcon->guest_chase_thresh         = 10;
    vcon->guest_chase_cond           = False;
+   vcon->regalloc_version           = 2;
 }
 
 
@@ -137,6 +138,7 @@ void LibVEX_Init (
    vassert(vcon->guest_chase_thresh < vcon->guest_max_insns);
    vassert(vcon->guest_chase_cond == True 
            || vcon->guest_chase_cond == False);
+   vassert(vcon->regalloc_version == 2 || vcon->regalloc_version == 3);
 
    /* Check that Vex has been built with sizes of basic types as
       stated in priv/libvex_basictypes.h.  Failure of any of these is
@@ -200,9 +202,51 @@ void LibVEX_Init (
 
 /* --------- Make a translation. --------- */
 
+/* If the caller asked for phase timings, charge the ticks since
+   *last to phase ph, and restart the clock. */
+static inline void charge_phase ( VexTranslateArgs* vta, ULong* last,
+                                  VexPhase ph )
+{
+   ULong now;
+   if (LIKELY(vta->read_timer == NULL || vta->phase_times == NULL))
+      return;
+   now = vta->read_timer();
+   vta->phase_times[ph] += now - *last;
+   *last = now;
+}
+
+static VexTranslateResult LibVEX_Translate_wrk ( VexTranslateArgs* vta );
+
 /* Exported to library client. */
 
 VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
+{
+   VexTranslateResult res;
+   VexControl         saved;
+
+   vassert(vex_initdone);
+
+   if (vta->iropt_level == -1 && vta->guest_chase_thresh == -1)
+      return LibVEX_Translate_wrk(vta);
+
+   /* Apply the per-translation overrides for the duration of this
+      translation only. */
+   saved = vex_control;
+   if (vta->iropt_level != -1) {
+      vassert(vta->iropt_level >= 0 && vta->iropt_level <= 2);
+      vex_control.iropt_level = vta->iropt_level;
+   }
+   if (vta->guest_chase_thresh != -1) {
+      vassert(vta->guest_chase_thresh >= 0);
+      vassert(vta->guest_chase_thresh < vex_control.guest_max_insns);
+      vex_control.guest_chase_thresh = vta->guest_chase_thresh;
+   }
+   res = LibVEX_Translate_wrk(vta);
+   vex_control = saved;
+   return res;
+}
+
+static VexTranslateResult LibVEX_Translate_wrk ( VexTranslateArgs* vta )
 {
    /* This the bundle of functions we need to do the back-end stuff
       (insn selection, reg-alloc, assembly) whilst being insulated
@@ -215,13 +259,15 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
    void         (*genSpill)     ( HInstr**, HInstr**, HReg, Int, Bool );
    void         (*genReload)    ( HInstr**, HInstr**, HReg, Int, Bool );
    HInstr*      (*directReload) ( HInstr*, HReg, Short );
+   HInstr*      (*genMove)      ( HReg, HReg, Bool );
    void         (*ppInstr)      ( HInstr*, Bool );
    void         (*ppReg)        ( HReg );
    HInstrArray* (*iselSB)       ( IRSB*, VexArch, VexArchInfo*, VexAbiInfo*,
-                                  Int, Int, Bool, Bool, Addr64 );
+                                  Int, Int, Int, Int, Bool, Bool, Addr64 );
    Int          (*emit)         ( /*MB_MOD*/Bool*,
                                   UChar*, Int, HInstr*, Bool,
-                                  void*, void*, void*, void* );
+                                  void*, void*, void*, void*, void*,
+                                  void* );
    IRExpr*      (*specHelper)   ( const HChar*, IRExpr**, IRStmt**, Int );
    Bool         (*preciseMemExnsFn) ( Int, Int );
 
@@ -232,24 +278,29 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
    IRSB*           irsb;
    HInstrArray*    vcode;
    HInstrArray*    rcode;
+   HRegAllocStats  ra_stats;
    Int             i, j, k, out_used, guest_sizeB;
    Int             offB_TISTART, offB_TILEN, offB_GUEST_IP, szB_GUEST_IP;
    Int             offB_HOST_EvC_COUNTER, offB_HOST_EvC_FAILADDR;
+   Int             offB_HOST_RetStack;
    UChar           insn_bytes[128];
    IRType          guest_word_type;
    IRType          host_word_type;
    Bool            mode64, chainingAllowed;
    Addr64          max_ga;
+   ULong           t_last;
 
    guest_layout           = NULL;
    available_real_regs    = NULL;
    n_available_real_regs  = 0;
+   t_last                 = 0;
    isMove                 = NULL;
    getRegUsage            = NULL;
    mapRegs                = NULL;
    genSpill               = NULL;
    genReload              = NULL;
    directReload           = NULL;
+   genMove                = NULL;
    ppInstr                = NULL;
    ppReg                  = NULL;
    iselSB                 = NULL;
@@ -265,6 +316,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
    szB_GUEST_IP           = 0;
    offB_HOST_EvC_COUNTER  = 0;
    offB_HOST_EvC_FAILADDR = 0;
+   offB_HOST_RetStack     = -1;
    mode64                 = False;
    chainingAllowed        = False;
 
@@ -281,6 +333,16 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
    } else {
       vassert(vta->disp_cp_chain_me_to_fastEP == NULL);
       vassert(vta->disp_cp_xindir             == NULL);
+      vassert(vta->disp_cp_xindir_icfill      == NULL);
+      vassert(vta->disp_cp_ret_fill           == NULL);
+   }
+   /* Inline caches for XIndirs are only implemented for amd64. */
+   if (vta->disp_cp_xindir_icfill != NULL)
+      vassert(vta->arch_host == VexArchAMD64);
+   /* So is the return-address stack, and only for amd64 guests. */
+   if (vta->disp_cp_ret_fill != NULL) {
+      vassert(vta->arch_host  == VexArchAMD64);
+      vassert(vta->arch_guest == VexArchAMD64);
    }
 
    vexSetAllocModeTEMP_and_clear();
@@ -304,11 +366,12 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          genReload    = (void(*)(HInstr**,HInstr**,HReg,Int,Bool))
                         genReload_X86;
          directReload = (HInstr*(*)(HInstr*,HReg,Short)) directReload_X86;
+         genMove      = (HInstr*(*)(HReg,HReg,Bool)) genMove_X86;
          ppInstr      = (void(*)(HInstr*, Bool)) ppX86Instr;
          ppReg        = (void(*)(HReg)) ppHRegX86;
          iselSB       = iselSB_X86;
          emit         = (Int(*)(Bool*,UChar*,Int,HInstr*,Bool,
-                               void*,void*,void*,void*))
+                               void*,void*,void*,void*,void*,void*))
                         emit_X86Instr;
          host_is_bigendian = False;
          host_word_type    = Ity_I32;
@@ -318,7 +381,8 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
       case VexArchAMD64:
          mode64      = True;
          getAllocableRegs_AMD64 ( &n_available_real_regs,
-                                  &available_real_regs );
+                                  &available_real_regs,
+                                  vta->archinfo_host.hwcaps );
          isMove      = (Bool(*)(HInstr*,HReg*,HReg*)) isMove_AMD64Instr;
          getRegUsage = (void(*)(HRegUsage*,HInstr*, Bool))
                        getRegUsage_AMD64Instr;
@@ -327,11 +391,12 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
                        genSpill_AMD64;
          genReload   = (void(*)(HInstr**,HInstr**,HReg,Int,Bool))
                        genReload_AMD64;
+         genMove     = (HInstr*(*)(HReg,HReg,Bool)) genMove_AMD64;
          ppInstr     = (void(*)(HInstr*, Bool)) ppAMD64Instr;
          ppReg       = (void(*)(HReg)) ppHRegAMD64;
          iselSB      = iselSB_AMD64;
          emit        = (Int(*)(Bool*,UChar*,Int,HInstr*,Bool,
-                               void*,void*,void*,void*))
+                               void*,void*,void*,void*,void*,void*))
                        emit_AMD64Instr;
          host_is_bigendian = False;
          host_word_type    = Ity_I64;
@@ -351,7 +416,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          ppReg       = (void(*)(HReg)) ppHRegPPC;
          iselSB      = iselSB_PPC;
          emit        = (Int(*)(Bool*,UChar*,Int,HInstr*,Bool,
-                               void*,void*,void*,void*))
+                               void*,void*,void*,void*,void*,void*))
                        emit_PPCInstr;
          host_is_bigendian = True;
          host_word_type    = Ity_I32;
@@ -371,7 +436,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          ppReg       = (void(*)(HReg)) ppHRegPPC;
          iselSB      = iselSB_PPC;
          emit        = (Int(*)(Bool*,UChar*,Int,HInstr*,Bool,
-                               void*,void*,void*,void*))
+                               void*,void*,void*,void*,void*,void*))
                        emit_PPCInstr;
          host_is_bigendian = True;
          host_word_type    = Ity_I64;
@@ -391,7 +456,8 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          ppReg       = (void(*)(HReg)) ppHRegS390;
          iselSB      = iselSB_S390;
          emit        = (Int(*)(Bool*,UChar*,Int,HInstr*,Bool,
-                               void*,void*,void*,void*)) emit_S390Instr;
+                               void*,void*,void*,void*,void*,void*))
+                        emit_S390Instr;
          host_is_bigendian = True;
          host_word_type    = Ity_I64;
          vassert(are_valid_hwcaps(VexArchS390X, vta->archinfo_host.hwcaps));
@@ -410,7 +476,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          ppReg       = (void(*)(HReg)) ppHRegARM;
          iselSB      = iselSB_ARM;
          emit        = (Int(*)(Bool*,UChar*,Int,HInstr*,Bool,
-                               void*,void*,void*,void*))
+                               void*,void*,void*,void*,void*,void*))
                        emit_ARMInstr;
          host_is_bigendian = False;
          host_word_type    = Ity_I32;
@@ -430,7 +496,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          ppReg       = (void(*)(HReg)) ppHRegMIPS;
          iselSB      = iselSB_MIPS;
          emit        = (Int(*)(Bool*,UChar*,Int,HInstr*,Bool,
-                               void*,void*,void*,void*))
+                               void*,void*,void*,void*,void*,void*))
                        emit_MIPSInstr;
 #        if defined(VKI_LITTLE_ENDIAN)
          host_is_bigendian = False;
@@ -454,7 +520,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          ppReg       = (void(*)(HReg)) ppHRegMIPS;
          iselSB      = iselSB_MIPS;
          emit        = (Int(*)(Bool*,UChar*,Int,HInstr*,Bool,
-                               void*,void*,void*,void*))
+                               void*,void*,void*,void*,void*,void*))
                        emit_MIPSInstr;
 #        if defined(VKI_LITTLE_ENDIAN)
          host_is_bigendian = False;
@@ -505,6 +571,8 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          szB_GUEST_IP           = sizeof( ((VexGuestAMD64State*)0)->guest_RIP );
          offB_HOST_EvC_COUNTER  = offsetof(VexGuestAMD64State,host_EvC_COUNTER);
          offB_HOST_EvC_FAILADDR = offsetof(VexGuestAMD64State,host_EvC_FAILADDR);
+         if (vta->disp_cp_ret_fill != NULL)
+            offB_HOST_RetStack = offsetof(VexGuestAMD64State,host_RetStack);
          vassert(are_valid_hwcaps(VexArchAMD64, vta->archinfo_guest.hwcaps));
          vassert(0 == sizeof(VexGuestAMD64State) % 16);
          vassert(sizeof( ((VexGuestAMD64State*)0)->guest_TISTART ) == 8);
@@ -643,6 +711,11 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
    res.n_sc_extents   = 0;
    res.offs_profInc   = -1;
    res.n_guest_instrs = 0;
+   res.n_trace_steps  = 0;
+   res.n_ra_spills    = 0;
+   res.n_ra_reloads   = 0;
+   res.n_ra_moves     = 0;
+   res.n_ra_coalesced = 0;
 
    /* yet more sanity checks ... */
    if (vta->arch_guest == vta->arch_host) {
@@ -654,6 +727,9 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
 
    vexAllocSanityCheck();
 
+   if (vta->read_timer && vta->phase_times)
+      t_last = vta->read_timer();
+
    if (vex_traceflags & VEX_TRACE_FE)
       vex_printf("\n------------------------" 
                    " Front end "
@@ -662,11 +738,13 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
    irsb = bb_to_IR ( vta->guest_extents,
                      &res.n_sc_extents,
                      &res.n_guest_instrs,
+                     &res.n_trace_steps,
                      vta->callback_opaque,
                      disInstrFn,
                      vta->guest_bytes, 
                      vta->guest_bytes_addr,
                      vta->chase_into_ok,
+                     vta->trace_successor,
                      host_is_bigendian,
                      vta->sigill_diag,
                      vta->arch_guest,
@@ -681,6 +759,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
                      szB_GUEST_IP );
 
    vexAllocSanityCheck();
+   charge_phase(vta, &t_last, VexPhase_FrontEnd);
 
    if (irsb == NULL) {
       /* Access failure. */
@@ -720,6 +799,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
                     False/*can be non-flat*/, guest_word_type );
 
    vexAllocSanityCheck();
+   charge_phase(vta, &t_last, VexPhase_FrontEnd);
 
    /* Clean it up, hopefully a lot. */
    irsb = do_iropt_BB ( irsb, specHelper, preciseMemExnsFn, 
@@ -737,6 +817,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
    }
 
    vexAllocSanityCheck();
+   charge_phase(vta, &t_last, VexPhase_Opt1);
 
    /* Get the thing instrumented. */
    if (vta->instrument1)
@@ -766,6 +847,8 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
       sanityCheckIRSB( irsb, "after instrumentation",
                        True/*must be flat*/, guest_word_type );
 
+   charge_phase(vta, &t_last, VexPhase_Instrument);
+
    /* Do a post-instrumentation cleanup pass. */
    if (vta->instrument1 || vta->instrument2) {
       do_deadcode_BB( irsb );
@@ -794,6 +877,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
    }
 
    vexAllocSanityCheck();
+   charge_phase(vta, &t_last, VexPhase_Opt2);
 
    if (vex_traceflags & VEX_TRACE_TREES) {
       vex_printf("\n------------------------" 
@@ -825,11 +909,14 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
                     &vta->abiinfo_both,
                     offB_HOST_EvC_COUNTER,
                     offB_HOST_EvC_FAILADDR,
+                    offB_HOST_RetStack,
+                    guest_layout->offset_SP,
                     chainingAllowed,
                     vta->addProfInc,
                     max_ga );
 
    vexAllocSanityCheck();
+   charge_phase(vta, &t_last, VexPhase_ISel);
 
    if (vex_traceflags & VEX_TRACE_VCODE)
       vex_printf("\n");
@@ -844,14 +931,30 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
    }
 
    /* Register allocate. */
-   rcode = doRegisterAllocation ( vcode, available_real_regs,
-                                  n_available_real_regs,
-                                  isMove, getRegUsage, mapRegs, 
-                                  genSpill, genReload, directReload, 
-                                  guest_sizeB,
-                                  ppInstr, ppReg, mode64 );
+   if (vex_control.regalloc_version == 3) {
+      rcode = doRegisterAllocation_v3 ( vcode, available_real_regs,
+                                        n_available_real_regs,
+                                        isMove, getRegUsage, mapRegs,
+                                        genSpill, genReload, directReload,
+                                        genMove, guest_sizeB,
+                                        ppInstr, ppReg, mode64,
+                                        &ra_stats );
+   } else {
+      rcode = doRegisterAllocation ( vcode, available_real_regs,
+                                     n_available_real_regs,
+                                     isMove, getRegUsage, mapRegs, 
+                                     genSpill, genReload, directReload, 
+                                     guest_sizeB,
+                                     ppInstr, ppReg, mode64,
+                                     &ra_stats );
+   }
+   res.n_ra_spills    = ra_stats.n_spills;
+   res.n_ra_reloads   = ra_stats.n_reloads;
+   res.n_ra_moves     = ra_stats.n_moves;
+   res.n_ra_coalesced = ra_stats.n_coalesced;
 
    vexAllocSanityCheck();
+   charge_phase(vta, &t_last, VexPhase_RegAlloc);
 
    if (vex_traceflags & VEX_TRACE_RCODE) {
       vex_printf("\n------------------------" 
@@ -863,6 +966,9 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          vex_printf("\n");
       }
       vex_printf("\n");
+      vex_printf("spills %d, reloads %d, moves %d, coalesced moves %d\n\n",
+                 ra_stats.n_spills, ra_stats.n_reloads,
+                 ra_stats.n_moves, ra_stats.n_coalesced);
    }
 
    /* HACK */
@@ -892,6 +998,8 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
                 vta->disp_cp_chain_me_to_slowEP,
                 vta->disp_cp_chain_me_to_fastEP,
                 vta->disp_cp_xindir,
+                vta->disp_cp_xindir_icfill,
+                vta->disp_cp_ret_fill,
                 vta->disp_cp_xassisted );
       if (UNLIKELY(vex_traceflags & VEX_TRACE_ASM)) {
          for (k = 0; k < j; k++)
@@ -902,6 +1010,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
          vex_printf("\n\n");
       }
       if (UNLIKELY(out_used + j > vta->host_bytes_size)) {
+         charge_phase(vta, &t_last, VexPhase_Assemble);
          vexSetAllocModeTEMP_and_clear();
          vex_traceflags = 0;
          res.status = VexTransOutputFull;
@@ -924,6 +1033,7 @@ VexTranslateResult LibVEX_Translate ( VexTranslateArgs* vta )
    *(vta->host_bytes_used) = out_used;
 
    vexAllocSanityCheck();
+   charge_phase(vta, &t_last, VexPhase_Assemble);
 
    vexSetAllocModeTEMP_and_clear();
 
@@ -1027,6 +1137,60 @@ VexInvalRange LibVEX_UnChain ( VexArch arch_host,
    return vir;
 }
 
+/* --------- Fill/empty XIndir inline caches. --------- */
+
+VexInvalRange LibVEX_PatchXIndirIC ( VexArch arch_host,
+                                     void*   place_to_patch,
+                                     Addr64  guest_addr,
+                                     void*   host_addr,
+                                     void*   disp_cp_xindir_icfill_EXPECTED,
+                                     void*   disp_cp_xindir )
+{
+   switch (arch_host) {
+      case VexArchAMD64:
+         return patchXIndirIC_AMD64(place_to_patch, guest_addr, host_addr,
+                                    disp_cp_xindir_icfill_EXPECTED,
+                                    disp_cp_xindir);
+      default:
+         vassert(0);
+   }
+}
+
+VexInvalRange LibVEX_UnPatchXIndirIC ( VexArch arch_host,
+                                       void*   place_to_unpatch,
+                                       Addr64  guest_addr_EXPECTED,
+                                       void*   host_addr_EXPECTED,
+                                       void*   disp_cp_xindir_icfill,
+                                       void*   disp_cp_xindir )
+{
+   switch (arch_host) {
+      case VexArchAMD64:
+         return unpatchXIndirIC_AMD64(place_to_unpatch,
+                                      guest_addr_EXPECTED,
+                                      host_addr_EXPECTED,
+                                      disp_cp_xindir_icfill,
+                                      disp_cp_xindir);
+      default:
+         vassert(0);
+   }
+}
+
+/* --------- Fill return-address stack sites. --------- */
+
+VexInvalRange LibVEX_PatchRetSite ( VexArch arch_host,
+                                    void*   place_to_patch,
+                                    void*   host_addr_EXPECTED,
+                                    void*   host_addr )
+{
+   switch (arch_host) {
+      case VexArchAMD64:
+         return patchRetSite_AMD64(place_to_patch,
+                                   host_addr_EXPECTED, host_addr);
+      default:
+         vassert(0);
+   }
+}
+
 Int LibVEX_evCheckSzB ( VexArch arch_host )
 {
    static Int cached = 0; /* DO NOT MAKE NON-STATIC */
@@ -1188,6 +1352,7 @@ void LibVEX_default_VexAbiInfo ( /*OUT*/VexAbiInfo* vbi )
    vbi->guest_stack_redzone_size       = 0;
    vbi->guest_amd64_assume_fs_is_zero  = False;
    vbi->guest_amd64_assume_gs_is_0x60  = False;
+   vbi->guest_amd64_calls_end_blocks   = False;
    vbi->guest_ppc_zap_RZ_at_blr        = False;
    vbi->guest_ppc_zap_RZ_at_bl         = NULL;
    vbi->guest_ppc_sc_continues_at_LR   = False;
@@ -301,6 +301,10 @@ void LibVEX_default_VexArchInfo ( /*OUT*/VexArchInfo* vai );
       guest is amd64-linux                ==> False
       guest is other                      ==> inapplicable
 
+   guest_amd64_calls_end_blocks
+      guest is amd64, and disp_cp_ret_fill is set ==> True
+      guest is other                      ==> inapplicable
+
    guest_ppc_zap_RZ_at_blr
       guest is ppc64-linux                ==> True
       guest is ppc32-linux                ==> False
@@ -349,6 +353,12 @@ typedef
          0x60? */
       Bool guest_amd64_assume_gs_is_0x60;
 
+      /* AMD64 GUESTS only: should direct calls always end the block,
+         rather than sometimes being followed into?  Only calls which
+         end a block push their return address on the return-address
+         shadow stack (see VexTranslateArgs.disp_cp_ret_fill). */
+      Bool guest_amd64_calls_end_blocks;
+
       /* PPC GUESTS only: should we zap the stack red zone at a 'blr'
          (function return) ? */
       Bool guest_ppc_zap_RZ_at_blr;
@@ -435,6 +445,11 @@ typedef
       /* EXPERIMENTAL: chase across conditional branches?  Not all
          front ends honour this.  Default: NO. */
       Bool guest_chase_cond;
+      /* Which register allocator to use: 2 (default) for the one in
+         host_generic_reg_alloc2.c, or 3 for the one in
+         host_generic_reg_alloc3.c, which splits live ranges around
+         fixed register uses and coalesces more moves. */
+      Int regalloc_version;
    }
    VexControl;
 
@@ -606,6 +621,16 @@ typedef
       /* Stats only: the number of guest insns included in the
          translation.  It may be zero (!). */
       UInt n_guest_instrs;
+      /* Stats only: the number of conditional branches along which
+         trace formation carried on (see trace_successor below). */
+      UInt n_trace_steps;
+      /* Stats only: the register allocator's work on the translation:
+         spill stores and reloads generated, reg-reg moves generated
+         to split live ranges, and reg-reg moves removed. */
+      UInt n_ra_spills;
+      UInt n_ra_reloads;
+      UInt n_ra_moves;
+      UInt n_ra_coalesced;
    }
    VexTranslateResult;
 
@@ -627,6 +652,22 @@ typedef
    VexGuestExtents;
 
 
+/* The phases of a translation, for LibVEX_Translate's optional
+   timing of itself (see read_timer/phase_times below). */
+typedef
+   enum {
+      VexPhase_FrontEnd=0, /* disassembly to IR */
+      VexPhase_Opt1,       /* pre-instrumentation IR optimisation */
+      VexPhase_Instrument, /* instrument1 and instrument2 */
+      VexPhase_Opt2,       /* post-instr cleanup, tree building, finaltidy */
+      VexPhase_ISel,       /* instruction selection */
+      VexPhase_RegAlloc,   /* register allocation */
+      VexPhase_Assemble,   /* assembly into host_bytes */
+      VexPhase_N
+   }
+   VexPhase;
+
+
 /* A structure to carry arguments for LibVEX_Translate.  There are so
    many of them, it seems better to have a structure. */
 typedef
@@ -657,6 +698,18 @@ typedef
 	 NULL. */
       Bool    (*chase_into_ok) ( /*callback_opaque*/void*, Addr64 );
 
+      /* IN: optionally, a callback which allows the caller to extend
+         the block along the hotter side of a conditional branch,
+         forming a trace.  May be NULL.  When an instruction ends with
+         a conditional branch whose targets are both known, this is
+         given the taken and the not-taken targets, and returns the
+         one to continue at, or zero to end the block there.  The
+         other target becomes a side exit.  The returned address must
+         also be acceptable to chase_into_ok.  If non-NULL, the front
+         ends' own guesses about conditional branches are not used. */
+      Addr64  (*trace_successor) ( /*callback_opaque*/void*,
+                                   Addr64 taken, Addr64 not_taken );
+
       /* OUT: which bits of guest code actually got translated */
       VexGuestExtents* guest_extents;
 
@@ -712,6 +765,14 @@ typedef
          translation? */
       Bool    addProfInc;
 
+      /* IN: per-translation overrides of VexControl.iropt_level and
+         VexControl.guest_chase_thresh, as given to LibVEX_Init.  -1
+         means use the VexControl value.  This allows a client to make
+         cheap translations of cold code and better ones of hot
+         code. */
+      Int     iropt_level;
+      Int     guest_chase_thresh;
+
       /* IN: address of the dispatcher entry points.  Describes the
          places where generated code should jump to at the end of each
          bb.
@@ -751,6 +812,33 @@ typedef
       void* disp_cp_chain_me_to_fastEP;
       void* disp_cp_xindir;
       void* disp_cp_xassisted;
+
+      /* If non-NULL, indirect exits carry an inline cache of one
+         (guest address, host code) pair, which starts out empty and
+         calls this when executed.  The caller is then expected to
+         fill it in using LibVEX_PatchXIndirIC.  Only supported when
+         the host is amd64, and only if disp_cp_xindir is non-NULL. */
+      void* disp_cp_xindir_icfill;
+
+      /* If non-NULL, calls and returns maintain the return-address
+         shadow stack pointed to by the guest state's host_RetStack
+         (see VexAMD64RetStack).  A call records, as the host code to
+         return to, a word in its own translation which initially
+         holds disp_cp_ret_fill.  When a return jumps there, %r11
+         holds the address of the word, which the caller is expected
+         to fill in using LibVEX_PatchRetSite.  Only supported when
+         guest and host are amd64, and only if disp_cp_xindir is
+         non-NULL. */
+      void* disp_cp_ret_fill;
+
+      /* IN: optionally, a function returning a monotonically
+         increasing tick count, and an array of VexPhase_N counters.
+         If both are non-NULL, the ticks spent in each phase of this
+         translation are added to the corresponding counter.  Phases
+         which are not reached (because the translation failed) are
+         not charged.  Both may be NULL. */
+      ULong (*read_timer) ( void );
+      ULong* phase_times;
    }
    VexTranslateArgs;
 
@@ -806,6 +894,41 @@ VexInvalRange LibVEX_UnChain ( VexArch arch_host,
                                void*   place_to_jump_to_EXPECTED,
                                void*   disp_cp_chain_me );
 
+/* Fill in the empty inline cache of an XIndir located at
+   place_to_patch (as reported by a call to disp_cp_xindir_icfill), so
+   that jumps to guest_addr go directly to host_addr, and other jumps
+   go to disp_cp_xindir.  It is expected (and checked) that the cache
+   is currently empty. */
+extern
+VexInvalRange LibVEX_PatchXIndirIC ( VexArch arch_host,
+                                     void*   place_to_patch,
+                                     Addr64  guest_addr,
+                                     void*   host_addr,
+                                     void*   disp_cp_xindir_icfill_EXPECTED,
+                                     void*   disp_cp_xindir );
+
+/* Undo LibVEX_PatchXIndirIC, so that the cache located at
+   place_to_unpatch is empty again.  It is expected (and checked) that
+   it currently holds guest_addr_EXPECTED and host_addr_EXPECTED. */
+extern
+VexInvalRange LibVEX_UnPatchXIndirIC ( VexArch arch_host,
+                                       void*   place_to_unpatch,
+                                       Addr64  guest_addr_EXPECTED,
+                                       void*   host_addr_EXPECTED,
+                                       void*   disp_cp_xindir_icfill,
+                                       void*   disp_cp_xindir );
+
+/* Change the host code address recorded for the calls in a
+   translation's return-address shadow stack entries (see
+   VexTranslateArgs.disp_cp_ret_fill) from host_addr_EXPECTED, which
+   is checked, to host_addr.  place_to_patch is as reported in %r11
+   when disp_cp_ret_fill is reached. */
+extern
+VexInvalRange LibVEX_PatchRetSite ( VexArch arch_host,
+                                    void*   place_to_patch,
+                                    void*   host_addr_EXPECTED,
+                                    void*   host_addr );
+
 /* Returns a constant -- the size of the event check that is put at
    the start of every translation.  This makes it possible to
    calculate the fast entry point address if the slow entry point
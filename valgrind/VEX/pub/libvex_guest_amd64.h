@@ -164,12 +164,37 @@ typedef
          been interrupted by a signal. */
       ULong guest_IP_AT_SYSCALL;
 
-      /* Padding to make it have an 16-aligned size */
-      ULong pad1;
+      /* Host address of the return-address shadow stack
+         (VexAMD64RetStack, below) used by code generated with
+         VexTranslateArgs.disp_cp_ret_fill set.  Otherwise unused.
+         Also makes the size 16-aligned. */
+      ULong host_RetStack;
    }
    VexGuestAMD64State;
 
 
+/* The return-address shadow stack.  Each guest call made by code
+   generated with VexTranslateArgs.disp_cp_ret_fill set pushes an
+   entry, and each guest return checks the top entry.  If its guest
+   return address is right, the return goes directly to the host code
+   recorded in it.  The stack is a ring, so deep recursion merely
+   overwrites the oldest entries. */
+#define VEX_AMD64_RETSTACK_N 16
+
+typedef
+   struct {
+      ULong top;  /* byte offset in ents[] of the top entry */
+      ULong pad;
+      struct {
+         ULong ra;   /* guest return address, or 1 if empty */
+         ULong sp;   /* guest %rsp just after the call */
+         ULong host; /* host code for ra, as known at the call */
+         ULong site; /* where host was read from */
+      } ents[VEX_AMD64_RETSTACK_N];
+   }
+   VexAMD64RetStack;
+
+
 
 /*---------------------------------------------------------------*/
 /*--- Utility functions for amd64 guest stuff.                ---*/
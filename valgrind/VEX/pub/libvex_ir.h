@@ -1819,6 +1819,12 @@ struct _IRExpr {
 
       /* The value held by a temporary.
          ppIRExpr output: t<tmp>, eg. t1
+
+         NOTE: IRExpr_RdTmp returns the same statically allocated
+         node every time it is called with a given temp (for all but
+         the highest-numbered temps), so one RdTmp node may be
+         referenced from many places in many IRSBs.  Never modify an
+         Iex_RdTmp node in place -- build a new expression instead.
       */
       struct {
          IRTemp tmp;       /* The temporary number */
@@ -1989,6 +1995,8 @@ static inline Bool is_IRExpr_VECRET_or_BBPTR ( IRExpr* e ) {
 extern IRExpr* IRExpr_Binder ( Int binder );
 extern IRExpr* IRExpr_Get    ( Int off, IRType ty );
 extern IRExpr* IRExpr_GetI   ( IRRegArray* descr, IRExpr* ix, Int bias );
+/* Shared: the result must never be modified in place (see Iex.RdTmp
+   above). */
 extern IRExpr* IRExpr_RdTmp  ( IRTemp tmp );
 extern IRExpr* IRExpr_Qop    ( IROp op, IRExpr* arg1, IRExpr* arg2, 
                                         IRExpr* arg3, IRExpr* arg4 );
@@ -1166,6 +1166,7 @@ inline static Int find_nsegment_idx ( Addr a )
    static UWord n_m = 0;
 
    UWord ix;
+   Int   segidx;
 
    if (LIKELY(cache_inited)) {
       /* do nothing */
@@ -1183,20 +1184,25 @@ inline static Int find_nsegment_idx ( Addr a )
    if (0 && 0 == (n_q & 0xFFFF))
       VG_(debugLog)(0,"xxx","find_nsegment_idx: %lu %lu\n", n_q, n_m);
 
+   /* The cache may be updated concurrently by helper threads started
+      with VG_(run_in_parallel), so read the index just once, and check
+      that it is right before returning it. */
+   segidx = cache_segidx[ix];
    if ((a >> 12) == cache_pageno[ix]
-       && cache_segidx[ix] >= 0
-       && cache_segidx[ix] < nsegments_used
-       && nsegments[cache_segidx[ix]].start <= a
-       && a <= nsegments[cache_segidx[ix]].end) {
+       && segidx >= 0
+       && segidx < nsegments_used
+       && nsegments[segidx].start <= a
+       && a <= nsegments[segidx].end) {
       /* hit */
-      /* aspacem_assert( cache_segidx[ix] == find_nsegment_idx_WRK(a) ); */
-      return cache_segidx[ix];
+      /* aspacem_assert( segidx == find_nsegment_idx_WRK(a) ); */
+      return segidx;
    }
    /* miss */
    n_m++;
-   cache_segidx[ix] = find_nsegment_idx_WRK(a);
+   segidx = find_nsegment_idx_WRK(a);
+   cache_segidx[ix] = segidx;
    cache_pageno[ix] = a >> 12;
-   return cache_segidx[ix];
+   return segidx;
 #  undef N_CACHE
 }
 
@@ -482,7 +482,7 @@ Bool VG_(is_watched)(PointKind kind, Addr addr, Int szB)
 }
 
 /* Returns the reason for which gdbserver instrumentation is needed */
-static VgVgdb VG_(gdbserver_instrumentation_needed) (VexGuestExtents* vge)
+VgVgdb VG_(gdbserver_instrumentation_needed) (VexGuestExtents* vge)
 {
    GS_Address* g;
    int e;
@@ -1,6 +1,6 @@
 
 /*--------------------------------------------------------------------*/
-/*--- A separately-chained hash table.               m_hashtable.c ---*/
+/*--- A hash table with linear probing.              m_hashtable.c ---*/
 /*--------------------------------------------------------------------*/
 
 /*
@@ -38,27 +38,49 @@
 /*--- Declarations                                                 ---*/
 /*--------------------------------------------------------------------*/
 
-#define CHAIN_NO(key,tbl) (((UWord)(key)) % tbl->n_chains)
+/* The table is an array of slots, searched by linear probing.  Each
+   slot holds a node's key as well as a pointer to the node, so that a
+   lookup reads only the slot array, usually a single cache line of it,
+   and touches no node but the one it finds.  There are no tombstones:
+   HT_remove moves later entries of a run back into the hole. */
+
+typedef
+   struct {
+      UWord        key;
+      VgHashNode*  node;    // NULL if the slot is empty
+   }
+   Slot;
 
 struct _VgHashTable {
-   UInt         n_chains;   // should be prime
+   UInt         n_slots;    // a power of 2
+   UInt         shift;      // bits per word - log2(n_slots)
    UInt         n_elements;
-   VgHashNode*  iterNode;   // current iterator node
-   UInt         iterChain;  // next chain to be traversed by the iterator
-   VgHashNode** chains;     // expanding array of hash chains
+   UInt         iterSlot;   // next slot to be looked at by the iterator
+   UInt         iterCount;  // nodes returned by the iterator so far
+   Slot*        slots;
    Bool         iterOK;     // table safe to iterate over?
    const HChar* name;       // name of table (for debugging only)
 };
 
-#define N_HASH_PRIMES 20
+#define N_INITIAL_SLOTS_LOG2 10
 
-static SizeT primes[N_HASH_PRIMES] = {
-         769UL,         1543UL,         3079UL,          6151UL,
-       12289UL,        24593UL,        49157UL,         98317UL,
-      196613UL,       393241UL,       786433UL,       1572869UL,
-     3145739UL,      6291469UL,     12582917UL,      25165843UL,
-    50331653UL,    100663319UL,    201326611UL,     402653189UL
-};
+/* The table is doubled in size when it would become more than 3/4
+   full. */
+#define TOO_FULL(n_elements, n_slots) \
+   (4 * (ULong)(n_elements) > 3 * (ULong)(n_slots))
+
+/* The slot at which to start looking for key.  Keys are often
+   addresses whose low bits are all zero, so multiply by 2^wordsize
+   divided by the golden ratio to spread them into the high bits, and
+   use those. */
+static inline UInt home_slot ( VgHashTable table, UWord key )
+{
+#  if VG_WORDSIZE == 8
+   return (UInt)((key * 0x9E3779B97F4A7C15ULL) >> table->shift);
+#  else
+   return (UInt)((key * 0x9E3779B9U) >> table->shift);
+#  endif
+}
 
 /*--------------------------------------------------------------------*/
 /*--- Functions                                                    ---*/
@@ -66,13 +88,14 @@ static SizeT primes[N_HASH_PRIMES] = {
 
 VgHashTable VG_(HT_construct) ( const HChar* name )
 {
-   /* Initialises to zero, ie. all entries NULL */
-   SizeT       n_chains = primes[0];
-   SizeT       sz       = n_chains * sizeof(VgHashNode*);
+   /* Initialises to zero, ie. all slots empty */
+   SizeT       n_slots  = 1 << N_INITIAL_SLOTS_LOG2;
    VgHashTable table    = VG_(calloc)("hashtable.Hc.1",
                                       1, sizeof(struct _VgHashTable));
-   table->chains        = VG_(calloc)("hashtable.Hc.2", 1, sz);
-   table->n_chains      = n_chains;
+   table->slots         = VG_(calloc)("hashtable.Hc.2", n_slots,
+                                      sizeof(Slot));
+   table->n_slots       = n_slots;
+   table->shift         = 8 * sizeof(UWord) - N_INITIAL_SLOTS_LOG2;
    table->n_elements    = 0;
    table->iterOK        = True;
    table->name          = name;
@@ -85,109 +108,132 @@ Int VG_(HT_count_nodes) ( VgHashTable table )
    return table->n_elements;
 }
 
-static void resize ( VgHashTable table )
+/* Put node in the first empty slot at or after its home slot. */
+static void append ( VgHashTable table, VgHashNode* node )
 {
-   Int          i;
-   SizeT        sz;
-   SizeT        old_chains = table->n_chains;
-   SizeT        new_chains = old_chains + 1;
-   VgHashNode** chains;
-   VgHashNode * node;
-
-   /* If we've run out of primes, do nothing. */
-   if (old_chains == primes[N_HASH_PRIMES-1])
-      return;
-
-   vg_assert(old_chains >= primes[0] 
-             && old_chains < primes[N_HASH_PRIMES-1]);
-
-   for (i = 0; i < N_HASH_PRIMES; i++) {
-      if (primes[i] > new_chains) {
-         new_chains = primes[i];
-         break;
-      }
-   }
+   UInt mask = table->n_slots - 1;
+   UInt i    = home_slot(table, node->key);
 
-   vg_assert(new_chains > old_chains);
-   vg_assert(new_chains > primes[0] 
-             && new_chains <= primes[N_HASH_PRIMES-1]);
+   while (table->slots[i].node != NULL)
+      i = (i + 1) & mask;
+   table->slots[i].key  = node->key;
+   table->slots[i].node = node;
+}
+
+static void resize ( VgHashTable table )
+{
+   UInt  i, k, start;
+   UInt  old_n_slots = table->n_slots;
+   Slot* old_slots   = table->slots;
 
    VG_(debugLog)(
       1, "hashtable",
          "resizing table `%s' from %lu to %lu (total elems %lu)\n",
-         table->name, (UWord)old_chains, (UWord)new_chains,
+         table->name, (UWord)old_n_slots, 2 * (UWord)old_n_slots,
          (UWord)table->n_elements );
 
-   table->n_chains = new_chains;
-   sz = new_chains * sizeof(VgHashNode*);
-   chains = VG_(calloc)("hashtable.resize.1", 1, sz);
-
-   for (i = 0; i < old_chains; i++) {
-      node = table->chains[i];
-      while (node != NULL) {
-         VgHashNode* next = node->next;
-         UWord chain = CHAIN_NO(node->key, table);
-         node->next = chains[chain];
-         chains[chain] = node;
-         node = next;
-      }
+   vg_assert(old_n_slots < (1U << 31));
+   table->n_slots = 2 * old_n_slots;
+   table->shift--;
+   table->slots = VG_(calloc)("hashtable.resize.1", table->n_slots,
+                              sizeof(Slot));
+
+   /* Move the nodes over a run at a time, starting just after an empty
+      slot, so that nodes with the same key stay in the same order. */
+   for (start = 0; old_slots[start].node != NULL; start++)
+      ;
+   for (k = 1; k <= old_n_slots; k++) {
+      i = (start + k) & (old_n_slots - 1);
+      if (old_slots[i].node != NULL)
+         append(table, old_slots[i].node);
    }
 
-   VG_(free)(table->chains);
-   table->chains = chains;
+   VG_(free)(old_slots);
 }
 
-/* Puts a new, heap allocated VgHashNode, into the VgHashTable.  Prepends
-   the node to the appropriate chain.  No duplicate key detection is done. */
+/* Puts a new, heap allocated VgHashNode, into the VgHashTable.  No
+   duplicate key detection is done, but the node is put ahead of any
+   others with the same key. */
 void VG_(HT_add_node) ( VgHashTable table, void* vnode )
 {
-   VgHashNode* node     = (VgHashNode*)vnode;
-   UWord chain          = CHAIN_NO(node->key, table);
-   node->next           = table->chains[chain];
-   table->chains[chain] = node;
-   table->n_elements++;
-   if ( (1 * (ULong)table->n_elements) > (1 * (ULong)table->n_chains) ) {
+   VgHashNode* node = (VgHashNode*)vnode;
+   UInt        mask, i;
+
+   if (TOO_FULL(table->n_elements + 1, table->n_slots))
       resize(table);
+
+   mask = table->n_slots - 1;
+   i    = home_slot(table, node->key);
+   while (table->slots[i].node != NULL) {
+      if (table->slots[i].key == node->key) {
+         /* Take the place of the older node, and move it (and so all
+            the older ones) further along. */
+         VgHashNode* older = table->slots[i].node;
+         table->slots[i].node = node;
+         node = older;
+      }
+      i = (i + 1) & mask;
    }
+   table->slots[i].key  = node->key;
+   table->slots[i].node = node;
+   table->n_elements++;
 
    /* Table has been modified; hence HT_Next should assert. */
    table->iterOK = False;
 }
 
+/* Returns the slot holding the first node with key, or -1. */
+static Int find_slot ( VgHashTable table, UWord key )
+{
+   UInt mask = table->n_slots - 1;
+   UInt i    = home_slot(table, key);
+
+   while (table->slots[i].node != NULL) {
+      if (table->slots[i].key == key)
+         return i;
+      i = (i + 1) & mask;
+   }
+   return -1;
+}
+
 /* Looks up a VgHashNode in the table.  Returns NULL if not found. */
 void* VG_(HT_lookup) ( VgHashTable table, UWord key )
 {
-   VgHashNode* curr = table->chains[ CHAIN_NO(key, table) ];
+   Int i = find_slot(table, key);
 
-   while (curr) {
-      if (key == curr->key) {
-         return curr;
-      }
-      curr = curr->next;
-   }
-   return NULL;
+   return i == -1 ? NULL : table->slots[i].node;
 }
 
 /* Removes a VgHashNode from the table.  Returns NULL if not found. */
 void* VG_(HT_remove) ( VgHashTable table, UWord key )
 {
-   UWord        chain         = CHAIN_NO(key, table);
-   VgHashNode*  curr          =   table->chains[chain];
-   VgHashNode** prev_next_ptr = &(table->chains[chain]);
+   UInt        mask = table->n_slots - 1;
+   Int         i    = find_slot(table, key);
+   UInt        hole, j;
+   VgHashNode* node;
 
    /* Table has been modified; hence HT_Next should assert. */
    table->iterOK = False;
 
-   while (curr) {
-      if (key == curr->key) {
-         *prev_next_ptr = curr->next;
-         table->n_elements--;
-         return curr;
+   if (i == -1)
+      return NULL;
+   node = table->slots[i].node;
+
+   /* Move back into the hole each later node of the run which may live
+      there, ie. whose home slot is not between the hole and it, so that
+      every node can still be found without passing an empty slot. */
+   hole = i;
+   for (j = (hole + 1) & mask; table->slots[j].node != NULL;
+        j = (j + 1) & mask) {
+      UInt home = home_slot(table, table->slots[j].key);
+      if (((j - home) & mask) >= ((j - hole) & mask)) {
+         table->slots[hole] = table->slots[j];
+         hole = j;
       }
-      prev_next_ptr = &(curr->next);
-      curr = curr->next;
    }
-   return NULL;
+   table->slots[hole].node = NULL;
+   table->n_elements--;
+   return node;
 }
 
 /* Allocates a suitably-sized array, copies pointers to all the hashtable
@@ -198,7 +244,6 @@ VgHashNode** VG_(HT_to_array) ( VgHashTable table, /*OUT*/ UInt* n_elems )
 {
    UInt       i, j;
    VgHashNode** arr;
-   VgHashNode*  node;
 
    *n_elems = table->n_elements;
    if (*n_elems == 0)
@@ -207,10 +252,9 @@ VgHashNode** VG_(HT_to_array) ( VgHashTable table, /*OUT*/ UInt* n_elems )
    arr = VG_(malloc)( "hashtable.Hta.1", *n_elems * sizeof(VgHashNode*) );
 
    j = 0;
-   for (i = 0; i < table->n_chains; i++) {
-      for (node = table->chains[i]; node != NULL; node = node->next) {
-         arr[j++] = node;
-      }
+   for (i = 0; i < table->n_slots; i++) {
+      if (table->slots[i].node != NULL)
+         arr[j++] = table->slots[i].node;
    }
    vg_assert(j == *n_elems);
 
@@ -220,47 +264,45 @@ VgHashNode** VG_(HT_to_array) ( VgHashTable table, /*OUT*/ UInt* n_elems )
 void VG_(HT_ResetIter)(VgHashTable table)
 {
    vg_assert(table);
-   table->iterNode  = NULL;
-   table->iterChain = 0;
+   table->iterSlot  = 0;
+   table->iterCount = 0;
    table->iterOK    = True;
 }
 
 void* VG_(HT_Next)(VgHashTable table)
 {
-   Int i;
+   UInt i;
    vg_assert(table);
    /* See long comment on HT_Next prototype in pub_tool_hashtable.h.
       In short if this fails, it means the caller tried to modify the
       table whilst iterating over it, which is a bug. */
    vg_assert(table->iterOK);
 
-   if (table->iterNode && table->iterNode->next) {
-      table->iterNode = table->iterNode->next;
-      return table->iterNode;
-   }
-
-   for (i = table->iterChain; i < table->n_chains; i++) {
-      if (table->chains[i]) {
-         table->iterNode  = table->chains[i];
-         table->iterChain = i + 1;  // Next chain to be traversed
-         return table->iterNode;
+   /* Stop as soon as all the nodes have been returned, rather than
+      looking at the empty slots after the last one; tools iterate over
+      tables that are usually empty, such as the mempool list, often. */
+   if (table->iterCount < table->n_elements) {
+      for (i = table->iterSlot; i < table->n_slots; i++) {
+         if (table->slots[i].node != NULL) {
+            table->iterSlot = i + 1;  // Next slot to be looked at
+            table->iterCount++;
+            return table->slots[i].node;
+         }
       }
    }
+   table->iterSlot = table->n_slots;
    return NULL;
 }
 
 void VG_(HT_destruct)(VgHashTable table, void(*freenode_fn)(void*))
 {
-   UInt       i;
-   VgHashNode *node, *node_next;
+   UInt i;
 
-   for (i = 0; i < table->n_chains; i++) {
-      for (node = table->chains[i]; node != NULL; node = node_next) {
-         node_next = node->next;
-         freenode_fn(node);
-      }
+   for (i = 0; i < table->n_slots; i++) {
+      if (table->slots[i].node != NULL)
+         freenode_fn(table->slots[i].node);
    }
-   VG_(free)(table->chains);
+   VG_(free)(table->slots);
    VG_(free)(table);
 }
 
@@ -901,6 +901,31 @@ Int VG_(socket) ( Int domain, Int type, Int protocol )
 #  endif
 }
 
+Int VG_(socketpair) ( Int domain, Int type, Int protocol, Int sv[2] )
+{
+#  if defined(VGP_x86_linux) || defined(VGP_ppc32_linux) \
+      || defined(VGP_ppc64_linux) || defined(VGP_s390x_linux)
+   SysRes res;
+   UWord  args[4];
+   args[0] = domain;
+   args[1] = type;
+   args[2] = protocol;
+   args[3] = (UWord)sv;
+   res = VG_(do_syscall2)(__NR_socketcall, VKI_SYS_SOCKETPAIR, (UWord)&args);
+   return sr_isError(res) ? -1 : 0;
+
+#  elif defined(VGP_amd64_linux) || defined(VGP_arm_linux) \
+        || defined(VGP_mips32_linux) || defined(VGP_mips64_linux) \
+        || defined(VGO_darwin)
+   SysRes res;
+   res = VG_(do_syscall4)(__NR_socketpair, domain, type, protocol, (UWord)sv);
+   return sr_isError(res) ? -1 : 0;
+
+#  else
+#    error "Unknown arch"
+#  endif
+}
+
 
 static
 Int my_connect ( Int sockfd, struct vki_sockaddr_in* serv_addr, Int addrlen )
@@ -30,6 +30,7 @@
 
 #include "pub_core_basics.h"
 #include "pub_core_machine.h"    // For VG_(machine_get_VexArchInfo)
+#include "pub_core_aspacemgr.h"  // For helper thread stacks
 #include "pub_core_vki.h"
 #include "pub_core_vkiscnums.h"
 #include "pub_core_libcbase.h"
@@ -606,14 +607,123 @@ Int VG_(fork) ( void )
 #  endif
 }
 
+/* ---------------------------------------------------------------------
+   Helper threads
+   ------------------------------------------------------------------ */
+
+#if defined(VGP_amd64_linux)
+
+/* In m_syswrap/syswrap-amd64-linux.c. */
+extern
+Long do_syscall_clone_amd64_linux ( Word (*fn)(void *),
+                                    void* stack,
+                                    Long  flags,
+                                    void* arg,
+                                    Long* child_tid,
+                                    Long* parent_tid,
+                                    vki_modify_ldt_t * );
+
+#define HELPER_STACK_SZB  (1024 * 1024)
+
+typedef
+   struct {
+      void (*fn)(void*, Int);
+      void* arg;
+      Int   index;
+      /* Set by the kernel to the thread's id when it is created, and
+         cleared (with a futex wake) once it has exited. */
+      volatile Int tid;
+   }
+   HelperThread;
+
+static Word helper_thread_main ( void* p )
+{
+   HelperThread* h = p;
+   h->fn(h->arg, h->index);
+   return 0;
+}
+
+#endif
+
+Int VG_(run_in_parallel) ( Int n, void (*fn)(void* arg, Int index),
+                           void* arg )
+{
+#  if defined(VGP_amd64_linux)
+   HelperThread* hs;
+   Addr          stacks = 0;
+   Int           i, n_started = 0;
+   vki_sigset_t  all, saved;
+   SysRes        sres;
+
+   if (n > VG_MAX_PARALLEL)
+      n = VG_MAX_PARALLEL;
+   if (n <= 1) {
+      fn(arg, 0);
+      return 1;
+   }
+
+   hs = VG_(malloc)("libcproc.rip.1", (n-1) * sizeof(HelperThread));
+   sres = VG_(am_mmap_anon_float_valgrind)( (n-1) * HELPER_STACK_SZB );
+   if (!sr_isError(sres))
+      stacks = sr_Res(sres);
+
+   /* The helpers start with every signal blocked, so that all signals
+      continue to be taken by the Valgrind threads. */
+   VG_(sigfillset)(&all);
+   VG_(sigprocmask)(VKI_SIG_SETMASK, &all, &saved);
+   for (i = 0; stacks != 0 && i < n-1; i++) {
+      HelperThread* h = &hs[i];
+      Long          res;
+
+      h->fn    = fn;
+      h->arg   = arg;
+      h->index = i+1;
+      h->tid   = 0;
+      res = do_syscall_clone_amd64_linux(
+               helper_thread_main,
+               (void*)(stacks + (i+1) * HELPER_STACK_SZB),
+               VKI_CLONE_VM | VKI_CLONE_FS | VKI_CLONE_FILES
+               | VKI_CLONE_SIGHAND | VKI_CLONE_THREAD | VKI_CLONE_SYSVSEM
+               | VKI_CLONE_PARENT_SETTID | VKI_CLONE_CHILD_CLEARTID,
+               h, (Long*)&h->tid, (Long*)&h->tid, NULL);
+      if (res < 0)
+         break;
+      n_started++;
+   }
+   VG_(sigprocmask)(VKI_SIG_SETMASK, &saved, NULL);
+
+   fn(arg, 0);
+
+   for (i = 0; i < n_started; i++) {
+      Int tid;
+      while ((tid = hs[i].tid) != 0)
+         VG_(do_syscall4)(__NR_futex, (UWord)&hs[i].tid, VKI_FUTEX_WAIT,
+                          tid, 0);
+   }
+
+   if (stacks != 0)
+      VG_(am_munmap_valgrind)( stacks, (n-1) * HELPER_STACK_SZB );
+   VG_(free)(hs);
+   return n_started + 1;
+
+#  else
+   fn(arg, 0);
+   return 1;
+#  endif
+}
+
+void VG_(yield_cpu) ( void )
+{
+   (void)VG_(do_syscall0)(__NR_sched_yield);
+}
+
 /* ---------------------------------------------------------------------
    Timing stuff
    ------------------------------------------------------------------ */
 
-UInt VG_(read_millisecond_timer) ( void )
+/* Microseconds since some arbitrary point in the past. */
+static ULong read_microsecond_clock ( void )
 {
-   /* 'now' and 'base' are in microseconds */
-   static ULong base = 0;
    ULong  now;
 
 #  if defined(VGO_linux)
@@ -647,13 +757,46 @@ UInt VG_(read_millisecond_timer) ( void )
 #    error "Unknown OS"
 #  endif
 
-   /* COMMON CODE */  
+   return now;
+}
+
+UInt VG_(read_millisecond_timer) ( void )
+{
+   /* 'now' and 'base' are in microseconds */
+   static ULong base = 0;
+   ULong  now = read_microsecond_clock();
+
    if (base == 0)
       base = now;
 
    return (now - base) / 1000;
 }
 
+/* A cheap, fine-grained tick count for timing short stretches of
+   Valgrind's own work.  On x86 and amd64 this is the CPU's time stamp
+   counter, so it counts cycles (at the nominal frequency) and does not
+   need a syscall.  Elsewhere it falls back to microseconds.
+   VG_(cycle_counter_unit) names the unit, for printing. */
+ULong VG_(read_cycle_counter) ( void )
+{
+#  if defined(VGA_x86) || defined(VGA_amd64)
+   UInt lo, hi;
+   __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+   return (((ULong)hi) << 32) | (ULong)lo;
+#  else
+   return read_microsecond_clock();
+#  endif
+}
+
+const HChar* VG_(cycle_counter_unit) ( void )
+{
+#  if defined(VGA_x86) || defined(VGA_amd64)
+   return "cycles";
+#  else
+   return "usecs";
+#  endif
+}
+
 
 /* ---------------------------------------------------------------------
    atfork()
@@ -50,6 +50,7 @@
 #include "pub_core_libcproc.h"
 #include "pub_core_libcsignal.h"
 #include "pub_core_sbprofile.h"
+#include "pub_core_selfprofile.h"
 #include "pub_core_syscall.h"       // VG_(strerror)
 #include "pub_core_mach.h"
 #include "pub_core_machine.h"
@@ -66,6 +67,8 @@
 #include "pub_core_translate.h"     // For VG_(translate)
 #include "pub_core_trampoline.h"
 #include "pub_core_transtab.h"
+#include "pub_core_pretranslate.h"
+#include "pub_core_transcache.h"
 #include "pub_core_inner.h"
 #if defined(ENABLE_INNER_CLIENT_REQUEST)
 #include "pub_core_clreq.h"
@@ -80,6 +83,8 @@ static void print_all_stats ( void )
 {
    VG_(print_translation_stats)();
    VG_(print_tt_tc_stats)();
+   VG_(print_transcache_stats)();
+   VG_(print_pretranslate_stats)();
    VG_(print_scheduler_stats)();
    VG_(print_ExeContext_stats)( False /* with_stacktraces */ );
    VG_(print_errormgr_stats)();
@@ -202,6 +207,25 @@ static void usage_NORETURN ( Bool debug_help )
 "           program counters in max <number> frames) [0]\n"
 "    --num-transtab-sectors=<number> size of translated code cache [%d]\n"
 "           more sectors may increase performance, but use more memory.\n"
+"    --generational-transtab=no|yes  keep frequently executed code when\n"
+"           the translated code cache is recycled [no]\n"
+"    --translation-cache-dir=<dir>  keep translations in <dir> between runs,\n"
+"           for tools that support it [none]\n"
+"    --tiered-translation=no|yes  translate code cheaply at first, and\n"
+"           retranslate frequently executed code more thoroughly [no]\n"
+"    --tiered-translation-thresh=<number>  executions after which a\n"
+"           block is retranslated [%d]\n"
+"    --trace-formation=no|yes  extend retranslated blocks along the more\n"
+"           frequently executed side of conditional branches [no]\n"
+"    --parallel-exec=no|yes    run threads in parallel, for tools that\n"
+"           support it; disables gdbserver (amd64-linux only) [no]\n"
+"    --pretranslate=no|yes     translate likely successors of new code\n"
+"           ahead of time in a helper process, for tools that\n"
+"           support it (Linux only) [no]\n"
+"    --indirect-branch-cache=no|yes  make indirect jumps in translated\n"
+"           code remember their target (amd64-linux only) [no]\n"
+"    --return-stack=no|yes     predict returns in translated code using a\n"
+"           shadow stack of return addresses (amd64-linux only) [no]\n"
 "    --show-emwarns=no|yes     show warnings about emulation limits? [no]\n"
 "    --require-text-symbol=:sonamepattern:symbolpattern    abort run if the\n"
 "                              stated shared object doesn't have the stated\n"
@@ -229,6 +253,13 @@ static void usage_NORETURN ( Bool debug_help )
 "    --profile-flags=<XXXXXXXX> ditto, but for profiling (X = 0|1) [00000000]\n"
 "    --profile-interval=<number> show profile every <number> event checks\n"
 "                                [0, meaning only at the end of the run]\n"
+"    --profile-translation=no|yes  show where translation time and generated\n"
+"                              code go, by JIT phase, object and function [no]\n"
+"    --self-profile=no|yes     sample where Valgrind itself spends its time\n"
+"                              and write a callgrind-format profile (Linux\n"
+"                              only) [no]\n"
+"    --self-profile-out-file=<file>  where to write it\n"
+"                              [valgrind-self.out.%p]\n"
 "    --trace-notbelow=<number> only show BBs above <number> [999999999]\n"
 "    --trace-notabove=<number> only show BBs below <number> [0]\n"
 "    --trace-syscalls=no|yes   show all system calls? [no]\n"
@@ -259,6 +290,7 @@ static void usage_NORETURN ( Bool debug_help )
 "    --vex-guest-max-insns=<1..100>         [50]\n"
 "    --vex-guest-chase-thresh=<0..99>       [10]\n"
 "    --vex-guest-chase-cond=no|yes          [no]\n"
+"    --vex-regalloc-version=2|3             [2]\n"
 "    --trace-flags and --profile-flags values (omit the middle space):\n"
 "       1000 0000   show conversion into IR\n"
 "       0100 0000   show after initial opt\n"
@@ -314,7 +346,8 @@ static void usage_NORETURN ( Bool debug_help )
                default_redzone_size       /* char* */,
                VG_(clo_vgdb_poll)         /* int */,
                VG_(vgdb_prefix_default)() /* char* */,
-               N_SECTORS_DEFAULT          /* int */
+               N_SECTORS_DEFAULT          /* int */,
+               VG_(clo_tiered_translation_thresh) /* int */
                ); 
    if (VG_(details).name) {
       VG_(printf)("  user options for %s:\n", VG_(details).name);
@@ -563,6 +596,21 @@ void main_process_cmd_line_options ( /*OUT*/Bool* logging_to_fd,
       else if VG_INT_CLO (arg, "--vgdb-poll",      VG_(clo_vgdb_poll)) {}
       else if VG_INT_CLO (arg, "--vgdb-error",     VG_(clo_vgdb_error)) {}
       else if VG_STR_CLO (arg, "--vgdb-prefix",    VG_(clo_vgdb_prefix)) {}
+      else if VG_STR_CLO (arg, "--translation-cache-dir",
+                          VG_(clo_translation_cache_dir)) {}
+      else if VG_BOOL_CLO(arg, "--tiered-translation",
+                          VG_(clo_tiered_translation)) {}
+      else if VG_BINT_CLO(arg, "--tiered-translation-thresh",
+                          VG_(clo_tiered_translation_thresh), 1, 1000000000) {}
+      else if VG_BOOL_CLO(arg, "--trace-formation",
+                          VG_(clo_trace_formation)) {}
+      else if VG_BOOL_CLO(arg, "--parallel-exec",  VG_(clo_parallel_exec)) {}
+      else if VG_BOOL_CLO(arg, "--pretranslate",   VG_(clo_pretranslate)) {}
+      else if VG_BOOL_CLO(arg, "--generational-transtab",
+                          VG_(clo_generational_transtab)) {}
+      else if VG_BOOL_CLO(arg, "--indirect-branch-cache",
+                          VG_(clo_indirect_branch_cache)) {}
+      else if VG_BOOL_CLO(arg, "--return-stack",   VG_(clo_return_stack)) {}
       else if VG_BOOL_CLO(arg, "--vgdb-shadow-registers",
                             VG_(clo_vgdb_shadow_registers)) {}
       else if VG_BOOL_CLO(arg, "--db-attach",      VG_(clo_db_attach)) {}
@@ -668,6 +716,8 @@ void main_process_cmd_line_options ( /*OUT*/Bool* logging_to_fd,
                        VG_(clo_vex_control).guest_chase_thresh, 0, 99) {}
       else if VG_BOOL_CLO(arg, "--vex-guest-chase-cond",
                        VG_(clo_vex_control).guest_chase_cond) {}
+      else if VG_BINT_CLO(arg, "--vex-regalloc-version",
+                       VG_(clo_vex_control).regalloc_version, 2, 3) {}
 
       else if VG_INT_CLO(arg, "--log-fd", tmp_log_fd) {
          log_to = VgLogTo_Fd;
@@ -795,6 +845,11 @@ void main_process_cmd_line_options ( /*OUT*/Bool* logging_to_fd,
 
       else if VG_INT_CLO (arg, "--profile-interval",
                           VG_(clo_profyle_interval)) {}
+      else if VG_BOOL_CLO(arg, "--profile-translation",
+                          VG_(clo_profile_translation)) {}
+      else if VG_BOOL_CLO(arg, "--self-profile", VG_(clo_self_profile)) {}
+      else if VG_STR_CLO (arg, "--self-profile-out-file",
+                          VG_(clo_self_profile_out_file)) {}
 
       else if VG_XACT_CLO(arg, "--gen-suppressions=no",
                                VG_(clo_gen_suppressions), 0) {}
@@ -858,6 +913,93 @@ void main_process_cmd_line_options ( /*OUT*/Bool* logging_to_fd,
 
    VG_(dyn_vgdb_error) = VG_(clo_vgdb_error);
 
+   /* Tiered translation counts block executions using the same
+      counters as --profile-flags. */
+   if (VG_(clo_tiered_translation) && VG_(clo_profyle_sbs)) {
+      VG_(fmsg_bad_option)("--tiered-translation=yes",
+         "Can't use --tiered-translation=yes with --profile-flags=\n");
+   }
+
+   /* Traces are formed using the first-tier translations' counts. */
+   if (VG_(clo_trace_formation) && !VG_(clo_tiered_translation)) {
+      VG_(fmsg_bad_option)("--trace-formation=yes",
+         "--trace-formation=yes requires --tiered-translation=yes\n");
+   }
+
+   /* Parallel execution needs a thread-safe tool, a dispatcher which
+      uses a per-thread fast cache, and no gdbserver,
+      which assumes that only one thread runs at a time. */
+   if (VG_(clo_parallel_exec)) {
+#     if !defined(VGP_amd64_linux)
+      VG_(fmsg_bad_option)("--parallel-exec=yes",
+         "--parallel-exec=yes is not supported on this platform.\n");
+#     endif
+      if (!VG_(needs).parallel_execution)
+         VG_(fmsg_bad_option)("--parallel-exec=yes",
+            "%s does not support parallel execution.\n", VG_(details).name);
+      if (VG_(clo_vgdb) == Vg_VgdbFull)
+         VG_(fmsg_bad_option)("--parallel-exec=yes",
+            "Can't use --parallel-exec=yes with --vgdb=full\n");
+      VG_(clo_vgdb) = Vg_VgdbNo;
+   }
+
+   /* Pre-translated code is handed over via the translation cache,
+      so the same restrictions apply.  Also, the helper process can't
+      see the execution counts that tiering relies on. */
+   if (VG_(clo_pretranslate)) {
+#     if !defined(VGO_linux)
+      VG_(fmsg_bad_option)("--pretranslate=yes",
+         "--pretranslate=yes is not supported on this platform.\n");
+#     endif
+      if (!VG_(needs).persistent_translations)
+         VG_(fmsg_bad_option)("--pretranslate=yes",
+            "%s does not support pre-translation.\n", VG_(details).name);
+      if (VG_(clo_profyle_sbs) || VG_(clo_tiered_translation)
+          || VG_(clo_generational_transtab))
+         VG_(fmsg_bad_option)("--pretranslate=yes",
+            "Can't use --pretranslate=yes with --profile-flags=, "
+            "--tiered-translation=yes\n"
+            "or --generational-transtab=yes\n");
+      /* The helpers' translation work is not seen by the profile. */
+      if (VG_(clo_profile_translation))
+         VG_(fmsg_bad_option)("--pretranslate=yes",
+            "Can't use --pretranslate=yes with "
+            "--profile-translation=yes\n");
+   }
+
+   /* Only the amd64 code generator and dispatcher know how to make
+      and fill inline caches. */
+   if (VG_(clo_indirect_branch_cache)) {
+#     if !defined(VGP_amd64_linux)
+      VG_(fmsg_bad_option)("--indirect-branch-cache=yes",
+         "--indirect-branch-cache=yes is not supported on this platform.\n");
+#     endif
+   }
+
+   /* Likewise the return-address stack. */
+   if (VG_(clo_return_stack)) {
+#     if !defined(VGP_amd64_linux)
+      VG_(fmsg_bad_option)("--return-stack=yes",
+         "--return-stack=yes is not supported on this platform.\n");
+#     endif
+   }
+
+   /* The sampler needs perf_event_open or thread CPU-time timers. */
+   if (VG_(clo_self_profile)) {
+#     if !defined(VGO_linux)
+      VG_(fmsg_bad_option)("--self-profile=yes",
+         "--self-profile=yes is not supported on this platform.\n");
+#     endif
+   }
+
+   /* Translations with execution counters can't be saved. */
+   if (VG_(clo_generational_transtab)
+       && VG_(clo_translation_cache_dir) != NULL) {
+      VG_(fmsg_bad_option)("--generational-transtab=yes",
+         "Can't use --generational-transtab=yes "
+         "with --translation-cache-dir=\n");
+   }
+
    if (VG_(clo_gen_suppressions) > 0 && 
        !VG_(needs).core_errors && !VG_(needs).tool_errors) {
       VG_(fmsg_bad_option)("--gen-suppressions=yes",
@@ -1994,6 +2136,14 @@ Int valgrind_main ( Int argc, HChar **argv, HChar **envp )
    VG_(debugLog)(1, "main", "Initialise TT/TC\n");
    VG_(init_tt_tc)();
 
+   //--------------------------------------------------------------
+   // Load the persistent translation cache, if any
+   //   p: main_process_cmd_line_options() [for the cache dir and key]
+   //   p: tl_pre_clo_init [for 'VG_(needs).persistent_translations']
+   //--------------------------------------------------------------
+   VG_(debugLog)(1, "main", "Initialise persistent translation cache\n");
+   VG_(init_transcache)();
+
    //--------------------------------------------------------------
    // Initialise the redirect table.
    //   p: init_tt_tc [so it can call VG_(search_transtab) safely]
@@ -2461,6 +2611,10 @@ void shutdown_actions_NORETURN( ThreadId tid,
    if (VG_(clo_track_fds))
       VG_(show_open_fds)("at exit");
 
+   /* Keep this run's translations for the next one. */
+   VG_(shutdown_pretranslate)();
+   VG_(save_transcache)();
+
    /* Call the tool's finalisation function.  This makes Memcheck's
       leak checker run, and possibly chuck a bunch of leak errors into
       the error management machinery. */
@@ -2502,6 +2656,12 @@ void shutdown_actions_NORETURN( ThreadId tid,
       VG_(get_and_show_SB_profile)(0/*denoting end-of-run*/);
    }
 
+   if (VG_(clo_profile_translation))
+      VG_(show_translation_profile)();
+
+   if (VG_(clo_self_profile))
+      VG_(self_profile_done)();
+
    /* Print Vex storage stats */
    if (0)
        LibVEX_ShowAllocStats();
@@ -86,6 +86,9 @@ UChar  VG_(clo_trace_flags)    = 0; // 00000000b
 Bool   VG_(clo_profyle_sbs)    = False;
 UChar  VG_(clo_profyle_flags)  = 0; // 00000000b
 ULong  VG_(clo_profyle_interval) = 0;
+Bool   VG_(clo_profile_translation) = False;
+Bool   VG_(clo_self_profile) = False;
+const HChar* VG_(clo_self_profile_out_file) = "valgrind-self.out.%p";
 Int    VG_(clo_trace_notbelow) = -1;  // unspecified
 Int    VG_(clo_trace_notabove) = -1;  // unspecified
 Bool   VG_(clo_trace_syscalls) = False;
@@ -127,6 +130,15 @@ Bool   VG_(clo_dsymutil)       = False;
 Bool   VG_(clo_sigill_diag)    = True;
 UInt   VG_(clo_unw_stack_scan_thresh) = 0; /* disabled by default */
 UInt   VG_(clo_unw_stack_scan_frames) = 5;
+const HChar* VG_(clo_translation_cache_dir) = NULL;
+Bool   VG_(clo_tiered_translation) = False;
+Int    VG_(clo_tiered_translation_thresh) = 1000;
+Bool   VG_(clo_trace_formation) = False;
+Bool   VG_(clo_parallel_exec) = False;
+Bool   VG_(clo_pretranslate) = False;
+Bool   VG_(clo_generational_transtab) = False;
+Bool   VG_(clo_indirect_branch_cache) = False;
+Bool   VG_(clo_return_stack) = False;
 
 
 /*====================================================================*/
@@ -0,0 +1,526 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Translating code ahead of time, in a helper process.         ---*/
+/*---                                             m_pretranslate.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   Copyright (C) 2000-2013 Julian Seward
+      jseward@acm.org
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#include "pub_core_basics.h"
+#include "pub_core_vki.h"
+#include "pub_core_vkiscnums.h"
+#include "pub_core_aspacemgr.h"
+#include "pub_core_hashtable.h"
+#include "pub_core_libcbase.h"
+#include "pub_core_libcassert.h"
+#include "pub_core_libcfile.h"
+#include "pub_core_libcprint.h"
+#include "pub_core_libcproc.h"
+#include "pub_core_libcsignal.h"
+#include "pub_core_mallocfree.h"
+#include "pub_core_options.h"
+#include "pub_core_syscall.h"
+#include "pub_core_transcache.h"
+#include "pub_core_translate.h"    // VG_(translate)
+#include "pub_core_transtab.h"     // VG_(search_transtab)
+#include "pub_core_xarray.h"
+#include "pub_core_pretranslate.h" // self
+
+
+/*------------------------------------------------------------*/
+/*--- Overview                                             ---*/
+/*------------------------------------------------------------*/
+
+/* When VG_(translate) makes a new translation it tells us the
+   block's static successors: the targets of its constant conditional
+   exits, and its constant final destination if that is a plain jump
+   or a call.  Those are likely to be needed soon, so we ask a helper
+   process to translate them (and, to a limited depth, their own
+   successors), and put the results in the translation cache.  When
+   the client then first gets to one of them, VG_(translate) finds a
+   finished translation there and only has to copy it into the TC,
+   after which it is chained like any other.
+
+   LibVEX and the tools' instrumentation functions are not reentrant,
+   so this can't be done by a thread in this process.  Instead the
+   helper is a copy of this process, made with clone() but without
+   the exit signal, so that the client's wait() calls never see it.
+   It has a snapshot of the client's code, redirections and tool
+   state as of when it was created, and runs VG_(translate) on that
+   in the usual way, except that finished translations are sent back
+   rather than added to its own (unused) TT/TC.
+
+   The snapshot goes out of date, so the results are only used if
+   they pass all the checks the translation cache makes for
+   translations from earlier runs: the translated code must be
+   unchanged, from file-backed mappings, with the same redirections.
+   See m_transcache.c.  In addition we compare the hash of the guest
+   code the helper saw with what is there now, before even putting
+   the translation in the cache.  If the helper reports that it can't
+   see code which we can (typically, a shared object loaded since it
+   was started), it is replaced by a fresh copy, but not too often.
+
+   Requests and results go over a SOCK_SEQPACKET socket pair, so that
+   each is a single message, and we never have to block: requests
+   which don't fit are simply dropped, and results are collected by
+   VG_(pretranslate_poll) at the start of each translation. */
+
+
+/*------------------------------------------------------------*/
+/*--- Types and state                                      ---*/
+/*------------------------------------------------------------*/
+
+/* How many levels of successors to translate: the ones we ask for,
+   their successors, and so on. */
+#define PT_DEPTH            3
+
+/* Most requests the helper will hold at once. */
+#define PT_MAX_QUEUE        2000
+
+/* Replace an out-of-date helper only once this many blocks have been
+   translated since it was started, and at most this many times in
+   all. */
+#define PT_RESTART_INTERVAL 1000
+#define PT_MAX_STARTS       20
+
+typedef
+   struct {
+      Addr64 nraddr;
+      UInt   depth;
+      UInt   pad;
+   }
+   PTRequest;
+
+/* Followed by code_len bytes of host code.  code_len == 0 means the
+   helper could not see any code at nraddr. */
+typedef
+   struct {
+      Addr64          nraddr;
+      Addr64          addr;
+      ULong           guest_hash;
+      VexGuestExtents vge;
+      UInt            kind;
+      UInt            n_guest_instrs;
+      UInt            code_len;
+      UInt            pad;
+   }
+   PTResult;
+
+/* Nodes of the sets of addresses already asked for (in the parent)
+   or already translated (in the helper). */
+typedef
+   struct _PTNode {
+      struct _PTNode* next;
+      UWord           key;
+   }
+   PTNode;
+
+/* Both sides: our end of the socket pair, or -1. */
+static Int  pt_fd        = -1;
+/* Are we the helper? */
+static Bool pt_in_helper = False;
+
+/* Parent: helper's pid, or 0 if not running. */
+static Int         pt_pid          = 0;
+/* Parent: set if the helper could not be run. */
+static Bool        pt_failed       = False;
+static Bool        pt_atfork_done  = False;
+static VgHashTable pt_requested    = NULL;
+static UInt        pt_bbs_at_start = 0;
+
+/* Big enough for any result.  VG_(translate) produces at most 60000
+   bytes of code. */
+static ULong pt_buf[(sizeof(PTResult) + 65536) / sizeof(ULong)];
+
+/* Helper: pending requests, used as a stack, so that the most recent
+   are dealt with first; the set of addresses seen; the depth of the
+   request being translated. */
+static XArray*     pt_queue     = NULL;
+static VgHashTable pt_done      = NULL;
+static UInt        pt_cur_depth = 0;
+static Bool        pt_blocking  = True;
+
+/* Stats */
+static ULong n_pt_requests = 0;
+static ULong n_pt_dropped  = 0;
+static ULong n_pt_results  = 0;
+static ULong n_pt_rejected = 0;
+static ULong n_pt_late     = 0;
+static ULong n_pt_misses   = 0;
+static ULong n_pt_starts   = 0;
+
+
+static Bool set_contains ( VgHashTable t, Addr64 a )
+{
+   return VG_(HT_lookup)(t, (UWord)a) != NULL;
+}
+
+static void set_add ( VgHashTable t, Addr64 a )
+{
+   PTNode* n = VG_(malloc)("pretranslate.set_add.1", sizeof(PTNode));
+   n->key = (UWord)a;
+   VG_(HT_add_node)(t, n);
+}
+
+static Bool is_file_code ( Addr64 a )
+{
+   NSegment const* seg = VG_(am_find_nsegment)((Addr)a);
+   return seg != NULL && seg->kind == SkFileC && seg->hasX;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- The helper process                                   ---*/
+/*------------------------------------------------------------*/
+
+Bool VG_(pretranslate_in_helper) ( void )
+{
+   return pt_in_helper;
+}
+
+static void helper_set_blocking ( Bool blocking )
+{
+   if (blocking != pt_blocking) {
+      VG_(fcntl)(pt_fd, VKI_F_SETFL, blocking ? 0 : VKI_O_NONBLOCK);
+      pt_blocking = blocking;
+   }
+}
+
+static void send_to_parent ( void* buf, Int n )
+{
+   Int r = VG_(write)(pt_fd, buf, n);
+   if (r == -VKI_EAGAIN) {
+      /* The parent hasn't collected earlier results yet. */
+      helper_set_blocking(True);
+      r = VG_(write)(pt_fd, buf, n);
+   }
+   /* If the parent has gone, there is nothing more to do. */
+   if (r != n)
+      VG_(exit)(0);
+}
+
+void VG_(pretranslate_deliver) ( VexGuestExtents* vge,
+                                 Addr64 nraddr, Addr64 addr, UInt kind,
+                                 UChar* code, UInt code_len,
+                                 UInt n_guest_instrs )
+{
+   PTResult* res = (PTResult*)pt_buf;
+
+   vg_assert(pt_in_helper);
+   vg_assert(code_len > 0 && sizeof(PTResult) + code_len <= sizeof(pt_buf));
+
+   /* Don't bother sending anything the parent would reject. */
+   VG_(memset)(res, 0, sizeof(*res));
+   if (!VG_(transcache_hash_guest_code)(vge, &res->guest_hash))
+      return;
+   res->nraddr         = nraddr;
+   res->addr           = addr;
+   res->vge            = *vge;
+   res->kind           = kind;
+   res->n_guest_instrs = n_guest_instrs;
+   res->code_len       = code_len;
+   VG_(memcpy)(res + 1, code, code_len);
+   send_to_parent(res, sizeof(PTResult) + code_len);
+}
+
+static void helper_enqueue ( Addr64 nraddr, UInt depth )
+{
+   PTRequest req;
+   if (VG_(sizeXA)(pt_queue) >= PT_MAX_QUEUE
+       || set_contains(pt_done, nraddr))
+      return;
+   req.nraddr = nraddr;
+   req.depth  = depth;
+   req.pad    = 0;
+   VG_(addToXA)(pt_queue, &req);
+}
+
+__attribute__((noreturn))
+static void helper_main ( ThreadId tid, Int fd )
+{
+   vki_sigset_t all;
+
+   /* Signals are for the parent; we just translate. */
+   VG_(sigfillset)(&all);
+   VG_(sigprocmask)(VKI_SIG_SETMASK, &all, NULL);
+
+   /* Anything we printed would duplicate or confuse the parent's
+      output. */
+   VG_(log_output_sink).fd = -1;
+   VG_(xml_output_sink).fd = -1;
+   VG_(clo_trace_flags)    = 0;
+
+   pt_in_helper = True;
+   pt_fd        = fd;
+   pt_queue     = VG_(newXA)(VG_(malloc), "pretranslate.helper.1",
+                             VG_(free), sizeof(PTRequest));
+   pt_done      = VG_(HT_construct)("pretranslate.done");
+
+   while (True) {
+      PTRequest req;
+      Int       r;
+
+      /* Take new requests first, but only wait for them when there
+         is nothing else to do. */
+      helper_set_blocking(VG_(sizeXA)(pt_queue) == 0);
+      r = VG_(read)(fd, &req, sizeof(req));
+      if (r == sizeof(req)) {
+         helper_enqueue(req.nraddr, req.depth);
+         continue;
+      }
+      if (r != -VKI_EAGAIN)
+         VG_(exit)(0);  /* the parent has gone */
+
+      req = *(PTRequest*)VG_(indexXA)(pt_queue, VG_(sizeXA)(pt_queue) - 1);
+      VG_(dropTailXA)(pt_queue, 1);
+      if (set_contains(pt_done, req.nraddr))
+         continue;
+      set_add(pt_done, req.nraddr);
+
+      if (!is_file_code(req.nraddr)) {
+         PTResult miss;
+         VG_(memset)(&miss, 0, sizeof(miss));
+         miss.nraddr = req.nraddr;
+         send_to_parent(&miss, sizeof(miss));
+         continue;
+      }
+
+      pt_cur_depth = req.depth;
+      (void)VG_(translate)( tid, req.nraddr,
+                            False/*debugging_translation*/,
+                            0/*debugging_verbosity*/,
+                            0/*bbs_done*/,
+                            True/*allow redirection*/ );
+   }
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Starting and stopping the helper                     ---*/
+/*------------------------------------------------------------*/
+
+static void give_up ( const HChar* why )
+{
+   if (VG_(clo_verbosity) > 1)
+      VG_(message)(Vg_DebugMsg, "pretranslate: %s; giving up\n", why);
+   pt_failed = True;
+}
+
+static void stop_helper ( void )
+{
+   Int status;
+   if (pt_pid > 0) {
+      VG_(kill)(pt_pid, VKI_SIGKILL);
+      VG_(waitpid)(pt_pid, &status, __VKI_WALL);
+   }
+   if (pt_fd >= 0)
+      VG_(close)(pt_fd);
+   if (pt_requested != NULL)
+      VG_(HT_destruct)(pt_requested, VG_(free));
+   pt_pid       = 0;
+   pt_fd        = -1;
+   pt_requested = NULL;
+}
+
+/* In the child of a client fork(), the helper is not ours. */
+static void atfork_child ( ThreadId tid )
+{
+   if (pt_fd >= 0)
+      VG_(close)(pt_fd);
+   if (pt_requested != NULL)
+      VG_(HT_destruct)(pt_requested, VG_(free));
+   pt_pid       = 0;
+   pt_fd        = -1;
+   pt_requested = NULL;
+}
+
+static void start_helper ( ThreadId tid )
+{
+#  if defined(VGO_linux)
+   Int    sv[2];
+   SysRes sres;
+
+   vg_assert(pt_pid == 0 && pt_fd == -1);
+
+   if (!pt_atfork_done) {
+      VG_(atfork)(NULL, NULL, atfork_child);
+      pt_atfork_done = True;
+   }
+
+   if (VG_(socketpair)(VKI_AF_UNIX, VKI_SOCK_SEQPACKET, 0, sv) != 0) {
+      give_up("can't create socket pair");
+      return;
+   }
+   sv[0] = VG_(safe_fd)(sv[0]);
+   sv[1] = VG_(safe_fd)(sv[1]);
+
+   /* fork(), but with no exit signal.  All the arguments are zero,
+      so the platforms' different clone() argument orders don't
+      matter. */
+   sres = VG_(do_syscall5)(__NR_clone, 0, 0, 0, 0, 0);
+   if (sr_isError(sres)) {
+      VG_(close)(sv[0]);
+      VG_(close)(sv[1]);
+      give_up("can't create helper process");
+      return;
+   }
+   if (sr_Res(sres) == 0) {
+      VG_(close)(sv[0]);
+      helper_main(tid, sv[1]);
+      /*NOTREACHED*/
+   }
+
+   VG_(close)(sv[1]);
+   pt_fd  = sv[0];
+   pt_pid = sr_Res(sres);
+   VG_(fcntl)(pt_fd, VKI_F_SETFL, VKI_O_NONBLOCK);
+   pt_requested    = VG_(HT_construct)("pretranslate.requested");
+   pt_bbs_at_start = VG_(get_bbs_translated)();
+   n_pt_starts++;
+   if (VG_(clo_verbosity) > 1)
+      VG_(message)(Vg_DebugMsg,
+                   "pretranslate: started helper process %d\n", pt_pid);
+#  else
+   give_up("not supported on this platform");
+#  endif
+}
+
+void VG_(shutdown_pretranslate) ( void )
+{
+   stop_helper();
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Requests and results                                 ---*/
+/*------------------------------------------------------------*/
+
+void VG_(pretranslate_note_successors) ( ThreadId tid,
+                                         Addr64* succs, Int n_succs )
+{
+   Int i;
+
+   if (pt_in_helper) {
+      if (pt_cur_depth > 1)
+         for (i = 0; i < n_succs; i++)
+            helper_enqueue(succs[i], pt_cur_depth - 1);
+      return;
+   }
+
+   if (!VG_(clo_pretranslate) || pt_failed || !VG_(transcache_enabled)())
+      return;
+   if (pt_pid == 0) {
+      start_helper(tid);
+      if (pt_pid == 0)
+         return;
+   }
+
+   for (i = 0; i < n_succs; i++) {
+      PTRequest req;
+      if (set_contains(pt_requested, succs[i])
+          || VG_(transcache_has)(succs[i])
+          || VG_(search_transtab)(NULL, NULL, NULL, succs[i], False))
+         continue;
+      req.nraddr = succs[i];
+      req.depth  = PT_DEPTH;
+      req.pad    = 0;
+      if (VG_(write_socket)(pt_fd, &req, sizeof(req)) != sizeof(req)) {
+         /* The helper is busy, or has died; VG_(pretranslate_poll)
+            will find out which. */
+         n_pt_dropped++;
+         continue;
+      }
+      set_add(pt_requested, succs[i]);
+      n_pt_requests++;
+   }
+}
+
+void VG_(pretranslate_poll) ( void )
+{
+   PTResult* res = (PTResult*)pt_buf;
+   ULong     h;
+   Int       r;
+
+   if (pt_pid == 0 || pt_in_helper)
+      return;
+
+   while (True) {
+      r = VG_(read)(pt_fd, pt_buf, sizeof(pt_buf));
+      if (r == -VKI_EAGAIN)
+         return;
+      if (r < (Int)sizeof(PTResult)
+          || r != (Int)sizeof(PTResult) + (Int)res->code_len) {
+         stop_helper();
+         give_up("helper process died");
+         return;
+      }
+      n_pt_results++;
+
+      if (res->code_len == 0) {
+         /* The helper can't see code that we can, so it is out of
+            date.  Replace it, unless we did so only recently. */
+         n_pt_misses++;
+         if (is_file_code(res->nraddr)
+             && VG_(get_bbs_translated)() - pt_bbs_at_start
+                >= PT_RESTART_INTERVAL
+             && n_pt_starts < PT_MAX_STARTS) {
+            stop_helper();
+            return;
+         }
+         continue;
+      }
+
+      if (VG_(search_transtab)(NULL, NULL, NULL, res->nraddr, False)) {
+         n_pt_late++;
+         continue;
+      }
+      if (!VG_(transcache_hash_guest_code)(&res->vge, &h)
+          || h != res->guest_hash) {
+         n_pt_rejected++;
+         continue;
+      }
+      VG_(transcache_add)( &res->vge, res->nraddr, res->addr, res->kind,
+                           (UChar*)(res + 1), res->code_len,
+                           res->n_guest_instrs );
+   }
+}
+
+void VG_(print_pretranslate_stats) ( void )
+{
+   if (!VG_(clo_pretranslate))
+      return;
+   VG_(message)(Vg_DebugMsg,
+      "pretranslate: %'llu requests, %'llu dropped, %'llu helper starts\n",
+      n_pt_requests, n_pt_dropped, n_pt_starts);
+   VG_(message)(Vg_DebugMsg,
+      "pretranslate: %'llu results, %'llu misses, %'llu late, "
+      "%'llu rejected\n",
+      n_pt_results, n_pt_misses, n_pt_late, n_pt_rejected);
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
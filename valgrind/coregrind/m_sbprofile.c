@@ -37,6 +37,9 @@
 #include "pub_core_debuginfo.h"
 #include "pub_core_translate.h"
 #include "pub_core_options.h"
+#include "pub_core_libcproc.h"     // VG_(read_cycle_counter)
+#include "pub_core_mallocfree.h"
+#include "pub_core_wordfm.h"
 #include "pub_core_sbprofile.h"    // self
 
 /*====================================================================*/
@@ -194,6 +197,253 @@ void VG_(get_and_show_SB_profile) ( ULong ecs_done )
 }
 
 
+/*====================================================================*/
+/*=== Translation profiling                                        ===*/
+/*====================================================================*/
+
+/* Where the JIT's time goes (--profile-translation=yes).  Each
+   translation's cost is charged to its VexPhases, to the object and
+   function containing its first guest instruction, and, if it is among
+   the most expensive, kept individually. */
+
+typedef
+   struct {
+      const HChar* name;
+      ULong        n_trans;
+      ULong        ticks;
+      ULong        guest_bytes;
+      ULong        code_bytes;
+   }
+   TPEntry;
+
+typedef
+   struct {
+      Addr64 addr;
+      ULong  ticks;
+      UInt   guest_bytes;
+      UInt   code_bytes;
+   }
+   TPBlock;
+
+#define N_TP_BLOCKS 20
+
+static ULong    tp_phase_ticks[VexPhase_N];
+static TPEntry  tp_total;
+static ULong    tp_start = 0;   /* when the first translation began */
+static WordFM*  tp_objs  = NULL; /* HChar* name -> TPEntry* */
+static WordFM*  tp_fns   = NULL; /* HChar* name -> TPEntry* */
+static TPBlock  tp_blocks[N_TP_BLOCKS];
+
+static const HChar* tp_phase_names[VexPhase_N]
+   = { "front end", "iropt", "instrument", "iropt post-instr",
+       "isel", "regalloc", "assemble" };
+
+static Word cmp_names ( UWord a, UWord b )
+{
+   return (Word)VG_(strcmp)((const HChar*)a, (const HChar*)b);
+}
+
+static void tp_charge ( WordFM* fm, const HChar* name, ULong ticks,
+                        UInt guest_bytes, UInt code_bytes )
+{
+   UWord    keyW, valW;
+   TPEntry* e;
+   if (VG_(lookupFM)(fm, &keyW, &valW, (UWord)name)) {
+      e = (TPEntry*)valW;
+   } else {
+      e = VG_(malloc)("sbprofile.tp_charge.1", sizeof(TPEntry));
+      VG_(memset)(e, 0, sizeof(TPEntry));
+      e->name = VG_(strdup)("sbprofile.tp_charge.2", name);
+      VG_(addToFM)(fm, (UWord)e->name, (UWord)e);
+   }
+   e->n_trans++;
+   e->ticks       += ticks;
+   e->guest_bytes += guest_bytes;
+   e->code_bytes  += code_bytes;
+}
+
+void VG_(record_translation_cost) ( Addr64 addr, UInt guest_bytes,
+                                    UInt code_bytes, ULong ticks,
+                                    const ULong* phase_ticks )
+{
+   HChar name[128];
+   Int   i, min;
+
+   vg_assert(VG_(clo_profile_translation));
+
+   if (tp_objs == NULL) {
+      tp_objs = VG_(newFM)(VG_(malloc), "sbprofile.rtc.1", VG_(free),
+                           cmp_names);
+      tp_fns  = VG_(newFM)(VG_(malloc), "sbprofile.rtc.2", VG_(free),
+                           cmp_names);
+      tp_start = VG_(read_cycle_counter)() - ticks;
+   }
+
+   for (i = 0; i < VexPhase_N; i++)
+      tp_phase_ticks[i] += phase_ticks[i];
+   tp_total.n_trans++;
+   tp_total.ticks       += ticks;
+   tp_total.guest_bytes += guest_bytes;
+   tp_total.code_bytes  += code_bytes;
+
+   if (!VG_(get_objname)((Addr)addr, name, sizeof(name)))
+      VG_(strcpy)(name, "???");
+   tp_charge(tp_objs, name, ticks, guest_bytes, code_bytes);
+   if (!VG_(get_fnname)((Addr)addr, name, sizeof(name)))
+      VG_(strcpy)(name, "???");
+   tp_charge(tp_fns, name, ticks, guest_bytes, code_bytes);
+
+   /* Replace the cheapest of the most expensive blocks, if this one
+      costs more. */
+   min = 0;
+   for (i = 1; i < N_TP_BLOCKS; i++)
+      if (tp_blocks[i].ticks < tp_blocks[min].ticks)
+         min = i;
+   if (ticks > tp_blocks[min].ticks) {
+      tp_blocks[min].addr        = addr;
+      tp_blocks[min].ticks       = ticks;
+      tp_blocks[min].guest_bytes = guest_bytes;
+      tp_blocks[min].code_bytes  = code_bytes;
+   }
+}
+
+/* Sort by decreasing cost. */
+static Int cmp_TPEntry_ptrs ( const void* a, const void* b )
+{
+   const TPEntry* ea = *(const TPEntry* const*)a;
+   const TPEntry* eb = *(const TPEntry* const*)b;
+   if (ea->ticks > eb->ticks) return -1;
+   if (ea->ticks < eb->ticks) return 1;
+   return VG_(strcmp)(ea->name, eb->name);
+}
+
+static Int cmp_TPBlocks ( const void* a, const void* b )
+{
+   const TPBlock* ba = (const TPBlock*)a;
+   const TPBlock* bb = (const TPBlock*)b;
+   if (ba->ticks > bb->ticks) return -1;
+   if (ba->ticks < bb->ticks) return 1;
+   return 0;
+}
+
+static void show_TPEntries ( WordFM* fm, const HChar* what, UInt n_max )
+{
+   TPEntry** es;
+   UWord     keyW, valW, n, i;
+   HChar     buf_here[10];
+
+   n  = VG_(sizeFM)(fm);
+   es = VG_(malloc)("sbprofile.show_TPEntries.1", n * sizeof(TPEntry*));
+   i  = 0;
+   VG_(initIterFM)(fm);
+   while (VG_(nextIterFM)(fm, &keyW, &valW))
+      es[i++] = (TPEntry*)valW;
+   VG_(doneIterFM)(fm);
+   vg_assert(i == n);
+   VG_(ssort)(es, n, sizeof(TPEntry*), cmp_TPEntry_ptrs);
+
+   VG_(printf)("\n-- Translation cost by %s (%lu of %lu shown) --\n\n",
+               what, n < n_max ? n : (UWord)n_max, n);
+   VG_(printf)("           ticks   (self)     transl  guest-bytes"
+               "   code-bytes  %s\n", what);
+   for (i = 0; i < n && i < n_max; i++) {
+      VG_(percentify)(es[i]->ticks, tp_total.ticks, 2, 6, buf_here);
+      VG_(printf)("%'16llu  %s %'10llu %'12llu %'12llu  %s\n",
+                  es[i]->ticks, buf_here, es[i]->n_trans,
+                  es[i]->guest_bytes, es[i]->code_bytes, es[i]->name);
+   }
+   VG_(free)(es);
+}
+
+void VG_(show_translation_profile) ( void )
+{
+   ULong  now, run_ticks, phase_sum, guest_bytes;
+   HChar  buf_here[10];
+   HChar  name[64];
+   Int    i;
+
+   vg_assert(VG_(clo_profile_translation));
+
+   now       = VG_(read_cycle_counter)();
+   run_ticks = tp_objs == NULL ? 0 : now - tp_start;
+   /* Avoid dividing by zero in the ratios below. */
+   guest_bytes = tp_total.guest_bytes == 0 ? 1 : tp_total.guest_bytes;
+
+   VG_(printf)("\n");
+   VG_(printf)("<<<---<<<---<<<---<<<---<<<---<<<---<<<---"
+               "<<<---<<<---<<<---<<<---<<<---<<<\n");
+   VG_(printf)("\n");
+   VG_(printf)("<<< BEGIN Translation Profile (ticks are %s)\n",
+               VG_(cycle_counter_unit)());
+   VG_(printf)("<<<\n");
+   VG_(printf)("\n");
+
+   VG_(percentify)(tp_total.ticks, run_ticks, 2, 6, buf_here);
+   VG_(printf)("Translations:      %'llu\n", tp_total.n_trans);
+   VG_(printf)("Guest bytes:       %'llu\n", tp_total.guest_bytes);
+   VG_(printf)("Code bytes:        %'llu (%llu.%llu x guest)\n",
+               tp_total.code_bytes,
+               tp_total.code_bytes / guest_bytes,
+               (10 * tp_total.code_bytes / guest_bytes) % 10);
+   VG_(printf)("Run time:          %'llu ticks since the first "
+               "translation\n", run_ticks);
+   VG_(printf)("Translation time:  %'llu ticks (%s of run time)\n",
+               tp_total.ticks, buf_here);
+   if (tp_total.n_trans > 0)
+      VG_(printf)("                   %'llu per translation, "
+                  "%'llu per guest byte\n",
+                  tp_total.ticks / tp_total.n_trans,
+                  tp_total.ticks / guest_bytes);
+
+   VG_(printf)("\n-- Translation cost by phase --\n\n");
+   VG_(printf)("           ticks   (self)  phase\n");
+   phase_sum = 0;
+   for (i = 0; i < VexPhase_N; i++) {
+      VG_(percentify)(tp_phase_ticks[i], tp_total.ticks, 2, 6, buf_here);
+      VG_(printf)("%'16llu  %s  %s\n",
+                  tp_phase_ticks[i], buf_here, tp_phase_names[i]);
+      phase_sum += tp_phase_ticks[i];
+   }
+   /* Setup and teardown in LibVEX_Translate, outside any phase. */
+   if (tp_total.ticks >= phase_sum) {
+      VG_(percentify)(tp_total.ticks - phase_sum, tp_total.ticks,
+                      2, 6, buf_here);
+      VG_(printf)("%'16llu  %s  %s\n",
+                  tp_total.ticks - phase_sum, buf_here, "other");
+   }
+
+   if (tp_objs != NULL) {
+      show_TPEntries(tp_objs, "object", 20);
+      show_TPEntries(tp_fns,  "function", 50);
+   }
+
+   VG_(ssort)(tp_blocks, N_TP_BLOCKS, sizeof(TPBlock), cmp_TPBlocks);
+   VG_(printf)("\n-- Most expensive translations --\n\n");
+   VG_(printf)("           ticks   (self)  guest-bytes   code-bytes"
+               "  address\n");
+   for (i = 0; i < N_TP_BLOCKS; i++) {
+      if (tp_blocks[i].ticks == 0)
+         continue;
+      name[0] = 0;
+      VG_(get_fnname_w_offset)((Addr)tp_blocks[i].addr, name, 64);
+      name[63] = 0;
+      VG_(percentify)(tp_blocks[i].ticks, tp_total.ticks, 2, 6, buf_here);
+      VG_(printf)("%'16llu  %s %'12u %'12u  0x%llx %s\n",
+                  tp_blocks[i].ticks, buf_here,
+                  tp_blocks[i].guest_bytes, tp_blocks[i].code_bytes,
+                  tp_blocks[i].addr, name);
+   }
+
+   VG_(printf)("\n");
+   VG_(printf)(">>>\n");
+   VG_(printf)(">>> END Translation Profile\n");
+   VG_(printf)(">>>\n");
+   VG_(printf)(">>>--->>>--->>>--->>>--->>>--->>>--->>>---"
+               ">>>--->>>--->>>--->>>--->>>--->>>\n");
+   VG_(printf)("\n");
+}
+
+
 /*--------------------------------------------------------------------*/
 /*--- end                                            m_sbprofile.c ---*/
 /*--------------------------------------------------------------------*/
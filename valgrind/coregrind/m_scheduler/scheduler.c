@@ -82,6 +82,7 @@
 #include "pub_core_options.h"
 #include "pub_core_replacemalloc.h"
 #include "pub_core_sbprofile.h"
+#include "pub_core_selfprofile.h"
 #include "pub_core_signals.h"
 #include "pub_core_stacks.h"
 #include "pub_core_stacktrace.h"    // For VG_(get_and_pp_StackTrace)()
@@ -130,21 +131,36 @@ static void mostly_clear_thread_record ( ThreadId tid );
 static ULong n_scheduling_events_MINOR = 0;
 static ULong n_scheduling_events_MAJOR = 0;
 
-/* Stats: number of XIndirs, and number that missed in the fast
-   cache. */
+/* Stats: number of XIndirs, number that missed in the fast cache,
+   and number that hit in a way other than way 0 (only counted by
+   dispatchers which probe the other ways). */
 static ULong stats__n_xindirs = 0;
 static ULong stats__n_xindir_misses = 0;
+static ULong stats__n_xindir_other_way_hits = 0;
 
 /* And 32-bit temp bins for the above, so that 32-bit platforms don't
    have to do 64 bit incs on the hot path through
    VG_(cp_disp_xindir). */
 /*global*/ UInt VG_(stats__n_xindirs_32) = 0;
 /*global*/ UInt VG_(stats__n_xindir_misses_32) = 0;
+/*global*/ UInt VG_(stats__n_xindir_other_way_hits_32) = 0;
 
 /* Sanity checking counts. */
 static UInt sanity_fast_count = 0;
 static UInt sanity_slow_count = 0;
 
+/* Stats: number of times all threads had to be brought out of
+   generated code with --parallel-exec=yes. */
+static ULong stats__n_parallel_stops = 0;
+
+/* With --parallel-exec=yes: the number of threads currently running
+   generated code without the lock, and stats for how many times a
+   thread started doing so, and how many of those times another thread
+   already was. */
+static volatile UInt n_parallel_running = 0;
+static ULong stats__n_parallel_runs     = 0;
+static ULong stats__n_parallel_overlaps = 0;
+
 void VG_(print_scheduler_stats)(void)
 {
    VG_(message)(Vg_DebugMsg,
@@ -154,12 +170,26 @@ void VG_(print_scheduler_stats)(void)
                 stats__n_xindirs, stats__n_xindir_misses,
                 stats__n_xindirs / (stats__n_xindir_misses 
                                     ? stats__n_xindir_misses : 1));
+   if (VG_TT_FAST_DISPATCH_ALL_WAYS)
+      VG_(message)(Vg_DebugMsg,
+                   "scheduler: %'llu indir transfers hit in fast-cache "
+                   "ways 1..%d\n",
+                   stats__n_xindir_other_way_hits, VG_TT_FAST_WAYS-1);
    VG_(message)(Vg_DebugMsg,
       "scheduler: %'llu/%'llu major/minor sched events.\n",
       n_scheduling_events_MAJOR, n_scheduling_events_MINOR);
    VG_(message)(Vg_DebugMsg, 
                 "   sanity: %d cheap, %d expensive checks.\n",
                 sanity_fast_count, sanity_slow_count );
+   if (VG_(clo_parallel_exec)) {
+      VG_(message)(Vg_DebugMsg,
+                   "scheduler: %'llu parallel-run stops\n",
+                   stats__n_parallel_stops);
+      VG_(message)(Vg_DebugMsg,
+                   "scheduler: %'llu parallel runs, %'llu overlapping "
+                   "another\n",
+                   stats__n_parallel_runs, stats__n_parallel_overlaps);
+   }
 }
 
 /*
@@ -194,6 +224,23 @@ void maybe_show_sb_profile ( void )
    }
 }
 
+/* For tiered translation: every so often, retranslate first-tier
+   blocks which have become hot.  The interval grows with the number
+   of first-tier blocks being watched, so as to keep the cost of
+   scanning them small relative to the amount of work done. */
+static
+void maybe_promote_hot_translations ( void )
+{
+   /* DO NOT MAKE NON-STATIC */
+   static ULong bbs_done_nextcheck = 0;
+   /* */
+   if (bbs_done >= bbs_done_nextcheck) {
+      UWord n_watched = VG_(promote_hot_translations)();
+      bbs_done_nextcheck = bbs_done + SCHEDULING_QUANTUM / 10
+                                    + 2 * (ULong)n_watched;
+   }
+}
+
 static
 const HChar* name_of_sched_event ( UInt event )
 {
@@ -226,6 +273,8 @@ const HChar* name_of_sched_event ( UInt event )
       case VG_TRC_INVARIANT_FAILED:    return "INVFAILED";
       case VG_TRC_CHAIN_ME_TO_SLOW_EP: return "CHAIN_ME_SLOW";
       case VG_TRC_CHAIN_ME_TO_FAST_EP: return "CHAIN_ME_FAST";
+      case VG_TRC_XINDIR_ICFILL:       return "XINDIR_ICFILL";
+      case VG_TRC_RET_FILL:            return "RET_FILL";
       default:                         return "??UNKNOWN??";
   }
 }
@@ -455,6 +504,92 @@ void VG_(vg_yield)(void)
 }
 
 
+/* ---------------------------------------------------------------------
+   Parallel execution (--parallel-exec=yes).
+
+   Normally a thread holds the_BigLock for the whole time it runs
+   generated code.  In parallel mode it instead drops the lock just
+   before entering generated code and takes it back when the code
+   returns to the scheduler, for whatever reason.  So translation,
+   transtab changes, syscall wrappers, client requests and signal
+   delivery all still happen under the lock; only running
+   translations is concurrent.  This relies on:
+
+   - the tool's instrumentation and helpers being thread-safe
+     (VG_(needs_parallel_execution)), and gdbserver being off;
+
+   - nothing ever modifying code another thread may be executing,
+     except after VG_(stop_parallel_threads) has brought all the
+     other threads out of generated code.  m_transtab does that before
+     chaining, unchaining and recycling sectors;
+
+   - each thread having a fast cache of its own, which the
+     dispatcher is told about (see VG_(get_fast_cache));
+
+   - a thread which takes a synchronous signal while running
+     unlocked taking the lock before doing anything else (see
+     sync_signalhandler).
+
+   While running unlocked a thread is in the VgTs_Yielding state and
+   has .in_parallel_run set.
+   ------------------------------------------------------------------ */
+
+void VG_(parallel_run_begin) ( ThreadId tid )
+{
+   ThreadState* tst = VG_(get_ThreadState)(tid);
+   vg_assert(VG_(clo_parallel_exec));
+   vg_assert(VG_(in_generated_code));
+   vg_assert(!tst->in_parallel_run);
+   VG_(in_generated_code) = False;
+   tst->in_parallel_run = True;
+   /* The stats are only updated holding the lock. */
+   stats__n_parallel_runs++;
+   if (__sync_fetch_and_add(&n_parallel_running, 1) > 0)
+      stats__n_parallel_overlaps++;
+   VG_(release_BigLock)(tid, VgTs_Yielding, "parallel run");
+}
+
+void VG_(parallel_run_end) ( ThreadId tid )
+{
+   ThreadState* tst = VG_(get_ThreadState)(tid);
+   vg_assert(tst->in_parallel_run);
+   /* Clear the flag before waiting for the lock, so that a thread in
+      VG_(stop_parallel_threads) sees that we are out of generated
+      code. */
+   tst->in_parallel_run = False;
+   __sync_fetch_and_sub(&n_parallel_running, 1);
+   VG_(acquire_BigLock)(tid, "parallel run");
+   VG_(in_generated_code) = True;
+}
+
+void VG_(stop_parallel_threads) ( void )
+{
+   ThreadId tid;
+   Bool     any;
+
+   if (!VG_(clo_parallel_exec))
+      return;
+
+   while (True) {
+      any = False;
+      for (tid = 1; tid < VG_N_THREADS; tid++) {
+         volatile ThreadState* tst = &VG_(threads)[tid];
+         if (!tst->in_parallel_run)
+            continue;
+         /* Make it fail its next event check.  It may race with the
+            thread's own decrement of the counter, hence the retry
+            loop. */
+         tst->arch.vex.host_EvC_COUNTER = 0;
+         any = True;
+      }
+      if (!any)
+         break;
+      VG_(do_syscall0)(__NR_sched_yield);
+   }
+   stats__n_parallel_stops++;
+}
+
+
 /* Set the standard set of blocked signals, used whenever we're not
    running a client syscall. */
 static void block_signals(void)
@@ -474,6 +609,10 @@ static void block_signals(void)
    VG_(sigdelset)(&mask, VKI_SIGSTOP);
    VG_(sigdelset)(&mask, VKI_SIGKILL);
 
+   /* Let --self-profile=yes sample us while we're not in a syscall */
+   if (VG_(clo_self_profile))
+      VG_(sigdelset)(&mask, VG_SIGVGPROF);
+
    VG_(sigprocmask)(VKI_SIG_SETMASK, &mask, NULL);
 }
 
@@ -531,6 +670,7 @@ void mostly_clear_thread_record ( ThreadId tid )
    VG_(clear_out_queued_signals)(tid, &savedmask);
 
    VG_(threads)[tid].sched_jmpbuf_valid = False;
+   VG_(threads)[tid].in_parallel_run = False;
 }
 
 /*                                                                             
@@ -826,7 +966,8 @@ void VG_(force_vgdb_poll) ( void )
 
    Return results are placed in two_words.  two_words[0] is set to the
    TRC.  In the case where that is VG_TRC_CHAIN_ME_TO_{SLOW,FAST}_EP,
-   the address to patch is placed in two_words[1].
+   VG_TRC_XINDIR_ICFILL or VG_TRC_RET_FILL, the address to patch is
+   placed in two_words[1].
 */
 static
 void run_thread_for_a_while ( /*OUT*/HWord* two_words,
@@ -839,6 +980,7 @@ void run_thread_for_a_while ( /*OUT*/HWord* two_words,
    volatile ThreadState* tst            = NULL; /* stop gcc complaining */
    volatile Int          done_this_time = 0;
    volatile HWord        host_code_addr = 0;
+   FastCacheEntry*       fast_cache;
 
    /* Paranoia */
    vg_assert(VG_(is_valid_tid)(tid));
@@ -850,9 +992,24 @@ void run_thread_for_a_while ( /*OUT*/HWord* two_words,
    do_pre_run_checks( (ThreadState*)tst );
    /* end Paranoia */
 
-   /* Futz with the XIndir stats counters. */
-   vg_assert(VG_(stats__n_xindirs_32) == 0);
-   vg_assert(VG_(stats__n_xindir_misses_32) == 0);
+   /* Futz with the XIndir stats counters.  In parallel mode other
+      threads may be updating them concurrently. */
+   if (!VG_(clo_parallel_exec)) {
+      vg_assert(VG_(stats__n_xindirs_32) == 0);
+      vg_assert(VG_(stats__n_xindir_misses_32) == 0);
+      vg_assert(VG_(stats__n_xindir_other_way_hits_32) == 0);
+   }
+
+   /* Get the fast cache up to date before anything looks in it. */
+   fast_cache = VG_(get_fast_cache)(tid);
+
+#  if defined(VGP_amd64_linux)
+   /* Likewise the return-address stack.  Point the guest state at it
+      every time, since the guest state may have been copied from
+      another thread's, eg by clone. */
+   if (VG_(clo_return_stack))
+      tst->arch.vex.host_RetStack = (ULong)(Addr)VG_(get_ret_stack)(tid);
+#  endif
 
    /* Clear return area. */
    two_words[0] = two_words[1] = 0;
@@ -863,11 +1020,11 @@ void run_thread_for_a_while ( /*OUT*/HWord* two_words,
       host_code_addr = alt_host_addr;
    } else {
       /* normal case -- redir translation */
-      UInt cno = (UInt)VG_TT_FAST_HASH((Addr)tst->arch.vex.VG_INSTR_PTR);
-      if (LIKELY(VG_(tt_fast)[cno].guest == (Addr)tst->arch.vex.VG_INSTR_PTR))
-         host_code_addr = VG_(tt_fast)[cno].host;
+      AddrH res = 0;
+      if (LIKELY(VG_(lookup_fast_cache)(tid, &res,
+                                        (Addr)tst->arch.vex.VG_INSTR_PTR)))
+         host_code_addr = res;
       else {
-         AddrH res   = 0;
          /* not found in VG_(tt_fast). Searching here the transtab
             improves the performance compared to returning directly
             to the scheduler. */
@@ -917,16 +1074,26 @@ void run_thread_for_a_while ( /*OUT*/HWord* two_words,
    vg_assert(VG_(in_generated_code) == False);
    VG_(in_generated_code) = True;
 
+   /* No-redir translations live in a small cache which is flushed
+      without stopping other threads, so run them with the lock held. */
+   if (VG_(clo_parallel_exec) && !use_alt_host_addr)
+      VG_(parallel_run_begin)(tid);
+
    SCHEDSETJMP(
       tid, 
       jumped, 
       VG_(disp_run_translations)( 
          two_words,
          (void*)&tst->arch.vex,
-         host_code_addr
+         host_code_addr,
+         fast_cache
       )
    );
 
+   /* If we took a signal, the handler has already taken the lock. */
+   if (tst->in_parallel_run)
+      VG_(parallel_run_end)(tid);
+
    vg_assert(VG_(in_generated_code) == True);
    VG_(in_generated_code) = False;
 
@@ -942,10 +1109,16 @@ void run_thread_for_a_while ( /*OUT*/HWord* two_words,
    /* Merge the 32-bit XIndir/miss counters into the 64 bit versions,
       and zero out the 32-bit ones in preparation for the next run of
       generated code. */
-   stats__n_xindirs += (ULong)VG_(stats__n_xindirs_32);
-   VG_(stats__n_xindirs_32) = 0;
-   stats__n_xindir_misses += (ULong)VG_(stats__n_xindir_misses_32);
-   VG_(stats__n_xindir_misses_32) = 0;
+   { UInt n_xindirs       = VG_(stats__n_xindirs_32);
+     UInt n_xindir_misses = VG_(stats__n_xindir_misses_32);
+     UInt n_xindir_other_way_hits = VG_(stats__n_xindir_other_way_hits_32);
+     stats__n_xindirs += (ULong)n_xindirs;
+     VG_(stats__n_xindirs_32) -= n_xindirs;
+     stats__n_xindir_misses += (ULong)n_xindir_misses;
+     VG_(stats__n_xindir_misses_32) -= n_xindir_misses;
+     stats__n_xindir_other_way_hits += (ULong)n_xindir_other_way_hits;
+     VG_(stats__n_xindir_other_way_hits_32) -= n_xindir_other_way_hits;
+   }
 
    /* Inspect the event counter. */
    vg_assert((Int)tst->arch.vex.host_EvC_COUNTER >= -1);
@@ -978,7 +1151,9 @@ void run_thread_for_a_while ( /*OUT*/HWord* two_words,
       VG_(run_innerloop). */
    /* Stay sane .. */
    if (two_words[0] == VG_TRC_CHAIN_ME_TO_SLOW_EP
-       || two_words[0] == VG_TRC_CHAIN_ME_TO_FAST_EP) {
+       || two_words[0] == VG_TRC_CHAIN_ME_TO_FAST_EP
+       || two_words[0] == VG_TRC_XINDIR_ICFILL
+       || two_words[0] == VG_TRC_RET_FILL) {
       vg_assert(two_words[1] != 0); /* we have a legit patch addr */
    } else {
       vg_assert(two_words[1] == 0); /* nobody messed with it */
@@ -995,8 +1170,14 @@ static void handle_tt_miss ( ThreadId tid )
    Bool found;
    Addr ip = VG_(get_IP)(tid);
 
-   /* Trivial event.  Miss in the fast-cache.  Do a full
+   /* Trivial event.  Miss in the fast-cache.  If the dispatcher only
+      looked in way 0, try the other ways; failing that, do a full
       lookup for it. */
+   if (!VG_TT_FAST_DISPATCH_ALL_WAYS) {
+      AddrH res;
+      if (VG_(lookup_fast_cache)( tid, &res, ip ))
+         return;
+   }
    found = VG_(search_transtab)( NULL, NULL, NULL,
                                  ip, True/*upd_fast_cache*/ );
    if (UNLIKELY(!found)) {
@@ -1017,35 +1198,49 @@ static void handle_tt_miss ( ThreadId tid )
    }
 }
 
+/* Find, or if necessary make, the translation for tid's guest IP,
+   ready for patching a jump through to it.  Returns False if it
+   can't be made. */
 static
-void handle_chain_me ( ThreadId tid, void* place_to_chain, Bool toFastEP )
+Bool find_patch_target ( ThreadId tid,
+                         /*OUT*/UInt* to_sNo, /*OUT*/UInt* to_tteNo )
 {
    Bool found          = False;
    Addr ip             = VG_(get_IP)(tid);
-   UInt to_sNo         = (UInt)-1;
-   UInt to_tteNo       = (UInt)-1;
 
-   found = VG_(search_transtab)( NULL, &to_sNo, &to_tteNo,
+   *to_sNo   = (UInt)-1;
+   *to_tteNo = (UInt)-1;
+   found = VG_(search_transtab)( NULL, to_sNo, to_tteNo,
                                  ip, False/*dont_upd_fast_cache*/ );
    if (!found) {
       /* Not found; we need to request a translation. */
       if (VG_(translate)( tid, ip, /*debug*/False, 0/*not verbose*/, 
                           bbs_done, True/*allow redirection*/ )) {
-         found = VG_(search_transtab)( NULL, &to_sNo, &to_tteNo,
+         found = VG_(search_transtab)( NULL, to_sNo, to_tteNo,
                                        ip, False ); 
-         vg_assert2(found, "handle_chain_me: missing tt_fast entry");
+         vg_assert2(found, "find_patch_target: missing tt_fast entry");
       } else {
 	 // If VG_(translate)() fails, it's because it had to throw a
 	 // signal because the client jumped to a bad address.  That
 	 // means that either a signal has been set up for delivery,
 	 // or the thread has been marked for termination.  Either
 	 // way, we just need to go back into the scheduler loop.
-        return;
+        return False;
       }
    }
    vg_assert(found);
-   vg_assert(to_sNo != -1);
-   vg_assert(to_tteNo != -1);
+   vg_assert(*to_sNo != -1);
+   vg_assert(*to_tteNo != -1);
+   return True;
+}
+
+static
+void handle_chain_me ( ThreadId tid, void* place_to_chain, Bool toFastEP )
+{
+   UInt to_sNo, to_tteNo;
+
+   if (!find_patch_target(tid, &to_sNo, &to_tteNo))
+      return;
 
    /* So, finally we know where to patch through to.  Do the patching
       and update the various admin tables that allow it to be undone
@@ -1054,6 +1249,32 @@ void handle_chain_me ( ThreadId tid, void* place_to_chain, Bool toFastEP )
                            to_sNo, to_tteNo, toFastEP );
 }
 
+#if defined(VGP_amd64_linux)
+/* An empty XIndir inline cache was executed.  Fill it with the
+   place it was going to. */
+static
+void handle_xindir_icfill ( ThreadId tid, void* place_to_fill )
+{
+   UInt to_sNo, to_tteNo;
+
+   if (!find_patch_target(tid, &to_sNo, &to_tteNo))
+      return;
+   VG_(tt_tc_fill_ic)( place_to_fill, to_sNo, to_tteNo );
+}
+
+/* A return went to a call's return point before it was known.  Make
+   the call record the place it returned to from now on. */
+static
+void handle_ret_fill ( ThreadId tid, void* place_to_fill )
+{
+   UInt to_sNo, to_tteNo;
+
+   if (!find_patch_target(tid, &to_sNo, &to_tteNo))
+      return;
+   VG_(tt_tc_fill_ret_site)( place_to_fill, to_sNo, to_tteNo );
+}
+#endif
+
 static void handle_syscall(ThreadId tid, UInt trc)
 {
    ThreadState * volatile tst = VG_(get_ThreadState)(tid);
@@ -1193,6 +1414,9 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
 
    /* set the proper running signal mask */
    block_signals();
+
+   if (VG_(clo_self_profile))
+      VG_(self_profile_start_thread)(tid);
    
    vg_assert(VG_(is_running_thread)(tid));
 
@@ -1309,7 +1533,9 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
             request, since chaining in the no-redir cache is too
             complex. */
          vg_assert(trc[0] != VG_TRC_CHAIN_ME_TO_SLOW_EP
-                   && trc[0] != VG_TRC_CHAIN_ME_TO_FAST_EP);
+                   && trc[0] != VG_TRC_CHAIN_ME_TO_FAST_EP
+                   && trc[0] != VG_TRC_XINDIR_ICFILL
+                   && trc[0] != VG_TRC_RET_FILL);
       }
 
       switch (trc[0]) {
@@ -1337,6 +1563,20 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
          break;
       }
 
+#     if defined(VGP_amd64_linux)
+      case VG_TRC_XINDIR_ICFILL: {
+         if (0) VG_(printf)("sched: XINDIR_ICFILL: %p\n", (void*)trc[1] );
+         handle_xindir_icfill(tid, (void*)trc[1]);
+         break;
+      }
+
+      case VG_TRC_RET_FILL: {
+         if (0) VG_(printf)("sched: RET_FILL: %p\n", (void*)trc[1] );
+         handle_ret_fill(tid, (void*)trc[1]);
+         break;
+      }
+#     endif
+
       case VEX_TRC_JMP_CLIENTREQ:
 	 do_client_request(tid);
 	 break;
@@ -1544,6 +1784,9 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
 
       if (UNLIKELY(VG_(clo_profyle_sbs)) && VG_(clo_profyle_interval) > 0)
          maybe_show_sb_profile();
+
+      if (UNLIKELY(VG_(clo_tiered_translation)))
+         maybe_promote_hot_translations();
    }
 
    if (VG_(clo_trace_sched))
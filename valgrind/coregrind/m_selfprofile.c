@@ -0,0 +1,497 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Sampling where Valgrind itself spends its time.              ---*/
+/*---                                              m_selfprofile.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   Copyright (C) 2000-2013 Julian Seward
+      jseward@acm.org
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#include "pub_core_basics.h"
+#include "pub_core_vki.h"
+#include "pub_core_vkiscnums.h"
+#include "pub_core_threadstate.h"
+#include "pub_core_clientstate.h"
+#include "pub_core_debuginfo.h"
+#include "pub_core_libcbase.h"
+#include "pub_core_libcassert.h"
+#include "pub_core_libcfile.h"
+#include "pub_core_libcprint.h"
+#include "pub_core_libcproc.h"
+#include "pub_core_mallocfree.h"
+#include "pub_core_options.h"
+#include "pub_core_signals.h"       // VG_SIGVGPROF
+#include "pub_core_syscall.h"
+#include "pub_core_transtab.h"      // VG_(is_in_translation_cache)
+#include "pub_core_wordfm.h"
+#include "pub_core_xarray.h"
+#include "pub_core_selfprofile.h"   // self
+
+/* Each thread gets VG_SIGVGPROF after every SP_PERIOD_CYCLES cycles
+   of user-mode CPU time it uses, counted by a perf_event_open
+   hardware counter whose overflow is delivered as a signal.  If the
+   kernel won't give us one (no PMU, perf_event_paranoid, seccomp),
+   we fall back to a POSIX timer on the thread's CPU-time clock, firing
+   every SP_PERIOD_USECS.  Either way the signal goes to the thread
+   that used the time, and is blocked while the thread is in a client
+   syscall, so the client never sees it or an EINTR caused by it.
+
+   sigvgprof_handler in m_signals passes the interrupted PC to
+   VG_(self_profile_sample), which counts it in an open-addressed hash
+   table allocated up front.  Samples in the code caches are only
+   counted as a whole: the guest code they belong to is the tools'
+   business.  Threads can run in parallel, so the table is updated
+   with atomic operations; a sample that finds no free slot is just
+   counted as dropped. */
+
+#define SP_PERIOD_CYCLES 1000000ULL
+#define SP_PERIOD_USECS  1000
+
+#define SP_TABLE_BITS    16
+#define SP_TABLE_SIZE    (1 << SP_TABLE_BITS)
+#define SP_MAX_PROBES    32
+
+typedef
+   struct {
+      Addr  pc;
+      UWord count;
+   }
+   SPEntry;
+
+typedef
+   enum { SP_None, SP_Perf, SP_Timer }
+   SPMethod;
+
+static SPEntry* sp_table = NULL;
+static UWord    sp_n_samples   = 0;
+static UWord    sp_n_generated = 0;  /* in the code caches */
+static UWord    sp_n_dropped   = 0;  /* found the table full */
+static Bool     sp_stopped     = False;
+static SPMethod sp_method      = SP_None;
+
+/* Per thread: the perf_event fd, or the timer id, or -1. */
+static Int      sp_handle[VG_N_THREADS];
+
+
+/* ---------------------------------------------------------------------
+   Starting and stopping a thread's sampler
+   ------------------------------------------------------------------ */
+
+#if defined(VGO_linux)
+
+static Int start_perf_sampler ( void )
+{
+   struct vki_perf_event_attr attr;
+   struct vki_f_owner_ex      owner;
+   SysRes sres;
+   Int    fd;
+
+   VG_(memset)(&attr, 0, sizeof(attr));
+   attr.type           = VKI_PERF_TYPE_HARDWARE;
+   attr.size           = sizeof(attr);
+   attr.config         = VKI_PERF_COUNT_HW_CPU_CYCLES;
+   attr.sample_period  = SP_PERIOD_CYCLES;
+   attr.exclude_kernel = 1;
+   attr.exclude_hv     = 1;
+
+   sres = VG_(do_syscall5)(__NR_perf_event_open, (UWord)&attr,
+                           0/*this thread*/, -1/*any cpu*/,
+                           -1/*no group*/, 0/*flags*/);
+   if (sr_isError(sres))
+      return -1;
+   fd = VG_(safe_fd)(sr_Res(sres));
+
+   /* Have each counter overflow sent to this thread as VG_SIGVGPROF.
+      O_ASYNC goes last, so nothing is sent until the rest is set. */
+   owner.type = VKI_F_OWNER_TID;
+   owner.pid  = VG_(gettid)();
+   if (VG_(fcntl)(fd, VKI_F_SETSIG, VG_SIGVGPROF) < 0
+       || VG_(fcntl)(fd, VKI_F_SETOWN_EX, (Addr)&owner) < 0
+       || VG_(fcntl)(fd, VKI_F_SETFL, VKI_O_ASYNC) < 0) {
+      VG_(close)(fd);
+      return -1;
+   }
+   return fd;
+}
+
+static Int start_timer_sampler ( void )
+{
+   struct vki_sigevent    sev;
+   struct vki_itimerspec  its;
+   Int    timer;
+   SysRes sres;
+
+   VG_(memset)(&sev, 0, sizeof(sev));
+   sev.sigev_notify        = VKI_SIGEV_THREAD_ID;
+   sev.sigev_signo         = VG_SIGVGPROF;
+   sev._sigev_un._tid      = VG_(gettid)();
+   sres = VG_(do_syscall3)(__NR_timer_create, VKI_CLOCK_THREAD_CPUTIME_ID,
+                           (UWord)&sev, (UWord)&timer);
+   if (sr_isError(sres))
+      return -1;
+
+   its.it_interval.tv_sec  = 0;
+   its.it_interval.tv_nsec = SP_PERIOD_USECS * 1000;
+   its.it_value            = its.it_interval;
+   sres = VG_(do_syscall4)(__NR_timer_settime, timer, 0, (UWord)&its, 0);
+   if (sr_isError(sres)) {
+      VG_(do_syscall1)(__NR_timer_delete, timer);
+      return -1;
+   }
+   return timer;
+}
+
+static void stop_sampler ( Int handle )
+{
+   if (sp_method == SP_Perf)
+      VG_(close)(handle);
+   else
+      VG_(do_syscall1)(__NR_timer_delete, handle);
+}
+
+#else
+
+static Int  start_perf_sampler  ( void ) { return -1; }
+static Int  start_timer_sampler ( void ) { return -1; }
+static void stop_sampler ( Int handle )  { }
+
+#endif
+
+/* After a fork the child has only the forking thread, and none of the
+   parent's timers.  Its perf_event fds still count the parent's
+   threads, so close them, and start again from nothing. */
+static void self_profile_atfork_child ( ThreadId me )
+{
+   Int i;
+   for (i = 0; i < VG_N_THREADS; i++) {
+      if (sp_handle[i] != -1 && sp_method == SP_Perf)
+         VG_(close)(sp_handle[i]);
+      sp_handle[i] = -1;
+   }
+   VG_(memset)(sp_table, 0, SP_TABLE_SIZE * sizeof(SPEntry));
+   sp_n_samples = sp_n_generated = sp_n_dropped = 0;
+   VG_(self_profile_start_thread)(me);
+}
+
+void VG_(self_profile_start_thread) ( ThreadId tid )
+{
+   Int i, h = -1;
+
+   vg_assert(VG_(clo_self_profile));
+   vg_assert(tid >= 0 && tid < VG_N_THREADS);
+
+   if (sp_table == NULL) {
+      sp_table = VG_(calloc)("selfprofile.table", SP_TABLE_SIZE,
+                             sizeof(SPEntry));
+      for (i = 0; i < VG_N_THREADS; i++)
+         sp_handle[i] = -1;
+      VG_(atfork)(NULL, NULL, self_profile_atfork_child);
+   }
+   if (sp_stopped)
+      return;
+
+   /* Choose how to sample when the first thread starts, and stick to
+      it, so that all threads' samples mean the same. */
+   if (sp_method != SP_Timer) {
+      h = start_perf_sampler();
+      if (h != -1)
+         sp_method = SP_Perf;
+   }
+   if (sp_method != SP_Perf) {
+      h = start_timer_sampler();
+      if (h != -1)
+         sp_method = SP_Timer;
+   }
+   if (h == -1) {
+      VG_(umsg)("Warning: --self-profile=yes: can't start sampling "
+                "thread %d\n", tid);
+      return;
+   }
+   sp_handle[tid] = h;
+}
+
+void VG_(self_profile_stop_thread) ( ThreadId tid )
+{
+   vg_assert(tid >= 0 && tid < VG_N_THREADS);
+   if (sp_handle[tid] == -1)
+      return;
+   stop_sampler(sp_handle[tid]);
+   sp_handle[tid] = -1;
+}
+
+
+/* ---------------------------------------------------------------------
+   Taking samples
+   ------------------------------------------------------------------ */
+
+void VG_(self_profile_sample) ( Addr pc )
+{
+   UWord h, i;
+
+   if (UNLIKELY(sp_table == NULL || sp_stopped))
+      return;
+
+   __sync_fetch_and_add(&sp_n_samples, 1);
+   if (VG_(is_in_translation_cache)(pc)) {
+      __sync_fetch_and_add(&sp_n_generated, 1);
+      return;
+   }
+
+   h = ((UInt)((pc >> 2) * 2654435761U)) >> (32 - SP_TABLE_BITS);
+   for (i = 0; i < SP_MAX_PROBES; i++) {
+      SPEntry* e = &sp_table[(h + i) & (SP_TABLE_SIZE - 1)];
+      if (e->pc == 0)
+         __sync_bool_compare_and_swap(&e->pc, 0, pc);
+      if (e->pc == pc) {
+         __sync_fetch_and_add(&e->count, 1);
+         return;
+      }
+   }
+   __sync_fetch_and_add(&sp_n_dropped, 1);
+}
+
+
+/* ---------------------------------------------------------------------
+   Writing the profile
+   ------------------------------------------------------------------ */
+
+#define SP_NAME_LEN 256
+
+static void sp_write ( Int fd, const HChar* format, ... )
+                       PRINTF_CHECK(2, 3);
+static void sp_write ( Int fd, const HChar* format, ... )
+{
+   HChar   buf[4 * SP_NAME_LEN];
+   va_list vargs;
+   va_start(vargs, format);
+   VG_(vsnprintf)(buf, sizeof(buf), format, vargs);
+   va_end(vargs);
+   VG_(write)(fd, buf, VG_(strlen)(buf));
+}
+
+static Int cmp_SPEntry_by_pc ( const void* a, const void* b )
+{
+   const SPEntry* ea = (const SPEntry*)a;
+   const SPEntry* eb = (const SPEntry*)b;
+   if (ea->pc < eb->pc) return -1;
+   if (ea->pc > eb->pc) return 1;
+   return 0;
+}
+
+typedef
+   struct {
+      const HChar* name;
+      UWord        count;
+   }
+   SPFn;
+
+static Word cmp_names ( UWord a, UWord b )
+{
+   return (Word)VG_(strcmp)((const HChar*)a, (const HChar*)b);
+}
+
+/* Sort by decreasing count. */
+static Int cmp_SPFn_ptrs ( const void* a, const void* b )
+{
+   const SPFn* fa = *(const SPFn* const*)a;
+   const SPFn* fb = *(const SPFn* const*)b;
+   if (fa->count > fb->count) return -1;
+   if (fa->count < fb->count) return 1;
+   return VG_(strcmp)(fa->name, fb->name);
+}
+
+static void sp_charge_fn ( WordFM* fns, const HChar* name, UWord count )
+{
+   UWord keyW, valW;
+   SPFn* f;
+   if (VG_(lookupFM)(fns, &keyW, &valW, (UWord)name)) {
+      f = (SPFn*)valW;
+   } else {
+      f = VG_(malloc)("selfprofile.charge_fn.1", sizeof(SPFn));
+      f->name  = VG_(strdup)("selfprofile.charge_fn.2", name);
+      f->count = 0;
+      VG_(addToFM)(fns, (UWord)f->name, (UWord)f);
+   }
+   f->count += count;
+}
+
+/* The summary printed at exit: the top few functions, by samples. */
+static void show_top_fns ( WordFM* fns, UWord n_max )
+{
+   SPFn** fs;
+   UWord  keyW, valW, n, i;
+   HChar  buf_here[10];
+
+   n  = VG_(sizeFM)(fns);
+   fs = VG_(malloc)("selfprofile.show_top_fns.1",
+                    (n > 0 ? n : 1) * sizeof(SPFn*));
+   i  = 0;
+   VG_(initIterFM)(fns);
+   while (VG_(nextIterFM)(fns, &keyW, &valW))
+      fs[i++] = (SPFn*)valW;
+   VG_(doneIterFM)(fns);
+   vg_assert(i == n);
+   VG_(ssort)(fs, n, sizeof(SPFn*), cmp_SPFn_ptrs);
+
+   for (i = 0; i < n && i < n_max; i++) {
+      VG_(percentify)(fs[i]->count, sp_n_samples, 2, 6, buf_here);
+      VG_(umsg)("  %s  %s\n", buf_here, fs[i]->name);
+   }
+   VG_(free)(fs);
+}
+
+void VG_(self_profile_done) ( void )
+{
+   SPEntry* es;
+   WordFM*  fns;
+   UWord    n, i;
+   Int      fd;
+   SysRes   sres;
+   HChar    buf_here[10];
+   HChar    ob[SP_NAME_LEN], fl[SP_NAME_LEN], fn[SP_NAME_LEN];
+   HChar    cur_ob[SP_NAME_LEN], cur_fl[SP_NAME_LEN], cur_fn[SP_NAME_LEN];
+   UInt     line;
+   HChar*   out_file;
+
+   vg_assert(VG_(clo_self_profile));
+
+   /* Stop all the samplers first, so that writing the profile doesn't
+      show up in it. */
+   sp_stopped = True;
+   for (i = 0; i < VG_N_THREADS; i++)
+      VG_(self_profile_stop_thread)(i);
+   if (sp_table == NULL)
+      return;
+
+   /* Pull the used slots out and put them in address order, so that
+      the pcs of each function come out together. */
+   n = 0;
+   for (i = 0; i < SP_TABLE_SIZE; i++)
+      if (sp_table[i].count > 0)
+         n++;
+   es = VG_(malloc)("selfprofile.done.1", (n > 0 ? n : 1) * sizeof(SPEntry));
+   n = 0;
+   for (i = 0; i < SP_TABLE_SIZE; i++)
+      if (sp_table[i].count > 0)
+         es[n++] = sp_table[i];
+   VG_(ssort)(es, n, sizeof(SPEntry), cmp_SPEntry_by_pc);
+
+   /* As for --log-file, expand %p etc only now, so that after a fork
+      parent and child write different files. */
+   out_file = VG_(expand_file_name)("--self-profile-out-file",
+                                    VG_(clo_self_profile_out_file));
+   sres = VG_(open)(out_file, VKI_O_CREAT|VKI_O_TRUNC|VKI_O_WRONLY,
+                              VKI_S_IRUSR|VKI_S_IWUSR);
+   fd = sr_isError(sres) ? -1 : sr_Res(sres);
+   if (fd == -1)
+      VG_(umsg)("error: can't open self-profile output file '%s'\n",
+                out_file);
+
+   fns = VG_(newFM)(VG_(malloc), "selfprofile.done.2", VG_(free),
+                    cmp_names);
+   if (sp_n_generated > 0)
+      sp_charge_fn(fns, "(generated code)", sp_n_generated);
+
+   if (fd != -1) {
+      sp_write(fd, "# callgrind format\n");
+      sp_write(fd, "version: 1\n");
+      sp_write(fd, "creator: valgrind --self-profile=yes\n");
+      sp_write(fd, "pid: %d\n", VG_(getpid)());
+      sp_write(fd, "cmd: %s", VG_(args_the_exename)
+                              ? VG_(args_the_exename) : "");
+      for (i = 0; i < VG_(sizeXA)( VG_(args_for_client) ); i++) {
+         HChar* arg = * (HChar**) VG_(indexXA)( VG_(args_for_client), i );
+         if (arg)
+            sp_write(fd, " %s", arg);
+      }
+      sp_write(fd, "\n");
+      if (sp_method == SP_Perf)
+         sp_write(fd, "desc: Samples: one per %llu cycles\n",
+                  SP_PERIOD_CYCLES);
+      else
+         sp_write(fd, "desc: Samples: one per %d us of CPU time\n",
+                  SP_PERIOD_USECS);
+      sp_write(fd, "positions: instr line\n");
+      sp_write(fd, "events: Samples\n");
+      sp_write(fd, "summary: %lu\n\n", sp_n_samples);
+      if (sp_n_generated > 0)
+         sp_write(fd, "ob=(generated code)\nfl=???\nfn=(generated code)\n"
+                      "0 0 %lu\n", sp_n_generated);
+   }
+
+   cur_ob[0] = cur_fl[0] = cur_fn[0] = 0;
+   for (i = 0; i < n; i++) {
+      Addr pc = es[i].pc;
+      if (!VG_(get_objname)(pc, ob, sizeof(ob)))
+         VG_(strcpy)(ob, "???");
+      if (!VG_(get_fnname)(pc, fn, sizeof(fn)))
+         VG_(strcpy)(fn, "???");
+      if (!VG_(get_filename_linenum)(pc, fl, sizeof(fl), NULL, 0, NULL,
+                                     &line)) {
+         VG_(strcpy)(fl, "???");
+         line = 0;
+      }
+      sp_charge_fn(fns, fn, es[i].count);
+
+      if (fd == -1)
+         continue;
+      if (VG_(strcmp)(ob, cur_ob) != 0 || VG_(strcmp)(fl, cur_fl) != 0
+          || VG_(strcmp)(fn, cur_fn) != 0) {
+         sp_write(fd, "\nob=%s\nfl=%s\nfn=%s\n", ob, fl, fn);
+         VG_(strcpy)(cur_ob, ob);
+         VG_(strcpy)(cur_fl, fl);
+         VG_(strcpy)(cur_fn, fn);
+      }
+      sp_write(fd, "0x%lx %u %lu\n", pc, line, es[i].count);
+   }
+
+   if (fd != -1) {
+      sp_write(fd, "\ntotals: %lu\n", sp_n_samples);
+      VG_(close)(fd);
+   }
+
+   if (VG_(clo_verbosity) > 0) {
+      if (sp_method == SP_Perf)
+         VG_(umsg)("Self-profile: %'lu samples, one per %'llu cycles\n",
+                   sp_n_samples, SP_PERIOD_CYCLES);
+      else
+         VG_(umsg)("Self-profile: %'lu samples, one per %'d us of CPU "
+                   "time\n", sp_n_samples, SP_PERIOD_USECS);
+      if (sp_n_dropped > 0) {
+         VG_(percentify)(sp_n_dropped, sp_n_samples, 2, 6, buf_here);
+         VG_(umsg)("  %s  (dropped: too many distinct pcs)\n", buf_here);
+      }
+      show_top_fns(fns, 10);
+      if (fd != -1)
+         VG_(umsg)("Self-profile written to %s\n", out_file);
+   }
+
+   VG_(free)(out_file);
+   VG_(free)(es);
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
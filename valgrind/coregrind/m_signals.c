@@ -227,6 +227,7 @@
 #include "pub_core_syswrap.h"
 #include "pub_core_tooliface.h"
 #include "pub_core_coredump.h"
+#include "pub_core_selfprofile.h"   // For VG_(self_profile_sample)()
 
 
 /* ---------------------------------------------------------------------
@@ -239,6 +240,8 @@ static void async_signalhandler ( Int sigNo, vki_siginfo_t *info,
                                              struct vki_ucontext * );
 static void sigvgkill_handler	( Int sigNo, vki_siginfo_t *info,
                                              struct vki_ucontext * );
+static void sigvgprof_handler	( Int sigNo, vki_siginfo_t *info,
+                                             struct vki_ucontext * );
 
 /* Maximum usable signal. */
 Int VG_(max_signal) = _VKI_NSIG;
@@ -749,6 +752,8 @@ void calculate_SKSS_from_SCSS ( SKSS* dst )
          // cases in the switch, so we handle them in the 'default' case.
 	 if (sig == VG_SIGVGKILL)
 	    skss_handler = sigvgkill_handler;
+	 else if (VG_(clo_self_profile) && sig == VG_SIGVGPROF)
+	    skss_handler = sigvgprof_handler;
 	 else {
 	    if (scss_handler == VKI_SIG_IGN)
 	       skss_handler = VKI_SIG_IGN;
@@ -2490,6 +2495,16 @@ void sync_signalhandler ( Int sigNo,
 {
    ThreadId tid = VG_(lwpid_to_vgtid)(VG_(gettid)());
    Bool from_user;
+   Bool was_parallel = False;
+
+   /* With --parallel-exec=yes, the thread may have been running
+      generated code without holding the lock.  Take it before looking
+      at any shared state; if we get to return into generated code,
+      give it up again. */
+   if (tid != VG_INVALID_THREADID && VG_(threads)[tid].in_parallel_run) {
+      VG_(parallel_run_end)(tid);
+      was_parallel = True;
+   }
 
    if (0) 
       VG_(printf)("sync_sighandler(%d, %p, %p)\n", sigNo, info, uc);
@@ -2536,6 +2551,9 @@ void sync_signalhandler ( Int sigNo,
    } else {
       sync_signalhandler_from_kernel(tid, sigNo, info, uc);
    }
+
+   if (was_parallel)
+      VG_(parallel_run_begin)(tid);
 }
 
 
@@ -2577,6 +2595,18 @@ static void sigvgkill_handler(int signo, vki_siginfo_t *si,
    VG_(core_panic)("sigvgkill_handler couldn't return to the scheduler\n");
 }
 
+/* 
+   A sampling tick for --self-profile=yes.  This can arrive whenever
+   the thread is running Valgrind or generated code, so do nothing but
+   note where it was.
+ */
+static void sigvgprof_handler(int signo, vki_siginfo_t *si,
+                                         struct vki_ucontext *uc)
+{
+   vg_assert(signo == VG_SIGVGPROF);
+   VG_(self_profile_sample)( VG_UCONTEXT_INSTR_PTR(uc) );
+}
+
 static __attribute((unused))
 void pp_ksigaction ( vki_sigaction_toK_t* sa )
 {
@@ -2627,6 +2657,9 @@ void VG_(poll_signals)(ThreadId tid)
    /* look for all the signals this thread isn't blocking */
    /* pollset = ~tst->sig_mask */
    VG_(sigcomplementset)( &pollset, &tst->sig_mask );
+   /* Leave any sampling tick pending for sigvgprof_handler. */
+   if (VG_(clo_self_profile))
+      VG_(sigdelset)( &pollset, VG_SIGVGPROF );
 
    block_all_host_signals(&saved_mask); // protect signal queue
 
@@ -2755,6 +2788,11 @@ void VG_(sigstartup_actions) ( void )
    scss.scss_per_sig[VG_SIGVGKILL].scss_handler = VKI_SIG_IGN;
    scss.scss_per_sig[VG_SIGVGKILL].scss_flags   = VKI_SA_SIGINFO;
    VG_(sigfillset)(&scss.scss_per_sig[VG_SIGVGKILL].scss_mask);
+   if (VG_(clo_self_profile)) {
+      scss.scss_per_sig[VG_SIGVGPROF].scss_handler = VKI_SIG_IGN;
+      scss.scss_per_sig[VG_SIGVGPROF].scss_flags   = VKI_SA_SIGINFO;
+      VG_(sigfillset)(&scss.scss_per_sig[VG_SIGVGPROF].scss_mask);
+   }
 
    /* Copy the process' signal mask into the root thread. */
    vg_assert(VG_(threads)[1].status == VgTs_Init);
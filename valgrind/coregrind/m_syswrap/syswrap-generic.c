@@ -53,6 +53,7 @@
 #include "pub_core_machine.h"       // VG_(get_SP)
 #include "pub_core_mallocfree.h"
 #include "pub_core_options.h"
+#include "pub_core_pretranslate.h"  // VG_(shutdown_pretranslate)
 #include "pub_core_scheduler.h"
 #include "pub_core_signals.h"
 #include "pub_core_stacktrace.h"    // For VG_(get_and_pp_StackTrace)()
@@ -2647,6 +2648,10 @@ PRE(sys_execve)
    VG_(nuke_all_threads_except)( tid, VgSrc_ExitThread );
    VG_(reap_threads)(tid);
 
+   // Stop the translation helper process, if any, so that it does not
+   // linger as a zombie child of the new program.
+   VG_(shutdown_pretranslate)();
+
    // Set up the child's exe path.
    //
    if (trace_this_child) {
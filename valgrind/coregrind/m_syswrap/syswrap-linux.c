@@ -52,6 +52,7 @@
 #include "pub_core_tooliface.h"
 #include "pub_core_options.h"
 #include "pub_core_scheduler.h"
+#include "pub_core_selfprofile.h"
 #include "pub_core_signals.h"
 #include "pub_core_syscall.h"
 #include "pub_core_syswrap.h"
@@ -206,6 +207,9 @@ static void run_a_thread_NORETURN ( Word tidW )
 
       /* OK, thread is dead, but others still exist.  Just exit. */
 
+      if (VG_(clo_self_profile))
+         VG_(self_profile_stop_thread)(tid);
+
       /* This releases the run lock */
       VG_(exit_thread)(tid);
       vg_assert(tst->status == VgTs_Zombie);
@@ -1289,6 +1289,9 @@ static void sanitize_client_sigmask(vki_sigset_t *mask)
    VG_(sigdelset)(mask, VKI_SIGKILL);
    VG_(sigdelset)(mask, VKI_SIGSTOP);
    VG_(sigdelset)(mask, VG_SIGVGKILL); /* never block */
+   /* A sampling tick would make the syscall fail with EINTR. */
+   if (VG_(clo_self_profile))
+      VG_(sigaddset)(mask, VG_SIGVGPROF);
 }
 
 typedef
@@ -95,7 +95,10 @@ VgNeeds VG_(needs) = {
    .var_info	         = False,
    .malloc_replacement   = False,
    .xml_output           = False,
-   .final_IR_tidy_pass   = False
+   .final_IR_tidy_pass   = False,
+   .persistent_translations = False,
+   .parallel_execution   = False,
+   .exec_counts          = False
 };
 
 /* static */
@@ -199,6 +202,16 @@ Bool VG_(sanity_check_needs)(const HChar** failmsg)
       return False;
    }
 
+   /* Execution counters live at addresses baked into the generated
+      code, and are incremented without any locking. */
+   if (VG_(needs).exec_counts
+       && (VG_(needs).persistent_translations
+           || VG_(needs).parallel_execution)) {
+      *failmsg = "Tool error: 'exec_counts' can't be combined with\n"
+                 "   'persistent_translations' or 'parallel_execution'\n";
+      return False;
+   }
+
    return True;
 
 #undef CHECK_NOT
@@ -335,6 +348,21 @@ void VG_(needs_final_IR_tidy_pass)(
    VG_(tdict).tool_final_IR_tidy_pass = final_tidy;
 }
 
+void VG_(needs_persistent_translations)( void )
+{
+   VG_(needs).persistent_translations = True;
+}
+
+void VG_(needs_parallel_execution)( void )
+{
+   VG_(needs).parallel_execution = True;
+}
+
+void VG_(needs_exec_counts)( void )
+{
+   VG_(needs).exec_counts = True;
+}
+
 /*--------------------------------------------------------------------*/
 /* Tracked events.  Digit 'n' on DEFn is the REGPARMness. */
 
@@ -0,0 +1,666 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Persistent on-disk cache of translations.                    ---*/
+/*---                                               m_transcache.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   Copyright (C) 2000-2013 Julian Seward
+      jseward@acm.org
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#include "pub_core_basics.h"
+#include "pub_core_vki.h"
+#include "pub_core_aspacemgr.h"
+#include "pub_core_clientstate.h"  // VG_(args_for_valgrind)
+#include "pub_core_debuglog.h"
+#include "pub_core_hashtable.h"
+#include "pub_core_libcbase.h"
+#include "pub_core_libcassert.h"
+#include "pub_core_libcfile.h"
+#include "pub_core_libcprint.h"
+#include "pub_core_libcproc.h"     // VG_(getpid)
+#include "pub_core_machine.h"      // VG_(machine_get_VexArchInfo)
+#include "pub_core_mallocfree.h"
+#include "pub_core_options.h"
+#include "pub_core_redir.h"        // VG_(redir_do_lookup)
+#include "pub_core_tooliface.h"
+#include "pub_core_xarray.h"
+#include "pub_core_transcache.h"   // self
+
+
+/*------------------------------------------------------------*/
+/*--- Overview                                             ---*/
+/*------------------------------------------------------------*/
+
+/* A translation, as handed back by LibVEX_Translate and before it is
+   copied into the TC, is position independent: chain-me exits refer
+   to the (fixed) addresses of VG_(disp_cp_chain_me_to_{slow,fast}EP),
+   calls to helpers refer to the (fixed) addresses of functions in the
+   tool executable, and guest addresses are embedded as constants.
+   Patching for chaining only happens later, in the TC, and is undone
+   on discard.  So such a translation can be reused in a later run
+   provided that:
+
+   (1) the tool executable is byte-for-byte the same, so that all
+       helper and dispatcher addresses are the same.  We approximate
+       this by (dev, inode, size, mtime) of /proc/self/exe.
+
+   (2) the tool, its options, the core options and the host CPU
+       capabilities are the same.  These all go into the cache key,
+       which in turn is part of the cache file name.
+
+   (3) the tool does not embed pointers to dynamically allocated
+       data in its instrumentation (Cachegrind and Callgrind do, for
+       example).  Tools promise this with
+       VG_(needs_persistent_translations).
+
+   (4) the guest code the translation was made from is still present,
+       unchanged, at the same addresses.  We only cache translations
+       made entirely from file-backed executable mappings, and at
+       lookup time check the mappings and compare a hash of the guest
+       bytes.  Hashing the actual bytes subsumes checking the
+       object's build-id, and also copes with objects that were
+       rebuilt in place.
+
+   (5) the translation does not embed origin tags (ECUs), which are
+       only meaningful in the process that created them.  They are
+       embedded by the SP-update pass when the tool tracks origins of
+       new stack memory (Memcheck's --track-origins=yes), so we don't
+       do anything in that case.
+
+   In addition, translations with self-checks, profile counters or
+   gdbserver instrumentation are never cached; m_translate.c takes
+   care of that.
+
+   The whole cache is read in at startup and written back (to a
+   temporary file which is then renamed, so that concurrent runs
+   sharing a cache directory don't corrupt each other's files) at
+   exit.
+
+   With --pretranslate=yes the same table is also used, in memory
+   only if there is no cache directory, to hold translations made
+   ahead of time by the helper process (see m_pretranslate.c).  Those
+   satisfy the same conditions, and are validated the same way. */
+
+
+/*------------------------------------------------------------*/
+/*--- Types and state                                      ---*/
+/*------------------------------------------------------------*/
+
+#define TC_MAGIC          0x4548434143544756ULL  /* "VGTCACHE" */
+#define TC_FORMAT_VERSION 1ULL
+
+/* Don't write files bigger than this; translations made after the
+   limit is reached are simply not saved. */
+#define TC_MAX_CODE_SZB   (256 * 1024 * 1024)
+
+typedef
+   struct _TCEntry {
+      struct _TCEntry* next;
+      UWord            key;         /* nraddr */
+      Addr64           addr;        /* address translated from */
+      UInt             kind;        /* redirection kind */
+      UInt             n_guest_instrs;
+      ULong            guest_hash;  /* hash of guest bytes in vge */
+      VexGuestExtents  vge;
+      UInt             code_len;
+      UChar*           code;
+   }
+   TCEntry;
+
+static Bool        tc_enabled   = False;
+static VgHashTable tc_table     = NULL;
+static HChar*      tc_fname     = NULL;
+static ULong       tc_key       = 0;
+/* Set when the in-memory cache differs from the file. */
+static Bool        tc_dirty     = False;
+
+/* Stats */
+static ULong n_tc_loaded  = 0;
+static ULong n_tc_lookups = 0;
+static ULong n_tc_hits    = 0;
+static ULong n_tc_stale   = 0;
+static ULong n_tc_added   = 0;
+static ULong n_tc_saved   = 0;
+
+
+/*------------------------------------------------------------*/
+/*--- Hashing                                              ---*/
+/*------------------------------------------------------------*/
+
+/* 64-bit FNV-1a. */
+static ULong hash_bytes ( ULong h, const void* p, SizeT n )
+{
+   const UChar* b = p;
+   SizeT i;
+   for (i = 0; i < n; i++) {
+      h ^= (ULong)b[i];
+      h *= 0x100000001b3ULL;
+   }
+   return h;
+}
+
+#define HASH_INIT 0xcbf29ce484222325ULL
+
+static ULong hash_str ( ULong h, const HChar* s )
+{
+   /* include the terminating zero, so that "ab","c" != "a","bc" */
+   return hash_bytes(h, s, VG_(strlen)(s) + 1);
+}
+
+static ULong hash_guest_code ( VexGuestExtents* vge )
+{
+   UInt  i;
+   ULong h = HASH_INIT;
+   for (i = 0; i < vge->n_used; i++)
+      h = hash_bytes(h, (void*)(Addr)vge->base[i], (SizeT)vge->len[i]);
+   return h;
+}
+
+/* Are all the guest code extents in file-backed executable mappings
+   (and hence safe to read), and are the chased-into extents still
+   not redirected?  The latter mirrors the check made by
+   chase_into_ok() in m_translate.c at translation time. */
+static Bool guest_code_is_cacheable ( VexGuestExtents* vge )
+{
+   UInt i;
+   if (vge->n_used < 1 || vge->n_used > 3)
+      return False;
+   for (i = 0; i < vge->n_used; i++) {
+      Addr  base = (Addr)vge->base[i];
+      SizeT len  = (SizeT)vge->len[i];
+      NSegment const* seg = VG_(am_find_nsegment)(base);
+      if (seg == NULL || seg->kind != SkFileC || !seg->hasR || !seg->hasX)
+         return False;
+      if (len > 0 && base + len - 1 > seg->end)
+         return False;
+      if (i > 0 && VG_(redir_do_lookup)(vge->base[i], NULL) != vge->base[i])
+         return False;
+   }
+   return True;
+}
+
+Bool VG_(transcache_hash_guest_code) ( VexGuestExtents* vge,
+                                       /*OUT*/ULong* h )
+{
+   if (!guest_code_is_cacheable(vge))
+      return False;
+   *h = hash_guest_code(vge);
+   return True;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Entries                                              ---*/
+/*------------------------------------------------------------*/
+
+static void* tc_malloc ( const HChar* cc, SizeT n )
+{
+   return VG_(arena_malloc)(VG_AR_TTAUX, cc, n);
+}
+
+static void tc_free ( void* p )
+{
+   VG_(arena_free)(VG_AR_TTAUX, p);
+}
+
+static void free_entry ( void* p )
+{
+   TCEntry* e = p;
+   tc_free(e->code);
+   tc_free(e);
+}
+
+/* Add E to the table, replacing any existing entry with the same
+   key. */
+static void insert_entry ( TCEntry* e )
+{
+   TCEntry* old = VG_(HT_remove)(tc_table, e->key);
+   if (old)
+      free_entry(old);
+   VG_(HT_add_node)(tc_table, e);
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Serialisation                                        ---*/
+/*------------------------------------------------------------*/
+
+/* Entries are written in host byte order; the cache key includes the
+   platform, so a file is never read on a different kind of host. */
+
+static void put_bytes ( XArray* xa, const void* p, SizeT n )
+{
+   VG_(addBytesToXA)(xa, p, n);
+}
+
+static void put_U32 ( XArray* xa, UInt w )  { put_bytes(xa, &w, 4); }
+static void put_U64 ( XArray* xa, ULong w ) { put_bytes(xa, &w, 8); }
+
+/* A cursor for reading, which fails (and stays failed) rather than
+   overrunning the buffer. */
+typedef
+   struct { const UChar* p; SizeT left; Bool ok; }
+   Cursor;
+
+static void get_bytes ( Cursor* c, void* dst, SizeT n )
+{
+   if (!c->ok || c->left < n) {
+      c->ok = False;
+      VG_(memset)(dst, 0, n);
+      return;
+   }
+   VG_(memcpy)(dst, c->p, n);
+   c->p    += n;
+   c->left -= n;
+}
+
+static UInt  get_U32 ( Cursor* c ) { UInt w;  get_bytes(c, &w, 4); return w; }
+static ULong get_U64 ( Cursor* c ) { ULong w; get_bytes(c, &w, 8); return w; }
+
+static void load_cache_file ( void )
+{
+   SysRes   sres;
+   Int      fd, i, n;
+   Long     fsize;
+   UChar*   buf;
+   Cursor   c;
+   ULong    n_entries, j;
+
+   sres = VG_(open)(tc_fname, VKI_O_RDONLY, 0);
+   if (sr_isError(sres))
+      return; /* no cache yet; fine */
+   fd = sr_Res(sres);
+
+   fsize = VG_(fsize)(fd);
+   if (fsize < 32 || fsize > 2LL * TC_MAX_CODE_SZB) {
+      VG_(close)(fd);
+      return;
+   }
+
+   buf = tc_malloc("transcache.load.1", fsize);
+   for (i = 0; i < fsize; i += n) {
+      n = VG_(read)(fd, buf + i, fsize - i);
+      if (n <= 0)
+         break;
+   }
+   VG_(close)(fd);
+
+   c.p    = buf;
+   c.left = i;
+   c.ok   = i == fsize;
+
+   if (get_U64(&c) != TC_MAGIC
+       || get_U64(&c) != TC_FORMAT_VERSION
+       || get_U64(&c) != tc_key)
+      c.ok = False;
+   n_entries = get_U64(&c);
+
+   for (j = 0; c.ok && j < n_entries; j++) {
+      TCEntry e;
+      UInt    k;
+      VG_(memset)(&e, 0, sizeof(e));
+      e.key            = (UWord)get_U64(&c);
+      e.addr           = get_U64(&c);
+      e.kind           = get_U32(&c);
+      e.n_guest_instrs = get_U32(&c);
+      e.guest_hash     = get_U64(&c);
+      e.vge.n_used     = get_U32(&c);
+      for (k = 0; k < 3; k++) {
+         e.vge.base[k] = get_U64(&c);
+         e.vge.len[k]  = (UShort)get_U32(&c);
+      }
+      e.code_len       = get_U32(&c);
+      if (e.vge.n_used < 1 || e.vge.n_used > 3
+          || e.code_len == 0 || e.code_len >= 60000
+          || e.code_len > c.left)
+         c.ok = False;
+      if (!c.ok)
+         break;
+
+      TCEntry* ne = tc_malloc("transcache.load.2", sizeof(TCEntry));
+      *ne = e;
+      ne->code = tc_malloc("transcache.load.3", e.code_len);
+      get_bytes(&c, ne->code, e.code_len);
+      insert_entry(ne);
+      n_tc_loaded++;
+   }
+
+   tc_free(buf);
+
+   if (!c.ok) {
+      /* Corrupt or truncated.  Keep whatever we managed to read --
+         each entry is validated against the guest code before use
+         anyway -- but make sure the file gets rewritten. */
+      VG_(debugLog)(1, "transcache", "%s: corrupt, ignoring remainder\n",
+                    tc_fname);
+      tc_dirty = True;
+   }
+
+   if (VG_(clo_verbosity) > 1)
+      VG_(message)(Vg_DebugMsg,
+                   "transcache: loaded %'llu translations from %s\n",
+                   n_tc_loaded, tc_fname);
+}
+
+static Bool write_all ( Int fd, const UChar* p, SizeT n )
+{
+   while (n > 0) {
+      Int chunk = n > (1 << 20) ? (1 << 20) : (Int)n;
+      Int w = VG_(write)(fd, p, chunk);
+      if (w <= 0)
+         return False;
+      p += w;
+      n -= w;
+   }
+   return True;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Initialisation                                       ---*/
+/*------------------------------------------------------------*/
+
+/* Command line args which cannot influence the generated code, and
+   so are left out of the cache key. */
+static Bool arg_is_irrelevant ( const HChar* arg )
+{
+   return VG_(strcmp)(arg, "-q") == 0
+          || VG_(strcmp)(arg, "-v") == 0
+          || VG_(strcmp)(arg, "-d") == 0
+          || VG_(strcmp)(arg, "--quiet") == 0
+          || VG_(strcmp)(arg, "--verbose") == 0
+          || VG_(strncmp)(arg, "--log-", 6) == 0
+          || VG_(strncmp)(arg, "--xml-", 6) == 0
+          || VG_(strncmp)(arg, "--stats=", 8) == 0
+          || VG_(strncmp)(arg, "--time-stamp=", 13) == 0
+          || VG_(strncmp)(arg, "--translation-cache-dir=", 24) == 0
+          || VG_(strncmp)(arg, "--pretranslate=", 15) == 0;
+}
+
+void VG_(init_transcache) ( void )
+{
+   struct vg_stat st;
+   SysRes         sres;
+   VexArch        vex_arch;
+   VexArchInfo    vex_archinfo;
+   Word           i;
+   ULong          h;
+
+   if (VG_(clo_translation_cache_dir) == NULL && !VG_(clo_pretranslate))
+      return;
+
+   /* (5) in the overview. */
+   if (VG_(tdict).track_new_mem_stack_w_ECU != NULL) {
+      VG_(umsg)("Warning: --translation-cache-dir and --pretranslate are "
+                "ignored when stack origins are tracked\n");
+      return;
+   }
+
+   if (VG_(clo_translation_cache_dir) == NULL) {
+      /* No file, but the helper process needs somewhere to put its
+         translations.  m_main has already checked that the tool
+         supports that. */
+      tc_table   = VG_(HT_construct)("transcache");
+      tc_enabled = True;
+      return;
+   }
+
+   if (!VG_(needs).persistent_translations) {
+      VG_(umsg)("Warning: --translation-cache-dir is not supported "
+                "by %s; ignoring it\n", VG_(details).name);
+      return;
+   }
+   if (VG_(clo_profyle_sbs)) {
+      VG_(umsg)("Warning: --translation-cache-dir is ignored when "
+                "--profile-flags is in use\n");
+      return;
+   }
+   if (!VG_(is_dir)(VG_(clo_translation_cache_dir))) {
+      VG_(umsg)("Warning: --translation-cache-dir=%s: "
+                "not a directory; ignoring it\n",
+                VG_(clo_translation_cache_dir));
+      return;
+   }
+
+   /* (1) in the overview: identity of the tool executable. */
+   sres = VG_(stat)("/proc/self/exe", &st);
+   if (sr_isError(sres)) {
+      VG_(umsg)("Warning: --translation-cache-dir: cannot identify "
+                "the tool executable; ignoring it\n");
+      return;
+   }
+
+   /* (2) in the overview: everything else the code depends on. */
+   VG_(machine_get_VexArchInfo)( &vex_arch, &vex_archinfo );
+   h = HASH_INIT;
+   h = hash_str(h, VERSION);
+   h = hash_str(h, VG_PLATFORM);
+   h = hash_str(h, VG_(details).name);
+   h = hash_bytes(h, &st.dev,        sizeof(st.dev));
+   h = hash_bytes(h, &st.ino,        sizeof(st.ino));
+   h = hash_bytes(h, &st.size,       sizeof(st.size));
+   h = hash_bytes(h, &st.mtime,      sizeof(st.mtime));
+   h = hash_bytes(h, &st.mtime_nsec, sizeof(st.mtime_nsec));
+   h = hash_bytes(h, &vex_arch,      sizeof(vex_arch));
+   h = hash_bytes(h, &vex_archinfo.hwcaps, sizeof(vex_archinfo.hwcaps));
+   for (i = 0; i < VG_(sizeXA)(VG_(args_for_valgrind)); i++) {
+      HChar* arg = *(HChar**)VG_(indexXA)(VG_(args_for_valgrind), i);
+      if (!arg_is_irrelevant(arg))
+         h = hash_str(h, arg);
+   }
+   tc_key = h;
+
+   tc_fname = tc_malloc("transcache.fname",
+                        VG_(strlen)(VG_(clo_translation_cache_dir))
+                        + VG_(strlen)(VG_(details).name)
+                        + VG_(strlen)(VG_PLATFORM) + 40);
+   VG_(sprintf)(tc_fname, "%s/vgtc-%s-%s-%016llx",
+                VG_(clo_translation_cache_dir), VG_(details).name,
+                VG_PLATFORM, tc_key);
+
+   tc_table   = VG_(HT_construct)("transcache");
+   tc_enabled = True;
+
+   load_cache_file();
+}
+
+Bool VG_(transcache_enabled) ( void )
+{
+   return tc_enabled;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Lookup and add                                       ---*/
+/*------------------------------------------------------------*/
+
+Bool VG_(transcache_lookup) ( /*OUT*/VexGuestExtents* vge,
+                              /*OUT*/UChar** code,
+                              /*OUT*/UInt*   code_len,
+                              /*OUT*/UInt*   n_guest_instrs,
+                              Addr64 nraddr, Addr64 addr,
+                              UInt kind )
+{
+   TCEntry* e;
+
+   if (!tc_enabled)
+      return False;
+
+   n_tc_lookups++;
+   e = VG_(HT_lookup)(tc_table, (UWord)nraddr);
+   if (e == NULL)
+      return False;
+
+   if (e->addr != addr || e->kind != kind
+       || e->vge.base[0] != addr
+       || !guest_code_is_cacheable(&e->vge)
+       || hash_guest_code(&e->vge) != e->guest_hash) {
+      /* Stale: the code has changed or moved, or the redirection
+         state differs.  Drop it; the caller will make a fresh
+         translation and offer it to us. */
+      VG_(HT_remove)(tc_table, (UWord)nraddr);
+      free_entry(e);
+      n_tc_stale++;
+      tc_dirty = True;
+      return False;
+   }
+
+   n_tc_hits++;
+   *vge            = e->vge;
+   *code           = e->code;
+   *code_len       = e->code_len;
+   *n_guest_instrs = e->n_guest_instrs;
+   return True;
+}
+
+Bool VG_(transcache_has) ( Addr64 nraddr )
+{
+   return tc_enabled && VG_(HT_lookup)(tc_table, (UWord)nraddr) != NULL;
+}
+
+void VG_(transcache_add) ( VexGuestExtents* vge,
+                           Addr64 nraddr, Addr64 addr, UInt kind,
+                           UChar* code, UInt code_len,
+                           UInt n_guest_instrs )
+{
+   TCEntry* e;
+
+   if (!tc_enabled)
+      return;
+   if (!guest_code_is_cacheable(vge))
+      return;
+
+   e = tc_malloc("transcache.add.1", sizeof(TCEntry));
+   VG_(memset)(e, 0, sizeof(*e));
+   e->key            = (UWord)nraddr;
+   e->addr           = addr;
+   e->kind           = kind;
+   e->n_guest_instrs = n_guest_instrs;
+   e->guest_hash     = hash_guest_code(vge);
+   e->vge            = *vge;
+   e->code_len       = code_len;
+   e->code           = tc_malloc("transcache.add.2", code_len);
+   VG_(memcpy)(e->code, code, code_len);
+   insert_entry(e);
+
+   n_tc_added++;
+   tc_dirty = True;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Saving                                               ---*/
+/*------------------------------------------------------------*/
+
+void VG_(save_transcache) ( void )
+{
+   XArray*   xa;
+   TCEntry** arr;
+   UInt      n, i, k;
+   ULong     code_szB = 0, n_written = 0;
+   HChar*    tmpname;
+   SysRes    sres;
+   Int       fd;
+   Bool      ok;
+
+   if (!tc_enabled || !tc_dirty || tc_fname == NULL)
+      return;
+
+   xa = VG_(newXA)(tc_malloc, "transcache.save.1", tc_free, sizeof(UChar));
+
+   arr = (TCEntry**)VG_(HT_to_array)(tc_table, &n);
+   for (i = 0; i < n; i++) {
+      TCEntry* e = arr[i];
+      if (code_szB + e->code_len > TC_MAX_CODE_SZB)
+         break;
+      code_szB += e->code_len;
+      put_U64(xa, (ULong)e->key);
+      put_U64(xa, e->addr);
+      put_U32(xa, e->kind);
+      put_U32(xa, e->n_guest_instrs);
+      put_U64(xa, e->guest_hash);
+      put_U32(xa, e->vge.n_used);
+      for (k = 0; k < 3; k++) {
+         put_U64(xa, k < e->vge.n_used ? e->vge.base[k] : 0);
+         put_U32(xa, k < e->vge.n_used ? (UInt)e->vge.len[k] : 0);
+      }
+      put_U32(xa, e->code_len);
+      put_bytes(xa, e->code, e->code_len);
+      n_written++;
+   }
+   VG_(free)(arr);
+
+   tmpname = tc_malloc("transcache.save.2", VG_(strlen)(tc_fname) + 30);
+   VG_(sprintf)(tmpname, "%s.tmp.%d", tc_fname, VG_(getpid)());
+
+   sres = VG_(open)(tmpname, VKI_O_CREAT|VKI_O_WRONLY|VKI_O_TRUNC,
+                    VKI_S_IRUSR|VKI_S_IWUSR);
+   if (sr_isError(sres)) {
+      VG_(umsg)("Warning: cannot create translation cache file %s\n",
+                tmpname);
+   } else {
+      ULong hdr[4];
+      fd     = sr_Res(sres);
+      hdr[0] = TC_MAGIC;
+      hdr[1] = TC_FORMAT_VERSION;
+      hdr[2] = tc_key;
+      hdr[3] = n_written;
+      ok = write_all(fd, (UChar*)hdr, sizeof(hdr));
+      if (ok && VG_(sizeXA)(xa) > 0)
+         ok = write_all(fd, VG_(indexXA)(xa, 0), VG_(sizeXA)(xa));
+      VG_(close)(fd);
+      if (ok && VG_(rename)(tmpname, tc_fname) == 0) {
+         n_tc_saved = n_written;
+         if (VG_(clo_verbosity) > 1)
+            VG_(message)(Vg_DebugMsg,
+                         "transcache: saved %'llu translations to %s\n",
+                         n_written, tc_fname);
+      } else {
+         VG_(umsg)("Warning: failed to write translation cache file %s\n",
+                   tc_fname);
+         VG_(unlink)(tmpname);
+      }
+   }
+
+   tc_free(tmpname);
+   VG_(deleteXA)(xa);
+   tc_dirty = False;
+}
+
+void VG_(print_transcache_stats) ( void )
+{
+   if (!tc_enabled)
+      return;
+   VG_(message)(Vg_DebugMsg,
+      "transcache: %'llu loaded, %'llu lookups, %'llu hits, %'llu stale\n",
+      n_tc_loaded, n_tc_lookups, n_tc_hits, n_tc_stale);
+   VG_(message)(Vg_DebugMsg,
+      "transcache: %'llu added, %'llu saved\n",
+      n_tc_added, n_tc_saved);
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
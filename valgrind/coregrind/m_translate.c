@@ -40,6 +40,7 @@
 #include "pub_core_libcassert.h"
 #include "pub_core_libcprint.h"
 #include "pub_core_options.h"
+#include "pub_core_libcproc.h"   // VG_(read_cycle_counter)
 
 #include "pub_core_debuginfo.h"  // VG_(get_fnname_w_offset)
 #include "pub_core_redir.h"      // VG_(redir_do_lookup)
@@ -50,6 +51,9 @@
 
 #include "pub_core_translate.h"
 #include "pub_core_transtab.h"
+#include "pub_core_transcache.h"
+#include "pub_core_pretranslate.h"
+#include "pub_core_sbprofile.h"  // VG_(record_translation_cost)
 #include "pub_core_dispatch.h" // VG_(run_innerloop__dispatch_{un}profiled)
                                // VG_(run_a_noredir_translation__return_point)
 
@@ -71,6 +75,14 @@ static UInt n_SP_updates_fast            = 0;
 static UInt n_SP_updates_generic_known   = 0;
 static UInt n_SP_updates_generic_unknown = 0;
 
+static UInt n_traces_formed = 0;
+static UInt n_trace_steps   = 0;
+
+static ULong n_ra_spills    = 0;
+static ULong n_ra_reloads   = 0;
+static ULong n_ra_moves     = 0;
+static ULong n_ra_coalesced = 0;
+
 void VG_(print_translation_stats) ( void )
 {
    HChar buf[7];
@@ -90,6 +102,17 @@ void VG_(print_translation_stats) ( void )
    VG_(message)(Vg_DebugMsg,
       "translate: generic_unknown SP updates identified: %'u (%s)\n",
       n_SP_updates_generic_unknown, buf );
+
+   if (VG_(clo_trace_formation))
+      VG_(message)(Vg_DebugMsg,
+         "translate: traces formed: %'u (%'u branches followed)\n",
+         n_traces_formed, n_trace_steps );
+
+   VG_(message)(Vg_DebugMsg,
+      "translate: regalloc v%d: %'llu spills, %'llu reloads, "
+      "%'llu split moves, %'llu coalesced\n",
+      VG_(clo_vex_control).regalloc_version,
+      n_ra_spills, n_ra_reloads, n_ra_moves, n_ra_coalesced );
 }
 
 /*------------------------------------------------------------*/
@@ -240,6 +263,57 @@ IRSB* tool_instrument_then_gdbserver_if_needed ( VgCallbackClosure* closureV,
        hWordTy);                                   
 }
 
+/* With --pretranslate=yes, the static successors of the block being
+   translated are collected here from the guest IR, before the tool
+   sees it, and then passed on to m_pretranslate. */
+#define N_SUCCS 8
+static Addr64 succs[N_SUCCS];
+static Int    n_succs = 0;
+
+static IRSB* (*instrument_after_succs)( VgCallbackClosure*, IRSB*,
+                                        VexGuestLayout*, VexGuestExtents*,
+                                        VexArchInfo*, IRType, IRType );
+
+static void add_succ ( IRConst* con )
+{
+   Addr64 a;
+   Int    i;
+   switch (con->tag) {
+      case Ico_U32: a = (Addr64)con->Ico.U32; break;
+      case Ico_U64: a = con->Ico.U64; break;
+      default: return;
+   }
+   for (i = 0; i < n_succs; i++)
+      if (succs[i] == a)
+         return;
+   if (n_succs < N_SUCCS)
+      succs[n_succs++] = a;
+}
+
+static
+IRSB* collect_succs_then_instrument ( VgCallbackClosure* closureV,
+                                      IRSB*              sb_in,
+                                      VexGuestLayout*    layout,
+                                      VexGuestExtents*   vge,
+                                      VexArchInfo*       vai,
+                                      IRType             gWordTy,
+                                      IRType             hWordTy )
+{
+   Int i;
+   n_succs = 0;
+   for (i = 0; i < sb_in->stmts_used; i++) {
+      IRStmt* st = sb_in->stmts[i];
+      if (st && st->tag == Ist_Exit && st->Ist.Exit.jk == Ijk_Boring)
+         add_succ(st->Ist.Exit.dst);
+   }
+   if (sb_in->next->tag == Iex_Const
+       && (sb_in->jumpkind == Ijk_Boring || sb_in->jumpkind == Ijk_Call))
+      add_succ(sb_in->next->Iex.Const.con);
+
+   return instrument_after_succs(closureV, sb_in, layout, vge, vai,
+                                 gWordTy, hWordTy);
+}
+
 /* For tools that want to know about SP changes, this pass adds
    in the appropriate hooks.  We have to do it after the tool's
    instrumentation, so the tool doesn't have to worry about the C calls
@@ -907,6 +981,27 @@ static Bool chase_into_ok ( void* closureV, Addr64 addr64 )
 }
 
 
+/* This is a callback passed to LibVEX_Translate when making the
+   second-tier translation of hot code with --trace-formation=yes.
+   It picks the side of a conditional branch to carry on along.  We
+   don't have counts for the branch itself, only for entries to the
+   first-tier translations of its targets, so go with whichever of
+   those has been run at least twice as often as the other.  Zero
+   means we don't know enough to say. */
+static Addr64 trace_successor ( void* closureV,
+                                Addr64 taken, Addr64 not_taken )
+{
+   ULong n_taken     = VG_(guest_entry_exec_count)(taken);
+   ULong n_not_taken = VG_(guest_entry_exec_count)(not_taken);
+
+   if (n_taken > 0 && n_taken >= 2 * n_not_taken)
+      return taken;
+   if (n_not_taken > 0 && n_not_taken >= 2 * n_taken)
+      return not_taken;
+   return 0;
+}
+
+
 /* --------------- helpers for with-TOC platforms --------------- */
 
 /* NOTE: with-TOC platforms are: ppc64-linux. */
@@ -1339,6 +1434,9 @@ Bool VG_(translate) ( ThreadId tid,
    Addr64             addr;
    T_Kind             kind;
    Int                tmpbuf_used, verbosity, i;
+   Bool               in_helper, profiling;
+   ULong              phase_ticks[VexPhase_N];
+   ULong              t_start = 0;
    Bool (*preamble_fn)(void*,IRSB*);
    VexArch            vex_arch;
    VexArchInfo        vex_archinfo;
@@ -1360,6 +1458,13 @@ Bool VG_(translate) ( ThreadId tid,
       vex_init_done = True;
    }
 
+   /* In the helper process, we are translating code ahead of time
+      for our parent, not for a client thread of our own. */
+   in_helper = VG_(pretranslate_in_helper)();
+
+   if (VG_(clo_pretranslate) && !debugging_translation)
+      VG_(pretranslate_poll)();
+
    /* Establish the translation kind and actual guest address to
       start from.  Sets (addr,kind). */
    if (allow_redirection) {
@@ -1399,7 +1504,7 @@ Bool VG_(translate) ( ThreadId tid,
                    addr, name2 );
    }
 
-   if (!debugging_translation)
+   if (!debugging_translation && !in_helper)
       VG_TRACK( pre_mem_read, Vg_CoreTranslate, 
                               tid, "(translator)", addr, 1 );
 
@@ -1429,6 +1534,8 @@ Bool VG_(translate) ( ThreadId tid,
 
    if ( (!translations_allowable_from_seg(seg, addr))
         || addr == TRANSTAB_BOGUS_GUEST_ADDR ) {
+      if (in_helper)
+         return False;
       if (VG_(clo_trace_signals))
          VG_(message)(Vg_DebugMsg, "translations not allowed here (0x%llx)"
                                    " - throwing SEGV\n", addr);
@@ -1467,6 +1574,27 @@ Bool VG_(translate) ( ThreadId tid,
       verbosity = VG_(clo_trace_flags);
    }
 
+   /* Can we reuse a translation made by an earlier run? */
+   if (!debugging_translation && verbosity == 0 && kind != T_NoRedir
+       && !in_helper && VG_(transcache_enabled)()) {
+      UChar* code;
+      UInt   code_len, n_guest_instrs;
+      if (VG_(transcache_lookup)( &vge, &code, &code_len, &n_guest_instrs,
+                                  nraddr, addr, kind )
+          && VG_(gdbserver_instrumentation_needed)( &vge ) == Vg_VgdbNo) {
+         VG_(am_set_segment_hasT_if_SkFileC_or_SkAnonC)( seg );
+         for (i = 1; i < vge.n_used; i++)
+            VG_(am_set_segment_hasT_if_SkFileC_or_SkAnonC)(
+               VG_(am_find_nsegment)( vge.base[i] ) );
+         VG_(machine_get_VexArchInfo)( &vex_arch, NULL );
+         VG_(add_to_transtab)( &vge, nraddr, (Addr)code, code_len,
+                               False/*!is_self_checking*/,
+                               -1/*no profInc*/,
+                               n_guest_instrs, vex_arch );
+         return True;
+      }
+   }
+
    /* Figure out which preamble-mangling callback to send. */
    preamble_fn = NULL;
    if (kind == T_Redir_Replace)
@@ -1504,6 +1632,7 @@ Bool VG_(translate) ( ThreadId tid,
 
 #  if defined(VGP_amd64_linux)
    vex_abiinfo.guest_amd64_assume_fs_is_zero  = True;
+   vex_abiinfo.guest_amd64_calls_end_blocks   = VG_(clo_return_stack);
 #  endif
 #  if defined(VGP_amd64_darwin)
    vex_abiinfo.guest_amd64_assume_gs_is_0x60  = True;
@@ -1534,6 +1663,7 @@ Bool VG_(translate) ( ThreadId tid,
    vta.guest_bytes      = (UChar*)ULong_to_Ptr(addr);
    vta.guest_bytes_addr = (Addr64)addr;
    vta.chase_into_ok    = chase_into_ok;
+   vta.trace_successor  = NULL;
    vta.guest_extents    = &vge;
    vta.host_bytes       = tmpbuf;
    vta.host_bytes_size  = N_TMPBUF;
@@ -1552,8 +1682,14 @@ Bool VG_(translate) ( ThreadId tid,
              : VG_(tdict).tool_instrument;
      IRSB*(*g)(void*,
                IRSB*,VexGuestLayout*,VexGuestExtents*,VexArchInfo*,
-               IRType,IRType)
-       = (IRSB*(*)(void*,IRSB*,VexGuestLayout*,VexGuestExtents*,
+               IRType,IRType);
+     n_succs = 0;
+     if (VG_(clo_pretranslate) && kind != T_NoRedir
+         && !debugging_translation) {
+        instrument_after_succs = f;
+        f = collect_succs_then_instrument;
+     }
+     g = (IRSB*(*)(void*,IRSB*,VexGuestLayout*,VexGuestExtents*,
                    VexArchInfo*,IRType,IRType))f;
      vta.instrument1     = g;
    }
@@ -1567,8 +1703,36 @@ Bool VG_(translate) ( ThreadId tid,
    vta.needs_self_check  = needs_self_check;
    vta.preamble_function = preamble_fn;
    vta.traceflags        = verbosity;
-   vta.sigill_diag       = VG_(clo_sigill_diag);
-   vta.addProfInc        = VG_(clo_profyle_sbs) && kind != T_NoRedir;
+   vta.sigill_diag       = VG_(clo_sigill_diag) && !in_helper;
+   vta.addProfInc        = VG_(needs).exec_counts
+                           || ((VG_(clo_profyle_sbs)
+                                || VG_(clo_generational_transtab))
+                               && kind != T_NoRedir);
+   vta.iropt_level       = -1;
+   vta.guest_chase_thresh = -1;
+
+   /* With tiered translation, code not yet known to be hot gets a
+      cheap translation: minimal optimisation, no chasing, and a
+      counter by which m_transtab notices when it becomes hot.  Hot
+      code is then retranslated with full optimisation and more
+      aggressive chasing (unless the tool has disabled chasing), and
+      with --trace-formation=yes, continues along the hot side of
+      conditional branches for as long as it can. */
+   if (VG_(clo_tiered_translation) && kind != T_NoRedir
+       && !debugging_translation) {
+      VexControl* vc = &VG_(clo_vex_control);
+      if (!VG_(is_hot_guest_entry)(nraddr)) {
+         vta.addProfInc         = True;
+         vta.iropt_level        = vc->iropt_level < 1 ? vc->iropt_level : 1;
+         vta.guest_chase_thresh = 0;
+      } else if (vc->guest_chase_thresh > 0 && VG_(clo_trace_formation)) {
+         vta.trace_successor    = trace_successor;
+         vta.guest_chase_thresh = vc->guest_max_insns - 1;
+      } else if (vc->guest_chase_thresh > 0
+                 && vc->guest_chase_thresh < vc->guest_max_insns / 2) {
+         vta.guest_chase_thresh = vc->guest_max_insns / 2;
+      }
+   }
 
    /* Set up the dispatch continuation-point info.  If this is a
       no-redir translation then it cannot be chained, and the chain-me
@@ -1589,23 +1753,74 @@ Bool VG_(translate) ( ThreadId tid,
          = VG_(fnptr_to_fnentry)( &VG_(disp_cp_chain_me_to_fastEP) );
       vta.disp_cp_xindir
          = VG_(fnptr_to_fnentry)( &VG_(disp_cp_xindir) );
+#     if defined(VGP_amd64_linux)
+      vta.disp_cp_xindir_icfill
+         = VG_(clo_indirect_branch_cache)
+              ? VG_(fnptr_to_fnentry)( &VG_(disp_cp_xindir_icfill) )
+              : NULL;
+      vta.disp_cp_ret_fill
+         = VG_(clo_return_stack)
+              ? VG_(fnptr_to_fnentry)( &VG_(disp_cp_ret_fill) )
+              : NULL;
+#     else
+      vta.disp_cp_xindir_icfill      = NULL;
+      vta.disp_cp_ret_fill           = NULL;
+#     endif
    } else {
       vta.disp_cp_chain_me_to_slowEP = NULL;
       vta.disp_cp_chain_me_to_fastEP = NULL;
       vta.disp_cp_xindir             = NULL;
+      vta.disp_cp_xindir_icfill      = NULL;
+      vta.disp_cp_ret_fill           = NULL;
    }
    /* This doesn't involve chaining and so is always allowable. */
    vta.disp_cp_xassisted
       = VG_(fnptr_to_fnentry)( &VG_(disp_cp_xassisted) );
 
+   /* With --profile-translation=yes, have Vex time its phases.
+      Debugging retranslations, and those made by a pre-translation
+      helper, are not part of the run's cost. */
+   profiling = VG_(clo_profile_translation) && !debugging_translation
+               && !in_helper;
+   if (profiling) {
+      for (i = 0; i < VexPhase_N; i++)
+         phase_ticks[i] = 0;
+      vta.read_timer  = VG_(read_cycle_counter);
+      vta.phase_times = phase_ticks;
+      t_start = VG_(read_cycle_counter)();
+   } else {
+      vta.read_timer  = NULL;
+      vta.phase_times = NULL;
+   }
+
    /* Sheesh.  Finally, actually _do_ the translation! */
    tres = LibVEX_Translate ( &vta );
 
+   if (profiling) {
+      ULong ticks = VG_(read_cycle_counter)() - t_start;
+      UInt  guest_bytes = 0;
+      for (i = 0; i < vge.n_used; i++)
+         guest_bytes += vge.len[i];
+      VG_(record_translation_cost)( addr, guest_bytes, tmpbuf_used,
+                                    ticks, phase_ticks );
+   }
+
    vg_assert(tres.status == VexTransOK);
    vg_assert(tres.n_sc_extents >= 0 && tres.n_sc_extents <= 3);
    vg_assert(tmpbuf_used <= N_TMPBUF);
    vg_assert(tmpbuf_used > 0);
 
+   if (!debugging_translation && !in_helper) {
+      if (tres.n_trace_steps > 0) {
+         n_traces_formed++;
+         n_trace_steps += tres.n_trace_steps;
+      }
+      n_ra_spills    += tres.n_ra_spills;
+      n_ra_reloads   += tres.n_ra_reloads;
+      n_ra_moves     += tres.n_ra_moves;
+      n_ra_coalesced += tres.n_ra_coalesced;
+   }
+
    /* Tell aspacem of all segments that have had translations taken
       from them.  Optimisation: don't re-look up vge.base[0] since seg
       should already point to it. */
@@ -1627,6 +1842,18 @@ Bool VG_(translate) ( ThreadId tid,
 
    // If debugging, don't do anything with the translated block;  we
    // only did this for the debugging output produced along the way.
+   if (in_helper) {
+      // Send it to the parent, if it could use it.  The conditions
+      // are the same as for the persistent cache below.
+      if (kind != T_NoRedir
+          && tres.n_sc_extents == 0
+          && tres.offs_profInc == -1
+          && VG_(gdbserver_instrumentation_needed)( &vge ) == Vg_VgdbNo)
+         VG_(pretranslate_deliver)( &vge, nraddr, addr, kind,
+                                    &tmpbuf[0], tmpbuf_used,
+                                    tres.n_guest_instrs );
+   }
+   else
    if (!debugging_translation) {
 
       if (kind != T_NoRedir) {
@@ -1643,15 +1870,31 @@ Bool VG_(translate) ( ThreadId tid,
                                 tres.offs_profInc,
                                 tres.n_guest_instrs,
                                 vex_arch );
+
+          // Offer it to the persistent cache if it doesn't depend on
+          // anything that might differ in a later run.
+          if (VG_(transcache_enabled)()
+              && verbosity == 0
+              && tres.n_sc_extents == 0
+              && tres.offs_profInc == -1
+              && VG_(gdbserver_instrumentation_needed)( &vge ) == Vg_VgdbNo)
+             VG_(transcache_add)( &vge, nraddr, addr, kind,
+                                  &tmpbuf[0], tmpbuf_used,
+                                  tres.n_guest_instrs );
       } else {
-          vg_assert(tres.offs_profInc == -1); /* -1 == unset */
           VG_(add_to_unredir_transtab)( &vge,
                                         nraddr,
                                         (Addr)(&tmpbuf[0]), 
-                                        tmpbuf_used );
+                                        tmpbuf_used,
+                                        tres.offs_profInc,
+                                        vex_arch );
       }
    }
 
+   // Have the likely successors translated ahead of time.
+   if (n_succs > 0)
+      VG_(pretranslate_note_successors)( tid, succs, n_succs );
+
    return True;
 }
 
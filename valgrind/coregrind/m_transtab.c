@@ -43,7 +43,11 @@
 #include "pub_core_aspacemgr.h"
 #include "pub_core_mallocfree.h" // VG_(out_of_memory_NORETURN)
 #include "pub_core_xarray.h"
+#include "pub_core_hashtable.h"
 #include "pub_core_dispatch.h"   // For VG_(disp_cp*) addresses
+#include "pub_core_libcsetjmp.h"  // to keep _threadstate.h happy
+#include "pub_core_threadstate.h" // to keep _scheduler.h happy
+#include "pub_core_scheduler.h"  // VG_(stop_parallel_threads)
 
 
 #define DEBUG_TRANSTAB 0
@@ -55,9 +59,14 @@
 
 /* Nr of sectors provided via command line parameter. */
 UInt VG_(clo_num_transtab_sectors) = N_SECTORS_DEFAULT;
-/* Nr of sectors.
-   Will be set by VG_(init_tt_tc) to VG_(clo_num_transtab_sectors). */
+/* Nr of sectors.  Will be set by VG_(init_tt_tc) to
+   VG_(clo_num_transtab_sectors), plus the sectors reserved for the old
+   generation with --generational-transtab=yes. */
 static UInt n_sectors = 0;
+/* Nr of sectors in the FIFO of new translations: sectors
+   0 .. n_young_sectors-1.  Any sectors beyond that belong to the old
+   generation. */
+static UInt n_young_sectors = 0;
 
 /*------------------ CONSTANTS ------------------*/
 /* Number of TC entries in each sector.  This needs to be a prime
@@ -76,6 +85,16 @@ static UInt n_sectors = 0;
 #define N_TTES_PER_SECTOR_USABLE \
            ((N_TTES_PER_SECTOR * SECTOR_TT_LIMIT_PERCENT) / 100)
 
+/* With --generational-transtab=yes, the old generation may use up to
+   half as many sectors again as the young one, and a translation is
+   promoted to it if it was executed at least this many times while
+   in a young sector. */
+#define MAX_N_OLD_SECTORS (MAX_N_SECTORS / 2)
+#define GEN_PROMOTE_THRESH 100
+
+/* Size of the arrays indexed by sector number. */
+#define N_SECTOR_SLOTS (MAX_N_SECTORS + MAX_N_OLD_SECTORS)
+
 /* Equivalence classes for fast address range deletion.  There are 1 +
    2^ECLASS_WIDTH bins.  The highest one, ECLASS_MISC, describes an
    address range which does not fall cleanly within any specific bin.
@@ -97,9 +116,20 @@ typedef
       UInt from_tteNo; /* TTE number in given sector */
       UInt from_offs;  /* code offset from TCEntry::tcptr where the patch is */
       Bool to_fastEP;  /* Is the patch to a fast or slow entry point? */
+      UChar kind;      /* What sort of patch is it?  An EdgeKind. */
    }
    InEdge;
 
+/* The sorts of patch an InEdge can describe.  Inline caches and
+   return-address stack sites always lead to the slow entry point. */
+typedef
+   enum {
+      Edge_Chain,      /* a chained XDirect */
+      Edge_IC,         /* a filled XIndir inline cache */
+      Edge_RetSite     /* a filled return-address stack site */
+   }
+   EdgeKind;
+
 
 /* Out edges ("from-me") in the graph created by chaining. */
 typedef
@@ -144,6 +174,10 @@ typedef
       ULong    count;
       UShort   weight;
 
+      /* True for a first-tier translation (see --tiered-translation),
+         whose .count is watched to decide when to retranslate it. */
+      Bool     tier1;
+
       /* Status of the slot.  Note, we need to be able to do lazy
          deletion, hence the Deleted state. */
       enum { InUse, Deleted, Empty } status;
@@ -193,7 +227,9 @@ typedef
          that we can undo the chaining of each mentioned patch point.
          The 'out_edges' list exists only so that we can visit the
          'in_edges' entries of all blocks we're patched through to, in
-         order to remove ourselves from then when we're deleted. */
+         order to remove ourselves from then when we're deleted.
+         A filled XIndir inline cache (--indirect-branch-cache=yes)
+         counts as a patched jump to the block it caches. */
 
       /* A translation can disappear for two reasons:
           1. erased (as part of the oldest sector cleanup) when the
@@ -348,9 +384,30 @@ typedef
    When running, youngest sector should be between >= 0 and <
    N_TC_SECTORS.  The initial -1 value indicates the TT/TC system is
    not yet initialised. 
+
+   With --generational-transtab=yes, every translation carries an
+   execution counter, and the FIFO above only holds the young
+   generation.  When a young sector is recycled, the entry points of
+   its translations which were executed at least GEN_PROMOTE_THRESH
+   times are remembered in promoted_entries.  When such an entry is
+   next translated, the translation goes into the old generation
+   instead: sectors n_young_sectors .. n_sectors-1, which are brought
+   into use one at a time as the old generation grows, and then
+   recycled in FIFO order among themselves.  So code which keeps
+   being used survives a recycling of the young sectors, at the cost
+   of one retranslation.  Translations can't simply be moved, since
+   chained jumps and profile counter addresses are baked into the
+   host code.  oldgen_sector is the old sector currently being
+   filled, or -1 if there is none yet.
 */
-static Sector sectors[MAX_N_SECTORS];
+static Sector sectors[N_SECTOR_SLOTS];
 static Int    youngest_sector = -1;
+static Int    oldgen_sector   = -1;
+
+/* Guest entry points whose next translation should go into the old
+   generation.  Nodes are bare VgHashNodes keyed by the entry
+   address. */
+static VgHashTable promoted_entries = NULL;
 
 /* The number of ULongs in each TCEntry area.  This is computed once
    at startup and does not change. */
@@ -361,12 +418,13 @@ static Int    tc_sector_szQ = 0;
    searched to find translations.  This is an optimisation to be used
    when searching for translations and should not affect
    correctness.  -1 denotes "no entry". */
-static Int sector_search_order[MAX_N_SECTORS];
+static Int sector_search_order[N_SECTOR_SLOTS];
 
 
-/* Fast helper for the TC.  A direct-mapped cache which holds a set of
-   recently used (guest address, host address) pairs.  This array is
-   referred to directly from m_dispatch/dispatch-<platform>.S.
+/* Fast helper for the TC.  A set-associative cache which holds a set
+   of recently used (guest address, host address) pairs.  This array is
+   referred to directly from m_dispatch/dispatch-<platform>.S.  See
+   pub_core_transtab_asm.h for its layout.
 
    Entries in tt_fast may refer to any valid TC entry, regardless of
    which sector it's in.  Consequently we must be very careful to
@@ -387,18 +445,128 @@ typedef
    FastCacheEntry;
 */
 /*global*/ __attribute__((aligned(16)))
-           FastCacheEntry VG_(tt_fast)[VG_TT_FAST_SIZE];
+           FastCacheEntry VG_(tt_fast)[VG_TT_FAST_WAYS * VG_TT_FAST_SIZE];
+
+/* With --parallel-exec=yes, each thread uses a fast cache of its own,
+   allocated when the thread first runs, instead of VG_(tt_fast).
+   Then a cache is only ever read or written by its own thread, so
+   threads can't see each other's half-made updates, and don't fight
+   over the cache lines.
+
+   Caches are invalidated lazily.  invalidateFastCache only bumps
+   fast_cache_epoch; a cache whose .epoch is out of date is cleared
+   the next time it is used.  That is safe because generated code is
+   only entered via VG_(get_fast_cache), and nothing is deleted from
+   the TC while any thread is running generated code. */
+typedef
+   struct {
+      FastCacheEntry* ents;
+      UInt            epoch;
+   }
+   FastCache;
+
+static FastCache shared_fast_cache = { VG_(tt_fast), 0 };
+static FastCache thread_fast_caches[VG_N_THREADS];
+static UInt      fast_cache_epoch = 1;
+
+#if defined(VGP_amd64_linux)
+/* With --return-stack=yes, each thread also has a return-address
+   shadow stack.  Its entries hold host code addresses, so it is
+   emptied along with the fast caches, using the same epoch. */
+typedef
+   struct {
+      VexAMD64RetStack* rs;
+      UInt              epoch;
+   }
+   RetStack;
+
+static RetStack ret_stacks[VG_N_THREADS];
+#endif
 
 /* Make sure we're not used before initialisation. */
 static Bool init_done = False;
 
 
+/* For tiered translation: the first-tier translations whose counts
+   are being watched.  A slot may have been deleted, or even reused,
+   since it was recorded here; .tcptr tells us whether the slot still
+   holds the translation we recorded.  Stale entries are pruned by
+   VG_(promote_hot_translations). */
+typedef
+   struct {
+      ULong* tcptr;
+      UInt   sno;
+      UInt   tteno;
+   }
+   Tier1Ref;
+
+static XArray* /* of Tier1Ref */ tier1_refs = NULL;
+
+/* Guest entry points which have been found to be hot, and so should
+   get a second-tier translation from now on, keyed by the entry
+   address.  .count is the first-tier translation's count when it was
+   found to be hot, for VG_(guest_entry_exec_count). */
+typedef
+   struct _HotEntry {
+      struct _HotEntry* next;
+      UWord             key;
+      ULong             count;
+   }
+   HotEntry;
+
+static VgHashTable hot_entries = NULL;
+
+/* With VG_(needs).exec_counts, the counts of translations which have
+   been thrown away, keyed by entry address, so that
+   VG_(apply_to_exec_counts) can still report them.  .vge is that of
+   the most recent such translation. */
+typedef
+   struct _RetiredCount {
+      struct _RetiredCount* next;
+      UWord                 key;
+      VexGuestExtents       vge;
+      ULong                 count;
+   }
+   RetiredCount;
+
+static VgHashTable retired_counts = NULL;
+
+/* A translation with the given entry, extents and execution count is
+   about to go away (or have its count reset); keep the count if the
+   tool wants it. */
+static void retire_exec_count ( Addr64 entry, VexGuestExtents* vge,
+                                ULong count )
+{
+   RetiredCount* rc;
+
+   if (!VG_(needs).exec_counts || count == 0)
+      return;
+   if (retired_counts == NULL)
+      retired_counts = VG_(HT_construct)("transtab.retired_counts");
+   rc = VG_(HT_lookup)(retired_counts, (UWord)entry);
+   if (rc == NULL) {
+      rc = VG_(malloc)("transtab.retired_counts.1", sizeof(RetiredCount));
+      rc->key   = (UWord)entry;
+      rc->count = 0;
+      VG_(HT_add_node)(retired_counts, rc);
+   }
+   rc->vge    = *vge;
+   rc->count += count;
+}
+
+
 /*------------------ STATS DECLS ------------------*/
 
 /* Number of fast-cache updates and flushes done. */
 static ULong n_fast_flushes = 0;
 static ULong n_fast_updates = 0;
 
+/* Number of fast-cache lookups done outside the dispatcher, and the
+   number of those which hit; also the number of per-thread caches. */
+static ULong n_fast_lookups    = 0;
+static ULong n_fast_lookup_hits = 0;
+static UInt  n_thread_fast_caches = 0;
+
 /* Number of full lookups done. */
 static ULong n_full_lookups = 0;
 static ULong n_lookup_probes = 0;
@@ -418,6 +586,28 @@ static ULong n_dump_osize = 0;
 static ULong n_disc_count = 0;
 static ULong n_disc_osize = 0;
 
+/* Number of first-tier translations made, and of those subsequently
+   discarded for retranslation as hot. */
+static ULong n_tier1_count    = 0;
+static ULong n_tier1_promoted = 0;
+
+/* Number of translations marked for promotion to the old generation
+   when their young sector was recycled, and of translations
+   subsequently put in the old generation. */
+static ULong n_gen_marked   = 0;
+static ULong n_gen_promoted = 0;
+
+/* Number of XIndir inline caches filled, and of those subsequently
+   emptied because their target was discarded. */
+static ULong n_ic_fills   = 0;
+static ULong n_ic_empties = 0;
+
+/* Likewise for return-address stack sites, and the number of times
+   a thread's return-address stack was emptied. */
+static ULong n_ret_fills    = 0;
+static ULong n_ret_empties  = 0;
+static ULong n_ret_flushes  = 0;
+
 
 /*-------------------------------------------------------------*/
 /*--- Misc                                                  ---*/
@@ -455,6 +645,7 @@ static void InEdge__init ( InEdge* ie )
    ie->from_tteNo = 0;
    ie->from_offs  = 0;
    ie->to_fastEP  = False;
+   ie->kind       = Edge_Chain;
 }
 
 static void OutEdge__init ( OutEdge* oe )
@@ -738,6 +929,61 @@ static Bool is_in_the_main_TC ( void* hcode )
 }
 
 
+/* Offset of PATCH_ADDR from the start of FROM_TTE's code. */
+static UInt patch_offset ( TTEntry* from_tte, void* patch_addr )
+{
+   HWord from_offs = (HWord)( (UChar*)patch_addr
+                              - (UChar*)from_tte->tcptr );
+   vg_assert(from_offs < 100000/* let's say */);
+   return (UInt)from_offs;
+}
+
+/* Has the place FROM_OFFS bytes into FROM_TTE's code already been
+   patched? */
+static Bool is_patched ( TTEntry* from_tte, UInt from_offs )
+{
+   UWord i, n = OutEdgeArr__size(&from_tte->out_edges);
+   for (i = 0; i < n; i++) {
+      OutEdge* oe = OutEdgeArr__index(&from_tte->out_edges, i);
+      if (oe->from_offs == from_offs)
+         return True;
+   }
+   return False;
+}
+
+/* Now do the tricky bit of a chaining or inline cache fill -- update
+   the ch_succs and ch_preds info for the two translations involved,
+   so we can undo the patch later, which we will have to do if the
+   to_ block gets removed for whatever reason. */
+static void add_edge ( UInt from_sNo, UInt from_tteNo, UInt from_offs,
+                       UInt to_sNo, UInt to_tteNo,
+                       Bool to_fastEP, EdgeKind kind )
+{
+   TTEntry* from_tte = index_tte(from_sNo, from_tteNo);
+   TTEntry* to_tte   = index_tte(to_sNo, to_tteNo);
+
+   /* This is the new from_ -> to_ link to add. */
+   InEdge ie;
+   InEdge__init(&ie);
+   ie.from_sNo   = from_sNo;
+   ie.from_tteNo = from_tteNo;
+   ie.from_offs  = from_offs;
+   ie.to_fastEP  = to_fastEP;
+   ie.kind       = kind;
+
+   /* This is the new to_ -> from_ backlink to add. */
+   OutEdge oe;
+   OutEdge__init(&oe);
+   oe.to_sNo    = to_sNo;
+   oe.to_tteNo  = to_tteNo;
+   oe.from_offs = from_offs;
+
+   /* Add .. */
+   InEdgeArr__add(&to_tte->in_edges, &ie);
+   OutEdgeArr__add(&from_tte->out_edges, &oe);
+}
+
+
 /* Fulfill a chaining request, and record admin info so we
    can undo it later, if required.
 */
@@ -783,7 +1029,16 @@ void VG_(tt_tc_do_chaining) ( void* from__patch_addr,
       return;
    }
 
-   TTEntry* from_tte = index_tte(from_sNo, from_tteNo);
+   TTEntry* from_tte  = index_tte(from_sNo, from_tteNo);
+   UInt     from_offs = patch_offset(from_tte, from__patch_addr);
+
+   // With --parallel-exec=yes, several threads may have asked for
+   // the same patch; only the first one does it.
+   if (is_patched(from_tte, from_offs))
+      return;
+
+   /* Other threads may be running the code we are about to patch. */
+   VG_(stop_parallel_threads)();
 
    /* Get VEX to do the patching itself.  We have to hand it off
       since it is host-dependent. */
@@ -798,33 +1053,104 @@ void VG_(tt_tc_do_chaining) ( void* from__patch_addr,
         );
    VG_(invalidate_icache)( (void*)vir.start, vir.len );
 
-   /* Now do the tricky bit -- update the ch_succs and ch_preds info
-      for the two translations involved, so we can undo the chaining
-      later, which we will have to do if the to_ block gets removed
-      for whatever reason. */
+   add_edge(from_sNo, from_tteNo, from_offs, to_sNo, to_tteNo,
+            to_fastEP, Edge_Chain);
+}
 
-   /* This is the new from_ -> to_ link to add. */
-   InEdge ie;
-   InEdge__init(&ie);
-   ie.from_sNo   = from_sNo;
-   ie.from_tteNo = from_tteNo;
-   ie.to_fastEP  = to_fastEP;
-   HWord from_offs = (HWord)( (UChar*)from__patch_addr
-                              - (UChar*)from_tte->tcptr );
-   vg_assert(from_offs < 100000/* let's say */);
-   ie.from_offs  = (UInt)from_offs;
 
-   /* This is the new to_ -> from_ backlink to add. */
-   OutEdge oe;
-   OutEdge__init(&oe);
-   oe.to_sNo    = to_sNo;
-   oe.to_tteNo  = to_tteNo;
-   oe.from_offs = (UInt)from_offs;
+#if defined(VGP_amd64_linux)
+/* Fill an XIndir inline cache, which asked to be filled with the
+   target to_sNo/to_tteNo, and record admin info so we can empty it
+   again later, if required.  This is much like chaining. */
+void VG_(tt_tc_fill_ic) ( void* from__patch_addr,
+                          UInt  to_sNo,
+                          UInt  to_tteNo )
+{
+   VexArch vex_arch = VexArch_INVALID;
+   VG_(machine_get_VexArchInfo)( &vex_arch, NULL );
 
-   /* Add .. */
-   InEdgeArr__add(&to_tte->in_edges, &ie);
-   OutEdgeArr__add(&from_tte->out_edges, &oe);
+   // Inline caches always lead to the slow entry point, as going
+   // through the dispatcher would.
+   TTEntry* to_tte = index_tte(to_sNo, to_tteNo);
+
+   UInt from_sNo   = (UInt)-1;
+   UInt from_tteNo = (UInt)-1;
+   if (!find_TTEntry_from_hcode( &from_sNo, &from_tteNo,
+                                 from__patch_addr )) {
+      VG_(debugLog)(1,"transtab",
+                    "host code %p not found (discarded? sector recycled?)"
+                    " => no inline cache filled\n",
+                    from__patch_addr);
+      return;
+   }
+
+   TTEntry* from_tte  = index_tte(from_sNo, from_tteNo);
+   UInt     from_offs = patch_offset(from_tte, from__patch_addr);
+   if (is_patched(from_tte, from_offs))
+      return;
+
+   VG_(stop_parallel_threads)();
+
+   VexInvalRange vir
+      = LibVEX_PatchXIndirIC(
+           vex_arch,
+           from__patch_addr,
+           to_tte->entry,
+           to_tte->tcptr,
+           VG_(fnptr_to_fnentry)( &VG_(disp_cp_xindir_icfill) ),
+           VG_(fnptr_to_fnentry)( &VG_(disp_cp_xindir) )
+        );
+   VG_(invalidate_icache)( (void*)vir.start, vir.len );
+
+   add_edge(from_sNo, from_tteNo, from_offs, to_sNo, to_tteNo,
+            False/*!to_fastEP*/, Edge_IC);
+   n_ic_fills++;
+}
+
+/* Make a return-address stack site, which asked to be filled with
+   the target to_sNo/to_tteNo, lead there, and record admin info so
+   we can undo it later, if required.  Again, much like chaining. */
+void VG_(tt_tc_fill_ret_site) ( void* from__patch_addr,
+                                UInt  to_sNo,
+                                UInt  to_tteNo )
+{
+   VexArch vex_arch = VexArch_INVALID;
+   VG_(machine_get_VexArchInfo)( &vex_arch, NULL );
+
+   TTEntry* to_tte = index_tte(to_sNo, to_tteNo);
+
+   UInt from_sNo   = (UInt)-1;
+   UInt from_tteNo = (UInt)-1;
+   if (!find_TTEntry_from_hcode( &from_sNo, &from_tteNo,
+                                 from__patch_addr )) {
+      VG_(debugLog)(1,"transtab",
+                    "host code %p not found (discarded? sector recycled?)"
+                    " => no return site filled\n",
+                    from__patch_addr);
+      return;
+   }
+
+   TTEntry* from_tte  = index_tte(from_sNo, from_tteNo);
+   UInt     from_offs = patch_offset(from_tte, from__patch_addr);
+   if (is_patched(from_tte, from_offs))
+      return;
+
+   VG_(stop_parallel_threads)();
+
+   VexInvalRange vir
+      = LibVEX_PatchRetSite(
+           vex_arch,
+           from__patch_addr,
+           VG_(fnptr_to_fnentry)( &VG_(disp_cp_ret_fill) ),
+           to_tte->tcptr
+        );
+   VG_(invalidate_icache)( (void*)vir.start, vir.len );
+
+   add_edge(from_sNo, from_tteNo, from_offs, to_sNo, to_tteNo,
+            False/*!to_fastEP*/, Edge_RetSite);
+   n_ret_fills++;
 }
+#endif
 
 
 /* Unchain one patch, as described by the specified InEdge.  For
@@ -835,13 +1161,43 @@ void VG_(tt_tc_do_chaining) ( void* from__patch_addr,
 __attribute__((noinline))
 static void unchain_one ( VexArch vex_arch,
                           InEdge* ie,
-                          void* to_fastEPaddr, void* to_slowEPaddr )
+                          void* to_fastEPaddr, void* to_slowEPaddr,
+                          Addr64 to_entry )
 {
    vg_assert(ie);
    TTEntry* tte
       = index_tte(ie->from_sNo, ie->from_tteNo);
    UChar* place_to_patch
       = ((UChar*)tte->tcptr) + ie->from_offs;
+#  if defined(VGP_amd64_linux)
+   if (ie->kind == Edge_RetSite) {
+      // Make the site ask to be filled again.
+      vg_assert( is_in_the_main_TC(place_to_patch) );
+      VexInvalRange vir
+         = LibVEX_PatchRetSite(
+              vex_arch, place_to_patch, to_slowEPaddr,
+              VG_(fnptr_to_fnentry)( &VG_(disp_cp_ret_fill) )
+           );
+      VG_(invalidate_icache)( (void*)vir.start, vir.len );
+      n_ret_empties++;
+      return;
+   }
+   if (ie->kind == Edge_IC) {
+      // Empty the inline cache, so it asks to be filled again.
+      vg_assert( is_in_the_main_TC(place_to_patch) );
+      VexInvalRange vir
+         = LibVEX_UnPatchXIndirIC(
+              vex_arch, place_to_patch, to_entry, to_slowEPaddr,
+              VG_(fnptr_to_fnentry)( &VG_(disp_cp_xindir_icfill) ),
+              VG_(fnptr_to_fnentry)( &VG_(disp_cp_xindir) )
+           );
+      VG_(invalidate_icache)( (void*)vir.start, vir.len );
+      n_ic_empties++;
+      return;
+   }
+#  else
+   vg_assert(ie->kind == Edge_Chain);
+#  endif
    UChar* disp_cp_chain_me
       = VG_(fnptr_to_fnentry)(
            ie->to_fastEP ? &VG_(disp_cp_chain_me_to_fastEP)
@@ -888,7 +1244,8 @@ void unchain_in_preparation_for_deletion ( VexArch vex_arch,
       // Undo the chaining.
       UChar* here_slow_EP = (UChar*)here_tte->tcptr;
       UChar* here_fast_EP = here_slow_EP + evCheckSzB;
-      unchain_one(vex_arch, ie, here_fast_EP, here_slow_EP);
+      unchain_one(vex_arch, ie, here_fast_EP, here_slow_EP,
+                  here_tte->entry);
       // Find the corresponding entry in the "from" node's out_edges,
       // and remove it.
       TTEntry* from_tte = index_tte(ie->from_sNo, ie->from_tteNo);
@@ -1215,7 +1572,7 @@ static Bool sanity_check_sector_search_order ( void )
 {
    Int i, j, nListed;
    /* assert the array is the right size */
-   vg_assert(MAX_N_SECTORS == (sizeof(sector_search_order) 
+   vg_assert(N_SECTOR_SLOTS == (sizeof(sector_search_order) 
                                / sizeof(sector_search_order[0])));
    /* Check it's of the form  valid_sector_numbers ++ [-1, -1, ..] */
    for (i = 0; i < n_sectors; i++) {
@@ -1317,34 +1674,176 @@ static inline UInt HASH_TT ( Addr64 key )
    return k32 % N_TTES_PER_SECTOR;
 }
 
+/* Bring FC up to date with any invalidations since it was last
+   used, and return its entries. */
+static FastCacheEntry* sync_fast_cache ( FastCache* fc )
+{
+   UInt j;
+   if (LIKELY(fc->epoch == fast_cache_epoch))
+      return fc->ents;
+
+   /* This loop is popular enough to make it worth unrolling a
+      bit, at least on ppc32. */
+   vg_assert(VG_TT_FAST_SIZE > 0 && (VG_TT_FAST_SIZE % 4) == 0);
+   for (j = 0; j < VG_TT_FAST_WAYS * VG_TT_FAST_SIZE; j += 4) {
+      fc->ents[j+0].guest = TRANSTAB_BOGUS_GUEST_ADDR;
+      fc->ents[j+1].guest = TRANSTAB_BOGUS_GUEST_ADDR;
+      fc->ents[j+2].guest = TRANSTAB_BOGUS_GUEST_ADDR;
+      fc->ents[j+3].guest = TRANSTAB_BOGUS_GUEST_ADDR;
+   }
+
+   vg_assert(j == VG_TT_FAST_WAYS * VG_TT_FAST_SIZE);
+   fc->epoch = fast_cache_epoch;
+   n_fast_flushes++;
+   return fc->ents;
+}
+
+FastCacheEntry* VG_(get_fast_cache) ( ThreadId tid )
+{
+   FastCache* fc;
+
+   if (!VG_(clo_parallel_exec))
+      return sync_fast_cache( &shared_fast_cache );
+
+   vg_assert(tid >= 1 && tid < VG_N_THREADS);
+   fc = &thread_fast_caches[tid];
+   if (fc->ents == NULL) {
+      SizeT  szB  = VG_TT_FAST_WAYS * VG_TT_FAST_SIZE
+                    * sizeof(FastCacheEntry);
+      SysRes sres = VG_(am_mmap_anon_float_valgrind)( szB );
+      if (sr_isError(sres))
+         VG_(out_of_memory_NORETURN)("VG_(get_fast_cache)", szB);
+      fc->ents  = (FastCacheEntry*)(AddrH)sr_Res(sres);
+      fc->epoch = fast_cache_epoch - 1;
+      n_thread_fast_caches++;
+   }
+   return sync_fast_cache( fc );
+}
+
+#if defined(VGP_amd64_linux)
+VexAMD64RetStack* VG_(get_ret_stack) ( ThreadId tid )
+{
+   RetStack* rs;
+   Int       j;
+
+   vg_assert(VG_(clo_return_stack));
+   vg_assert(tid >= 1 && tid < VG_N_THREADS);
+   rs = &ret_stacks[tid];
+   if (rs->rs == NULL) {
+      rs->rs    = ttaux_malloc("transtab.get_ret_stack.1",
+                               sizeof(VexAMD64RetStack));
+      rs->epoch = fast_cache_epoch - 1;
+   }
+   if (LIKELY(rs->epoch == fast_cache_epoch))
+      return rs->rs;
+
+   /* Empty it.  Guest address 1 never matches a real return, and if
+      it did, disp_cp_xindir would still be the right place to go. */
+   rs->rs->top = 0;
+   for (j = 0; j < VEX_AMD64_RETSTACK_N; j++) {
+      rs->rs->ents[j].ra   = 1;
+      rs->rs->ents[j].sp   = 0;
+      rs->rs->ents[j].host
+         = (ULong)(Addr)VG_(fnptr_to_fnentry)( &VG_(disp_cp_xindir) );
+      rs->rs->ents[j].site = 0;
+   }
+   rs->epoch = fast_cache_epoch;
+   n_ret_flushes++;
+   return rs->rs;
+}
+#endif
+
+/* Put (KEY, TCPTR) in way 0 of its set in the running thread's fast
+   cache, moving the other entries of the set one way along and
+   dropping the last one.  If KEY is already in the set, its old entry
+   is dropped instead. */
 static void setFastCacheEntry ( Addr64 key, ULong* tcptr )
 {
-   UInt cno = (UInt)VG_TT_FAST_HASH(key);
-   VG_(tt_fast)[cno].guest = (Addr)key;
-   VG_(tt_fast)[cno].host  = (Addr)tcptr;
+   UInt            cno = (UInt)VG_TT_FAST_HASH(key);
+   ThreadId        tid = VG_(get_running_tid)();
+   FastCacheEntry* fc;
+   Int             w;
+
+   /* Nobody to run it, eg during startup: nothing to do. */
+   if (VG_(clo_parallel_exec) && tid == VG_INVALID_THREADID)
+      return;
+   fc = VG_(get_fast_cache)( tid );
+
+   for (w = 0; w < VG_TT_FAST_WAYS - 1; w++)
+      if (fc[w * VG_TT_FAST_SIZE + cno].guest == (Addr)key)
+         break;
+   for (/* */; w > 0; w--)
+      fc[w * VG_TT_FAST_SIZE + cno] = fc[(w-1) * VG_TT_FAST_SIZE + cno];
+   fc[cno].guest = (Addr)key;
+   fc[cno].host  = (Addr)tcptr;
    n_fast_updates++;
    /* This shouldn't fail.  It should be assured by m_translate
       which should reject any attempt to make translation of code
       starting at TRANSTAB_BOGUS_GUEST_ADDR. */
-   vg_assert(VG_(tt_fast)[cno].guest != TRANSTAB_BOGUS_GUEST_ADDR);
+   vg_assert(fc[cno].guest != TRANSTAB_BOGUS_GUEST_ADDR);
 }
 
-/* Invalidate the fast cache VG_(tt_fast). */
-static void invalidateFastCache ( void )
+Bool VG_(lookup_fast_cache) ( ThreadId tid, /*OUT*/AddrH* hcode,
+                              Addr guest )
 {
-   UInt j;
-   /* This loop is popular enough to make it worth unrolling a
-      bit, at least on ppc32. */
-   vg_assert(VG_TT_FAST_SIZE > 0 && (VG_TT_FAST_SIZE % 4) == 0);
-   for (j = 0; j < VG_TT_FAST_SIZE; j += 4) {
-      VG_(tt_fast)[j+0].guest = TRANSTAB_BOGUS_GUEST_ADDR;
-      VG_(tt_fast)[j+1].guest = TRANSTAB_BOGUS_GUEST_ADDR;
-      VG_(tt_fast)[j+2].guest = TRANSTAB_BOGUS_GUEST_ADDR;
-      VG_(tt_fast)[j+3].guest = TRANSTAB_BOGUS_GUEST_ADDR;
+   UInt            cno = (UInt)VG_TT_FAST_HASH(guest);
+   FastCacheEntry* fc  = VG_(get_fast_cache)( tid );
+   FastCacheEntry  tmp;
+   Int             w;
+
+   n_fast_lookups++;
+   for (w = 0; w < VG_TT_FAST_WAYS; w++) {
+      FastCacheEntry* ent = &fc[w * VG_TT_FAST_SIZE + cno];
+      if (ent->guest != guest)
+         continue;
+      *hcode = ent->host;
+      /* Move it one way nearer way 0, as the dispatchers do. */
+      if (w > 0) {
+         FastCacheEntry* prev = &fc[(w-1) * VG_TT_FAST_SIZE + cno];
+         tmp   = *prev;
+         *prev = *ent;
+         *ent  = tmp;
+      }
+      n_fast_lookup_hits++;
+      return True;
    }
+   return False;
+}
 
-   vg_assert(j == VG_TT_FAST_SIZE);
-   n_fast_flushes++;
+/* Invalidate all the fast caches.  This is done lazily, see the
+   comment on fast_cache_epoch. */
+static void invalidateFastCache ( void )
+{
+   fast_cache_epoch++;
+}
+
+/* Arrange for the next translation of ENTRY to be put in the old
+   generation. */
+static void mark_for_promotion ( Addr64 entry )
+{
+   VgHashNode* node;
+   if (promoted_entries == NULL)
+      promoted_entries = VG_(HT_construct)("transtab.promoted_entries");
+   if (VG_(HT_lookup)(promoted_entries, (UWord)entry) != NULL)
+      return;
+   node = VG_(malloc)("transtab.promoted_entries.1", sizeof(VgHashNode));
+   node->key = (UWord)entry;
+   VG_(HT_add_node)(promoted_entries, node);
+   n_gen_marked++;
+}
+
+/* Should the translation of ENTRY go into the old generation?  If so,
+   forget that it was marked. */
+static Bool take_promotion ( Addr64 entry )
+{
+   VgHashNode* node;
+   if (promoted_entries == NULL)
+      return False;
+   node = VG_(HT_remove)(promoted_entries, (UWord)entry);
+   if (node == NULL)
+      return False;
+   VG_(free)(node);
+   return True;
 }
 
 static void initialiseSector ( Int sno )
@@ -1418,7 +1917,9 @@ static void initialiseSector ( Int sno )
 
    } else {
 
-      /* Sector has been used before.  Dump the old contents. */
+      /* Sector has been used before.  Dump the old contents.  No
+         other thread may be running code from it while we do so. */
+      VG_(stop_parallel_threads)();
       VG_(debugLog)(1,"transtab", "recycle sector %d\n", sno);
       if (VG_(clo_stats))
          VG_(dmsg)("transtab: " "recycle sector %d\n", sno);
@@ -1438,12 +1939,18 @@ static void initialiseSector ( Int sno )
             vg_assert(sec->tt[i].n_tte2ec >= 1);
             vg_assert(sec->tt[i].n_tte2ec <= 3);
             n_dump_osize += vge_osize(&sec->tt[i].vge);
+            /* Let survivors into the old generation. */
+            if (VG_(clo_generational_transtab)
+                && sec->tt[i].count >= GEN_PROMOTE_THRESH)
+               mark_for_promotion( sec->tt[i].entry );
             /* Tell the tool too. */
             if (VG_(needs).superblock_discards) {
                VG_TDICT_CALL( tool_discard_superblock_info,
                               sec->tt[i].entry,
                               sec->tt[i].vge );
             }
+            retire_exec_count( sec->tt[i].entry, &sec->tt[i].vge,
+                               sec->tt[i].count );
             unchain_in_preparation_for_deletion(vex_arch, sno, i);
          } else {
             vg_assert(sec->tt[i].n_tte2ec == 0);
@@ -1512,6 +2019,7 @@ void VG_(add_to_transtab)( VexGuestExtents* vge,
                            VexArch          arch_host )
 {
    Int    tcAvailQ, reqdQ, y, i;
+   Int*   cur;
    ULong  *tcptr, *tcptr2;
    UChar* srcP;
    UChar* dstP;
@@ -1535,7 +2043,17 @@ void VG_(add_to_transtab)( VexGuestExtents* vge,
    if (is_self_checking)
       n_in_sc_count++;
 
-   y = youngest_sector;
+   /* Decide which generation the translation belongs in.  Survivors
+      of a young sector recycling go into the old generation. */
+   cur = &youngest_sector;
+   if (VG_(clo_generational_transtab) && take_promotion(entry)) {
+      cur = &oldgen_sector;
+      if (oldgen_sector == -1)
+         oldgen_sector = n_young_sectors;
+      n_gen_promoted++;
+   }
+
+   y = *cur;
    vg_assert(isValidSector(y));
 
    if (sectors[y].tc == NULL)
@@ -1552,10 +2070,11 @@ void VG_(add_to_transtab)( VexGuestExtents* vge,
 
    if (tcAvailQ < reqdQ 
        || sectors[y].tt_n_inuse >= N_TTES_PER_SECTOR_USABLE) {
-      /* No.  So move on to the next sector.  Either it's never been
-         used before, in which case it will get its tt/tc allocated
-         now, or it has been used before, in which case it is set to be
-         empty, hence throwing out the oldest sector. */
+      /* No.  So move on to the next sector of the same generation.
+         Either it's never been used before, in which case it will get
+         its tt/tc allocated now, or it has been used before, in which
+         case it is set to be empty, hence throwing out the oldest
+         sector of that generation. */
       vg_assert(tc_sector_szQ > 0);
       Int tt_loading_pct = (100 * sectors[y].tt_n_inuse) 
                            / N_TTES_PER_SECTOR;
@@ -1571,10 +2090,16 @@ void VG_(add_to_transtab)( VexGuestExtents* vge,
                    "(TT loading %2d%%, TC loading %2d%%)\n",
                    y, tt_loading_pct, tc_loading_pct);
       }
-      youngest_sector++;
-      if (youngest_sector >= n_sectors)
-         youngest_sector = 0;
-      y = youngest_sector;
+      if (cur == &youngest_sector) {
+         youngest_sector++;
+         if (youngest_sector >= n_young_sectors)
+            youngest_sector = 0;
+      } else {
+         oldgen_sector++;
+         if (oldgen_sector >= n_sectors)
+            oldgen_sector = n_young_sectors;
+      }
+      y = *cur;
       initialiseSector(y);
    }
 
@@ -1632,6 +2157,23 @@ void VG_(add_to_transtab)( VexGuestExtents* vge,
                                 dstP + offs_profInc,
                                 &sectors[y].tt[i].count );
       VG_(invalidate_icache)( (void*)vir.start, vir.len );
+
+      /* With tiered translation, the counter of a first-tier
+         translation tells us when to retranslate.  (With
+         --generational-transtab=yes second-tier translations have a
+         counter too.) */
+      if (VG_(clo_tiered_translation) && !VG_(is_hot_guest_entry)(entry)) {
+         Tier1Ref ref;
+         ref.tcptr = tcptr;
+         ref.sno   = y;
+         ref.tteno = i;
+         sectors[y].tt[i].tier1 = True;
+         if (tier1_refs == NULL)
+            tier1_refs = VG_(newXA)(ttaux_malloc, "transtab.tier1.1",
+                                    ttaux_free, sizeof(Tier1Ref));
+         VG_(addToXA)(tier1_refs, &ref);
+         n_tier1_count++;
+      }
    }
 
    VG_(invalidate_icache)( dstP, code_len );
@@ -1805,6 +2347,7 @@ static void delete_tte ( /*MOD*/Sector* sec, UInt secNo, Int tteno,
    }
 
    /* Now fix up this TTEntry. */
+   retire_exec_count( tte->entry, &tte->vge, tte->count );
    tte->status   = Deleted;
    tte->n_tte2ec = 0;
 
@@ -1907,6 +2450,8 @@ void VG_(discard_translations) ( Addr64 guest_start, ULong range,
    if (range == 0)
       return;
 
+   VG_(stop_parallel_threads)();
+
    VexArch vex_arch = VexArch_INVALID;
    VG_(machine_get_VexArchInfo)( &vex_arch, NULL );
 
@@ -2028,6 +2573,7 @@ typedef
       VexGuestExtents vge;
       Addr            hcode;
       Bool            inUse;
+      ULong           count;   /* as TTEntry.count */
    }
    UTCEntry;
 
@@ -2058,8 +2604,12 @@ static void init_unredir_tt_tc ( void )
       unredir_tc = (ULong *)(AddrH)sr_Res(sres);
    }
    unredir_tc_used = 0;
-   for (i = 0; i < N_UNREDIR_TT; i++)
+   for (i = 0; i < N_UNREDIR_TT; i++) {
+      if (unredir_tt[i].inUse)
+         retire_exec_count( unredir_tt[i].vge.base[0], &unredir_tt[i].vge,
+                            unredir_tt[i].count );
       unredir_tt[i].inUse = False;
+   }
    unredir_tt_highwater = -1;
 }
 
@@ -2087,7 +2637,9 @@ static Bool sanity_check_redir_tt_tc ( void )
 void VG_(add_to_unredir_transtab)( VexGuestExtents* vge,
                                    Addr64           entry,
                                    AddrH            code,
-                                   UInt             code_len )
+                                   UInt             code_len,
+                                   Int              offs_profInc,
+                                   VexArch          arch_host )
 {
    Int   i, j, code_szQ;
    HChar *srcP, *dstP;
@@ -2131,6 +2683,16 @@ void VG_(add_to_unredir_transtab)( VexGuestExtents* vge,
    unredir_tt[i].inUse = True;
    unredir_tt[i].vge   = *vge;
    unredir_tt[i].hcode = (Addr)dstP;
+   unredir_tt[i].count = 0;
+
+   if (offs_profInc != -1) {
+      vg_assert(offs_profInc >= 0 && offs_profInc < code_len);
+      VexInvalRange vir
+         = LibVEX_PatchProfInc( arch_host,
+                                dstP + offs_profInc,
+                                &unredir_tt[i].count );
+      VG_(invalidate_icache)( (void*)vir.start, vir.len );
+   }
 
    unredir_tc_used += code_szQ;
    vg_assert(unredir_tc_used >= 0);
@@ -2154,6 +2716,23 @@ Bool VG_(search_unredir_transtab) ( /*OUT*/AddrH* result,
    return False;
 }
 
+/* Is hcode in either code cache?  This only compares addresses, so it
+   is safe to call from a signal handler. */
+Bool VG_(is_in_translation_cache) ( Addr hcode )
+{
+   Int sno;
+   for (sno = 0; sno < n_sectors; sno++) {
+      if (sectors[sno].tc == NULL)
+         continue;
+      if (hcode >= (Addr)sectors[sno].tc
+          && hcode < (Addr)&sectors[sno].tc[tc_sector_szQ])
+         return True;
+   }
+   return unredir_tc != NULL
+          && hcode >= (Addr)unredir_tc
+          && hcode < (Addr)&unredir_tc[N_UNREDIR_TCQ];
+}
+
 static void unredir_discard_translations( Addr64 guest_start, ULong range )
 {
    Int i;
@@ -2162,8 +2741,11 @@ static void unredir_discard_translations( Addr64 guest_start, ULong range )
 
    for (i = 0; i <= unredir_tt_highwater; i++) {
       if (unredir_tt[i].inUse
-          && overlaps( guest_start, range, &unredir_tt[i].vge))
+          && overlaps( guest_start, range, &unredir_tt[i].vge)) {
+         retire_exec_count( unredir_tt[i].vge.base[0], &unredir_tt[i].vge,
+                            unredir_tt[i].count );
          unredir_tt[i].inUse = False;
+      }
    }
 }
 
@@ -2186,7 +2768,8 @@ void VG_(init_tt_tc) ( void )
    vg_assert(sizeof(Addr) == sizeof(void*));
    vg_assert(sizeof(FastCacheEntry) == 2 * sizeof(Addr));
    /* check fast cache entries are packed back-to-back with no spaces */
-   vg_assert(sizeof( VG_(tt_fast) ) == VG_TT_FAST_SIZE * sizeof(FastCacheEntry));
+   vg_assert(sizeof( VG_(tt_fast) )
+             == VG_TT_FAST_WAYS * VG_TT_FAST_SIZE * sizeof(FastCacheEntry));
    /* check fast cache is aligned as we requested.  Not fatal if it
       isn't, but we might as well make sure. */
    vg_assert(VG_IS_16_ALIGNED( ((Addr) & VG_(tt_fast)[0]) ));
@@ -2204,19 +2787,24 @@ void VG_(init_tt_tc) ( void )
    vg_assert(tc_sector_szQ >= 2 * N_TTES_PER_SECTOR_USABLE);
    vg_assert(tc_sector_szQ <= 100 * N_TTES_PER_SECTOR_USABLE);
 
-   n_sectors = VG_(clo_num_transtab_sectors);
-   vg_assert(n_sectors >= MIN_N_SECTORS);
-   vg_assert(n_sectors <= MAX_N_SECTORS);
+   n_young_sectors = VG_(clo_num_transtab_sectors);
+   vg_assert(n_young_sectors >= MIN_N_SECTORS);
+   vg_assert(n_young_sectors <= MAX_N_SECTORS);
+   n_sectors = n_young_sectors;
+   if (VG_(clo_generational_transtab))
+      n_sectors += n_young_sectors / 2;
+   vg_assert(n_sectors <= N_SECTOR_SLOTS);
 
    /* Initialise the sectors, even the ones we aren't going to use.
       Set all fields to zero. */
    youngest_sector = 0;
-   for (i = 0; i < MAX_N_SECTORS; i++)
+   oldgen_sector   = -1;
+   for (i = 0; i < N_SECTOR_SLOTS; i++)
       VG_(memset)(&sectors[i], 0, sizeof(sectors[i]));
 
    /* Initialise the sector_search_order hint table, including the
       entries we aren't going to use. */
-   for (i = 0; i < MAX_N_SECTORS; i++)
+   for (i = 0; i < N_SECTOR_SLOTS; i++)
       sector_search_order[i] = -1;
 
    /* Initialise the fast cache. */
@@ -2268,6 +2856,12 @@ void VG_(print_tt_tc_stats) ( void )
    VG_(message)(Vg_DebugMsg,
       "    tt/tc: %'llu fast-cache updates, %'llu flushes\n",
       n_fast_updates, n_fast_flushes );
+   VG_(message)(Vg_DebugMsg,
+      "    tt/tc: %'llu fast-cache lookups in C, %'llu hits\n",
+      n_fast_lookups, n_fast_lookup_hits );
+   if (VG_(clo_parallel_exec))
+      VG_(message)(Vg_DebugMsg,
+         "    tt/tc: %u per-thread fast caches\n", n_thread_fast_caches );
 
    VG_(message)(Vg_DebugMsg,
                 " transtab: new        %'lld "
@@ -2281,6 +2875,31 @@ void VG_(print_tt_tc_stats) ( void )
    VG_(message)(Vg_DebugMsg,
                 " transtab: discarded  %'llu (%'llu -> ?" "?)\n",
                 n_disc_count, n_disc_osize );
+   if (VG_(clo_tiered_translation))
+      VG_(message)(Vg_DebugMsg,
+                   " transtab: tier-1     %'llu (%'llu promoted)\n",
+                   n_tier1_count, n_tier1_promoted );
+   if (VG_(clo_indirect_branch_cache))
+      VG_(message)(Vg_DebugMsg,
+                   " transtab: inline caches %'llu filled, "
+                   "%'llu emptied\n",
+                   n_ic_fills, n_ic_empties );
+   if (VG_(clo_return_stack))
+      VG_(message)(Vg_DebugMsg,
+                   " transtab: return sites %'llu filled, %'llu emptied; "
+                   "%'llu stack flushes\n",
+                   n_ret_fills, n_ret_empties, n_ret_flushes );
+   if (VG_(clo_generational_transtab)) {
+      Int sno, n_old_inuse = 0;
+      for (sno = n_young_sectors; sno < n_sectors; sno++)
+         if (sectors[sno].tc != NULL)
+            n_old_inuse++;
+      VG_(message)(Vg_DebugMsg,
+                   " transtab: old gen    %'llu marked, %'llu promoted, "
+                   "%d of %d sectors\n",
+                   n_gen_marked, n_gen_promoted,
+                   n_old_inuse, n_sectors - n_young_sectors );
+   }
 
    if (DEBUG_TRANSTAB) {
       Int i;
@@ -2294,6 +2913,161 @@ void VG_(print_tt_tc_stats) ( void )
    }
 }
 
+/*------------------------------------------------------------*/
+/*--- Tiered translation.                                  ---*/
+/*------------------------------------------------------------*/
+
+UWord VG_(promote_hot_translations) ( void )
+{
+   Word     i, j, n;
+   Bool     anyDeleted = False;
+   VexArch  vex_arch   = VexArch_INVALID;
+
+   vg_assert(init_done);
+   vg_assert(VG_(clo_tiered_translation));
+
+   if (tier1_refs == NULL)
+      return 0;
+
+   VG_(machine_get_VexArchInfo)( &vex_arch, NULL );
+
+   n = VG_(sizeXA)(tier1_refs);
+   for (i = j = 0; i < n; i++) {
+      Tier1Ref* ref = VG_(indexXA)(tier1_refs, i);
+      Sector*   sec = &sectors[ref->sno];
+      TTEntry*  tte;
+      HotEntry* hot;
+
+      if (sec->tc == NULL)
+         continue;
+      tte = &sec->tt[ref->tteno];
+      if (tte->status != InUse || !tte->tier1 || tte->tcptr != ref->tcptr)
+         continue; /* gone; forget it */
+
+      if (tte->count < (ULong)VG_(clo_tiered_translation_thresh)) {
+         /* still cold; keep watching */
+         *(Tier1Ref*)VG_(indexXA)(tier1_refs, j++) = *ref;
+         continue;
+      }
+
+      /* Hot.  Remember that, and throw away the cheap translation;
+         the next time this entry is reached it will be retranslated
+         properly. */
+      if (hot_entries == NULL)
+         hot_entries = VG_(HT_construct)("transtab.hot_entries");
+      hot = VG_(HT_lookup)(hot_entries, (UWord)tte->entry);
+      if (hot == NULL) {
+         hot = VG_(malloc)("transtab.hot_entries.1", sizeof(HotEntry));
+         hot->key   = (UWord)tte->entry;
+         hot->count = 0;
+         VG_(HT_add_node)(hot_entries, hot);
+      }
+      if (tte->count > hot->count)
+         hot->count = tte->count;
+      if (!anyDeleted)
+         VG_(stop_parallel_threads)();
+      delete_tte( sec, ref->sno, ref->tteno, vex_arch );
+      n_tier1_promoted++;
+      anyDeleted = True;
+   }
+   VG_(dropTailXA)(tier1_refs, n - j);
+
+   if (anyDeleted)
+      invalidateFastCache();
+
+   return (UWord)j;
+}
+
+Bool VG_(is_hot_guest_entry) ( Addr64 entry )
+{
+   return hot_entries != NULL
+          && VG_(HT_lookup)(hot_entries, (UWord)entry) != NULL;
+}
+
+ULong VG_(guest_entry_exec_count) ( Addr64 entry )
+{
+   UInt      sno, tteno;
+   TTEntry*  tte;
+   HotEntry* hot;
+
+   vg_assert(VG_(clo_tiered_translation));
+
+   if (hot_entries != NULL) {
+      hot = VG_(HT_lookup)(hot_entries, (UWord)entry);
+      if (hot != NULL)
+         return hot->count;
+   }
+   if (!VG_(search_transtab)(NULL, &sno, &tteno, entry, False))
+      return 0;
+   tte = &sectors[sno].tt[tteno];
+   return tte->tier1 ? tte->count : 0;
+}
+
+void VG_(apply_to_exec_counts) (
+   Addr64 start, ULong len,
+   void (*f)(Addr64, const VexGuestExtents*, ULong, void*),
+   void* opaque )
+{
+   Int           sno, i;
+   RetiredCount* rc;
+
+   vg_assert(VG_(needs).exec_counts);
+
+   for (sno = 0; sno < n_sectors; sno++) {
+      if (sectors[sno].tc == NULL)
+         continue;
+      for (i = 0; i < N_TTES_PER_SECTOR; i++) {
+         TTEntry* tte = &sectors[sno].tt[i];
+         if (tte->status == InUse && tte->count > 0
+             && overlaps(start, len, &tte->vge))
+            f(tte->entry, &tte->vge, tte->count, opaque);
+      }
+   }
+
+   for (i = 0; i <= unredir_tt_highwater; i++) {
+      UTCEntry* utce = &unredir_tt[i];
+      if (utce->inUse && utce->count > 0
+          && overlaps(start, len, &utce->vge))
+         f(utce->vge.base[0], &utce->vge, utce->count, opaque);
+   }
+
+   if (retired_counts != NULL) {
+      VG_(HT_ResetIter)(retired_counts);
+      while ((rc = VG_(HT_Next)(retired_counts)) != NULL) {
+         if (overlaps(start, len, &rc->vge))
+            f((Addr64)rc->key, &rc->vge, rc->count, opaque);
+      }
+   }
+}
+
+ULong VG_(get_exec_count) ( Addr64 entry )
+{
+   UInt          sno, tteno;
+   Int           i;
+   ULong         count = 0;
+   RetiredCount* rc;
+
+   vg_assert(VG_(needs).exec_counts);
+
+   if (VG_(search_transtab)(NULL, &sno, &tteno, entry, False))
+      count += sectors[sno].tt[tteno].count;
+
+   for (i = 0; i <= unredir_tt_highwater; i++) {
+      UTCEntry* utce = &unredir_tt[i];
+      if (utce->inUse && utce->vge.base[0] == entry)
+         count += utce->count;
+   }
+
+   if (retired_counts != NULL) {
+      rc = VG_(HT_lookup)(retired_counts, (UWord)entry);
+      if (rc != NULL)
+         count += rc->count;
+   }
+
+   return count;
+}
+
+
 /*------------------------------------------------------------*/
 /*--- Printing out of profiling results.                   ---*/
 /*------------------------------------------------------------*/
@@ -2362,6 +3136,9 @@ ULong VG_(get_SB_profile) ( SBProfEntry tops[], UInt n_tops )
       for (i = 0; i < N_TTES_PER_SECTOR; i++) {
          if (sectors[sno].tt[i].status != InUse)
             continue;
+         retire_exec_count( sectors[sno].tt[i].entry,
+                            &sectors[sno].tt[i].vge,
+                            sectors[sno].tt[i].count );
          sectors[sno].tt[i].count = 0;
       }
    }
@@ -59,11 +59,18 @@
 
    two_words holds the return values (two words).  First is
    a TRC value.  Second is generally unused, except in the case
-   where we have to return a chain-me request.
+   where we have to return a chain-me or inline cache fill request.
+
+   fast_cache is the fast cache (see pub_core_transtab.h) that
+   VG_(disp_cp_xindir) should look in.  It is always VG_(tt_fast)
+   except with --parallel-exec=yes, so only the dispatchers for
+   platforms supporting that look at it; the others use VG_(tt_fast)
+   directly.
 */
 void VG_(disp_run_translations)( HWord* two_words,
                                  void*  guest_state, 
-                                 Addr   host_addr );
+                                 Addr   host_addr,
+                                 void*  fast_cache );
 
 /* We need to know addresses of the continuation-point (cp_) labels so
    we can tell VEX what they are.  They will get baked into the code
@@ -75,6 +82,19 @@ void VG_(disp_cp_xindir)(void);
 void VG_(disp_cp_xassisted)(void);
 void VG_(disp_cp_evcheck_fail)(void);
 
+#if defined(VGP_amd64_linux)
+/* Called from an empty XIndir inline cache (--indirect-branch-cache=
+   yes).  Returns VG_TRC_XINDIR_ICFILL, with the address of the cache
+   as the second word. */
+void VG_(disp_cp_xindir_icfill)(void);
+
+/* Reached by a return, via a return-address stack entry for a call
+   whose return point has not yet been found (--return-stack=yes).
+   Returns VG_TRC_RET_FILL, with the address of the call's patchable
+   word as the second word. */
+void VG_(disp_cp_ret_fill)(void);
+#endif
+
 #endif   // __PUB_CORE_DISPATCH_H
 
 /*--------------------------------------------------------------------*/
@@ -32,6 +32,7 @@
 
 #include "pub_tool_gdbserver.h"
 #include "pub_core_threadstate.h"   // VgSchedReturnCode
+#include "pub_core_options.h"      // VgVgdb
 
 /* Return the path prefix for the named pipes (FIFOs) used by vgdb/gdb
    to communicate with valgrind */
@@ -138,6 +139,12 @@ extern IRSB* VG_(instrument_for_gdbserver_if_needed)
       VexGuestExtents* vge,
       IRType gWordTy, IRType hWordTy);
 
+/* Would VG_(instrument_for_gdbserver_if_needed) instrument a block
+   covering VGE, and if so, why?  Translations made with gdbserver
+   instrumentation must not be reused from the persistent
+   translation cache. */
+extern VgVgdb VG_(gdbserver_instrumentation_needed) (VexGuestExtents* vge);
+
 /* reason for which gdbserver connection must be finished */
 typedef
    enum {
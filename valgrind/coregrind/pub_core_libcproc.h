@@ -84,6 +84,11 @@ extern void VG_(do_atfork_pre)    ( ThreadId tid );
 extern void VG_(do_atfork_parent) ( ThreadId tid );
 extern void VG_(do_atfork_child)  ( ThreadId tid );
 
+// A cheap, fine-grained tick count for timing Valgrind's own work,
+// and the name of its unit ("cycles" or "usecs").
+extern ULong        VG_(read_cycle_counter) ( void );
+extern const HChar* VG_(cycle_counter_unit) ( void );
+
 // icache invalidation
 extern void VG_(invalidate_icache) ( void *ptr, SizeT nbytes );
 
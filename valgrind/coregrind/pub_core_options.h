@@ -156,6 +156,16 @@ extern UChar VG_(clo_profyle_flags);
    this-many back edges (event checks).  default: zero (== show
    profiling results only at the end of the run. */
 extern ULong VG_(clo_profyle_interval);
+/* DEBUG: time each JIT phase and show, at the end of the run, where
+   translation time and generated code went.  default: NO */
+extern Bool  VG_(clo_profile_translation);
+/* DEBUG: sample where the host CPU is while running Valgrind itself,
+   and write the samples as a callgrind-format profile at exit.
+   default: NO */
+extern Bool  VG_(clo_self_profile);
+/* DEBUG: where to write that profile.  May contain %p etc, as for
+   --log-file. */
+extern const HChar* VG_(clo_self_profile_out_file);
 
 /* DEBUG: if tracing codegen, be quiet until after this bb */
 extern Int   VG_(clo_trace_notbelow);
@@ -275,6 +285,45 @@ extern Int VG_(clo_merge_recursive_frames);
 /* Max number of sectors that will be used by the translation code cache. */
 extern UInt VG_(clo_num_transtab_sectors);
 
+/* Give every translation an execution counter, and keep frequently
+   executed ones in an old generation of sectors when the sectors of
+   new translations are recycled?  Default: NO */
+extern Bool VG_(clo_generational_transtab);
+
+/* Directory in which to keep translations between runs, or NULL
+   (the default) for no persistent translation cache. */
+extern const HChar* VG_(clo_translation_cache_dir);
+
+/* Translate code with little optimisation at first, and retranslate
+   blocks executed at least VG_(clo_tiered_translation_thresh) times
+   with full optimisation?  Default: NO */
+extern Bool VG_(clo_tiered_translation);
+extern Int  VG_(clo_tiered_translation_thresh);
+
+/* When retranslating hot code, extend the block along the side of
+   each conditional branch which first-tier execution counts show to
+   be taken more often?  Needs VG_(clo_tiered_translation).
+   Default: NO */
+extern Bool VG_(clo_trace_formation);
+
+/* Let threads run generated code concurrently, without holding the
+   big lock?  Only for tools which declare
+   VG_(needs_parallel_execution).  Default: NO */
+extern Bool VG_(clo_parallel_exec);
+
+/* Translate the static successors of newly translated blocks ahead
+   of time, in a helper process?  Default: NO */
+extern Bool VG_(clo_pretranslate);
+
+/* Give each indirect jump in translated code an inline cache of the
+   last place it went to?  amd64-linux only.  Default: NO */
+extern Bool VG_(clo_indirect_branch_cache);
+
+/* Keep a shadow stack of return addresses, so that returns in
+   translated code can go straight to the code for their call's return
+   point?  amd64-linux only.  Default: NO */
+extern Bool VG_(clo_return_stack);
+
 /* Delay startup to allow GDB to be attached?  Default: NO */
 extern Bool VG_(clo_wait_for_gdb);
 
@@ -0,0 +1,77 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Translating code ahead of time, in a helper process.         ---*/
+/*---                                      pub_core_pretranslate.h ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   Copyright (C) 2000-2013 Julian Seward
+      jseward@acm.org
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#ifndef __PUB_CORE_PRETRANSLATE_H
+#define __PUB_CORE_PRETRANSLATE_H
+
+//--------------------------------------------------------------------
+// PURPOSE: With --pretranslate=yes, this module runs a helper process
+// which translates the static successors of newly translated blocks
+// before the client gets to them.  The results are put in the
+// translation cache (m_transcache), from which VG_(translate) picks
+// them up when the blocks are first executed.
+//--------------------------------------------------------------------
+
+#include "pub_core_basics.h"   // VG_ macro
+
+/* Collect any translations the helper has finished.  Called by
+   VG_(translate) before looking in the translation cache. */
+extern void VG_(pretranslate_poll) ( void );
+
+/* Ask for the guest addresses SUCCS[0 .. N_SUCCS-1], the static
+   successors of a block just translated for thread TID, to be
+   translated ahead of time.  Starts the helper if necessary. */
+extern void VG_(pretranslate_note_successors) ( ThreadId tid,
+                                                Addr64* succs,
+                                                Int n_succs );
+
+/* Are we the helper process? */
+extern Bool VG_(pretranslate_in_helper) ( void );
+
+/* In the helper: send a finished translation back to the parent.
+   The arguments are as for VG_(transcache_add). */
+extern void VG_(pretranslate_deliver) ( VexGuestExtents* vge,
+                                        Addr64 nraddr, Addr64 addr,
+                                        UInt kind,
+                                        UChar* code, UInt code_len,
+                                        UInt n_guest_instrs );
+
+/* Stop the helper, if it is running.  Called at exit and before
+   execve. */
+extern void VG_(shutdown_pretranslate) ( void );
+
+extern void VG_(print_pretranslate_stats) ( void );
+
+#endif   // __PUB_CORE_PRETRANSLATE_H
+
+/*--------------------------------------------------------------------*/
+/*--- end                                  pub_core_pretranslate.h ---*/
+/*--------------------------------------------------------------------*/
@@ -40,6 +40,18 @@
    run-end profile. */
 void VG_(get_and_show_SB_profile) ( ULong ecs_done );
 
+/* For --profile-translation=yes: note the cost of one translation,
+   starting at guest address 'addr', covering 'guest_bytes' bytes of
+   guest code and producing 'code_bytes' bytes of host code.  'ticks'
+   is the total time spent in LibVEX_Translate and 'phase_ticks' its
+   breakdown by VexPhase, both in VG_(read_cycle_counter) units. */
+void VG_(record_translation_cost) ( Addr64 addr, UInt guest_bytes,
+                                    UInt code_bytes, ULong ticks,
+                                    const ULong* phase_ticks );
+
+/* Print the translation profile gathered by the above. */
+void VG_(show_translation_profile) ( void );
+
 #endif   // __PUB_CORE_SBPROFILE_H
 
 /*--------------------------------------------------------------------*/
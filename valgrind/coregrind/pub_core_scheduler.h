@@ -112,6 +112,21 @@ extern void VG_(print_scheduler_stats) ( void );
 /* If False, a fault is Valgrind-internal (ie, a bug) */
 extern Bool VG_(in_generated_code);
 
+/* With --parallel-exec=yes, a thread gives up the_BigLock while it
+   runs generated code.  VG_(parallel_run_begin) is called (holding
+   the lock) just before entering generated code, and
+   VG_(parallel_run_end) takes the lock back afterwards, either on the
+   normal return path or in the synchronous signal handler. */
+extern void VG_(parallel_run_begin) ( ThreadId tid );
+extern void VG_(parallel_run_end)   ( ThreadId tid );
+
+/* Called holding the lock: wait until no other thread is running
+   generated code.  Those threads will then block on the lock until
+   the caller releases it.  Must be called before modifying any code
+   which another thread might be executing.  Does nothing unless
+   --parallel-exec=yes. */
+extern void VG_(stop_parallel_threads) ( void );
+
 /* Sanity checks which may be done at any time.  The scheduler decides when. */
 extern void VG_(sanity_check_general) ( Bool force_expensive );
 
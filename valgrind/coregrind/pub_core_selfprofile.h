@@ -0,0 +1,63 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Sampling where Valgrind itself spends its time.              ---*/
+/*---                                       pub_core_selfprofile.h ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   Copyright (C) 2000-2013 Julian Seward
+      jseward@acm.org
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#ifndef __PUB_CORE_SELFPROFILE_H
+#define __PUB_CORE_SELFPROFILE_H
+
+//--------------------------------------------------------------------
+// PURPOSE: With --self-profile=yes, this module has each thread
+// interrupted at regular intervals of its CPU time by VG_SIGVGPROF,
+// counts the host PCs the signal lands on, and at exit writes them out
+// as a callgrind-format profile of the core, the tool and the
+// generated code.  The interval is measured with a hardware cycle
+// counter (perf_event_open) when the kernel allows it, and otherwise
+// with a per-thread CPU-time timer.
+//--------------------------------------------------------------------
+
+#include "pub_core_basics.h"   // VG_ macro
+
+/* Start and stop sampling the calling thread, which is 'tid'. */
+extern void VG_(self_profile_start_thread) ( ThreadId tid );
+extern void VG_(self_profile_stop_thread)  ( ThreadId tid );
+
+/* Note one sample at host address 'pc'.  Called from the VG_SIGVGPROF
+   handler, so it must not allocate, print or take locks. */
+extern void VG_(self_profile_sample) ( Addr pc );
+
+/* Stop sampling, write the profile to --self-profile-out-file and
+   print a short summary. */
+extern void VG_(self_profile_done) ( void );
+
+#endif   // __PUB_CORE_SELFPROFILE_H
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
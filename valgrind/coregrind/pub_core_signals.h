@@ -37,6 +37,7 @@
 
 #include "pub_tool_signals.h"       // I want to get rid of this header...
 #include "pub_core_vki.h"           // vki_sigset_t et al.
+#include "pub_core_options.h"       // VG_(clo_self_profile)
 
 /* Highest signal the kernel will let us use */
 extern Int VG_(max_signal);
@@ -44,9 +45,12 @@ extern Int VG_(max_signal);
 /* Returns the name of the vki signal sigNo */
 extern const HChar *VG_(signame)(Int sigNo);
 
-/* Use high signals because native pthreads wants to use low */
+/* Use high signals because native pthreads wants to use low.
+   VG_SIGVGPROF drives --self-profile=yes, and is only kept from the
+   client when that is in use. */
 #define VG_SIGVGKILL       (VG_(max_signal)-0)
-#define VG_SIGVGRTUSERMAX  (VG_(max_signal)-1)
+#define VG_SIGVGPROF       (VG_(max_signal)-1)
+#define VG_SIGVGRTUSERMAX  (VG_(max_signal) - (VG_(clo_self_profile) ? 2 : 1))
 
 extern void VG_(sigstartup_actions) ( void );
 
@@ -361,6 +361,11 @@ typedef struct {
 
    /* This thread's name. NULL, if no name. */
    HChar *thread_name;
+
+   /* True while the thread is running generated code without holding
+      the_BigLock (--parallel-exec=yes).  Read by other threads, hence
+      volatile. */
+   volatile Bool in_parallel_run;
 }
 ThreadState;
 
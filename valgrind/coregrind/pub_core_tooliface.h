@@ -92,6 +92,9 @@ typedef
       Bool malloc_replacement;
       Bool xml_output;
       Bool final_IR_tidy_pass;
+      Bool persistent_translations;
+      Bool parallel_execution;
+      Bool exec_counts;
    } 
    VgNeeds;
 
@@ -0,0 +1,98 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Persistent on-disk cache of translations.                    ---*/
+/*---                                        pub_core_transcache.h ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   Copyright (C) 2000-2013 Julian Seward
+      jseward@acm.org
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#ifndef __PUB_CORE_TRANSCACHE_H
+#define __PUB_CORE_TRANSCACHE_H
+
+//--------------------------------------------------------------------
+// PURPOSE: This module keeps an optional on-disk cache of finished
+// (post-register-allocation, unchained) translations, so that
+// repeated runs of the same program under the same tool and options
+// can skip LibVEX_Translate for blocks seen in earlier runs.  It is
+// enabled by --translation-cache-dir=, and only for tools which
+// declare VG_(needs_persistent_translations).  With --pretranslate=yes
+// it is also the staging area, in memory only if there is no cache
+// directory, for translations made by the helper process in
+// m_pretranslate.c.
+//--------------------------------------------------------------------
+
+#include "pub_core_basics.h"   // VG_ macro
+
+/* Decide whether the cache can be used, and if so, load the cache
+   file matching this tool/options/version combination.  Must be
+   called after command line processing and tool initialisation. */
+extern void VG_(init_transcache) ( void );
+
+/* Is the cache in use at all? */
+extern Bool VG_(transcache_enabled) ( void );
+
+/* Look for a cached translation of the block whose entry is NRADDR,
+   which (after redirection) was translated starting from ADDR, with
+   redirection kind KIND (a T_Kind value from m_translate.c).  The
+   entry is only returned if all the guest code it was made from is
+   still present, unchanged, in file-backed executable mappings.  On
+   success, *CODE points at the cached host code, which remains owned
+   by this module. */
+extern Bool VG_(transcache_lookup) ( /*OUT*/VexGuestExtents* vge,
+                                     /*OUT*/UChar** code,
+                                     /*OUT*/UInt*   code_len,
+                                     /*OUT*/UInt*   n_guest_instrs,
+                                     Addr64 nraddr, Addr64 addr,
+                                     UInt kind );
+
+/* Offer a freshly made translation to the cache.  The caller must
+   already have established that the translation is not
+   self-checking, has no profile counter and was not instrumented for
+   gdbserver.  The translation may still be rejected, eg if some of
+   its guest code does not come from a file-backed mapping. */
+extern void VG_(transcache_add) ( VexGuestExtents* vge,
+                                  Addr64 nraddr, Addr64 addr, UInt kind,
+                                  UChar* code, UInt code_len,
+                                  UInt n_guest_instrs );
+
+/* Is there any entry, possibly stale, for NRADDR? */
+extern Bool VG_(transcache_has) ( Addr64 nraddr );
+
+/* If the guest code covered by VGE could be cached, compute its
+   hash, as used to validate entries, into *H and return True. */
+extern Bool VG_(transcache_hash_guest_code) ( VexGuestExtents* vge,
+                                              /*OUT*/ULong* h );
+
+/* Write the cache back to disk.  Called once, at exit. */
+extern void VG_(save_transcache) ( void );
+
+extern void VG_(print_transcache_stats) ( void );
+
+#endif   // __PUB_CORE_TRANSCACHE_H
+
+/*--------------------------------------------------------------------*/
+/*--- end                                    pub_core_transcache.h ---*/
+/*--------------------------------------------------------------------*/
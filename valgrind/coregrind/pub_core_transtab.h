@@ -49,7 +49,19 @@ typedef
    FastCacheEntry;
 
 extern __attribute__((aligned(16)))
-       FastCacheEntry VG_(tt_fast) [VG_TT_FAST_SIZE];
+       FastCacheEntry VG_(tt_fast) [VG_TT_FAST_WAYS * VG_TT_FAST_SIZE];
+
+/* The fast cache which thread TID must use when it runs generated
+   code: VG_(tt_fast), or with --parallel-exec=yes the thread's own.
+   Must be called before each run, since it also applies any pending
+   invalidations. */
+extern FastCacheEntry* VG_(get_fast_cache) ( ThreadId tid );
+
+/* Look up GUEST in all the ways of TID's fast cache.  This is for
+   the scheduler, and covers the ways which the dispatcher on this
+   platform may not probe. */
+extern Bool VG_(lookup_fast_cache) ( ThreadId tid, /*OUT*/AddrH* hcode,
+                                     Addr guest );
 
 #define TRANSTAB_BOGUS_GUEST_ADDR ((Addr)1)
 
@@ -92,6 +104,27 @@ void VG_(tt_tc_do_chaining) ( void* from__patch_addr,
                               UInt  to_tteNo,
                               Bool  to_fastEP );
 
+#if defined(VGP_amd64_linux)
+/* Fill the XIndir inline cache at from__patch_addr so that it leads
+   to the given translation. */
+extern
+void VG_(tt_tc_fill_ic) ( void* from__patch_addr,
+                          UInt  to_sNo,
+                          UInt  to_tteNo );
+
+/* Make the return-address stack site at from__patch_addr lead to the
+   given translation. */
+extern
+void VG_(tt_tc_fill_ret_site) ( void* from__patch_addr,
+                                UInt  to_sNo,
+                                UInt  to_tteNo );
+
+/* The return-address shadow stack for thread TID to use when it next
+   runs (--return-stack=yes), emptied of anything invalidated since it
+   was last used. */
+extern VexAMD64RetStack* VG_(get_ret_stack) ( ThreadId tid );
+#endif
+
 extern Bool VG_(search_transtab) ( /*OUT*/AddrH* res_hcode,
                                    /*OUT*/UInt*  res_sNo,
                                    /*OUT*/UInt*  res_tteNo,
@@ -103,6 +136,22 @@ extern void VG_(discard_translations) ( Addr64 start, ULong range,
 
 extern void VG_(print_tt_tc_stats) ( void );
 
+/* Tiered translation (--tiered-translation=yes).  First-tier
+   translations are those added with a profile counter while
+   VG_(clo_tiered_translation) is set.  VG_(promote_hot_translations)
+   discards those which have been executed at least
+   VG_(clo_tiered_translation_thresh) times and marks their entry
+   points as hot, so that the next translation of them is a
+   second-tier one.  It returns the number of first-tier translations
+   still being watched, so the caller can pace itself. */
+extern UWord VG_(promote_hot_translations) ( void );
+extern Bool  VG_(is_hot_guest_entry)       ( Addr64 entry );
+
+/* How many times the first-tier translation of ENTRY has been
+   executed, or had been when it was found to be hot.  Zero if it has
+   never had one, or it has been discarded. */
+extern ULong VG_(guest_entry_exec_count)   ( Addr64 entry );
+
 extern UInt VG_(get_bbs_translated) ( void );
 
 /* Add to / search the auxiliary, small, unredirected translation
@@ -112,11 +161,17 @@ extern
 void VG_(add_to_unredir_transtab)( VexGuestExtents* vge,
                                    Addr64           entry,
                                    AddrH            code,
-                                   UInt             code_len );
+                                   UInt             code_len,
+                                   Int              offs_profInc,
+                                   VexArch          arch_host );
 extern 
 Bool VG_(search_unredir_transtab) ( /*OUT*/AddrH* result,
                                     Addr64        guest_addr );
 
+/* Does hcode lie in either of the above's code caches?  Cheap, and
+   safe to call from a signal handler. */
+extern Bool VG_(is_in_translation_cache) ( Addr hcode );
+
 // SB profiling stuff
 
 typedef struct _SBProfEntry {
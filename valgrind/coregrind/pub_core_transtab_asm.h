@@ -31,8 +31,16 @@
 #ifndef __PUB_CORE_TRANSTAB_ASM_H
 #define __PUB_CORE_TRANSTAB_ASM_H
 
-/* Constants for the fast translation lookup cache.  It is a direct
-   mapped cache, with 2^VG_TT_FAST_BITS entries.
+/* Constants for the fast translation lookup cache.  It is a
+   VG_TT_FAST_WAYS-way set associative cache, with 2^VG_TT_FAST_BITS
+   sets.  The ways are stored as separate planes: way W of set S is
+   entry W * VG_TT_FAST_SIZE + S.  So way 0 looks exactly like a
+   direct mapped cache of 2^VG_TT_FAST_BITS entries, which is all
+   that dispatchers that don't know about the other ways probe.
+   Entries are moved towards way 0 when they are hit in another way,
+   so way 0 holds the most recently used translation of each set.
+
+   Set numbers are computed as follows.
 
    On x86/amd64, the cache index is computed as
    'address[VG_TT_FAST_BITS-1 : 0]'.
@@ -52,6 +60,15 @@
 #define VG_TT_FAST_BITS 15
 #define VG_TT_FAST_SIZE (1 << VG_TT_FAST_BITS)
 #define VG_TT_FAST_MASK ((VG_TT_FAST_SIZE) - 1)
+#define VG_TT_FAST_WAYS 4
+
+/* Does the dispatcher (VG_(disp_cp_xindir)) on this platform probe
+   all the ways, or just way 0? */
+#if defined(VGP_amd64_linux) || defined(VGP_x86_linux)
+#  define VG_TT_FAST_DISPATCH_ALL_WAYS 1
+#else
+#  define VG_TT_FAST_DISPATCH_ALL_WAYS 0
+#endif
 
 /* This macro isn't usable in asm land; nevertheless this seems
    like a good place to put it. */
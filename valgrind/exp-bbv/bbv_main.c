@@ -70,11 +70,22 @@ static HChar buf[1024];
 
    /* Global values */
 static OSet* instr_info_table;  /* table that holds the basic block info */
+static OSet* entry_table;       /* table of BB_entry, by entry point    */
+static struct BB_entry *touched=NULL;  /* entered since the last sync   */
 static Int block_num=1;         /* global next block number */
 static Int current_thread=0;
 static Int allocated_threads=1;
 struct thread_info *bbv_thread=NULL;
 
+   /* Instructions the current thread can retire before its interval  */
+   /*   is over.  Each block subtracts its length from this inline,    */
+   /*   and only calls bbv_block_slow() when that takes it below zero  */
+   /*   or when reps_pending says a rep instruction is still open.     */
+   /*   Until fold_instrs() is called, the current thread's dyn_instr  */
+   /*   and total_instr do not include the blocks counted this way.    */
+static Word instrs_left;
+static Word reps_pending;
+
    /* Per-thread variables */
 struct thread_info {
    ULong dyn_instr;         /* Current retired instruction count */
@@ -89,15 +100,38 @@ struct thread_info {
 
 #define FUNCTION_NAME_LENGTH 20
 
+   /* The part of a block following a side exit, which is not always */
+   /*   reached when the block is entered and so is counted inline   */
+struct BB_tail {
+   Int        n_instrs;          /* non-rep instructions in this part    */
+   ULong      count;             /* times reached                        */
+   ULong      seen;              /* count at the last sync               */
+};
+
 struct BB_info {
    Addr       BB_addr;           /* used as key, must be first           */
-   Int        n_instrs;          /* instructions in the basic block      */
+   Int        n_instrs;          /* non-rep instrs before any side exit  */
    Int        block_num;         /* unique block identifier              */
    Int        *inst_counter;     /* times entered * num_instructions     */
+   Int        n_tails;           /* parts after side exits               */
+   struct BB_tail *tails;
    Bool       is_entry;          /* is this block a function entry point */
    HChar      fn_name[FUNCTION_NAME_LENGTH];  /* Function block is in    */
 };
 
+   /* An entry point (closure->nraddr) of translations of a block.    */
+   /*   The core counts how often they are entered.  untouched is 1   */
+   /*   until they are next entered after a sync, which takes the     */
+   /*   slow path once to put this on the touched list, so that a     */
+   /*   sync only has to look at the entry points that have run.      */
+struct BB_entry {
+   Addr       entry;             /* used as key, must be first           */
+   struct BB_info  *bb;          /* block the translations are of        */
+   ULong      seen;              /* core's count at the last sync        */
+   Word       untouched;         /* read inline by add_block_count()     */
+   struct BB_entry *next_touched;
+};
+
 
    /* dump the optional PC file, which contains basic block number to */
    /*   instruction address and function name mappings                */
@@ -202,32 +236,115 @@ static void close_out_reps(void)
    bbv_thread[current_thread].global_rep_count+=bbv_thread[current_thread].rep_count;
    bbv_thread[current_thread].unique_rep_count++;
    bbv_thread[current_thread].rep_count=0;
+   reps_pending=0;
 }
 
-   /* Generic function to get called each instruction */
-static VG_REGPARM(1) void per_instruction_BBV(struct BB_info *bbInfo)
+   /* Add the instructions counted inline since the last call to */
+   /*   the current thread's dyn_instr and total_instr           */
+static void fold_instrs(void)
 {
-   Int n_instrs=1;
+   struct thread_info *t = &bbv_thread[current_thread];
+   Word done = (Word)interval_size - (Word)t->dyn_instr - instrs_left;
+
+   t->dyn_instr   += done;
+   t->total_instr += done;
+}
+
+   /* Credit the current thread with the blocks entered since the */
+   /*   last call, using the execution counts kept by the core.   */
+   /*   Must be called before the thread changes.  Only the entry */
+   /*   points on the touched list can have run since, so this    */
+   /*   costs little however often threads switch.                */
+static void sync_exec_counts(void)
+{
+   struct BB_entry *e;
+   struct BB_info *bb_elem;
+   ULong count;
+   Int i;
 
-   tl_assert(bbInfo);
+   if (instr_count_only) return;
+
+   for (e=touched; e; e=e->next_touched) {
+      bb_elem = e->bb;
+      count = VG_(get_exec_count)(e->entry);
+      bb_elem->inst_counter[current_thread] +=
+         (Int)((count - e->seen) * bb_elem->n_instrs);
+      e->seen = count;
+      e->untouched = 1;
+
+      for (i=0; i<bb_elem->n_tails; i++) {
+         struct BB_tail *tail = &bb_elem->tails[i];
+         bb_elem->inst_counter[current_thread] +=
+            (Int)((tail->count - tail->seen) * tail->n_instrs);
+         tail->seen = tail->count;
+      }
+   }
+   touched = NULL;
+}
 
-      /* we finished rep but didn't clear out count */
-   if (bbv_thread[current_thread].rep_count) {
-      n_instrs++;
-      close_out_reps();
+   /* Called on entry to a block of n_instrs non-rep instructions    */
+   /*   when counting them inline would end the interval, when a     */
+   /*   rep instruction has to be closed out first, or when the entry */
+   /*   point is untouched.  Counts them one at a time, writing out   */
+   /*   the vector whenever an interval ends.                         */
+static VG_REGPARM(2) void bbv_block_slow(struct BB_entry *bbEntry,
+                                         UWord n_instrs)
+{
+   struct BB_info *bbInfo;
+   struct thread_info *t;
+   Bool  owed=True;   /* this entry not yet in bbInfo->inst_counter */
+   UWord i;
+
+   tl_assert(bbEntry);
+   bbInfo = bbEntry->bb;
+
+   if (bbEntry->untouched) {
+      bbEntry->untouched = 0;
+      bbEntry->next_touched = touched;
+      touched = bbEntry;
    }
 
-   bbInfo->inst_counter[current_thread]+=n_instrs;
+   instrs_left += n_instrs;   /* undo the inline subtraction */
+   fold_instrs();
+   t = &bbv_thread[current_thread];
 
-   bbv_thread[current_thread].total_instr+=n_instrs;
-   bbv_thread[current_thread].dyn_instr +=n_instrs;
+   for (i=0; i<n_instrs; i++) {
+      Int n=1;
 
-   handle_overflow();
+         /* we finished rep but didn't clear out count */
+      if (t->rep_count) {
+         n++;
+         close_out_reps();
+         bbInfo->inst_counter[current_thread]++;
+      }
+      if (!owed) {
+         bbInfo->inst_counter[current_thread]++;
+      }
+
+      t->total_instr+=n;
+      t->dyn_instr  +=n;
+
+      if (t->dyn_instr > interval_size) {
+         if (owed) {
+               /* The core has already counted this entry, so the */
+               /* vector gets all of the block; take back the     */
+               /* instructions that belong to the next interval.  */
+            sync_exec_counts();
+            bbInfo->inst_counter[current_thread] -= n_instrs-1-i;
+            owed=False;
+         }
+         handle_overflow();
+      }
+   }
+
+   instrs_left = (Word)interval_size - (Word)t->dyn_instr;
 }
 
    /* Function to get called if instruction has a rep prefix */
 static VG_REGPARM(1) void per_instruction_BBV_rep(Addr addr)
 {
+   fold_instrs();
+
       /* handle back-to-back rep instructions */
    if (bbv_thread[current_thread].last_rep_addr!=addr) {
       if (bbv_thread[current_thread].rep_count) {
@@ -240,30 +357,16 @@ static VG_REGPARM(1) void per_instruction_BBV_rep(Addr addr)
 
    bbv_thread[current_thread].rep_count++;
 
+   reps_pending=1;
+   instrs_left = (Word)interval_size - (Word)bbv_thread[current_thread].dyn_instr;
 }
 
-   /* Function to call if our instruction has a fldcw instruction */
-static VG_REGPARM(1) void per_instruction_BBV_fldcw(struct BB_info *bbInfo)
+   /* Function to call if our instruction has a fldcw instruction; */
+   /*   the instruction itself is counted with the rest of its block */
+static void per_instruction_BBV_fldcw(void)
 {
-   Int n_instrs=1;
-
-   tl_assert(bbInfo);
-
-      /* we finished rep but didn't clear out count */
-   if (bbv_thread[current_thread].rep_count) {
-      n_instrs++;
-      close_out_reps();
-   }
-
       /* count fldcw instructions */
    bbv_thread[current_thread].fldcw_count++;
-
-   bbInfo->inst_counter[current_thread]+=n_instrs;
-
-   bbv_thread[current_thread].total_instr+=n_instrs;
-   bbv_thread[current_thread].dyn_instr +=n_instrs;
-
-   handle_overflow();
 }
 
    /* Check if the instruction pointed to is one that needs */
@@ -339,6 +442,156 @@ static Int get_inst_type(Int len, Addr addr)
 
 
 
+#if defined(VG_BIGENDIAN)
+# define BBVEndness Iend_BE
+#elif defined(VG_LITTLEENDIAN)
+# define BBVEndness Iend_LE
+#else
+# error "Unknown endianness"
+#endif
+
+   /* Add IR to count a block of n_instrs non-rep instructions:      */
+   /*    left = instrs_left - n_instrs;  instrs_left = left;         */
+   /*    if ((left < 0) | reps_pending | bbEntry->untouched)         */
+   /*       bbv_block_slow(bbEntry, n);                              */
+static void add_block_count(IRSB* sbOut, struct BB_entry* bbEntry,
+                            Int n_instrs, IRType hWordTy)
+{
+   Bool     is64 = (hWordTy == Ity_I64);
+   IRTemp   old  = newIRTemp(sbOut->tyenv, hWordTy);
+   IRTemp   left = newIRTemp(sbOut->tyenv, hWordTy);
+   IRTemp   lt   = newIRTemp(sbOut->tyenv, Ity_I1);
+   IRTemp   neg  = newIRTemp(sbOut->tyenv, hWordTy);
+   IRTemp   reps = newIRTemp(sbOut->tyenv, hWordTy);
+   IRTemp   any  = newIRTemp(sbOut->tyenv, hWordTy);
+   IRTemp   unt  = newIRTemp(sbOut->tyenv, hWordTy);
+   IRTemp   all  = newIRTemp(sbOut->tyenv, hWordTy);
+   IRTemp   slow = newIRTemp(sbOut->tyenv, Ity_I1);
+   IRDirty  *di;
+
+   addStmtToIRSB( sbOut, IRStmt_WrTmp(old,
+      IRExpr_Load(BBVEndness, hWordTy,
+                  mkIRExpr_HWord( (HWord)&instrs_left ))));
+   addStmtToIRSB( sbOut, IRStmt_WrTmp(left,
+      IRExpr_Binop(is64 ? Iop_Sub64 : Iop_Sub32,
+                   IRExpr_RdTmp(old),
+                   mkIRExpr_HWord( (HWord)n_instrs ))));
+   addStmtToIRSB( sbOut, IRStmt_Store(BBVEndness,
+                                      mkIRExpr_HWord( (HWord)&instrs_left ),
+                                      IRExpr_RdTmp(left)));
+
+   addStmtToIRSB( sbOut, IRStmt_WrTmp(lt,
+      IRExpr_Binop(is64 ? Iop_CmpLT64S : Iop_CmpLT32S,
+                   IRExpr_RdTmp(left), mkIRExpr_HWord(0))));
+   addStmtToIRSB( sbOut, IRStmt_WrTmp(neg,
+      IRExpr_Unop(is64 ? Iop_1Uto64 : Iop_1Uto32, IRExpr_RdTmp(lt))));
+   addStmtToIRSB( sbOut, IRStmt_WrTmp(reps,
+      IRExpr_Load(BBVEndness, hWordTy,
+                  mkIRExpr_HWord( (HWord)&reps_pending ))));
+   addStmtToIRSB( sbOut, IRStmt_WrTmp(any,
+      IRExpr_Binop(is64 ? Iop_Or64 : Iop_Or32,
+                   IRExpr_RdTmp(neg), IRExpr_RdTmp(reps))));
+   addStmtToIRSB( sbOut, IRStmt_WrTmp(unt,
+      IRExpr_Load(BBVEndness, hWordTy,
+                  mkIRExpr_HWord( (HWord)&bbEntry->untouched ))));
+   addStmtToIRSB( sbOut, IRStmt_WrTmp(all,
+      IRExpr_Binop(is64 ? Iop_Or64 : Iop_Or32,
+                   IRExpr_RdTmp(any), IRExpr_RdTmp(unt))));
+   addStmtToIRSB( sbOut, IRStmt_WrTmp(slow,
+      IRExpr_Binop(is64 ? Iop_CmpNE64 : Iop_CmpNE32,
+                   IRExpr_RdTmp(all), mkIRExpr_HWord(0))));
+
+   di = unsafeIRDirty_0_N( 2, "bbv_block_slow",
+                           VG_(fnptr_to_fnentry)( &bbv_block_slow ),
+                           mkIRExprVec_2( mkIRExpr_HWord( (HWord)bbEntry ),
+                                          mkIRExpr_HWord( (HWord)n_instrs )));
+   di->guard = IRExpr_RdTmp(slow);
+   addStmtToIRSB( sbOut, IRStmt_Dirty(di) );
+}
+
+   /* Add IR to count one arrival at a block's tail */
+static void add_tail_count(IRSB* sbOut, struct BB_tail* tail)
+{
+   IRTemp   old = newIRTemp(sbOut->tyenv, Ity_I64);
+   IRTemp   new = newIRTemp(sbOut->tyenv, Ity_I64);
+
+   addStmtToIRSB( sbOut, IRStmt_WrTmp(old,
+      IRExpr_Load(BBVEndness, Ity_I64,
+                  mkIRExpr_HWord( (HWord)&tail->count ))));
+   addStmtToIRSB( sbOut, IRStmt_WrTmp(new,
+      IRExpr_Binop(Iop_Add64, IRExpr_RdTmp(old),
+                   IRExpr_Const(IRConst_U64(1)))));
+   addStmtToIRSB( sbOut, IRStmt_Store(BBVEndness,
+                                      mkIRExpr_HWord( (HWord)&tail->count ),
+                                      IRExpr_RdTmp(new)));
+}
+
+   /* Count the non-rep instructions from statement i, an IMark, up  */
+   /*   to the first IMark after a side exit.  The index of that      */
+   /*   IMark, or sbIn->stmts_used if there is none, goes in *next.   */
+static Int part_length(IRSB* sbIn, Int i, Int* next)
+{
+   Int  n_instrs=0;
+   Bool exited=False;
+
+   for (; i<sbIn->stmts_used; i++) {
+      IRStmt* st = sbIn->stmts[i];
+
+      if (st->tag == Ist_Exit) {
+         exited=True;
+      }
+      else if (st->tag == Ist_IMark) {
+         if (exited) break;
+         if (!(get_inst_type(st->Ist.IMark.len,
+                             st->Ist.IMark.addr) & REP_INSTRUCTION)) {
+            n_instrs++;
+         }
+      }
+   }
+
+   *next=i;
+   return n_instrs;
+}
+
+   /* Does the block starting at statement i split into parts of */
+   /*   the lengths recorded in bbInfo?                          */
+static Bool same_parts(struct BB_info* bbInfo, IRSB* sbIn, Int i)
+{
+   Int k;
+
+   if (part_length(sbIn, i, &i) != bbInfo->n_instrs) return False;
+   for (k=0; k<bbInfo->n_tails; k++) {
+      if (i == sbIn->stmts_used) return False;
+      if (part_length(sbIn, i, &i) != bbInfo->tails[k].n_instrs) return False;
+   }
+   return i == sbIn->stmts_used;
+}
+
+   /* Record in bbInfo how the block starting at statement i splits */
+   /*   into parts.  Any old tails array is left alone, as a         */
+   /*   translation made from the old code may still count into it.  */
+static void set_parts(struct BB_info* bbInfo, IRSB* sbIn, Int i)
+{
+   Int j,k;
+
+   bbInfo->n_instrs = part_length(sbIn, i, &j);
+   bbInfo->n_tails = 0;
+   for (k=j; k<sbIn->stmts_used; bbInfo->n_tails++) {
+      part_length(sbIn, k, &k);
+   }
+
+   bbInfo->tails = NULL;
+   if (bbInfo->n_tails > 0) {
+      bbInfo->tails = VG_(malloc)("bbv_instrument.tails",
+                                  bbInfo->n_tails*sizeof(struct BB_tail));
+      for (k=0; k<bbInfo->n_tails; k++) {
+         bbInfo->tails[k].n_instrs = part_length(sbIn, j, &j);
+         bbInfo->tails[k].count = 0;
+         bbInfo->tails[k].seen = 0;
+      }
+   }
+}
+
    /* Our instrumentation function       */
    /*    sbIn = super block to translate */
    /*    layout = guest layout           */
@@ -350,14 +603,16 @@ static IRSB* bbv_instrument ( VgCallbackClosure* closure,
                              VexArchInfo* archinfo_host,
                              IRType gWordTy, IRType hWordTy )
 {
-   Int      i,n_instrs=1;
+   Int      i,n_tails;
+   Bool     exited;
    IRSB     *sbOut;
    IRStmt   *st;
    struct BB_info  *bbInfo;
+   struct BB_entry *bbEntry;
    Addr64   origAddr,ourAddr;
+   Addr     entryAddr;
    IRDirty  *di;
-   IRExpr   **argv, *arg1;
-   Int      regparms,opcode_type;
+   Int      opcode_type;
 
       /* We don't handle a host/guest word size mismatch */
    if (gWordTy != hWordTy) {
@@ -394,7 +649,7 @@ static IRSB* bbv_instrument ( VgCallbackClosure* closure,
          /* allocate and initialize a new basic block structure */
       bbInfo=VG_(OSetGen_AllocNode)(instr_info_table, sizeof(struct BB_info));
       bbInfo->BB_addr = origAddr;
-      bbInfo->n_instrs = n_instrs;
+      set_parts(bbInfo, sbIn, i);
       bbInfo->inst_counter=VG_(calloc)("bbv_instrument",
                                        allocated_threads,
                                        sizeof(Int));
@@ -409,51 +664,82 @@ static IRSB* bbv_instrument ( VgCallbackClosure* closure,
          /* insert structure into table */
       VG_(OSetGen_Insert)( instr_info_table, bbInfo );
    }
+   else if (!same_parts(bbInfo, sbIn, i)) {
 
-      /* Iterate through the basic block, putting the original   */
-      /* instructions in place, plus putting a call to updateBBV */
-      /* for each original instruction                           */
+         /* The code here has changed.  Credit the entries made so far */
+         /* at the old lengths before counting new ones at the new.    */
+      sync_exec_counts();
+      set_parts(bbInfo, sbIn, i);
+   }
+
+      /* Get the BB_entry for this translation's entry point */
+   entryAddr=(Addr)closure->nraddr;
+   bbEntry = VG_(OSetGen_Lookup)(entry_table, &entryAddr);
+
+   if (bbEntry==NULL) {
+      bbEntry=VG_(OSetGen_AllocNode)(entry_table, sizeof(struct BB_entry));
+      bbEntry->entry = entryAddr;
+      bbEntry->bb = bbInfo;
+      bbEntry->seen = 0;
+      bbEntry->untouched = !instr_count_only;
+      bbEntry->next_touched = NULL;
+      VG_(OSetGen_Insert)( entry_table, bbEntry );
+   }
+   else if (bbEntry->bb != bbInfo) {
 
-      /* This is less efficient than only instrumenting the BB   */
-      /* But it gives proper results given the fact that         */
-      /* valgrind uses superblocks (not basic blocks) by default */
+         /* The entry point now leads to other code (a redirection */
+         /* has changed).  Credit the old block with its entries.  */
+      sync_exec_counts();
+      bbEntry->bb = bbInfo;
+   }
 
+      /* Count the instructions up to the first side exit as soon as  */
+      /* the block is entered, so the common case costs a subtract    */
+      /* and a test rather than a call per instruction; the core      */
+      /* counts the entries for the vectors.  Each part after a side  */
+      /* exit is counted the same way when it is reached, with an     */
+      /* inline counter of its own.  Chasing and unrolling are        */
+      /* disabled in bbv_post_clo_init() so that parts stay short.    */
+   if (bbInfo->n_instrs > 0) {
+      add_block_count(sbOut, bbEntry, bbInfo->n_instrs, hWordTy);
+   }
 
+   exited=False;
+   n_tails=0;
    while(i < sbIn->stmts_used) {
       st=sbIn->stmts[i];
 
+      if (st->tag == Ist_Exit) {
+         exited=True;
+      }
+
       if (st->tag == Ist_IMark) {
 
+         if (exited) {
+            struct BB_tail *tail = &bbInfo->tails[n_tails++];
+            if (tail->n_instrs > 0) {
+               add_tail_count(sbOut, tail);
+               add_block_count(sbOut, bbEntry, tail->n_instrs, hWordTy);
+            }
+            exited=False;
+         }
+
          ourAddr = st->Ist.IMark.addr;
 
          opcode_type=get_inst_type(st->Ist.IMark.len,ourAddr);
 
-         regparms=1;
-         arg1= mkIRExpr_HWord( (HWord)bbInfo);
-         argv= mkIRExprVec_1(arg1);
-
-
          if (opcode_type&REP_INSTRUCTION) {
-            arg1= mkIRExpr_HWord(ourAddr);
-            argv= mkIRExprVec_1(arg1);
-            di= unsafeIRDirty_0_N( regparms, "per_instruction_BBV_rep",
+            di= unsafeIRDirty_0_N( 1, "per_instruction_BBV_rep",
                                 VG_(fnptr_to_fnentry)( &per_instruction_BBV_rep ),
-                                argv);
+                                mkIRExprVec_1( mkIRExpr_HWord(ourAddr) ));
+            addStmtToIRSB( sbOut,  IRStmt_Dirty(di));
          }
          else if (opcode_type&FLDCW_INSTRUCTION) {
-            di= unsafeIRDirty_0_N( regparms, "per_instruction_BBV_fldcw",
+            di= unsafeIRDirty_0_N( 0, "per_instruction_BBV_fldcw",
                                 VG_(fnptr_to_fnentry)( &per_instruction_BBV_fldcw ),
-                                argv);
-         }
-         else {
-         di= unsafeIRDirty_0_N( regparms, "per_instruction_BBV",
-                                VG_(fnptr_to_fnentry)( &per_instruction_BBV ),
-                                argv);
+                                mkIRExprVec_0());
+            addStmtToIRSB( sbOut,  IRStmt_Dirty(di));
          }
-
-
-            /* Insert our call */
-         addStmtToIRSB( sbOut,  IRStmt_Dirty(di));
       }
 
          /* Insert the original instruction */
@@ -462,6 +748,8 @@ static IRSB* bbv_instrument ( VgCallbackClosure* closure,
       i++;
    }
 
+   tl_assert(n_tails == bbInfo->n_tails);
+
    return sbOut;
 }
 
@@ -509,7 +797,14 @@ static void bbv_thread_called ( ThreadId tid, ULong nDisp )
       bbv_thread=allocate_new_thread(bbv_thread,allocated_threads,tid+1);
       allocated_threads=tid+1;
    }
-   current_thread=tid;
+   if (tid != current_thread) {
+         /* settle up with the thread that was running */
+      fold_instrs();
+      sync_exec_counts();
+      current_thread=tid;
+      instrs_left = (Word)interval_size - (Word)bbv_thread[tid].dyn_instr;
+      reps_pending = (bbv_thread[tid].rep_count != 0);
+   }
 }
 
 
@@ -528,6 +823,12 @@ static void bbv_post_clo_init(void)
       /* This is the same as the command line option */
       /* --vex-guest-chase-thresh=0                  */
    VG_(clo_vex_control).guest_chase_thresh = 0;
+
+      /* Blocks are counted as a whole on entry, so they */
+      /* must not contain unrolled copies of a loop      */
+   VG_(clo_vex_control).iropt_unroll_thresh = 0;
+
+   instrs_left = interval_size;
 }
 
    /* Parse the command line options */
@@ -565,6 +866,8 @@ static void bbv_fini(Int exitcode)
 {
    Int i;
 
+   fold_instrs();
+
    if (generate_pc_file) {
       dumpPcFile();
    }
@@ -621,10 +924,16 @@ static void bbv_pre_clo_init(void)
 
    VG_(track_start_client_code)( bbv_thread_called );
 
+      /* the core counts how often each block is entered */
+   VG_(needs_exec_counts)();
+
 
    instr_info_table = VG_(OSetGen_Create)(/*keyOff*/0,
                                           NULL,
                                           VG_(malloc), "bbv.1", VG_(free));
+   entry_table = VG_(OSetGen_Create)(/*keyOff*/0,
+                                     NULL,
+                                     VG_(malloc), "bbv.2", VG_(free));
 
    bbv_thread=allocate_new_thread(bbv_thread,0,allocated_threads);
 }
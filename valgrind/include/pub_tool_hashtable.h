@@ -33,14 +33,13 @@
 
 #include "pub_tool_basics.h"   // VG_ macro
 
-/* Generic type for a separately-chained hash table.  Via a kind of dodgy
-   C-as-C++ style inheritance, tools can extend the VgHashNode type, so long
-   as the first two fields match the sizes of these two fields.  Requires
-   a bit of casting by the tool. */
-
-// Problems with this data structure:
-// - Separate chaining gives bad cache behaviour.  Hash tables with linear
-//   probing give better cache behaviour.
+/* Generic type for a hash table.  Via a kind of dodgy C-as-C++ style
+   inheritance, tools can extend the VgHashNode type, so long as the first
+   two fields match the sizes of these two fields.  Requires a bit of
+   casting by the tool.  The table uses linear probing and keeps a copy of
+   each node's key next to its pointer to the node; it doesn't use the
+   'next' field, which a node not in a table can use for something else.
+   A node's key must not be changed while it is in a table. */
 
 typedef
    struct _VgHashNode {
@@ -60,6 +60,29 @@ extern Int  VG_(system) ( const HChar* cmd );
 extern Int  VG_(fork)   ( void);
 extern void VG_(execv)  ( const HChar* filename, HChar** argv );
 
+/* ---------------------------------------------------------------------
+   Helper threads
+   ------------------------------------------------------------------ */
+
+#define VG_MAX_PARALLEL 64
+
+/* Calls fn(arg, index) on up to 'n' host threads at once: the caller,
+   with index 0, and helper threads with indices 1 upwards, which share
+   the address space.  Returns once they have all returned, giving the
+   number of threads used, which is 1 if helpers can't be started (as
+   on platforms other than amd64-linux).  The helpers are not Valgrind
+   threads and run with all signals blocked, so 'fn' must not
+   allocate, print, use VG_(set_fault_catcher) or touch memory that
+   might fault when called with index != 0; any locking between the
+   threads is up to 'fn'.  Only safe to use while the guest is
+   stopped. */
+extern Int VG_(run_in_parallel) ( Int n, void (*fn)(void* arg, Int index),
+                                  void* arg );
+
+/* Gives up the CPU for a while; for threads run by
+   VG_(run_in_parallel) waiting on each other. */
+extern void VG_(yield_cpu) ( void );
+
 /* ---------------------------------------------------------------------
    Resource limits and capabilities
    ------------------------------------------------------------------ */
@@ -482,6 +482,59 @@ extern void VG_(needs_xml_output) ( void );
    function here. */
 extern void VG_(needs_final_IR_tidy_pass) ( IRSB*(*final_tidy)(IRSB*) );
 
+/* Can the tool's translations be saved to disk and reused by a later
+   run (see --translation-cache-dir)?  Only say yes if the code
+   generated by the instrumentation function depends on nothing but the
+   guest code and the command line options; in particular it must not
+   embed addresses of dynamically allocated tool data, such as
+   per-block cost centres. */
+extern void VG_(needs_persistent_translations) ( void );
+
+/* Can several threads run the tool's instrumented code at the same
+   time (see --parallel-exec)?  Only say yes if the instrumentation,
+   and every helper it calls, is safe to run concurrently and without
+   holding the core's lock.  All core events, client requests and the
+   tool's malloc replacement are still called with the lock held. */
+extern void VG_(needs_parallel_execution) ( void );
+
+/* Does the tool want to know how many times each translation has been
+   run?  If so, every translation gets a counter which the generated
+   code increments, inline, each time the translation is entered, and
+   the tool can read the counters with VG_(apply_to_exec_counts).
+   This is much cheaper than calling a helper at the start of every
+   superblock.  Since the counters' addresses are part of the generated
+   code and the increments are not atomic, it can't be combined with
+   VG_(needs_persistent_translations) or
+   VG_(needs_parallel_execution).  Unlike the other needs, this one can
+   also be asked for from the tool's post_clo_init function, so that it
+   can depend on the tool's options. */
+extern void VG_(needs_exec_counts) ( void );
+
+/* Call f once for each translation, current or discarded, that was
+   made from guest code overlapping [start, start+len) and has been
+   run at least once.  entry is the translation's entry point (what
+   the instrumentation function saw as closure->nraddr), vge the guest
+   code it was made from -- vge->base[0] is the address of its first
+   instruction -- and count the number of times it has been entered.
+   The counts of discarded translations are kept, adding together
+   those for the same entry point, so one entry point can be reported
+   several times; the counts for it are then to be summed.  The
+   counters go on counting, so calling this again later gives the
+   totals up to that time.  Needs VG_(needs_exec_counts). */
+extern void VG_(apply_to_exec_counts) (
+   Addr64 start, ULong len,
+   void (*f)(Addr64 entry, const VexGuestExtents* vge, ULong count,
+             void* opaque),
+   void* opaque
+);
+
+/* The number of times the translations with the given entry point,
+   current or discarded, have been entered, as VG_(apply_to_exec_counts)
+   would report them summed.  This only looks at that entry point, so
+   it is much cheaper than VG_(apply_to_exec_counts) for a tool which
+   knows which translations have run.  Needs VG_(needs_exec_counts). */
+extern ULong VG_(get_exec_count) ( Addr64 entry );
+
 
 /* ------------------------------------------------------------------ */
 /* Core events to track */
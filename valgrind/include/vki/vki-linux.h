@@ -555,6 +555,11 @@ typedef struct vki_sigevent {
 	} _sigev_un;
 } vki_sigevent_t;
 
+#define VKI_SIGEV_SIGNAL	0	/* notify via signal */
+#define VKI_SIGEV_NONE		1	/* other notification: meaningless */
+#define VKI_SIGEV_THREAD	2	/* deliver via thread creation */
+#define VKI_SIGEV_THREAD_ID	4	/* deliver to thread */
+
 //----------------------------------------------------------------------
 // From elsewhere...
 //----------------------------------------------------------------------
@@ -591,6 +596,7 @@ typedef struct vki_sigevent {
 #ifndef ARCH_HAS_SOCKET_TYPES
 enum vki_sock_type {
 	VKI_SOCK_STREAM	= 1,
+	VKI_SOCK_SEQPACKET = 5,
 	// [[others omitted]]
 };
 #endif /* ARCH_HAS_SOCKET_TYPES */
@@ -2735,6 +2741,16 @@ struct	vki_iwreq
 // From linux-2.6.31.5/include/linux/perf_event.h
 /*--------------------------------------------------------------------*/
 
+enum vki_perf_type_id {
+	VKI_PERF_TYPE_HARDWARE			= 0,
+	VKI_PERF_TYPE_SOFTWARE			= 1,
+};
+
+enum vki_perf_hw_id {
+	VKI_PERF_COUNT_HW_CPU_CYCLES		= 0,
+	VKI_PERF_COUNT_HW_INSTRUCTIONS		= 1,
+};
+
 struct vki_perf_event_attr {
 
 	/*
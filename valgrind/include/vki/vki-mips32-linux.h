@@ -321,6 +321,7 @@ struct vki_sigcontext {
 
 #define VKI_O_APPEND		0x0008
 #define VKI_O_NONBLOCK		0x0080
+#define VKI_O_ASYNC		0x1000
 #define VKI_O_LARGEFILE     	0x2000
 
 #define VKI_AT_FDCWD            -100
@@ -972,6 +973,7 @@ typedef struct vki_siginfo {
 //----------------------------------------------------------------------
 enum vki_sock_type {
         VKI_SOCK_STREAM = 2,
+        VKI_SOCK_SEQPACKET = 5,
         // [[others omitted]]
 };
 #define ARCH_HAS_SOCKET_TYPES 1
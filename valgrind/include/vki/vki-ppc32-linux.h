@@ -316,6 +316,7 @@ struct vki_sigcontext {
 #define VKI_O_TRUNC		01000		/* not fcntl */
 #define VKI_O_APPEND		02000
 #define VKI_O_NONBLOCK		04000
+#define VKI_O_ASYNC		020000
 #define VKI_O_LARGEFILE     0200000
 
 #define VKI_AT_FDCWD            -100
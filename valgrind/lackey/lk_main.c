@@ -248,11 +248,6 @@ static void add_one_func_call(void)
    n_func_calls++;
 }
 
-static void add_one_SB_entered(void)
-{
-   n_SBs_entered++;
-}
-
 static void add_one_SB_completed(void)
 {
    n_SBs_completed++;
@@ -288,6 +283,16 @@ static void add_one_inverted_Jcc_untaken(void)
    n_IJccs_untaken++;
 }
 
+/* Superblock entries aren't counted by a helper call at the start of
+   each one; instead the core counts how many times each translation is
+   entered (see VG_(needs_exec_counts)), and they are added up at the
+   end. */
+static void add_SB_entries(Addr64 entry, const VexGuestExtents* vge,
+                           ULong count, void* opaque)
+{
+   n_SBs_entered += count;
+}
+
 /*------------------------------------------------------------*/
 /*--- Stuff for --detailed-counts                          ---*/
 /*------------------------------------------------------------*/
@@ -636,6 +641,11 @@ static void lk_post_clo_init(void)
 {
    Int op, tyIx;
 
+   /* Only --basic-counts uses the counts, so don't have every
+      translation count its entries otherwise. */
+   if (clo_basic_counts)
+      VG_(needs_exec_counts)();
+
    if (clo_detailed_counts) {
       for (op = 0; op < N_OPS; op++)
          for (tyIx = 0; tyIx < N_TYPES; tyIx++)
@@ -675,14 +685,6 @@ IRSB* lk_instrument ( VgCallbackClosure* closure,
       i++;
    }
 
-   if (clo_basic_counts) {
-      /* Count this superblock. */
-      di = unsafeIRDirty_0_N( 0, "add_one_SB_entered", 
-                                 VG_(fnptr_to_fnentry)( &add_one_SB_entered ),
-                                 mkIRExprVec_0() );
-      addStmtToIRSB( sbOut, IRStmt_Dirty(di) );
-   }
-
    if (clo_trace_sbs) {
       /* Print this superblock's address. */
       di = unsafeIRDirty_0_N( 
@@ -1002,6 +1004,8 @@ static void lk_fini(Int exitcode)
       ULong total_Jccs = n_Jccs + n_IJccs;
       ULong taken_Jccs = (n_Jccs - n_Jccs_untaken) + n_IJccs_untaken;
 
+      VG_(apply_to_exec_counts)(0, ~0ULL, add_SB_entries, NULL);
+
       VG_(umsg)("Counted %'llu call%s to %s()\n",
                 n_func_calls, ( n_func_calls==1 ? "" : "s" ), clo_fnname);
 
@@ -376,6 +376,23 @@ extern HChar * MC_(snprintf_delta) (HChar * buf, Int size,
 
 Bool MC_(is_valid_aligned_word)     ( Addr a );
 Bool MC_(is_within_valid_secondary) ( Addr a );
+UWord MC_(valid_aligned_words)      ( Addr a );
+
+// Runs fn on up to n threads with VG_(run_in_parallel), treating the
+// shadow memory as with --mt-shadow=yes while they run.  fn may read
+// the shadow memory, but not write any it has not been given space for
+// (see reserve_shadow in mc_main.c), since the helper threads must not
+// allocate.
+Int MC_(run_shadow_helpers) ( Int n, void (*fn)(void* arg, Int index),
+                              void* arg );
+
+// With --leak-check-incremental=yes, memory is divided into cards of
+// SM_SIZE bytes.  A card is dirty if the memory in it, or its V+A bits,
+// might have changed since MC_(clean_card) was last called for it.
+// Cards for which MC_(card_is_tracked) is False are always dirty.
+Bool MC_(card_is_tracked) ( Addr a );
+Bool MC_(card_is_dirty)   ( Addr a );
+void MC_(clean_card)      ( Addr a );
 
 // Prints as user msg a description of the given loss record.
 void MC_(pp_LossRecord)(UInt n_this_record, UInt n_total_records,
@@ -535,6 +552,14 @@ typedef
    Default : no heuristic. */
 extern UInt MC_(clo_leak_check_heuristics);
 
+/* Number of threads marking the blocks reachable from the root set in
+   a leak search.  Default : 1. */
+extern Int MC_(clo_leak_check_threads);
+
+/* Whether a leak search reuses what an earlier one found in memory
+   which hasn't been written to since.  Default : NO */
+extern Bool MC_(clo_leak_check_incremental);
+
 /* Assume accesses immediately below %esp are due to gcc-2.96 bugs.
  * default: NO */
 extern Bool MC_(clo_workaround_gcc296_bugs);
@@ -562,6 +587,15 @@ typedef
    KeepStacktraces;
 extern KeepStacktraces MC_(clo_keep_stacktraces);
 
+/* Keep the shadow memory structures safe for use by several threads at
+   once?  (A debugging option for now: it costs a little and the core
+   still runs Memcheck's helpers one thread at a time.) */
+extern Bool MC_(clo_mt_shadow);
+
+/* At startup, check --mt-shadow=yes by having several host threads
+   update neighbouring bytes' shadow at once? */
+extern Bool MC_(clo_mt_shadow_selftest);
+
 /* Indicates the level of instrumentation/checking done by Memcheck.
 
    1 = No undefined value checking, Addrcheck-style behaviour only:
@@ -621,6 +655,15 @@ VG_REGPARM(2) void MC_(helperc_STOREV16be) ( Addr, UWord );
 VG_REGPARM(2) void MC_(helperc_STOREV16le) ( Addr, UWord );
 VG_REGPARM(2) void MC_(helperc_STOREV8)    ( Addr, UWord );
 
+/* The same, also marking the card dirty, for --leak-check-incremental=yes */
+VG_REGPARM(1) void MC_(helperc_STOREV64be_card) ( Addr, ULong );
+VG_REGPARM(1) void MC_(helperc_STOREV64le_card) ( Addr, ULong );
+VG_REGPARM(2) void MC_(helperc_STOREV32be_card) ( Addr, UWord );
+VG_REGPARM(2) void MC_(helperc_STOREV32le_card) ( Addr, UWord );
+VG_REGPARM(2) void MC_(helperc_STOREV16be_card) ( Addr, UWord );
+VG_REGPARM(2) void MC_(helperc_STOREV16le_card) ( Addr, UWord );
+VG_REGPARM(2) void MC_(helperc_STOREV8_card)    ( Addr, UWord );
+
 VG_REGPARM(2) void  MC_(helperc_LOADV256be) ( /*OUT*/V256*, Addr );
 VG_REGPARM(2) void  MC_(helperc_LOADV256le) ( /*OUT*/V256*, Addr );
 VG_REGPARM(2) void  MC_(helperc_LOADV128be) ( /*OUT*/V128*, Addr );
@@ -633,6 +676,13 @@ VG_REGPARM(1) UWord MC_(helperc_LOADV16be)  ( Addr );
 VG_REGPARM(1) UWord MC_(helperc_LOADV16le)  ( Addr );
 VG_REGPARM(1) UWord MC_(helperc_LOADV8)     ( Addr );
 
+/* Coalesced range handlers.  The range passed to these covers at
+   most MC_RANGE_SPAN bytes; the mask has two bits per byte. */
+#define MC_RANGE_SPAN  (4 * sizeof(UWord))
+VG_REGPARM(2) UWord MC_(helperc_LOADV_range)          ( Addr, UWord );
+VG_REGPARM(2) UWord MC_(helperc_STOREV_range_defined) ( Addr, UWord );
+VG_REGPARM(2) UWord MC_(helperc_STOREV_range_defined_card) ( Addr, UWord );
+
 void MC_(helperc_MAKE_STACK_UNINIT) ( Addr base, UWord len,
                                                  Addr nia );
 
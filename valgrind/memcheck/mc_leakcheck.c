@@ -37,6 +37,7 @@
 #include "pub_tool_libcbase.h"
 #include "pub_tool_libcassert.h"
 #include "pub_tool_libcprint.h"
+#include "pub_tool_libcproc.h"      // VG_(yield_cpu)
 #include "pub_tool_libcsignal.h"
 #include "pub_tool_machine.h"
 #include "pub_tool_mallocfree.h"
@@ -459,6 +460,111 @@ static SizeT lc_chunks_n_frees_marker;
 // lc_extras[i] describe the same block).
 static LC_Extra* lc_extras;
 
+// The start addresses of lc_chunks in Eytzinger order, ie. laid out as
+// an implicit binary search tree with the children of entry k (counting
+// from 1) at 2k and 2k+1.  The first few levels of the tree, which every
+// search reads, are packed together at the front, so looking up a
+// pointer touches far fewer cache lines than a binary search of
+// lc_chunks, which also dereferences an MC_Chunk at each step.
+// lc_chunk_tree_end[k] is the end of that block (zero-sized blocks
+// covering 1 byte, see find_chunk_for), and lc_chunk_tree_idx[k] its
+// index in lc_chunks, so that a value which doesn't point into a block
+// is rejected without looking at any MC_Chunk.
+static Addr* lc_chunk_tree;
+static Addr* lc_chunk_tree_end;
+static Int*  lc_chunk_tree_idx;
+// Whether any two blocks in lc_chunks start at the same address.
+static Bool  lc_chunks_share_starts;
+// Every block lies within [lc_chunks_lo, lc_chunks_hi[, which is used to
+// throw away most values which aren't pointers to a block cheaply.
+static Addr  lc_chunks_lo;
+static Addr  lc_chunks_hi;
+
+// Fill in the subtree of lc_chunk_tree rooted at k from lc_chunks[i],
+// lc_chunks[i+1], ...  Return the index of the first chunk not used.
+static Int fill_chunk_tree ( Int k, Int i )
+{
+   if (k <= lc_n_chunks) {
+      MC_Chunk* ch = lc_chunks[i = fill_chunk_tree(2*k, i)];
+      lc_chunk_tree[k]     = ch->data;
+      lc_chunk_tree_end[k] = ch->data + ch->szB + (ch->szB == 0 ? 1 : 0);
+      lc_chunk_tree_idx[k] = i;
+      if (i > 0 && lc_chunks[i-1]->data == ch->data)
+         lc_chunks_share_starts = True;
+      i = fill_chunk_tree(2*k+1, i+1);
+   }
+   return i;
+}
+
+// (Re)build lc_chunk_tree, lc_chunk_tree_idx, lc_chunks_lo and
+// lc_chunks_hi from lc_chunks, which must be sorted.
+static void build_chunk_tree ( void )
+{
+   Int i;
+
+   if (lc_chunk_tree) {
+      VG_(free)(lc_chunk_tree);
+      VG_(free)(lc_chunk_tree_end);
+      VG_(free)(lc_chunk_tree_idx);
+      lc_chunk_tree = NULL;
+      lc_chunk_tree_end = NULL;
+      lc_chunk_tree_idx = NULL;
+   }
+   // An empty range, in case there are no chunks.
+   lc_chunks_lo = 1;
+   lc_chunks_hi = 0;
+   lc_chunks_share_starts = False;
+   if (lc_n_chunks == 0)
+      return;
+
+   lc_chunk_tree     = VG_(malloc)("mc.bct.1",
+                                   (lc_n_chunks + 1) * sizeof(Addr));
+   lc_chunk_tree_end = VG_(malloc)("mc.bct.2",
+                                   (lc_n_chunks + 1) * sizeof(Addr));
+   lc_chunk_tree_idx = VG_(malloc)("mc.bct.3",
+                                   (lc_n_chunks + 1) * sizeof(Int));
+   i = fill_chunk_tree(1, 0);
+   tl_assert(i == lc_n_chunks);
+
+   lc_chunks_lo = lc_chunks[0]->data;
+   for (i = 1; i <= lc_n_chunks; i++) {
+      if (lc_chunk_tree_end[i] > lc_chunks_hi)
+         lc_chunks_hi = lc_chunk_tree_end[i];
+   }
+}
+
+// Find the i such that ptr points at or inside the block described by
+// lc_chunks[i], using lc_chunk_tree.  Return -1 if none found.
+static Int find_lc_chunk_for ( Addr ptr )
+{
+   Int k = 1, pred = 0, i = -1;
+
+   // Descend to a leaf.  The last node at which the search goes right is
+   // the last block starting at or before ptr.
+   while (k <= lc_n_chunks) {
+      Bool right = lc_chunk_tree[k] <= ptr;
+      if (right)
+         pred = k;
+      k = 2*k + (right ? 1 : 0);
+   }
+
+   if (pred != 0 && ptr < lc_chunk_tree_end[pred]) {
+      i = lc_chunk_tree_idx[pred];
+      // The only blocks which can share a start address are zero-sized
+      // ones in front of another block.  Return the first, as the linear
+      // search does.
+      if (lc_chunks_share_starts && ptr == lc_chunk_tree[pred]) {
+         while (i > 0 && lc_chunks[i-1]->data == ptr)
+            i--;
+      }
+   }
+
+#  if VG_DEBUG_LEAKCHECK
+   tl_assert(i == find_chunk_for_OLD ( ptr, lc_chunks, lc_n_chunks ));
+#  endif
+   return i;
+}
+
 // chunks will be converted and merged in loss record, maintained in lr_table
 // lr_table elements are kept from one leak_search to another to implement
 // the "print new/changed leaks" client request
@@ -489,6 +595,60 @@ static Int* lc_markstack;
 // the stack has one element, 1 if it has two, etc.
 static Int  lc_markstack_top;    
 
+// With --leak-check-threads=N (N > 1), the memory root set is scanned and
+// the blocks it reaches are marked by N threads: the thread doing the leak
+// check, and N-1 helper threads started with MC_(run_shadow_helpers).  What
+// they read (lc_chunks, the shadow memory and the segment list) doesn't
+// change while the guest is stopped.  The reachedness bitfields of a
+// block's LC_Extra share its first word, which is updated with a
+// compare-and-swap, so each update is as if done by a single thread.
+//
+// Each thread has a small stack of its own.  When that overflows, half
+// of it is moved to lc_markstack, which is shared, and a thread with no
+// work refills its stack from there.  As each block is pending on at
+// most one stack at a time, lc_markstack never overflows.
+//
+// The helpers can't take a signal, so they only scan memory that is in
+// an anonymous client mapping.  Root segments mapped from files are
+// scanned before the helpers start, and blocks outside anonymous memory
+// are put on lc_markstack_main, to be scanned by the thread doing the
+// leak check, which catches faults as usual.
+#define LC_LOCAL_STACK 256
+
+typedef
+   struct {
+      Int   index;                  // as passed by VG_(run_in_parallel)
+      Int   local_top;              // -1 if local is empty
+      Int   local[LC_LOCAL_STACK];
+      SizeT scanned_szB;
+   }
+   LC_Worker;
+
+// The pieces of the root set the threads take in turn.
+typedef
+   struct {
+      Addr  start;
+      SizeT szB;
+   }
+   LC_RootPiece;
+
+#define LC_ROOT_PIECE_SZB (16 * SM_SIZE)
+
+static LC_Worker*    lc_workers;
+static LC_RootPiece* lc_root_pieces;
+static Int           lc_n_root_pieces;
+static Int           lc_root_pieces_size;
+static volatile Int  lc_next_root_piece;
+// Protects lc_markstack and lc_markstack_main while threads are marking.
+static volatile Int  lc_markstack_lock;
+// Threads which have, or may find, something to do.
+static volatile Int  lc_n_busy;
+static Int*          lc_markstack_main;
+static Int           lc_markstack_main_top;
+
+#define LC_EXTRA_WORD(ex)  (*(volatile UInt*)(ex))
+#define LC_VOLATILE(v)     (*(volatile Int*)&(v))
+
 // Keeps track of how many bytes of memory we've scanned, for printing.
 // (Nb: We don't keep track of how many register bytes we've scanned.)
 static SizeT lc_scanned_szB;
@@ -525,36 +685,37 @@ lc_is_a_chunk_ptr(Addr ptr, Int* pch_no, MC_Chunk** pch, LC_Extra** pex)
    MC_Chunk* ch;
    LC_Extra* ex;
 
-   // Quick filter. Note: implemented with am, not with get_vabits2
+   // Quick filter: most values which aren't pointers are outside the
+   // range of the heap.
+   if (ptr < lc_chunks_lo || ptr >= lc_chunks_hi)
+      return False;
+
+   ch_no = find_lc_chunk_for(ptr);
+   tl_assert(ch_no >= -1 && ch_no < lc_n_chunks);
+
+   // Note: implemented with am, not with get_vabits2
    // as ptr might be random data pointing anywhere. On 64 bit
    // platforms, getting va bits for random data can be quite costly
    // due to the secondary map.
-   if (!VG_(am_is_valid_for_client)(ptr, 1, VKI_PROT_READ)) {
+   if (ch_no == -1 || !VG_(am_is_valid_for_client)(ptr, 1, VKI_PROT_READ)) {
       return False;
    } else {
-      ch_no = find_chunk_for(ptr, lc_chunks, lc_n_chunks);
-      tl_assert(ch_no >= -1 && ch_no < lc_n_chunks);
+      // Ok, we've found a pointer to a chunk.  Get the MC_Chunk and its
+      // LC_Extra.
+      ch = lc_chunks[ch_no];
+      ex = &(lc_extras[ch_no]);
 
-      if (ch_no == -1) {
-         return False;
-      } else {
-         // Ok, we've found a pointer to a chunk.  Get the MC_Chunk and its
-         // LC_Extra.
-         ch = lc_chunks[ch_no];
-         ex = &(lc_extras[ch_no]);
+      tl_assert(ptr >= ch->data);
+      tl_assert(ptr < ch->data + ch->szB + (ch->szB==0  ? 1  : 0));
 
-         tl_assert(ptr >= ch->data);
-         tl_assert(ptr < ch->data + ch->szB + (ch->szB==0  ? 1  : 0));
+      if (VG_DEBUG_LEAKCHECK)
+         VG_(printf)("ptr=%#lx -> block %d\n", ptr, ch_no);
 
-         if (VG_DEBUG_LEAKCHECK)
-            VG_(printf)("ptr=%#lx -> block %d\n", ptr, ch_no);
+      *pch_no = ch_no;
+      *pch    = ch;
+      *pex    = ex;
 
-         *pch_no = ch_no;
-         *pch    = ch;
-         *pex    = ex;
-
-         return True;
-      }
+      return True;
    }
 }
 
@@ -774,25 +935,21 @@ static LeakCheckHeuristic heuristic_reachedness (Addr ptr,
 }
 
 
-// If 'ptr' is pointing to a heap-allocated block which hasn't been seen
-// before, push it onto the mark stack.
-static void
-lc_push_without_clique_if_a_chunk_ptr(Addr ptr, Bool is_prior_definite)
+// Update the reachedness of block 'ch', whose extra info is 'ex', given
+// that 'ptr' points into it.  Returns True if its state has changed, in
+// which case it must be (re)scanned.
+static Bool
+lc_upgrade_reachedness(Addr ptr, MC_Chunk* ch, LC_Extra* ex,
+                       Bool is_prior_definite)
 {
-   Int ch_no;
-   MC_Chunk* ch;
-   LC_Extra* ex;
    Reachedness ch_via_ptr; // Is ch reachable via ptr, and how ?
 
-   if ( ! lc_is_a_chunk_ptr(ptr, &ch_no, &ch, &ex) )
-      return;
-
    if (ex->state == Reachable) {
       if (ex->heuristic && ptr == ch->data)
          // If block was considered reachable via an heuristic, and it is now
          // directly reachable via ptr, clear the heuristic field.
          ex->heuristic = LchNone;
-      return;
+      return False;
    }
    
    // Possibly upgrade the state, ie. one of:
@@ -821,7 +978,7 @@ lc_push_without_clique_if_a_chunk_ptr(Addr ptr, Bool is_prior_definite)
 
       // State has changed to Reachable so (re)scan the block to make
       // sure any blocks it points to are correctly marked.
-      lc_push(ch_no, ch);
+      return True;
 
    } else if (ex->state == Unreached) {
       // Either 'ptr' is a interior-pointer, or the prior node isn't definite,
@@ -830,8 +987,26 @@ lc_push_without_clique_if_a_chunk_ptr(Addr ptr, Bool is_prior_definite)
 
       // State has changed to Possible so (re)scan the block to make
       // sure any blocks it points to are correctly marked.
-      lc_push(ch_no, ch);
+      return True;
    }
+
+   return False;
+}
+
+// If 'ptr' is pointing to a heap-allocated block which hasn't been seen
+// before, push it onto the mark stack.
+static void
+lc_push_without_clique_if_a_chunk_ptr(Addr ptr, Bool is_prior_definite)
+{
+   Int ch_no;
+   MC_Chunk* ch;
+   LC_Extra* ex;
+
+   if ( ! lc_is_a_chunk_ptr(ptr, &ch_no, &ch, &ex) )
+      return;
+
+   if (lc_upgrade_reachedness(ptr, ch, ex, is_prior_definite))
+      lc_push(ch_no, ch);
 }
 
 static void
@@ -896,8 +1071,114 @@ lc_push_if_a_chunk_ptr(Addr ptr,
 }
 
 
+static void lc_lock_markstack(void)
+{
+   while (__sync_lock_test_and_set(&lc_markstack_lock, 1)) {
+      while (lc_markstack_lock)
+         VG_(yield_cpu)();
+   }
+}
+
+static void lc_unlock_markstack(void)
+{
+   __sync_lock_release(&lc_markstack_lock);
+}
+
+// Push a chunk onto w's stack; its pending bit has already been set.
+static void lc_par_push(LC_Worker* w, Int ch_no)
+{
+   if (w->local_top == LC_LOCAL_STACK-1) {
+      // Full: move the bottom half to the shared stack.
+      Int i, half = LC_LOCAL_STACK/2;
+      lc_lock_markstack();
+      for (i = 0; i < half; i++) {
+         lc_markstack_top++;
+         tl_assert(lc_markstack_top < lc_n_chunks);
+         lc_markstack[lc_markstack_top] = w->local[i];
+      }
+      lc_unlock_markstack();
+      for (i = half; i < LC_LOCAL_STACK; i++)
+         w->local[i-half] = w->local[i];
+      w->local_top -= half;
+   }
+   w->local[++w->local_top] = ch_no;
+}
+
+// Pop a chunk from w's stack, refilling it from the shared stack if
+// it is empty.
+static Bool lc_par_pop(LC_Worker* w, Int* ret)
+{
+   if (w->local_top == -1) {
+      if (LC_VOLATILE(lc_markstack_top) == -1)
+         return False;
+      lc_lock_markstack();
+      while (lc_markstack_top >= 0 && w->local_top < LC_LOCAL_STACK/2 - 1) {
+         w->local[++w->local_top] = lc_markstack[lc_markstack_top];
+         lc_markstack_top--;
+      }
+      lc_unlock_markstack();
+      if (w->local_top == -1)
+         return False;
+   }
+   *ret = w->local[w->local_top--];
+   return True;
+}
+
+// The parallel version of lc_push_without_clique_if_a_chunk_ptr.
+static void
+lc_par_push_if_a_chunk_ptr(LC_Worker* w, Addr ptr, Bool is_prior_definite)
+{
+   Int ch_no;
+   MC_Chunk* ch;
+   LC_Extra* ex;
+
+   if ( ! lc_is_a_chunk_ptr(ptr, &ch_no, &ch, &ex) )
+      return;
+
+   while (True) {
+      UInt     old = LC_EXTRA_WORD(ex);
+      LC_Extra nyu;
+      Bool     push;
+
+      LC_EXTRA_WORD(&nyu) = old;
+      push = lc_upgrade_reachedness(ptr, ch, &nyu, is_prior_definite)
+             && !nyu.pending;
+      if (push)
+         nyu.pending = True;
+      if (LC_EXTRA_WORD(&nyu) == old)
+         return;
+      if (__sync_bool_compare_and_swap(&LC_EXTRA_WORD(ex), old,
+                                       LC_EXTRA_WORD(&nyu))) {
+         if (push)
+            lc_par_push(w, ch_no);
+         return;
+      }
+   }
+}
+
+// Clear the pending bit of a block which is about to be scanned, and
+// return whether the block is definitely reachable at that point.
+static Bool lc_par_clear_pending(LC_Extra* ex)
+{
+   while (True) {
+      UInt     old = LC_EXTRA_WORD(ex);
+      LC_Extra nyu;
+
+      LC_EXTRA_WORD(&nyu) = old;
+      tl_assert(nyu.pending);
+      nyu.pending = False;
+      if (__sync_bool_compare_and_swap(&LC_EXTRA_WORD(ex), old,
+                                       LC_EXTRA_WORD(&nyu)))
+         return Possible != nyu.state;
+   }
+}
+
 static VG_MINIMAL_JMP_BUF(memscan_jmpbuf);
 static volatile Addr bad_scanned_addr;
+// The signal mask to restore after catching a fault while scanning.  It
+// doesn't change during a leak search (or who_points_at), so it is read
+// once at the start rather than with a syscall for every block scanned.
+static vki_sigset_t memscan_sigmask;
 
 static
 void scan_all_valid_memory_catcher ( Int sigNo, Addr addr )
@@ -910,6 +1191,208 @@ void scan_all_valid_memory_catcher ( Int sigNo, Addr addr )
    }
 }
 
+// With --leak-check-incremental=yes, lc_cards keeps, for each card (see
+// MC_(card_is_dirty)) of anonymous client memory that a leak search has
+// scanned, a bitmap of the words in it which might be pointers to a
+// block: the words that were valid, and held a value between lc_cards_lo
+// and lc_cards_hi, when the card was last scanned.  Every client mapping,
+// and so every block, is in that range.  While the card stays clean, a
+// later leak search reads only those words.
+#define LC_CARD_WORDS   (SM_SIZE / sizeof(Addr))
+#define LC_BITS         (8 * sizeof(UWord))
+
+typedef
+   struct _LC_Card {
+      struct _LC_Card* next;
+      UWord            key;     // card start / SM_SIZE
+      UInt             gen;     // last leak search which used it
+      UWord            maybe_ptr[LC_CARD_WORDS / LC_BITS];
+   }
+   LC_Card;
+
+static VgHashTable lc_cards = NULL;
+static Addr        lc_cards_lo;
+static Addr        lc_cards_hi;
+
+// How many cards the current leak search has reused and rescanned.
+static SizeT lc_n_cards_reused;
+static SizeT lc_n_cards_rescanned;
+
+// Fill in c's bitmap from the card starting at card.
+static void lc_rescan_card(LC_Card* c, Addr card)
+{
+#if defined(VGA_s390x)
+   // See lc_scan_memory.
+   volatile
+#endif
+   Addr ptr = card;
+   const Addr end = card + SM_SIZE;
+
+   VG_(memset)(c->maybe_ptr, 0, sizeof(c->maybe_ptr));
+   if (!MC_(is_within_valid_secondary)(card))
+      return;
+
+   VG_(set_fault_catcher)(scan_all_valid_memory_catcher);
+   if (VG_MINIMAL_SETJMP(memscan_jmpbuf) != 0) {
+      // Just skip what can't be read, as lc_scan_memory does.
+      VG_(sigprocmask)(VKI_SIG_SETMASK, &memscan_sigmask, NULL);
+#     if defined(VGA_s390x)
+      lc_sig_skipped_szB += VKI_PAGE_SIZE;
+      ptr = VG_PGROUNDUP(ptr + 1);
+#     else
+      lc_sig_skipped_szB += sizeof(Addr);
+      tl_assert(bad_scanned_addr >= card && bad_scanned_addr < end);
+      ptr = bad_scanned_addr + sizeof(Addr);
+#     endif
+   }
+   while (ptr < end) {
+      Addr addr;
+
+      // Only anonymous memory is summarised, see lc_scan_cards.
+      if (UNLIKELY((ptr % VKI_PAGE_SIZE) == 0)) {
+         NSegment const* seg = VG_(am_find_nsegment)(ptr);
+         if (!seg || seg->kind != SkAnonC
+             || !VG_(am_is_valid_for_client)(ptr, sizeof(Addr),
+                                             VKI_PROT_READ)) {
+            ptr += VKI_PAGE_SIZE;
+            continue;
+         }
+      }
+
+      if (MC_(is_valid_aligned_word)(ptr)) {
+         lc_scanned_szB += sizeof(Addr);
+         addr = *(Addr *)ptr;
+         if (addr >= lc_cards_lo && addr <= lc_cards_hi) {
+            UWord i = (ptr - card) / sizeof(Addr);
+            c->maybe_ptr[i / LC_BITS] |= (UWord)1 << (i % LC_BITS);
+         }
+      }
+      ptr += sizeof(Addr);
+   }
+
+   VG_(set_fault_catcher)(NULL);
+}
+
+// Return the up to date summary of the card starting at card.
+static LC_Card* lc_get_card(Addr card)
+{
+   LC_Card* c = VG_(HT_lookup)(lc_cards, card / SM_SIZE);
+   Bool     count = c == NULL || c->gen != MC_(leak_search_gen);
+
+   if (c == NULL) {
+      c = VG_(malloc)("mc.lgc.1", sizeof(LC_Card));
+      c->key = card / SM_SIZE;
+      VG_(HT_add_node)(lc_cards, c);
+   } else if (!MC_(card_is_dirty)(card)) {
+      if (count)
+         lc_n_cards_reused++;
+      c->gen = MC_(leak_search_gen);
+      return c;
+   }
+
+   lc_rescan_card(c, card);
+   MC_(clean_card)(card);
+   if (count)
+      lc_n_cards_rescanned++;
+   c->gen = MC_(leak_search_gen);
+   return c;
+}
+
+// The lc_scan_memory of [start, start+len[ for a leak search, using
+// lc_cards.  Return False, having done nothing, if the range isn't all
+// in one anonymous client mapping.  Other memory, such as file mappings,
+// which could be devices, is scanned by lc_scan_memory as usual.
+static Bool
+lc_scan_cards(Addr start, SizeT len, Bool is_prior_definite,
+              Int clique, Int cur_clique)
+{
+   const Addr first = VG_ROUNDUP(start, sizeof(Addr));
+   const Addr end = VG_ROUNDDN(start+len, sizeof(Addr));
+   NSegment const* seg;
+   Addr card;
+
+   if (first >= end)
+      return False;
+   seg = VG_(am_find_nsegment)(first);
+   if (!seg || seg->kind != SkAnonC || end - 1 > seg->end
+       || !MC_(card_is_tracked)(end - 1))
+      return False;
+
+   for (card = VG_ROUNDDN(first, SM_SIZE); card < end; card += SM_SIZE) {
+      LC_Card* c  = lc_get_card(card);
+      UWord    i  = (first > card ? first - card : 0) / sizeof(Addr);
+      UWord    hi = (end < card + SM_SIZE ? end - card : SM_SIZE)
+                    / sizeof(Addr);
+
+      while (i < hi) {
+         UWord bits = c->maybe_ptr[i / LC_BITS] >> (i % LC_BITS);
+         if (bits == 0) {
+            i = VG_ROUNDDN(i, LC_BITS) + LC_BITS;
+         } else {
+            if (bits & 1) {
+               Addr addr = *(Addr *)(card + i * sizeof(Addr));
+               lc_push_if_a_chunk_ptr(addr, clique, cur_clique,
+                                      is_prior_definite);
+            }
+            i++;
+         }
+      }
+   }
+   return True;
+}
+
+// Set up lc_cards for a leak search.
+static void lc_start_cards(void)
+{
+   Int   i, n_seg_starts;
+   Addr* seg_starts = VG_(get_segment_starts)( &n_seg_starts );
+   Addr  lo = ~(Addr)0, hi = 0;
+
+   for (i = 0; i < n_seg_starts; i++) {
+      NSegment const* seg = VG_(am_find_nsegment)( seg_starts[i] );
+      if (seg->kind != SkAnonC && seg->kind != SkFileC
+          && seg->kind != SkShmC)
+         continue;
+      if (seg->start < lo) lo = seg->start;
+      if (seg->end > hi)   hi = seg->end;
+   }
+   VG_(free)(seg_starts);
+
+   // If there is now client memory outside the range the summaries were
+   // made for, they might miss pointers into it.
+   if (lc_cards && (lo < lc_cards_lo || hi > lc_cards_hi)) {
+      VG_(HT_destruct)(lc_cards, VG_(free));
+      lc_cards = NULL;
+   }
+   if (lc_cards == NULL) {
+      lc_cards = VG_(HT_construct)("mc.lsc.1");
+      lc_cards_lo = lo;
+      lc_cards_hi = hi;
+   }
+
+   lc_n_cards_reused = 0;
+   lc_n_cards_rescanned = 0;
+}
+
+// Forget the cards the leak search didn't use, rather than keep
+// summaries of memory which no longer holds anything reachable.
+static void lc_end_cards(void)
+{
+   UInt i, n_cards;
+   LC_Card** cards = (LC_Card**)VG_(HT_to_array)(lc_cards, &n_cards);
+
+   for (i = 0; i < n_cards; i++) {
+      if (cards[i]->gen != MC_(leak_search_gen))
+         VG_(free)(VG_(HT_remove)(lc_cards, cards[i]->key));
+   }
+   if (cards)
+      VG_(free)(cards);
+}
+
+// lc_scan_memory gets the validity of the words it scans from
+// MC_(valid_aligned_words), a block of this many bytes at a time.
+#define LC_BLOCK_SZB   (8 * sizeof(UWord) * sizeof(Addr))
+
 // lc_scan_memory has 2 modes:
 //
 // 1. Leak check mode (searched == 0).
@@ -939,10 +1422,14 @@ void scan_all_valid_memory_catcher ( Int sigNo, Addr addr )
 // In such a case, lc_scan_memory just scans [start..start+len[ for pointers
 // to searched and outputs the places where searched is found.
 // It does not recursively scans the found memory.
+//
+// w is the thread doing the scan when marking in parallel, else NULL.
+// A helper thread (w->index != 0) can't catch a fault, so it relies on
+// aspacemgr alone to avoid unreadable pages.
 static void
 lc_scan_memory(Addr start, SizeT len, Bool is_prior_definite,
                Int clique, Int cur_clique,
-               Addr searched, SizeT szB)
+               Addr searched, SizeT szB, LC_Worker* w)
 {
    /* memory scan is based on the assumption that valid pointers are aligned
       on a multiple of sizeof(Addr). So, we can (and must) skip the begin and
@@ -956,13 +1443,22 @@ lc_scan_memory(Addr start, SizeT len, Bool is_prior_definite,
 #endif
    Addr ptr = VG_ROUNDUP(start, sizeof(Addr));
    const Addr end = VG_ROUNDDN(start+len, sizeof(Addr));
-   vki_sigset_t sigmask;
+   const Bool catch_faults = w == NULL || w->index == 0;
+   // The validity of each word in [ptr, valid_end[, from
+   // MC_(valid_aligned_words).
+   UWord valid = 0;
+   Addr  valid_end = 0;
+   SizeT* scanned_szB = w ? &w->scanned_szB : &lc_scanned_szB;
 
    if (VG_DEBUG_LEAKCHECK)
       VG_(printf)("scan %#lx-%#lx (%lu)\n", start, end, len);
 
-   VG_(sigprocmask)(VKI_SIG_SETMASK, NULL, &sigmask);
-   VG_(set_fault_catcher)(scan_all_valid_memory_catcher);
+   if (lc_cards && w == NULL && searched == 0
+       && lc_scan_cards(start, len, is_prior_definite, clique, cur_clique))
+      return;
+
+   if (catch_faults)
+      VG_(set_fault_catcher)(scan_all_valid_memory_catcher);
 
    /* Optimisation: the loop below will check for each begin
       of SM chunk if the chunk is fully unaddressable. The idea is to
@@ -997,29 +1493,33 @@ lc_scan_memory(Addr start, SizeT len, Bool is_prior_definite,
    // Note that if the application is using mprotect(NONE), then
    // a page can be unreadable but have addressable and defined
    // VA bits (see mc_main.c function mc_new_mem_mprotect).
-   if (VG_MINIMAL_SETJMP(memscan_jmpbuf) != 0) {
-      // Catch read error ...
-      // We need to restore the signal mask, because we were
-      // longjmped out of a signal handler.
-      VG_(sigprocmask)(VKI_SIG_SETMASK, &sigmask, NULL);
+   if (catch_faults) {
+      if (VG_MINIMAL_SETJMP(memscan_jmpbuf) != 0) {
+         // Catch read error ...
+         // We need to restore the signal mask, because we were
+         // longjmped out of a signal handler.
+         VG_(sigprocmask)(VKI_SIG_SETMASK, &memscan_sigmask, NULL);
 #     if defined(VGA_s390x)
-      // For a SIGSEGV, s390 delivers the page address of the bad address.
-      // For a SIGBUS, old s390 kernels deliver a NULL address.
-      // bad_scanned_addr can thus not be used.
-      // So, on this platform, we always skip a full page from ptr.
-      // The below implies to mark ptr as volatile, as we read the value
-      // after a longjmp to here.
-      lc_sig_skipped_szB += VKI_PAGE_SIZE;
-      ptr = ptr + VKI_PAGE_SIZE; // Unaddressable, - skip it.
+         // For a SIGSEGV, s390 delivers the page address of the bad address.
+         // For a SIGBUS, old s390 kernels deliver a NULL address.
+         // bad_scanned_addr can thus not be used.
+         // So, on this platform, we always skip a full page from ptr.
+         // The below implies to mark ptr as volatile, as we read the value
+         // after a longjmp to here.
+         lc_sig_skipped_szB += VKI_PAGE_SIZE;
+         ptr = ptr + VKI_PAGE_SIZE; // Unaddressable, - skip it.
 #     else
-      // On other platforms, just skip one Addr.
-      lc_sig_skipped_szB += sizeof(Addr);
-      tl_assert(bad_scanned_addr >= VG_ROUNDUP(start, sizeof(Addr)));
-      tl_assert(bad_scanned_addr < VG_ROUNDDN(start+len, sizeof(Addr)));
-      ptr = bad_scanned_addr + sizeof(Addr); // Unaddressable, - skip it.
+         // On other platforms, just skip one Addr.
+         lc_sig_skipped_szB += sizeof(Addr);
+         tl_assert(bad_scanned_addr >= VG_ROUNDUP(start, sizeof(Addr)));
+         tl_assert(bad_scanned_addr < VG_ROUNDDN(start+len, sizeof(Addr)));
+         ptr = bad_scanned_addr + sizeof(Addr); // Unaddressable, - skip it.
 #endif
+         valid_end = 0;
+      }
    }
    while (ptr < end) {
+      Bool is_valid;
       Addr addr;
 
       // Skip invalid chunks.
@@ -1038,8 +1538,24 @@ lc_scan_memory(Addr start, SizeT len, Bool is_prior_definite,
          }
       }
 
-      if ( MC_(is_valid_aligned_word)(ptr) ) {
-         lc_scanned_szB += sizeof(Addr);
+      // Get the validity of a whole block of words at once, and skip
+      // the block if none of them is valid.
+      if (UNLIKELY((ptr % LC_BLOCK_SZB) == 0) && ptr + LC_BLOCK_SZB <= end) {
+         valid = MC_(valid_aligned_words)(ptr);
+         valid_end = ptr + LC_BLOCK_SZB;
+         if (valid == 0) {
+            ptr = valid_end;
+            continue;
+         }
+      }
+
+      if (LIKELY(ptr < valid_end))
+         is_valid = (valid >> ((ptr % LC_BLOCK_SZB) / sizeof(Addr))) & 1;
+      else
+         is_valid = MC_(is_valid_aligned_word)(ptr);
+
+      if ( is_valid ) {
+         *scanned_szB += sizeof(Addr);
          // If the below read fails, we will longjmp to the loop begin.
          addr = *(Addr *)ptr;
          // If we get here, the scanned word is in valid memory.  Now
@@ -1073,6 +1589,8 @@ lc_scan_memory(Addr start, SizeT len, Bool is_prior_definite,
                   }
                }
             }
+         } else if (w) {
+            lc_par_push_if_a_chunk_ptr(w, addr, is_prior_definite);
          } else {
             lc_push_if_a_chunk_ptr(addr, clique, cur_clique, is_prior_definite);
          }
@@ -1082,8 +1600,8 @@ lc_scan_memory(Addr start, SizeT len, Bool is_prior_definite,
       ptr += sizeof(Addr);
    }
 
-   VG_(sigprocmask)(VKI_SIG_SETMASK, &sigmask, NULL);
-   VG_(set_fault_catcher)(NULL);
+   if (catch_faults)
+      VG_(set_fault_catcher)(NULL);
 }
 
 
@@ -1101,7 +1619,189 @@ static void lc_process_markstack(Int clique)
 
       lc_scan_memory(lc_chunks[top]->data, lc_chunks[top]->szB,
                      is_prior_definite, clique, (clique == -1 ? -1 : top),
-                     /*searched*/ 0, 0);
+                     /*searched*/ 0, 0, /*w*/NULL);
+   }
+}
+
+// True if a helper thread may read [start, start+szB[, i.e. if it is
+// all in one readable anonymous client mapping.  Helpers have no fault
+// catcher, and memory made PROT_NONE can still have defined V/A bits.
+static Bool lc_helper_can_scan(Addr start, SizeT szB)
+{
+   NSegment const* seg = VG_(am_find_nsegment)(start);
+
+   return seg && seg->kind == SkAnonC && seg->hasR
+          && (szB == 0 || start + szB - 1 <= seg->end);
+}
+
+// Read a word of each page of [start, start+szB[ that lc_scan_memory
+// would read, with the fault catcher set.  Returns False if one can't be
+// read, i.e. if aspacemgr is out of step with the real mappings (see
+// lc_scan_memory).  *last_page is the last page read, which isn't read
+// again.
+static Bool lc_probe_pages(Addr start, SizeT szB, Addr* last_page)
+{
+   Addr p;
+
+   if (szB == 0)
+      return True;
+   VG_(set_fault_catcher)(scan_all_valid_memory_catcher);
+   if (VG_MINIMAL_SETJMP(memscan_jmpbuf) != 0) {
+      VG_(sigprocmask)(VKI_SIG_SETMASK, &memscan_sigmask, NULL);
+      VG_(set_fault_catcher)(NULL);
+      return False;
+   }
+   for (p = VG_PGROUNDDN(start); p < start + szB; p += VKI_PAGE_SIZE) {
+      Addr a = VG_ROUNDUP(p < start ? start : p, sizeof(Addr));
+      if (p == *last_page || a >= start + szB)
+         continue;
+      if (MC_(is_within_valid_secondary)(a)
+          && VG_(am_is_valid_for_client)(a, sizeof(Addr), VKI_PROT_READ))
+         (void) *(volatile Addr*)a;
+      *last_page = p;
+   }
+   VG_(set_fault_catcher)(NULL);
+   return True;
+}
+
+// True if the helper threads can read all they might be given to read.
+// They scan the root pieces and the blocks for which lc_helper_can_scan
+// holds, and the heuristics read the start of any block.  (The vtable
+// heuristic also reads the words a block points to, but only in readable
+// file mappings.)  This is checked by reading every page concerned,
+// since a helper has no fault catcher.
+static Bool lc_helpers_can_read(void)
+{
+   Addr last_page = 0;
+   Int  i;
+
+   for (i = 0; i < lc_n_root_pieces; i++) {
+      if (!lc_probe_pages(lc_root_pieces[i].start, lc_root_pieces[i].szB,
+                          &last_page))
+         return False;
+   }
+   last_page = 0;
+   for (i = 0; i < lc_n_chunks; i++) {
+      MC_Chunk* ch = lc_chunks[i];
+      if (lc_helper_can_scan(ch->data, ch->szB)) {
+         if (!lc_probe_pages(ch->data, ch->szB, &last_page))
+            return False;
+      } else if (detect_memory_leaks_last_heuristics) {
+         return False;
+      }
+   }
+   return True;
+}
+
+// Scan the block ch_no, which w has just popped.
+static void lc_par_scan_block(LC_Worker* w, Int ch_no)
+{
+   MC_Chunk* ch = lc_chunks[ch_no];
+   Bool is_prior_definite;
+
+   tl_assert(ch_no >= 0 && ch_no < lc_n_chunks);
+   if (w->index != 0 && !lc_helper_can_scan(ch->data, ch->szB)) {
+      // Leave it, still pending, to the thread doing the leak check.
+      lc_lock_markstack();
+      lc_markstack_main_top++;
+      tl_assert(lc_markstack_main_top < lc_n_chunks);
+      lc_markstack_main[lc_markstack_main_top] = ch_no;
+      lc_unlock_markstack();
+      return;
+   }
+
+   // See comment about 'is_prior_definite' at the top to understand this.
+   is_prior_definite = lc_par_clear_pending(&lc_extras[ch_no]);
+   lc_scan_memory(ch->data, ch->szB, is_prior_definite,
+                  /*clique*/-1, /*cur_clique*/-1,
+                  /*searched*/0, 0, w);
+}
+
+// Find w something to do, and do it.  Return False if there was
+// nothing to do.
+static Bool lc_par_work(LC_Worker* w)
+{
+   Int ch_no = -1;
+   Int piece;
+
+   if (lc_par_pop(w, &ch_no)) {
+      lc_par_scan_block(w, ch_no);
+      return True;
+   }
+
+   if (w->index == 0 && LC_VOLATILE(lc_markstack_main_top) >= 0) {
+      lc_lock_markstack();
+      if (lc_markstack_main_top >= 0) {
+         ch_no = lc_markstack_main[lc_markstack_main_top];
+         lc_markstack_main_top--;
+      }
+      lc_unlock_markstack();
+      if (ch_no != -1) {
+         lc_par_scan_block(w, ch_no);
+         return True;
+      }
+   }
+
+   if (LC_VOLATILE(lc_next_root_piece) < lc_n_root_pieces) {
+      piece = __sync_fetch_and_add(&lc_next_root_piece, 1);
+      if (piece < lc_n_root_pieces) {
+         lc_scan_memory(lc_root_pieces[piece].start,
+                        lc_root_pieces[piece].szB, /*is_prior_definite*/True,
+                        /*clique*/-1, /*cur_clique*/-1,
+                        /*searched*/0, 0, w);
+         return True;
+      }
+   }
+
+   return False;
+}
+
+// Run by each marking thread.  A thread stops when it has found nothing
+// to do and no other thread is busy, so that none can make more work.
+// Work which is left over when this is racy is found by the thread doing
+// the leak check, which runs this once more on its own afterwards.
+static void lc_mark_worker(void* arg, Int index)
+{
+   LC_Worker* w = &lc_workers[index];
+
+   __sync_fetch_and_add(&lc_n_busy, 1);
+   while (True) {
+      if (lc_par_work(w))
+         continue;
+
+      __sync_fetch_and_sub(&lc_n_busy, 1);
+      while (True) {
+         if (LC_VOLATILE(lc_n_busy) == 0
+             && LC_VOLATILE(lc_markstack_top) == -1
+             && LC_VOLATILE(lc_next_root_piece) >= lc_n_root_pieces)
+            return;
+         if (LC_VOLATILE(lc_markstack_top) >= 0
+             || (index == 0 && LC_VOLATILE(lc_markstack_main_top) >= 0)) {
+            __sync_fetch_and_add(&lc_n_busy, 1);
+            break;
+         }
+         VG_(yield_cpu)();
+      }
+   }
+}
+
+static void lc_add_root_pieces(Addr start, SizeT szB)
+{
+   while (szB > 0) {
+      SizeT piece_szB = szB < LC_ROOT_PIECE_SZB ? szB : LC_ROOT_PIECE_SZB;
+
+      if (lc_n_root_pieces == lc_root_pieces_size) {
+         lc_root_pieces_size = lc_root_pieces_size == 0
+                               ? 64 : 2 * lc_root_pieces_size;
+         lc_root_pieces = VG_(realloc)("mc.lcarp.1", lc_root_pieces,
+                                       lc_root_pieces_size
+                                       * sizeof(LC_RootPiece));
+      }
+      lc_root_pieces[lc_n_root_pieces].start = start;
+      lc_root_pieces[lc_n_root_pieces].szB   = piece_szB;
+      lc_n_root_pieces++;
+      start += piece_szB;
+      szB   -= piece_szB;
    }
 }
 
@@ -1624,13 +2324,77 @@ static void scan_memory_root_set(Addr searched, SizeT szB)
                       "  Scanning root segment: %#lx..%#lx (%lu)\n",
                       seg->start, seg->end, seg_size);
       }
+      if (lc_workers && seg->kind == SkAnonC) {
+         // Leave it to lc_mark_in_parallel.
+         lc_add_root_pieces(seg->start, seg_size);
+         continue;
+      }
       lc_scan_memory(seg->start, seg_size, /*is_prior_definite*/True,
                      /*clique*/-1, /*cur_clique*/-1,
-                     searched, szB);
+                     searched, szB, /*w*/NULL);
    }
    VG_(free)(seg_starts);
 }
 
+// Scan the root set and mark the blocks reachable from it, with
+// n_threads threads.  This does the same as scan_memory_root_set,
+// scanning the registers and then lc_process_markstack(-1).
+static void lc_mark_in_parallel(Int n_threads)
+{
+   Int   i, n_workers;
+   SizeT scanned_szB;
+
+   lc_workers = VG_(malloc)("mc.lmip.1", n_threads * sizeof(LC_Worker));
+   for (i = 0; i < n_threads; i++) {
+      lc_workers[i].index       = i;
+      lc_workers[i].local_top   = -1;
+      lc_workers[i].scanned_szB = 0;
+   }
+   lc_markstack_main = VG_(malloc)("mc.lmip.2", lc_n_chunks * sizeof(Int));
+   lc_markstack_main_top = -1;
+   lc_root_pieces = NULL;
+   lc_n_root_pieces = 0;
+   lc_root_pieces_size = 0;
+   lc_next_root_piece = 0;
+   lc_markstack_lock = 0;
+   lc_n_busy = 0;
+
+   // File mappings and the registers are done first, by this thread alone.
+   scan_memory_root_set(/*searched*/0, 0);
+   VG_(apply_to_GP_regs)(lc_push_if_a_chunk_ptr_register);
+   scanned_szB = lc_scanned_szB;
+
+   // The shadow memory is read by several threads at once.  If a helper
+   // might read an unreadable page, this thread does all the work,
+   // below, with its fault catcher.
+   if (lc_helpers_can_read())
+      n_workers = MC_(run_shadow_helpers)(n_threads, lc_mark_worker, NULL);
+   else
+      n_workers = 1;
+   if (VG_(clo_verbosity) > 2)
+      VG_(message)(Vg_DebugMsg, "  Marked with %d threads\n", n_workers);
+
+   // Pick up anything the threads left.
+   lc_mark_worker(NULL, 0);
+   tl_assert(lc_markstack_top == -1);
+   tl_assert(lc_markstack_main_top == -1);
+   tl_assert(lc_next_root_piece >= lc_n_root_pieces);
+
+   for (i = 0; i < n_threads; i++) {
+      tl_assert(lc_workers[i].local_top == -1);
+      scanned_szB += lc_workers[i].scanned_szB;
+   }
+   lc_scanned_szB = scanned_szB;
+
+   VG_(free)(lc_workers);
+   lc_workers = NULL;
+   VG_(free)(lc_markstack_main);
+   lc_markstack_main = NULL;
+   if (lc_root_pieces)
+      VG_(free)(lc_root_pieces);
+   lc_root_pieces = NULL;
+}
+
 /*------------------------------------------------------------*/
 /*--- Top-level entry point.                               ---*/
 /*------------------------------------------------------------*/
@@ -1651,6 +2415,7 @@ void MC_(detect_memory_leaks) ( ThreadId tid, LeakCheckParams* lcp)
    tl_assert((SM_SIZE % VKI_PAGE_SIZE) == 0);
 
    MC_(leak_search_gen)++;
+   VG_(sigprocmask)(VKI_SIG_SETMASK, NULL, &memscan_sigmask);
    MC_(detect_memory_leaks_last_delta_mode) = lcp->deltamode;
    detect_memory_leaks_last_heuristics = lcp->heuristics;
 
@@ -1663,6 +2428,7 @@ void MC_(detect_memory_leaks) ( ThreadId tid, LeakCheckParams* lcp)
    lc_chunks_n_frees_marker = MC_(get_cmalloc_n_frees)();
    if (lc_n_chunks == 0) {
       tl_assert(lc_chunks == NULL);
+      build_chunk_tree();
       if (lr_table != NULL) {
          // forget the previous recorded LossRecords as next leak search
          // can in any case just create new leaks.
@@ -1750,6 +2516,8 @@ void MC_(detect_memory_leaks) ( ThreadId tid, LeakCheckParams* lcp)
       }
    }
 
+   build_chunk_tree();
+
    // Initialise lc_extras.
    if (lc_extras) {
       VG_(free)(lc_extras);
@@ -1776,22 +2544,32 @@ void MC_(detect_memory_leaks) ( ThreadId tid, LeakCheckParams* lcp)
                  lc_n_chunks );
    }
 
-   // Scan the memory root-set, pushing onto the mark stack any blocks
-   // pointed to.
-   scan_memory_root_set(/*searched*/0, 0);
+   if (MC_(clo_leak_check_incremental))
+      lc_start_cards();
 
-   // Scan GP registers for chunk pointers.
-   VG_(apply_to_GP_regs)(lc_push_if_a_chunk_ptr_register);
+   if (MC_(clo_leak_check_threads) > 1) {
+      lc_mark_in_parallel(MC_(clo_leak_check_threads));
+   } else {
+      // Scan the memory root-set, pushing onto the mark stack any blocks
+      // pointed to.
+      scan_memory_root_set(/*searched*/0, 0);
+
+      // Scan GP registers for chunk pointers.
+      VG_(apply_to_GP_regs)(lc_push_if_a_chunk_ptr_register);
 
-   // Process the pushed blocks.  After this, every block that is reachable
-   // from the root-set has been traced.
-   lc_process_markstack(/*clique*/-1);
+      // Process the pushed blocks.  After this, every block that is
+      // reachable from the root-set has been traced.
+      lc_process_markstack(/*clique*/-1);
+   }
 
    if (VG_(clo_verbosity) > 1 && !VG_(clo_xml)) {
       VG_(umsg)("Checked %'lu bytes\n", lc_scanned_szB);
       if (lc_sig_skipped_szB > 0)
          VG_(umsg)("Skipped %'lu bytes due to read errors\n",
                    lc_sig_skipped_szB);
+      if (lc_cards)
+         VG_(umsg)("Reused %'lu and rescanned %'lu cards of memory\n",
+                   lc_n_cards_reused, lc_n_cards_rescanned);
       VG_(umsg)( "\n" );
    }
 
@@ -1824,6 +2602,9 @@ void MC_(detect_memory_leaks) ( ThreadId tid, LeakCheckParams* lcp)
          tl_assert(ex->state == Unreached);
       }
    }
+
+   if (lc_cards)
+      lc_end_cards();
       
    print_results( tid, lcp);
 
@@ -1866,6 +2647,7 @@ void MC_(who_points_at) ( Addr address, SizeT szB)
                  szB, address);
 
    chunks = find_active_chunks(&n_chunks);
+   VG_(sigprocmask)(VKI_SIG_SETMASK, NULL, &memscan_sigmask);
 
    // Scan memory root-set, searching for ptr pointing in address[szB]
    scan_memory_root_set(address, szB);
@@ -1875,7 +2657,7 @@ void MC_(who_points_at) ( Addr address, SizeT szB)
       lc_scan_memory(chunks[i]->data, chunks[i]->szB,
                      /*is_prior_definite*/True,
                      /*clique*/-1, /*cur_clique*/-1,
-                     address, szB);
+                     address, szB, /*w*/NULL);
    }
    VG_(free) ( chunks );
 
@@ -38,6 +38,7 @@
 #include "pub_tool_libcbase.h"
 #include "pub_tool_libcassert.h"
 #include "pub_tool_libcprint.h"
+#include "pub_tool_libcproc.h"      // VG_MAX_PARALLEL
 #include "pub_tool_machine.h"
 #include "pub_tool_mallocfree.h"
 #include "pub_tool_options.h"
@@ -258,6 +259,114 @@ static void ocache_sarp_Clear_Origins ( Addr, UWord ); /* fwds */
 // occurs.  So try extra hard.
 #define INLINE    inline __attribute__((always_inline))
 
+/* --------------- Concurrent access --------------- */
+
+/* Normally all the shadow memory structures are only ever touched by
+   the thread holding the core's big lock.  With --mt-shadow=yes they
+   are instead maintained so that helpers running on several threads
+   at once can use them: distinguished secondaries are replaced with an
+   atomic pointer update, auxmap_L1 entries are checked against the
+   auxmap_L2 node they point at, auxmap_L2 is protected by a lock, the
+   origin cache is split into independently locked shards, stores of
+   less than 4 bytes update their vabits8 byte with a compare-and-swap,
+   and the secondary V bit table has a lock.  The fixed-size stack
+   pointer helpers also work above MAX_PRIMARY_ADDRESS without falling
+   back to a range operation.  Range operations (set_address_range_perms
+   etc) are still assumed to be done by the thread holding the big lock.
+
+   Reading the shadow of memory above MAX_PRIMARY_ADDRESS never
+   allocates an auxmap entry.  Storage for everything else which may be
+   allocated or freed on a shadow write comes from the reserves below
+   while helper threads are running. */
+
+typedef  volatile UInt  MC_SpinLock;
+
+static INLINE void mc_spin_lock ( MC_SpinLock* lk )
+{
+   while (__sync_lock_test_and_set(lk, 1)) {
+      while (*lk)
+         ;
+   }
+}
+
+static INLINE void mc_spin_unlock ( MC_SpinLock* lk )
+{
+   __sync_lock_release(lk);
+}
+
+/* Add n to a stats counter which several threads may update at once. */
+static INLINE void mt_stat_add ( UWord* ctr, UWord n )
+{
+   if (UNLIKELY(MC_(clo_mt_shadow)))
+      __sync_fetch_and_add(ctr, n);
+   else
+      *ctr += n;
+}
+
+/* The locks above protect the structures, not the allocators their
+   storage comes from: VG_(am_shadow_alloc), and VG_(malloc) and
+   VG_(free) via the OSets, none of which is thread-safe.  Threads
+   started by VG_(run_in_parallel) must not call them at all.  So while
+   such threads are running (shadow_helpers_running, see
+   MC_(run_shadow_helpers)), new SecMaps and tree nodes are instead
+   taken from reserves, filled beforehand by reserve_shadow, and
+   freed nodes are put back in them.  shadow_alloc_lock protects the
+   reserves, and is always the innermost lock.  At other times a
+   reserve which isn't empty is still used first. */
+
+typedef
+   struct {
+      void* free;    /* spare blocks, linked through their first word */
+      UWord n_free;
+   }
+   ShadowReserve;
+
+static MC_SpinLock shadow_alloc_lock      = 0;
+static Bool        shadow_helpers_running = False;
+
+static void* take_from_reserve ( ShadowReserve* r )
+{
+   void* p;
+   mc_spin_lock(&shadow_alloc_lock);
+   p = r->free;
+   if (p != NULL) {
+      r->free = *(void**)p;
+      r->n_free--;
+   }
+   mc_spin_unlock(&shadow_alloc_lock);
+   return p;
+}
+
+static void put_in_reserve ( ShadowReserve* r, void* p )
+{
+   mc_spin_lock(&shadow_alloc_lock);
+   *(void**)p = r->free;
+   r->free = p;
+   r->n_free++;
+   mc_spin_unlock(&shadow_alloc_lock);
+}
+
+/* Allocate a node for 'set', whose nodes are kept in reserve 'r'. */
+static void* alloc_shadow_node ( ShadowReserve* r, OSet* set, SizeT szB )
+{
+   void* p;
+   if (UNLIKELY(MC_(clo_mt_shadow))) {
+      p = take_from_reserve(r);
+      if (p != NULL)
+         return p;
+      tl_assert(!shadow_helpers_running);
+   }
+   return VG_(OSetGen_AllocNode)(set, szB);
+}
+
+static void free_shadow_node ( ShadowReserve* r, OSet* set, void* p )
+{
+   if (UNLIKELY(shadow_helpers_running))
+      put_in_reserve(r, p);
+   else
+      VG_(OSetGen_FreeNode)(set, p);
+}
+
 static INLINE Addr start_of_this_sm ( Addr a ) {
    return (a & (~SM_MASK));
 }
@@ -273,12 +382,14 @@ typedef
 
 // 3 distinguished secondary maps, one for no-access, one for
 // accessible but undefined, and one for accessible and defined.
-// Distinguished secondaries may never be modified.
+// Distinguished secondaries may never be modified.  They are word
+// aligned, like the dynamically allocated ones, since the coalesced
+// range handlers read vabits8[] a word at a time.
 #define SM_DIST_NOACCESS   0
 #define SM_DIST_UNDEFINED  1
 #define SM_DIST_DEFINED    2
 
-static SecMap sm_distinguished[3];
+static SecMap sm_distinguished[3] __attribute__((aligned(sizeof(UWord))));
 
 static INLINE Bool is_distinguished_sm ( SecMap* sm ) {
    return sm >= &sm_distinguished[0] && sm <= &sm_distinguished[2];
@@ -287,17 +398,24 @@ static INLINE Bool is_distinguished_sm ( SecMap* sm ) {
 // Forward declaration
 static void update_SM_counts(SecMap* oldSM, SecMap* newSM);
 
+static ShadowReserve sm_reserve;
+
 /* dist_sm points to one of our three distinguished secondaries.  Make
    a copy of it so that we can write to it.
 */
 static SecMap* copy_for_writing ( SecMap* dist_sm )
 {
-   SecMap* new_sm;
+   SecMap* new_sm = NULL;
    tl_assert(dist_sm == &sm_distinguished[0]
           || dist_sm == &sm_distinguished[1]
           || dist_sm == &sm_distinguished[2]);
 
-   new_sm = VG_(am_shadow_alloc)(sizeof(SecMap));
+   if (UNLIKELY(MC_(clo_mt_shadow)))
+      new_sm = take_from_reserve(&sm_reserve);
+   if (new_sm == NULL) {
+      tl_assert(!shadow_helpers_running);
+      new_sm = VG_(am_shadow_alloc)(sizeof(SecMap));
+   }
    if (new_sm == NULL)
       VG_(out_of_memory_NORETURN)( "memcheck:allocate new SecMap", 
                                    sizeof(SecMap) );
@@ -306,6 +424,36 @@ static SecMap* copy_for_writing ( SecMap* dist_sm )
    return new_sm;
 }
 
+/* Protects SecMap allocation, and the SecMap counts, with
+   --mt-shadow=yes. */
+static MC_SpinLock sm_alloc_lock = 0;
+
+/* *p points to a distinguished secondary.  Install a writable copy of
+   it in its place, and return the copy.  With --mt-shadow=yes another
+   thread may be trying to do the same, so check again under the lock,
+   and publish the copy with a barrier so that nobody can see the
+   pointer before the contents. */
+static SecMap* install_writable_sm ( SecMap** p )
+{
+   SecMap* dist_sm;
+   SecMap* new_sm;
+
+   if (LIKELY(!MC_(clo_mt_shadow))) {
+      *p = copy_for_writing(*p);
+      return *p;
+   }
+
+   mc_spin_lock(&sm_alloc_lock);
+   dist_sm = *p;
+   if (is_distinguished_sm(dist_sm)) {
+      new_sm = copy_for_writing(dist_sm);
+      if (!__sync_bool_compare_and_swap(p, dist_sm, new_sm))
+         tl_assert(0);
+   }
+   mc_spin_unlock(&sm_alloc_lock);
+   return *p;
+}
+
 /* --------------- Stats --------------- */
 
 static Int   n_issued_SMs      = 0;
@@ -389,6 +537,14 @@ static struct {
        auxmap_L1[N_AUXMAP_L1];
 
 static OSet* auxmap_L2 = NULL;
+static ShadowReserve auxmap_reserve;
+
+/* With --mt-shadow=yes, protects auxmap_L2, and serialises all
+   modifications of auxmap_L1.  Readers of auxmap_L1 do not take it;
+   instead they check that the .ent they find really has the .base they
+   were looking for, since they may see a half-updated entry.  That is
+   safe because auxmap_L2 nodes are never freed. */
+static MC_SpinLock auxmap_lock = 0;
 
 static void init_auxmap_L1_L2 ( void )
 {
@@ -503,6 +659,45 @@ static void insert_into_auxmap_L1_at ( Word rank, AuxMapEnt* ent )
    auxmap_L1[rank].ent  = ent;
 }
 
+/* The --mt-shadow=yes version of maybe_find_in_auxmap.  auxmap_L1 is
+   not reordered on lookups, since that would mean writing to it from
+   every thread all the time. */
+static AuxMapEnt* maybe_find_in_auxmap_mt ( Addr a )
+{
+   AuxMapEnt  key;
+   AuxMapEnt* res;
+   Word       i;
+
+   __sync_fetch_and_add(&n_auxmap_L1_searches, 1);
+   for (i = 0; i < N_AUXMAP_L1; i++) {
+      if (auxmap_L1[i].base == a) {
+         res = auxmap_L1[i].ent;
+         if (LIKELY(res != NULL && res->base == a)) {
+            __sync_fetch_and_add(&n_auxmap_L1_cmps, (ULong)(i+1));
+            return res;
+         }
+      }
+   }
+   __sync_fetch_and_add(&n_auxmap_L1_cmps, (ULong)N_AUXMAP_L1);
+
+   __sync_fetch_and_add(&n_auxmap_L2_searches, 1);
+   key.base = a;
+   key.sm   = 0;
+
+   mc_spin_lock(&auxmap_lock);
+   res = VG_(OSetGen_Lookup)(auxmap_L2, &key);
+   if (res) {
+      /* Another thread may have put it in the L1 since we looked. */
+      for (i = 0; i < N_AUXMAP_L1; i++)
+         if (auxmap_L1[i].base == a)
+            break;
+      if (i == N_AUXMAP_L1)
+         insert_into_auxmap_L1_at( AUXMAP_L1_INSERT_IX, res );
+   }
+   mc_spin_unlock(&auxmap_lock);
+   return res;
+}
+
 static INLINE AuxMapEnt* maybe_find_in_auxmap ( Addr a )
 {
    AuxMapEnt  key;
@@ -512,6 +707,9 @@ static INLINE AuxMapEnt* maybe_find_in_auxmap ( Addr a )
    tl_assert(a > MAX_PRIMARY_ADDRESS);
    a &= ~(Addr)0xFFFF;
 
+   if (UNLIKELY(MC_(clo_mt_shadow)))
+      return maybe_find_in_auxmap_mt(a);
+
    /* First search the front-cache, which is a self-organising
       list containing the most popular entries. */
 
@@ -576,13 +774,30 @@ static AuxMapEnt* find_or_alloc_in_auxmap ( Addr a )
       to allocate one. */
    a &= ~(Addr)0xFFFF;
 
-   nyu = (AuxMapEnt*) VG_(OSetGen_AllocNode)( auxmap_L2, sizeof(AuxMapEnt) );
+   if (UNLIKELY(MC_(clo_mt_shadow))) {
+      /* Someone else may have beaten us to it. */
+      AuxMapEnt key;
+      key.base = a;
+      key.sm   = 0;
+      mc_spin_lock(&auxmap_lock);
+      res = VG_(OSetGen_Lookup)(auxmap_L2, &key);
+      if (res) {
+         mc_spin_unlock(&auxmap_lock);
+         return res;
+      }
+   }
+
+   nyu = (AuxMapEnt*) alloc_shadow_node( &auxmap_reserve, auxmap_L2,
+                                         sizeof(AuxMapEnt) );
    tl_assert(nyu);
    nyu->base = a;
    nyu->sm   = &sm_distinguished[SM_DIST_NOACCESS];
    VG_(OSetGen_Insert)( auxmap_L2, nyu );
    insert_into_auxmap_L1_at( AUXMAP_L1_INSERT_IX, nyu );
    n_auxmap_L2_nodes++;
+
+   if (UNLIKELY(MC_(clo_mt_shadow)))
+      mc_spin_unlock(&auxmap_lock);
    return nyu;
 }
 
@@ -620,6 +835,12 @@ static INLINE SecMap* get_secmap_for_reading_low ( Addr a )
 
 static INLINE SecMap* get_secmap_for_reading_high ( Addr a )
 {
+   if (UNLIKELY(MC_(clo_mt_shadow))) {
+      /* Don't allocate an entry just to find that 'a' is not
+         addressable. */
+      AuxMapEnt* am = maybe_find_in_auxmap(a);
+      return am ? am->sm : &sm_distinguished[SM_DIST_NOACCESS];
+   }
    return *get_secmap_high_ptr(a);
 }
 
@@ -627,7 +848,7 @@ static INLINE SecMap* get_secmap_for_writing_low(Addr a)
 {
    SecMap** p = get_secmap_low_ptr(a);
    if (UNLIKELY(is_distinguished_sm(*p)))
-      *p = copy_for_writing(*p);
+      return install_writable_sm(p);
    return *p;
 }
 
@@ -635,7 +856,7 @@ static INLINE SecMap* get_secmap_for_writing_high ( Addr a )
 {
    SecMap** p = get_secmap_high_ptr(a);
    if (UNLIKELY(is_distinguished_sm(*p)))
-      *p = copy_for_writing(*p);
+      return install_writable_sm(p);
    return *p;
 }
 
@@ -679,12 +900,77 @@ static SecMap* maybe_get_secmap_for ( Addr a )
    }
 }
 
+/* --------------- Dirty cards --------------- */
+
+/* With --leak-check-incremental=yes, one byte for each 64k of the
+   main primary map, which is set whenever the memory in that 64k, or
+   its V+A bits, may have changed.  The leak checker keeps a summary of
+   the pointers in each 64k it scans, clears its byte, and uses the
+   summary instead of scanning the memory again until the byte is set.
+   Memory above MAX_PRIMARY_ADDRESS is always dirty.  NULL when not
+   in use.  Stores done by generated code are marked by the _card
+   versions of the STOREV helpers, which the instrumenter uses instead
+   of the plain ones only when the option is given, so that the plain
+   ones don't pay for it. */
+static UChar* dirty_cards = NULL;
+
+static INLINE void mark_card_dirty ( Addr a )
+{
+   if (UNLIKELY(dirty_cards != NULL) && LIKELY(a <= MAX_PRIMARY_ADDRESS))
+      dirty_cards[a >> 16] = 1;
+}
+
+static void mark_cards_dirty ( Addr a, SizeT len )
+{
+   Addr last = a + len - 1;
+
+   if (LIKELY(dirty_cards == NULL) || len == 0 || a > MAX_PRIMARY_ADDRESS)
+      return;
+   if (last < a || last > MAX_PRIMARY_ADDRESS)
+      last = MAX_PRIMARY_ADDRESS;
+   VG_(memset)(&dirty_cards[a >> 16], 1, (last >> 16) - (a >> 16) + 1);
+}
+
+Bool MC_(card_is_tracked) ( Addr a )
+{
+   return dirty_cards != NULL && a <= MAX_PRIMARY_ADDRESS;
+}
+
+Bool MC_(card_is_dirty) ( Addr a )
+{
+   tl_assert(MC_(card_is_tracked)(a));
+   return dirty_cards[a >> 16];
+}
+
+void MC_(clean_card) ( Addr a )
+{
+   tl_assert(MC_(card_is_tracked)(a));
+   dirty_cards[a >> 16] = 0;
+}
+
 /* --------------- Fundamental functions --------------- */
 
+/* Replace the bits of *vabits8 selected by mask with bits.  The other
+   bits belong to neighbouring bytes, which with --mt-shadow=yes
+   another thread may be storing to at the same time. */
+static INLINE
+void update_vabits8_atomically ( UChar* vabits8, UChar mask, UChar bits )
+{
+   UChar old;
+   do {
+      old = *(volatile UChar*)vabits8;
+   } while (!__sync_bool_compare_and_swap(vabits8, old,
+                                          (UChar)((old & ~mask) | bits)));
+}
+
 static INLINE
 void insert_vabits2_into_vabits8 ( Addr a, UChar vabits2, UChar* vabits8 )
 {
    UInt shift =  (a & 3)  << 1;        // shift by 0, 2, 4, or 6
+   if (UNLIKELY(MC_(clo_mt_shadow))) {
+      update_vabits8_atomically( vabits8, 0x3 << shift, vabits2 << shift );
+      return;
+   }
    *vabits8  &= ~(0x3     << shift);   // mask out the two old bits
    *vabits8  |=  (vabits2 << shift);   // mask  in the two new bits
 }
@@ -695,6 +981,10 @@ void insert_vabits4_into_vabits8 ( Addr a, UChar vabits4, UChar* vabits8 )
    UInt shift;
    tl_assert(VG_IS_2_ALIGNED(a));      // Must be 2-aligned
    shift     =  (a & 2)   << 1;        // shift by 0 or 4
+   if (UNLIKELY(MC_(clo_mt_shadow))) {
+      update_vabits8_atomically( vabits8, 0xf << shift, vabits4 << shift );
+      return;
+   }
    *vabits8 &= ~(0xf      << shift);   // mask out the four old bits
    *vabits8 |=  (vabits4 << shift);    // mask  in the four new bits
 }
@@ -730,6 +1020,7 @@ void set_vabits2 ( Addr a, UChar vabits2 )
 {
    SecMap* sm       = get_secmap_for_writing(a);
    UWord   sm_off   = SM_OFF(a);
+   mark_card_dirty(a);
    insert_vabits2_into_vabits8( a, vabits2, &(sm->vabits8[sm_off]) );
 }
 
@@ -760,6 +1051,7 @@ void set_vabits8_for_aligned_word32 ( Addr a, UChar vabits8 )
 {
    SecMap* sm       = get_secmap_for_writing(a);
    UWord   sm_off   = SM_OFF(a);
+   mark_card_dirty(a);
    sm->vabits8[sm_off] = vabits8;
 }
 
@@ -768,6 +1060,27 @@ void set_vabits8_for_aligned_word32 ( Addr a, UChar vabits8 )
 static UWord get_sec_vbits8(Addr a);
 static void  set_sec_vbits8(Addr a, UWord vbits8);
 
+/* Protects the secondary V bit table with --mt-shadow=yes.  A thread
+   making a byte partially defined holds it until the byte's vabits2
+   say so, so that a table GC on another thread can't drop the new
+   node in between. */
+static MC_SpinLock sec_vbits_lock = 0;
+
+/* get_vbits8 for a byte which was partially defined, with
+   --mt-shadow=yes.  Another thread may have stored to the byte since,
+   and GC'd its node, so look again under the lock. */
+static UChar get_partdefined_vbits8_mt ( Addr a )
+{
+   UChar vabits2, vbits8;
+   mc_spin_lock(&sec_vbits_lock);
+   vabits2 = get_vabits2(a);
+   if      ( VA_BITS2_PARTDEFINED == vabits2 ) { vbits8 = get_sec_vbits8(a); }
+   else if ( VA_BITS2_UNDEFINED   == vabits2 ) { vbits8 = V_BITS8_UNDEFINED; }
+   else                                        { vbits8 = V_BITS8_DEFINED;   }
+   mc_spin_unlock(&sec_vbits_lock);
+   return vbits8;
+}
+
 // Returns False if there was an addressability error.
 static INLINE
 Bool set_vbits8 ( Addr a, UChar vbits8 )
@@ -780,6 +1093,13 @@ Bool set_vbits8 ( Addr a, UChar vbits8 )
       // longer necessary.
       if      ( V_BITS8_DEFINED   == vbits8 ) { vabits2 = VA_BITS2_DEFINED;   }
       else if ( V_BITS8_UNDEFINED == vbits8 ) { vabits2 = VA_BITS2_UNDEFINED; }
+      else if ( UNLIKELY(MC_(clo_mt_shadow)) ) {
+         mc_spin_lock(&sec_vbits_lock);
+         set_sec_vbits8(a, vbits8);
+         set_vabits2(a, VA_BITS2_PARTDEFINED);
+         mc_spin_unlock(&sec_vbits_lock);
+         return ok;
+      }
       else                                    { vabits2 = VA_BITS2_PARTDEFINED;
                                                 set_sec_vbits8(a, vbits8);  }
       set_vabits2(a, vabits2);
@@ -809,7 +1129,10 @@ Bool get_vbits8 ( Addr a, UChar* vbits8 )
       ok = False;
    } else {
       tl_assert( VA_BITS2_PARTDEFINED == vabits2 );
-      *vbits8 = get_sec_vbits8(a);
+      if (UNLIKELY(MC_(clo_mt_shadow)))
+         *vbits8 = get_partdefined_vbits8_mt(a);
+      else
+         *vbits8 = get_sec_vbits8(a);
    }
    return ok;
 }
@@ -864,6 +1187,7 @@ Bool get_vbits8 ( Addr a, UChar* vbits8 )
 // stale PDBs to reside for long periods in the table.
 
 static OSet* secVBitTable;
+static ShadowReserve sec_vbits_reserve;   /* nodes of secVBitTable */
 
 // Stats
 static ULong sec_vbits_new_nodes = 0;
@@ -961,7 +1285,10 @@ static void gcSecVBitTable(void)
    n_nodes     = VG_(OSetGen_Size)(secVBitTable);
    n_survivors = VG_(OSetGen_Size)(secVBitTable2);
 
-   // Destroy the old table, and put the new one in its place.
+   // Destroy the old table, and put the new one in its place.  Any
+   // reserved nodes belong to the old table's pool, so go with it.
+   sec_vbits_reserve.free   = NULL;
+   sec_vbits_reserve.n_free = 0;
    VG_(OSetGen_Destroy)(secVBitTable);
    secVBitTable = secVBitTable2;
 
@@ -1021,13 +1348,17 @@ static void set_sec_vbits8(Addr a, UWord vbits8)
    } else {
       // Do a table GC if necessary.  Nb: do this before creating and
       // inserting the new node, to avoid erroneously GC'ing the new node.
-      if (secVBitLimit == VG_(OSetGen_Size)(secVBitTable)) {
+      // A GC allocates, so while helper threads are running the table
+      // is allowed to grow past the limit instead.
+      if (VG_(OSetGen_Size)(secVBitTable) >= secVBitLimit
+          && LIKELY(!shadow_helpers_running)) {
          gcSecVBitTable();
       }
 
       // New node:  assign the specific byte, make the rest invalid (they
       // should never be read as-is, but be cautious).
-      n = VG_(OSetGen_AllocNode)(secVBitTable, sizeof(SecVBitNode));
+      n = alloc_shadow_node(&sec_vbits_reserve, secVBitTable,
+                            sizeof(SecVBitNode));
       n->a            = aAligned;
       for (i = 0; i < BYTES_PER_SEC_VBIT_NODE; i++) {
          n->vbits8[i] = V_BITS8_UNDEFINED;
@@ -1400,6 +1731,9 @@ void mc_STOREVn_slow ( Addr a, SizeT nBits, ULong vbytes, Bool bigendian )
 
    PROF_EVENT(35, "mc_STOREVn_slow");
 
+   /* An unaligned store may straddle two cards. */
+   mark_cards_dirty(a, szB);
+
    /* ------------ BEGIN semi-fast cases ------------ */
    /* These deal quickly-ish with the common auxiliary primary map
       cases on 64-bit platforms.  Are merely a speedup hack; can be
@@ -1490,6 +1824,8 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
 
    PROF_EVENT(150, "set_address_range_perms");
 
+   mark_cards_dirty(a, lenT);
+
    /* Check the V+A bits make sense. */
    tl_assert(VA_BITS16_NOACCESS  == vabits16 ||
              VA_BITS16_UNDEFINED == vabits16 ||
@@ -1600,7 +1936,7 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
          lenA = 0;
       } else {
          PROF_EVENT(155, "set_address_range_perms-dist-sm1");
-         *sm_ptr = copy_for_writing(*sm_ptr);
+         install_writable_sm(sm_ptr);
       }
    }
    sm = *sm_ptr;
@@ -1683,7 +2019,7 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
          return;
       } else {
          PROF_EVENT(162, "set_address_range_perms-dist-sm2");
-         *sm_ptr = copy_for_writing(*sm_ptr);
+         install_writable_sm(sm_ptr);
       }
    }
    sm = *sm_ptr;
@@ -1994,6 +2330,12 @@ void MC_(copy_address_range_state) ( Addr src, Addr dst, SizeT len )
    Memcheck runs out of memory in preference to losing useful origin
    info due to cache size limitations.
 
+   The backing store is split into OC_N_SHARDS separate trees, chosen
+   by the low bits of the set number.  With --mt-shadow=yes each shard
+   also has a lock, which covers its sets in ocacheL1 as well as its
+   tree.  find_OCacheLine takes the lock and release_OCacheLine drops
+   it, so every use of a line must be bracketed by the two.
+
    Shadowing registers is a bit tricky, because the shadow values are
    32 bits, regardless of the size of the register.  That gives a
    problem for registers smaller than 32 bits.  The solution is to
@@ -2283,6 +2625,24 @@ typedef
 static OCache* ocacheL1 = NULL;
 static UWord   ocacheL1_event_ctr = 0;
 
+#define OC_N_SHARD_BITS  6
+#define OC_N_SHARDS      (1 << OC_N_SHARD_BITS)
+
+typedef
+   struct {
+      MC_SpinLock lock;      /* only used with --mt-shadow=yes */
+      OSet*       l2;        /* this shard's part of ocacheL2 */
+      UWord       l2_n_nodes;
+   }
+   OCacheShard;
+
+static OCacheShard ocache_shards[OC_N_SHARDS];
+
+static INLINE OCacheShard* oc_shard_for ( Addr a ) {
+   UWord setno = (a >> OC_BITS_PER_LINE) & (OC_N_SETS - 1);
+   return &ocache_shards[setno & (OC_N_SHARDS - 1)];
+}
+
 static void init_ocacheL2 ( void ); /* fwds */
 static void init_OCache ( void )
 {
@@ -2306,7 +2666,7 @@ static void init_OCache ( void )
 static void moveLineForwards ( OCacheSet* set, UWord lineno )
 {
    OCacheLine tmp;
-   stats_ocacheL1_movefwds++;
+   mt_stat_add(&stats_ocacheL1_movefwds, 1);
    tl_assert(lineno > 0 && lineno < OC_LINES_PER_SET);
    tmp = set->line[lineno-1];
    set->line[lineno-1] = set->line[lineno];
@@ -2325,8 +2685,6 @@ static void zeroise_OCacheLine ( OCacheLine* line, Addr tag ) {
 //////////////////////////////////////////////////////////////
 //// OCache backing store
 
-static OSet* ocacheL2 = NULL;
-
 static void* ocacheL2_malloc ( const HChar* cc, SizeT szB ) {
    return VG_(malloc)(cc, szB);
 }
@@ -2337,16 +2695,26 @@ static void ocacheL2_free ( void* v ) {
 /* Stats: # nodes currently in tree */
 static UWord stats__ocacheL2_n_nodes = 0;
 
+/* Spare nodes.  All the shards' trees allocate their nodes with the
+   same functions, so a node can be allocated by one and inserted in
+   another. */
+static ShadowReserve ocacheL2_reserve;
+
 static void init_ocacheL2 ( void )
 {
-   tl_assert(!ocacheL2);
+   UWord i;
    tl_assert(sizeof(Word) == sizeof(Addr)); /* since OCacheLine.tag :: Addr */
    tl_assert(0 == offsetof(OCacheLine,tag));
-   ocacheL2 
-      = VG_(OSetGen_Create)( offsetof(OCacheLine,tag), 
-                             NULL, /* fast cmp */
-                             ocacheL2_malloc, "mc.ioL2", ocacheL2_free);
-   tl_assert(ocacheL2);
+   for (i = 0; i < OC_N_SHARDS; i++) {
+      tl_assert(!ocache_shards[i].l2);
+      ocache_shards[i].lock = 0;
+      ocache_shards[i].l2
+         = VG_(OSetGen_Create)( offsetof(OCacheLine,tag), 
+                                NULL, /* fast cmp */
+                                ocacheL2_malloc, "mc.ioL2", ocacheL2_free);
+      tl_assert(ocache_shards[i].l2);
+      ocache_shards[i].l2_n_nodes = 0;
+   }
    stats__ocacheL2_n_nodes = 0;
 }
 
@@ -2355,8 +2723,8 @@ static OCacheLine* ocacheL2_find_tag ( Addr tag )
 {
    OCacheLine* line;
    tl_assert(is_valid_oc_tag(tag));
-   stats__ocacheL2_refs++;
-   line = VG_(OSetGen_Lookup)( ocacheL2, &tag );
+   mt_stat_add(&stats__ocacheL2_refs, 1);
+   line = VG_(OSetGen_Lookup)( oc_shard_for(tag)->l2, &tag );
    return line;
 }
 
@@ -2364,14 +2732,16 @@ static OCacheLine* ocacheL2_find_tag ( Addr tag )
    free up the associated memory. */
 static void ocacheL2_del_tag ( Addr tag )
 {
-   OCacheLine* line;
+   OCacheLine*  line;
+   OCacheShard* shard = oc_shard_for(tag);
    tl_assert(is_valid_oc_tag(tag));
-   stats__ocacheL2_refs++;
-   line = VG_(OSetGen_Remove)( ocacheL2, &tag );
+   mt_stat_add(&stats__ocacheL2_refs, 1);
+   line = VG_(OSetGen_Remove)( shard->l2, &tag );
    if (line) {
-      VG_(OSetGen_FreeNode)(ocacheL2, line);
-      tl_assert(stats__ocacheL2_n_nodes > 0);
-      stats__ocacheL2_n_nodes--;
+      free_shadow_node(&ocacheL2_reserve, shard->l2, line);
+      tl_assert(shard->l2_n_nodes > 0);
+      shard->l2_n_nodes--;
+      mt_stat_add(&stats__ocacheL2_n_nodes, -(UWord)1);
    }
 }
 
@@ -2379,16 +2749,29 @@ static void ocacheL2_del_tag ( Addr tag )
    present. */
 static void ocacheL2_add_line ( OCacheLine* line )
 {
-   OCacheLine* copy;
+   OCacheLine*  copy;
+   OCacheShard* shard = oc_shard_for(line->tag);
+   UWord        n_nodes, max;
    tl_assert(is_valid_oc_tag(line->tag));
-   copy = VG_(OSetGen_AllocNode)( ocacheL2, sizeof(OCacheLine) );
+   copy = alloc_shadow_node( &ocacheL2_reserve, shard->l2,
+                             sizeof(OCacheLine) );
    tl_assert(copy);
    *copy = *line;
-   stats__ocacheL2_refs++;
-   VG_(OSetGen_Insert)( ocacheL2, copy );
-   stats__ocacheL2_n_nodes++;
-   if (stats__ocacheL2_n_nodes > stats__ocacheL2_n_nodes_max)
-      stats__ocacheL2_n_nodes_max = stats__ocacheL2_n_nodes;
+   mt_stat_add(&stats__ocacheL2_refs, 1);
+   VG_(OSetGen_Insert)( shard->l2, copy );
+   shard->l2_n_nodes++;
+   if (UNLIKELY(MC_(clo_mt_shadow))) {
+      n_nodes = __sync_add_and_fetch(&stats__ocacheL2_n_nodes, 1);
+      do {
+         max = stats__ocacheL2_n_nodes_max;
+      } while (n_nodes > max
+               && !__sync_bool_compare_and_swap(&stats__ocacheL2_n_nodes_max,
+                                                max, n_nodes));
+   } else {
+      stats__ocacheL2_n_nodes++;
+      if (stats__ocacheL2_n_nodes > stats__ocacheL2_n_nodes_max)
+         stats__ocacheL2_n_nodes_max = stats__ocacheL2_n_nodes;
+   }
 }
 
 ////
@@ -2409,9 +2792,9 @@ static OCacheLine* find_OCacheLine_SLOW ( Addr a )
    for (line = 1; line < OC_LINES_PER_SET; line++) {
       if (ocacheL1->set[setno].line[line].tag == tag) {
          if (line == 1) {
-            stats_ocacheL1_found_at_1++;
+            mt_stat_add(&stats_ocacheL1_found_at_1, 1);
          } else {
-            stats_ocacheL1_found_at_N++;
+            mt_stat_add(&stats_ocacheL1_found_at_N, 1);
          }
          if (UNLIKELY(0 == (ocacheL1_event_ctr++ 
                             & ((1<<OC_MOVE_FORWARDS_EVERY_BITS)-1)))) {
@@ -2424,7 +2807,7 @@ static OCacheLine* find_OCacheLine_SLOW ( Addr a )
 
    /* A miss.  Use the last slot.  Implicitly this means we're
       ejecting the line in the last slot. */
-   stats_ocacheL1_misses++;
+   mt_stat_add(&stats_ocacheL1_misses, 1);
    tl_assert(line == OC_LINES_PER_SET);
    line--;
    tl_assert(line > 0);
@@ -2447,7 +2830,7 @@ static OCacheLine* find_OCacheLine_SLOW ( Addr a )
       case 'n':
          /* line contains at least one real, useful origin.  Copy it
             to the backing store. */
-         stats_ocacheL1_lossage++;
+         mt_stat_add(&stats_ocacheL1_lossage, 1);
          inL2 = ocacheL2_find_tag( victim->tag );
          if (inL2) {
             *inL2 = *victim;
@@ -2469,7 +2852,7 @@ static OCacheLine* find_OCacheLine_SLOW ( Addr a )
    } else {
       /* Missed at both levels of the cache hierarchy.  We have to
          declare it as full of zeroes (unknown origins). */
-      stats__ocacheL2_misses++;
+      mt_stat_add(&stats__ocacheL2_misses, 1);
       zeroise_OCacheLine( &ocacheL1->set[setno].line[line], tag );
    }
 
@@ -2486,13 +2869,16 @@ static INLINE OCacheLine* find_OCacheLine ( Addr a )
    UWord tagmask = ~((1 << OC_BITS_PER_LINE) - 1);
    UWord tag     = a & tagmask;
 
-   stats_ocacheL1_find++;
+   mt_stat_add(&stats_ocacheL1_find, 1);
 
    if (OC_ENABLE_ASSERTIONS) {
       tl_assert(setno >= 0 && setno < OC_N_SETS);
       tl_assert(0 == (tag & (4 * OC_W32S_PER_LINE - 1)));
    }
 
+   if (UNLIKELY(MC_(clo_mt_shadow)))
+      mc_spin_lock( &oc_shard_for(a)->lock );
+
    if (LIKELY(ocacheL1->set[setno].line[0].tag == tag)) {
       return &ocacheL1->set[setno].line[0];
    }
@@ -2500,6 +2886,13 @@ static INLINE OCacheLine* find_OCacheLine ( Addr a )
    return find_OCacheLine_SLOW( a );
 }
 
+/* Must be called when done with a line returned by find_OCacheLine. */
+static INLINE void release_OCacheLine ( Addr a )
+{
+   if (UNLIKELY(MC_(clo_mt_shadow)))
+      mc_spin_unlock( &oc_shard_for(a)->lock );
+}
+
 static INLINE void set_aligned_word64_Origin_to_undef ( Addr a, UInt otag )
 {
    //// BEGIN inlined, specialised version of MC_(helperc_b_store8)
@@ -2515,6 +2908,7 @@ static INLINE void set_aligned_word64_Origin_to_undef ( Addr a, UInt otag )
      line->descr[lineoff+1] = 0xF;
      line->w32[lineoff+0]   = otag;
      line->w32[lineoff+1]   = otag;
+     release_OCacheLine( a );
    }
    //// END inlined, specialised version of MC_(helperc_b_store8)
 }
@@ -2542,11 +2936,15 @@ static INLINE void make_aligned_word32_undefined ( Addr a )
 
       if (UNLIKELY(a > MAX_PRIMARY_ADDRESS)) {
          PROF_EVENT(301, "make_aligned_word32_undefined-slow1");
-         make_mem_undefined(a, 4);
-         return;
+         if (LIKELY(!MC_(clo_mt_shadow))) {
+            make_mem_undefined(a, 4);
+            return;
+         }
+         sm = get_secmap_for_writing_high(a);
+      } else {
+         mark_card_dirty(a);
+         sm = get_secmap_for_writing_low(a);
       }
-
-      sm                  = get_secmap_for_writing_low(a);
       sm_off              = SM_OFF(a);
       sm->vabits8[sm_off] = VA_BITS8_UNDEFINED;
    }
@@ -2567,6 +2965,7 @@ void make_aligned_word32_undefined_w_otag ( Addr a, UInt otag )
      line = find_OCacheLine( a );
      line->descr[lineoff] = 0xF;
      line->w32[lineoff]   = otag;
+     release_OCacheLine( a );
    }
    //// END inlined, specialised version of MC_(helperc_b_store4)
 }
@@ -2585,11 +2984,15 @@ void make_aligned_word32_noaccess ( Addr a )
 
       if (UNLIKELY(a > MAX_PRIMARY_ADDRESS)) {
          PROF_EVENT(311, "make_aligned_word32_noaccess-slow1");
-         MC_(make_mem_noaccess)(a, 4);
-         return;
+         if (LIKELY(!MC_(clo_mt_shadow))) {
+            MC_(make_mem_noaccess)(a, 4);
+            return;
+         }
+         sm = get_secmap_for_writing_high(a);
+      } else {
+         mark_card_dirty(a);
+         sm = get_secmap_for_writing_low(a);
       }
-
-      sm                  = get_secmap_for_writing_low(a);
       sm_off              = SM_OFF(a);
       sm->vabits8[sm_off] = VA_BITS8_NOACCESS;
 
@@ -2603,6 +3006,7 @@ void make_aligned_word32_noaccess ( Addr a )
          }
          line = find_OCacheLine( a );
          line->descr[lineoff] = 0;
+         release_OCacheLine( a );
       }
       //// END inlined, specialised version of MC_(helperc_b_store4)
    }
@@ -2626,11 +3030,15 @@ static INLINE void make_aligned_word64_undefined ( Addr a )
 
       if (UNLIKELY(a > MAX_PRIMARY_ADDRESS)) {
          PROF_EVENT(321, "make_aligned_word64_undefined-slow1");
-         make_mem_undefined(a, 8);
-         return;
+         if (LIKELY(!MC_(clo_mt_shadow))) {
+            make_mem_undefined(a, 8);
+            return;
+         }
+         sm = get_secmap_for_writing_high(a);
+      } else {
+         mark_card_dirty(a);
+         sm = get_secmap_for_writing_low(a);
       }
-
-      sm       = get_secmap_for_writing_low(a);
       sm_off16 = SM_OFF_16(a);
       ((UShort*)(sm->vabits8))[sm_off16] = VA_BITS16_UNDEFINED;
    }
@@ -2652,6 +3060,7 @@ void make_aligned_word64_undefined_w_otag ( Addr a, UInt otag )
      line->descr[lineoff+1] = 0xF;
      line->w32[lineoff+0]   = otag;
      line->w32[lineoff+1]   = otag;
+     release_OCacheLine( a );
    }
    //// END inlined, specialised version of MC_(helperc_b_store8)
 }
@@ -2670,11 +3079,15 @@ void make_aligned_word64_noaccess ( Addr a )
 
       if (UNLIKELY(a > MAX_PRIMARY_ADDRESS)) {
          PROF_EVENT(331, "make_aligned_word64_noaccess-slow1");
-         MC_(make_mem_noaccess)(a, 8);
-         return;
+         if (LIKELY(!MC_(clo_mt_shadow))) {
+            MC_(make_mem_noaccess)(a, 8);
+            return;
+         }
+         sm = get_secmap_for_writing_high(a);
+      } else {
+         mark_card_dirty(a);
+         sm = get_secmap_for_writing_low(a);
       }
-
-      sm       = get_secmap_for_writing_low(a);
       sm_off16 = SM_OFF_16(a);
       ((UShort*)(sm->vabits8))[sm_off16] = VA_BITS16_NOACCESS;
 
@@ -2688,6 +3101,7 @@ void make_aligned_word64_noaccess ( Addr a )
          line = find_OCacheLine( a );
          line->descr[lineoff+0] = 0;
          line->descr[lineoff+1] = 0;
+         release_OCacheLine( a );
       }
       //// END inlined, specialised version of MC_(helperc_b_store8)
    }
@@ -3451,6 +3865,8 @@ void MC_(helperc_MAKE_STACK_UNINIT) ( Addr base, UWord len, Addr nia )
       VG_(printf)("helperc_MAKE_STACK_UNINIT (%#lx,%lu,nia=%#lx)\n",
                   base, len, nia );
 
+   mark_cards_dirty(base, len);
+
    if (UNLIKELY( MC_(clo_mc_level) == 3 )) {
       UInt ecu = convert_nia_to_ecu ( nia );
       tl_assert(VG_(is_plausible_ECU)(ecu));
@@ -4003,6 +4419,9 @@ void mc_new_mem_mmap ( Addr a, SizeT len, Bool rr, Bool ww, Bool xx,
 static
 void mc_new_mem_mprotect ( Addr a, SizeT len, Bool rr, Bool ww, Bool xx )
 {
+   /* The leak checker's summaries of the pages depend on whether they
+      can be read. */
+   mark_cards_dirty(a, len);
    if (rr || ww || xx) {
       /* (4) mprotect other  ->  change any "noaccess" to "defined" */
       make_mem_defined_if_noaccess(a, len);
@@ -4394,6 +4813,16 @@ VG_REGPARM(1) void MC_(helperc_STOREV64le) ( Addr a, ULong vbits64 )
 {
    mc_STOREV64(a, vbits64, False);
 }
+VG_REGPARM(1) void MC_(helperc_STOREV64be_card) ( Addr a, ULong vbits64 )
+{
+   mark_card_dirty(a);
+   mc_STOREV64(a, vbits64, True);
+}
+VG_REGPARM(1) void MC_(helperc_STOREV64le_card) ( Addr a, ULong vbits64 )
+{
+   mark_card_dirty(a);
+   mc_STOREV64(a, vbits64, False);
+}
 
 
 /* ------------------------ Size = 4 ------------------------ */
@@ -4510,6 +4939,16 @@ VG_REGPARM(2) void MC_(helperc_STOREV32le) ( Addr a, UWord vbits32 )
 {
    mc_STOREV32(a, vbits32, False);
 }
+VG_REGPARM(2) void MC_(helperc_STOREV32be_card) ( Addr a, UWord vbits32 )
+{
+   mark_card_dirty(a);
+   mc_STOREV32(a, vbits32, True);
+}
+VG_REGPARM(2) void MC_(helperc_STOREV32le_card) ( Addr a, UWord vbits32 )
+{
+   mark_card_dirty(a);
+   mc_STOREV32(a, vbits32, False);
+}
 
 
 /* ------------------------ Size = 2 ------------------------ */
@@ -4621,6 +5060,16 @@ VG_REGPARM(2) void MC_(helperc_STOREV16le) ( Addr a, UWord vbits16 )
 {
    mc_STOREV16(a, vbits16, False);
 }
+VG_REGPARM(2) void MC_(helperc_STOREV16be_card) ( Addr a, UWord vbits16 )
+{
+   mark_card_dirty(a);
+   mc_STOREV16(a, vbits16, True);
+}
+VG_REGPARM(2) void MC_(helperc_STOREV16le_card) ( Addr a, UWord vbits16 )
+{
+   mark_card_dirty(a);
+   mc_STOREV16(a, vbits16, False);
+}
 
 
 /* ------------------------ Size = 1 ------------------------ */
@@ -4668,8 +5117,8 @@ UWord MC_(helperc_LOADV8) ( Addr a )
 }
 
 
-VG_REGPARM(2)
-void MC_(helperc_STOREV8) ( Addr a, UWord vbits8 )
+static INLINE
+void mc_STOREV8 ( Addr a, UWord vbits8 )
 {
    PROF_EVENT(270, "mc_STOREV8");
 
@@ -4720,6 +5169,163 @@ void MC_(helperc_STOREV8) ( Addr a, UWord vbits8 )
 #endif
 }
 
+VG_REGPARM(2)
+void MC_(helperc_STOREV8) ( Addr a, UWord vbits8 )
+{
+   mc_STOREV8(a, vbits8);
+}
+VG_REGPARM(2)
+void MC_(helperc_STOREV8_card) ( Addr a, UWord vbits8 )
+{
+   mark_card_dirty(a);
+   mc_STOREV8(a, vbits8);
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Functions called directly from generated code:       ---*/
+/*--- Coalesced range handlers.                            ---*/
+/*------------------------------------------------------------*/
+
+/* The instrumenter (see "Coalescing of loads and stores" in
+   mc_translate.c) groups loads, or runs of stores of defined data,
+   done at small constant offsets from a common base address, and
+   calls one of these once per group.  The bytes touched by the group
+   lie within [a, a+MC_RANGE_SPAN), and |vmask| selects them: it has
+   VA_BITS2 field i set to 11b if byte a+i is touched and 00b
+   otherwise.  If the handler returns nonzero the members' own
+   LOADV/STOREV calls are skipped, so these handlers must only say
+   "yes" in the boring case where doing that makes no difference: they
+   never report errors, and on any doubt return zero and leave shadow
+   memory untouched.
+
+   A vabits word (a UWord of vabits8[]) describes MC_RANGE_SPAN
+   bytes, so the range needs at most two of them. */
+
+static INLINE UWord* range_vabits_word ( SecMap* sm, Addr a )
+{
+   return (UWord*)&sm->vabits8[SM_OFF(a)];
+}
+
+/* The value of a vabits word, arranged so that the field for the
+   lowest addressed byte is in the least significant bits. */
+static INLINE UWord range_vabits_value ( UWord w )
+{
+#  if defined(VG_BIGENDIAN)
+   UWord r = 0;
+   Int   i;
+   for (i = 0; i < sizeof(UWord); i++, w >>= 8)
+      r = (r << 8) | (w & 0xFF);
+   return r;
+#  else
+   return w;
+#  endif
+}
+
+/* Returns 1 if all the bytes selected by |vmask| are addressable and
+   defined, else 0. */
+VG_REGPARM(2)
+UWord MC_(helperc_LOADV_range) ( Addr a, UWord vmask )
+{
+   PROF_EVENT(280, "mc_LOADV_range");
+
+#ifndef PERF_FAST_LOADV
+   return 0;
+#else
+   {
+      const UWord defined = (UWord)~0 / 3 * 2;   /* 0xAAAA.. */
+      UInt    sh   = 2 * (a & (MC_RANGE_SPAN-1));
+      Addr    a0   = a & ~(Addr)(MC_RANGE_SPAN-1);
+      SecMap* sm   = get_secmap_for_reading(a0);
+      UWord   want = vmask << sh;
+
+      if ((range_vabits_value(*range_vabits_word(sm, a0)) & want)
+          != (defined & want))
+         goto no;
+      if (sh == 0 || (want = vmask >> (8 * sizeof(UWord) - sh)) == 0)
+         return 1;
+
+      /* The range straddles two vabits words. */
+      a0 += MC_RANGE_SPAN;
+      if (UNLIKELY(is_start_of_sm(a0)))
+         sm = get_secmap_for_reading(a0);
+      if ((range_vabits_value(*range_vabits_word(sm, a0)) & want)
+          == (defined & want))
+         return 1;
+
+     no:
+      PROF_EVENT(281, "mc_LOADV_range-no");
+      return 0;
+   }
+#endif
+}
+
+/* If all the bytes selected by |vmask| are addressable, and are either
+   defined or undefined (not partially defined), mark them as defined
+   and return 1.  Otherwise change nothing and return 0. */
+static INLINE
+UWord mc_STOREV_range_defined ( Addr a, UWord vmask )
+{
+   PROF_EVENT(285, "mc_STOREV_range_defined");
+
+#ifndef PERF_FAST_STOREV
+   return 0;
+#else
+   {
+      const UWord lo_bits = (UWord)~0 / 3;        /* 0x5555.. */
+      const UWord defined = lo_bits * 2;          /* 0xAAAA.. */
+      UInt    sh     = 2 * (a & (MC_RANGE_SPAN-1));
+      Addr    a0     = a & ~(Addr)(MC_RANGE_SPAN-1);
+      Addr    a1     = a0 + MC_RANGE_SPAN;
+      SecMap* sm0    = get_secmap_for_reading(a0);
+      SecMap* sm1    = sm0;
+      UWord   want0  = vmask << sh;
+      UWord   want1  = sh == 0 ? 0 : vmask >> (8 * sizeof(UWord) - sh);
+      UWord*  p0     = range_vabits_word(sm0, a0);
+      UWord*  p1     = NULL;
+      UWord   v0, v1 = 0;
+
+      /* Check first, so that a refusal has no side effects.  Each
+         selected field must be 01b or 10b. */
+      v0 = range_vabits_value(*p0);
+      if (is_distinguished_sm(sm0)
+          || ((v0 ^ (v0 >> 1)) & want0 & lo_bits) != (want0 & lo_bits))
+         goto no;
+      if (want1 != 0) {
+         if (UNLIKELY(is_start_of_sm(a1)))
+            sm1 = get_secmap_for_reading(a1);
+         p1 = range_vabits_word(sm1, a1);
+         v1 = range_vabits_value(*p1);
+         if (is_distinguished_sm(sm1)
+             || ((v1 ^ (v1 >> 1)) & want1 & lo_bits) != (want1 & lo_bits))
+            goto no;
+      }
+
+      *p0 = range_vabits_value((v0 & ~want0) | (defined & want0));
+      if (p1)
+         *p1 = range_vabits_value((v1 & ~want1) | (defined & want1));
+      return 1;
+
+     no:
+      PROF_EVENT(286, "mc_STOREV_range_defined-no");
+      return 0;
+   }
+#endif
+}
+
+VG_REGPARM(2)
+UWord MC_(helperc_STOREV_range_defined) ( Addr a, UWord vmask )
+{
+   return mc_STOREV_range_defined(a, vmask);
+}
+VG_REGPARM(2)
+UWord MC_(helperc_STOREV_range_defined_card) ( Addr a, UWord vmask )
+{
+   mark_card_dirty(a);
+   mark_card_dirty(a + MC_RANGE_SPAN - 1);
+   return mc_STOREV_range_defined(a, vmask);
+}
+
 
 /*------------------------------------------------------------*/
 /*--- Functions called directly from generated code:       ---*/
@@ -4876,6 +5482,51 @@ Bool MC_(is_valid_aligned_word) ( Addr a )
       return True;
 }
 
+/* For the memory leak detector: return a mask with bit i set if the
+   word at a + i * sizeof(UWord) is valid in the sense of
+   MC_(is_valid_aligned_word), for the 8 * sizeof(UWord) words starting
+   at a, which must be aligned to that many words.  This looks at the
+   V+A bits of four words at a time, so is much quicker than asking
+   about each word in turn. */
+UWord MC_(valid_aligned_words) ( Addr a )
+{
+   const UWord n_words      = 8 * sizeof(UWord);
+   const UWord all_defined  = (UWord)0xaaaaaaaaaaaaaaaaULL;
+   UWord       i, j, vabits, mask = 0;
+   SecMap*     sm;
+
+   tl_assert((a % (n_words * sizeof(UWord))) == 0);
+
+   if (UNLIKELY(ignoreRanges.used > 0)) {
+      for (i = 0; i < n_words; i++) {
+         if (MC_(is_valid_aligned_word)(a + i * sizeof(UWord)))
+            mask |= (UWord)1 << i;
+      }
+      return mask;
+   }
+
+   sm = get_secmap_for_reading(a);
+   if (sm == &sm_distinguished[SM_DIST_DEFINED])
+      return ~(UWord)0;
+   if (sm == &sm_distinguished[SM_DIST_NOACCESS]
+       || sm == &sm_distinguished[SM_DIST_UNDEFINED])
+      return 0;
+
+   // Each UWord of vabits8 holds the V+A bits of four words.
+   for (i = 0; i < n_words; i += 4) {
+      vabits = *(UWord*)&sm->vabits8[SM_OFF(a + i * sizeof(UWord))];
+      if (vabits == all_defined) {
+         mask |= (UWord)0xF << i;
+      } else if (vabits != 0) {
+         for (j = i; j < i + 4; j++) {
+            if (MC_(is_valid_aligned_word)(a + j * sizeof(UWord)))
+               mask |= (UWord)1 << j;
+         }
+      }
+   }
+   return mask;
+}
+
 
 /*------------------------------------------------------------*/
 /*--- Initialisation                                       ---*/
@@ -5039,11 +5690,15 @@ VgRes         MC_(clo_leak_resolution)        = Vg_HighRes;
 UInt          MC_(clo_show_leak_kinds)        = R2S(Possible) | R2S(Unreached);
 UInt          MC_(clo_error_for_leak_kinds)   = R2S(Possible) | R2S(Unreached);
 UInt          MC_(clo_leak_check_heuristics)  = 0;
+Int           MC_(clo_leak_check_threads)     = 1;
+Bool          MC_(clo_leak_check_incremental) = False;
 Bool          MC_(clo_workaround_gcc296_bugs) = False;
 Int           MC_(clo_malloc_fill)            = -1;
 Int           MC_(clo_free_fill)              = -1;
 KeepStacktraces MC_(clo_keep_stacktraces)     = KS_alloc_then_free;
 Int           MC_(clo_mc_level)               = 2;
+Bool          MC_(clo_mt_shadow)              = False;
+Bool          MC_(clo_mt_shadow_selftest)     = False;
 
 static Bool MC_(parse_leak_heuristics) ( const HChar *str0, UInt *lhs )
 {
@@ -5150,6 +5805,10 @@ static Bool mc_process_cmd_line_options(const HChar* arg)
       if (!MC_(parse_leak_heuristics)(tmp_str, &MC_(clo_leak_check_heuristics)))
          return False;
    }
+   else if VG_BINT_CLO(arg, "--leak-check-threads",
+                       MC_(clo_leak_check_threads), 1, VG_MAX_PARALLEL) {}
+   else if VG_BOOL_CLO(arg, "--leak-check-incremental",
+                       MC_(clo_leak_check_incremental)) {}
    else if (VG_BOOL_CLO(arg, "--show-reachable", tmp_show)) {
       if (tmp_show) {
          MC_(clo_show_leak_kinds) = RallS;
@@ -5232,6 +5891,10 @@ static Bool mc_process_cmd_line_options(const HChar* arg)
    else if VG_XACT_CLO(arg, "--keep-stacktraces=none",
                        MC_(clo_keep_stacktraces), KS_none) {}
 
+   else if VG_BOOL_CLO(arg, "--mt-shadow", MC_(clo_mt_shadow)) {}
+   else if VG_BOOL_CLO(arg, "--mt-shadow-selftest",
+                       MC_(clo_mt_shadow_selftest)) {}
+
    else
       return VG_(replacement_malloc_process_cmd_line_option)(arg);
 
@@ -5256,6 +5919,9 @@ static void mc_print_usage(void)
 "    --leak-check-heuristics=heur1,heur2,... which heuristics to use for\n"
 "        improving leak search false positive [none]\n"
 "        where heur is one of stdstring newarray multipleinheritance all none\n"
+"    --leak-check-threads=<number>    threads to search for leaks with [1]\n"
+"    --leak-check-incremental=no|yes  rescan only memory written since the\n"
+"                                     previous leak search? [no]\n"
 "    --show-reachable=yes             same as --show-leak-kinds=all\n"
 "    --show-reachable=no --show-possibly-lost=yes\n"
 "                                     same as --show-leak-kinds=definite,possible\n"
@@ -5278,7 +5944,9 @@ static void mc_print_usage(void)
 static void mc_print_debug_usage(void)
 {  
    VG_(printf)(
-"    (none)\n"
+"    --mt-shadow=no|yes               keep shadow memory safe for concurrent\n"
+"                                     updates by several threads [no]\n"
+"    --mt-shadow-selftest=no|yes      check --mt-shadow=yes at startup [no]\n"
    );
 }
 
@@ -6071,6 +6739,7 @@ static INLINE UInt merge_origins ( UInt or1, UInt or2 ) {
 
 UWord VG_REGPARM(1) MC_(helperc_b_load1)( Addr a ) {
    OCacheLine* line;
+   UWord res;
    UChar descr;
    UWord lineoff = oc_line_offset(a);
    UWord byteoff = a & 3; /* 0, 1, 2 or 3 */
@@ -6087,14 +6756,17 @@ UWord VG_REGPARM(1) MC_(helperc_b_load1)( Addr a ) {
    }
 
    if (LIKELY(0 == (descr & (1 << byteoff))))  {
-      return 0;
+      res = 0;
    } else {
-      return line->w32[lineoff];
+      res = line->w32[lineoff];
    }
+   release_OCacheLine( a );
+   return res;
 }
 
 UWord VG_REGPARM(1) MC_(helperc_b_load2)( Addr a ) {
    OCacheLine* line;
+   UWord res;
    UChar descr;
    UWord lineoff, byteoff;
 
@@ -6119,14 +6791,17 @@ UWord VG_REGPARM(1) MC_(helperc_b_load2)( Addr a ) {
    }
 
    if (LIKELY(0 == (descr & (3 << byteoff)))) {
-      return 0;
+      res = 0;
    } else {
-      return line->w32[lineoff];
+      res = line->w32[lineoff];
    }
+   release_OCacheLine( a );
+   return res;
 }
 
 UWord VG_REGPARM(1) MC_(helperc_b_load4)( Addr a ) {
    OCacheLine* line;
+   UWord res;
    UChar descr;
    UWord lineoff;
 
@@ -6150,14 +6825,17 @@ UWord VG_REGPARM(1) MC_(helperc_b_load4)( Addr a ) {
    }
 
    if (LIKELY(0 == descr)) {
-      return 0;
+      res = 0;
    } else {
-      return line->w32[lineoff];
+      res = line->w32[lineoff];
    }
+   release_OCacheLine( a );
+   return res;
 }
 
 UWord VG_REGPARM(1) MC_(helperc_b_load8)( Addr a ) {
    OCacheLine* line;
+   UWord res;
    UChar descrLo, descrHi, descr;
    UWord lineoff;
 
@@ -6183,12 +6861,14 @@ UWord VG_REGPARM(1) MC_(helperc_b_load8)( Addr a ) {
    }
 
    if (LIKELY(0 == descr)) {
-      return 0; /* both 32-bit chunks are defined */
+      res = 0; /* both 32-bit chunks are defined */
    } else {
       UInt oLo = descrLo == 0 ? 0 : line->w32[lineoff + 0];
       UInt oHi = descrHi == 0 ? 0 : line->w32[lineoff + 1];
-      return merge_origins(oLo, oHi);
+      res = merge_origins(oLo, oHi);
    }
+   release_OCacheLine( a );
+   return res;
 }
 
 UWord VG_REGPARM(1) MC_(helperc_b_load16)( Addr a ) {
@@ -6230,6 +6910,7 @@ void VG_REGPARM(2) MC_(helperc_b_store1)( Addr a, UWord d32 ) {
       line->descr[lineoff] |= (1 << byteoff);
       line->w32[lineoff] = d32;
    }
+   release_OCacheLine( a );
 }
 
 void VG_REGPARM(2) MC_(helperc_b_store2)( Addr a, UWord d32 ) {
@@ -6258,6 +6939,7 @@ void VG_REGPARM(2) MC_(helperc_b_store2)( Addr a, UWord d32 ) {
       line->descr[lineoff] |= (3 << byteoff);
       line->w32[lineoff] = d32;
    }
+   release_OCacheLine( a );
 }
 
 void VG_REGPARM(2) MC_(helperc_b_store4)( Addr a, UWord d32 ) {
@@ -6284,6 +6966,7 @@ void VG_REGPARM(2) MC_(helperc_b_store4)( Addr a, UWord d32 ) {
       line->descr[lineoff] = 0xF;
       line->w32[lineoff] = d32;
    }
+   release_OCacheLine( a );
 }
 
 void VG_REGPARM(2) MC_(helperc_b_store8)( Addr a, UWord d32 ) {
@@ -6313,6 +6996,7 @@ void VG_REGPARM(2) MC_(helperc_b_store8)( Addr a, UWord d32 ) {
       line->w32[lineoff + 0] = d32;
       line->w32[lineoff + 1] = d32;
    }
+   release_OCacheLine( a );
 }
 
 void VG_REGPARM(2) MC_(helperc_b_store16)( Addr a, UWord d32 ) {
@@ -6397,6 +7081,268 @@ static void ocache_sarp_Clear_Origins ( Addr a, UWord len ) {
 }
 
 
+/*------------------------------------------------------------*/
+/*--- Running helper threads on the shadow memory          ---*/
+/*------------------------------------------------------------*/
+
+/* Put enough SecMaps and tree nodes in the reserves for helper threads
+   to write the shadow of [a, a+len) without allocating: a SecMap, and
+   above MAX_PRIMARY_ADDRESS an auxmap entry, for each 64k; a secondary
+   V bit node for each BYTES_PER_SEC_VBIT_NODE bytes; and for each
+   origin cache line, a node for it and for each line it may push out
+   of its ocacheL1 set. */
+static void reserve_shadow ( Addr a, SizeT len )
+{
+   UWord i, n_sms, n_sec_vbits, n_oc_lines;
+
+   tl_assert(len > 0);
+   tl_assert(!shadow_helpers_running);
+   n_sms       = ((a + len - 1) >> 16) - (a >> 16) + 1;
+   n_sec_vbits = len / BYTES_PER_SEC_VBIT_NODE + 2;
+   n_oc_lines  = (len >> OC_BITS_PER_LINE) + 2;
+
+   for (i = 0; i < n_sms; i++) {
+      SecMap* sm = VG_(am_shadow_alloc)(sizeof(SecMap));
+      if (sm == NULL)
+         VG_(out_of_memory_NORETURN)( "memcheck:reserve SecMaps",
+                                      sizeof(SecMap) );
+      put_in_reserve(&sm_reserve, sm);
+      if ((((a >> 16) + i) << 16) > MAX_PRIMARY_ADDRESS)
+         put_in_reserve(&auxmap_reserve,
+                        VG_(OSetGen_AllocNode)(auxmap_L2,
+                                               sizeof(AuxMapEnt)));
+   }
+   for (i = 0; i < n_sec_vbits; i++)
+      put_in_reserve(&sec_vbits_reserve,
+                     VG_(OSetGen_AllocNode)(secVBitTable,
+                                            sizeof(SecVBitNode)));
+   if (MC_(clo_mc_level) == 3) {
+      for (i = 0; i < n_oc_lines * (1 + OC_LINES_PER_SET); i++)
+         put_in_reserve(&ocacheL2_reserve,
+                        VG_(OSetGen_AllocNode)(ocache_shards[0].l2,
+                                               sizeof(OCacheLine)));
+   }
+}
+
+Int MC_(run_shadow_helpers) ( Int n, void (*fn)(void* arg, Int index),
+                              void* arg )
+{
+   Bool mt_shadow = MC_(clo_mt_shadow);
+   Int  n_started;
+
+   tl_assert(!shadow_helpers_running);
+   MC_(clo_mt_shadow)     = True;
+   shadow_helpers_running = True;
+   n_started = VG_(run_in_parallel)(n, fn, arg);
+   shadow_helpers_running = False;
+   MC_(clo_mt_shadow)     = mt_shadow;
+   return n_started;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Self test for --mt-shadow=yes                        ---*/
+/*------------------------------------------------------------*/
+
+/* The core does not yet run Memcheck's helpers on several threads at
+   once, so with --mt-shadow-selftest=yes we do it ourselves at
+   startup, with MC_(run_shadow_helpers).  The threads work on the
+   shadow of MTS_N_AREAS areas: one in Valgrind's heap, and on 64-bit
+   targets the others above MAX_PRIMARY_ADDRESS, where nothing is
+   mapped, one ocacheL1 set's worth of address space apart so that
+   their origin cache lines compete for the same sets.
+
+   First each thread makes its share of the 8-byte words of every area
+   addressable, as the stack pointer helpers do, so that the threads
+   race each other to allocate the areas' auxmap entries and secondary
+   maps.  Then they store to interleaved bytes (or words, for origins)
+   through the helpers that generated code calls, and check that each
+   of their bytes holds what they last stored there.  Neighbouring
+   bytes share vabits8 bytes and origin cache lines, so lost updates
+   show up as wrong bytes; and since there are more areas than ocacheL1
+   has lines per set, the lines keep being evicted to ocacheL2 and
+   brought back.  The areas' shadow can't matter to the client, and is
+   made no-access again afterwards. */
+
+#define MTS_SZB      32768
+#define MTS_N_AREAS  (1 + OC_LINES_PER_SET + 1)
+#define MTS_THREADS  8
+#define MTS_ROUNDS   16
+
+typedef
+   struct {
+      Addr  areas[MTS_N_AREAS];
+      Int   n_areas;
+      Int   phase;   /* 0: make addressable, 1: STOREV8, 2: STOREV16,
+                        3: origins */
+      UWord n_wrong[MTS_THREADS];
+   }
+   MtsState;
+
+/* What is stored to byte i in round r: a mix of defined, undefined and
+   partially defined bytes, the last going through the secondary V bit
+   table. */
+static UChar mts_vbits8 ( UWord i, UWord r )
+{
+   switch ((i * 7 + r * 3) % 5) {
+      case 0:  return V_BITS8_DEFINED;
+      case 1:  return V_BITS8_UNDEFINED;
+      case 2:  return 0x0F;
+      case 3:  return V_BITS8_DEFINED;
+      default: return (UChar)(0x3C ^ r);
+   }
+}
+
+static UInt mts_otag ( UWord i, UWord r )
+{
+   return (UInt)((i << 4) | (r << 1) | 1);
+}
+
+/* Count the units of thread 'index' in area 'base' which don't hold
+   what it last stored. */
+static UWord mts_check_area ( Int phase, Addr base, Int index )
+{
+   UWord i, r = MTS_ROUNDS-1, wrong = 0;
+
+   switch (phase) {
+      case 0:
+         for (i = 8 * index; i < MTS_SZB; i += 8 * MTS_THREADS) {
+            if (MC_(helperc_LOADV64le)( base + i ) != V_BITS64_UNDEFINED)
+               wrong++;
+            else if (MC_(clo_mc_level) == 3
+                     && (MC_(helperc_b_load4)( base + i ) != mts_otag(i, r)
+                         || MC_(helperc_b_load4)( base + i + 4 )
+                            != mts_otag(i, r)))
+               wrong++;
+         }
+         break;
+      case 1:
+         for (i = index; i < MTS_SZB; i += MTS_THREADS)
+            if ((MC_(helperc_LOADV8)( base + i ) & 0xFF)
+                != mts_vbits8(i, r))
+               wrong++;
+         break;
+      case 2:
+         for (i = 2 * index; i < MTS_SZB; i += 2 * MTS_THREADS)
+            if ((MC_(helperc_LOADV16le)( base + i ) & 0xFFFF)
+                != (mts_vbits8(i, r) | (mts_vbits8(i+1, r) << 8)))
+               wrong++;
+         break;
+      case 3:
+         for (i = 4 * index; i < MTS_SZB; i += 4 * MTS_THREADS)
+            if (MC_(helperc_b_load4)( base + i ) != mts_otag(i, r))
+               wrong++;
+         break;
+      default:
+         tl_assert(0);
+   }
+   return wrong;
+}
+
+static UWord mts_check ( MtsState* st, Int index )
+{
+   UWord wrong = 0;
+   Int   k;
+   for (k = 0; k < st->n_areas; k++)
+      wrong += mts_check_area(st->phase, st->areas[k], index);
+   return wrong;
+}
+
+static void mts_worker ( void* stV, Int index )
+{
+   MtsState* st = stV;
+   UWord     r, i;
+   Int       k;
+
+   if (index >= MTS_THREADS)
+      return;
+
+   for (r = 0; r < MTS_ROUNDS; r++) {
+      for (k = 0; k < st->n_areas; k++) {
+         Addr base = st->areas[k];
+         switch (st->phase) {
+            case 0:
+               for (i = 8 * index; i < MTS_SZB; i += 8 * MTS_THREADS) {
+                  if (MC_(clo_mc_level) == 3)
+                     make_aligned_word64_undefined_w_otag( base + i,
+                                                           mts_otag(i, r) );
+                  else
+                     make_aligned_word64_undefined( base + i );
+               }
+               break;
+            case 1:
+               for (i = index; i < MTS_SZB; i += MTS_THREADS)
+                  MC_(helperc_STOREV8)( base + i, mts_vbits8(i, r) );
+               break;
+            case 2:
+               for (i = 2 * index; i < MTS_SZB; i += 2 * MTS_THREADS)
+                  MC_(helperc_STOREV16le)( base + i,
+                                           mts_vbits8(i, r)
+                                           | (mts_vbits8(i+1, r) << 8) );
+               break;
+            case 3:
+               for (i = 4 * index; i < MTS_SZB; i += 4 * MTS_THREADS)
+                  MC_(helperc_b_store4)( base + i, mts_otag(i, r) );
+               break;
+            default:
+               tl_assert(0);
+         }
+      }
+   }
+   /* Check while the others may still be storing ... */
+   st->n_wrong[index] = mts_check(st, index);
+}
+
+static void mt_shadow_selftest ( void )
+{
+   MtsState st;
+   Int      i, k, n_threads = 0;
+   UWord    n_wrong = 0;
+   Int      n_sms0  = n_issued_SMs;
+   ULong    n_aux0  = n_auxmap_L2_nodes;
+   UWord    n_evicted0 = stats_ocacheL1_lossage;
+
+   VG_(memset)(&st, 0, sizeof(st));
+   st.areas[0] = (Addr)VG_(malloc)("mc.mt_shadow_selftest.1", MTS_SZB);
+   st.n_areas  = 1;
+   if (sizeof(Addr) == 8) {
+      for (k = 1; k < MTS_N_AREAS; k++) {
+         Addr a = MAX_PRIMARY_ADDRESS + 1
+                  + (Addr)(k-1) * (OC_N_SETS << OC_BITS_PER_LINE);
+         NSegment const* seg = VG_(am_find_nsegment)(a);
+         tl_assert(seg == NULL || seg->kind == SkFree
+                   || seg->kind == SkResvn);
+         tl_assert(maybe_find_in_auxmap(a) == NULL);
+         st.areas[st.n_areas++] = a;
+      }
+   }
+   for (k = 0; k < st.n_areas; k++)
+      reserve_shadow( st.areas[k], MTS_SZB );
+
+   for (st.phase = 0; st.phase < 4; st.phase++) {
+      if (st.phase == 3 && MC_(clo_mc_level) < 3)
+         break;
+      n_threads = MC_(run_shadow_helpers)( MTS_THREADS, mts_worker, &st );
+      /* ... and again once they have all finished.  If not all the
+         threads could be started, the bytes of the missing ones were
+         neither stored to nor checked. */
+      for (i = 0; i < n_threads; i++)
+         n_wrong += st.n_wrong[i] + mts_check(&st, i);
+   }
+
+   VG_(umsg)("mt-shadow self-test: %d threads, %lu wrong\n",
+             n_threads, n_wrong);
+   VG_(umsg)("mt-shadow self-test: %d secondary maps, %llu auxmap entries "
+             "allocated, %lu origin cache lines evicted\n",
+             n_issued_SMs - n_sms0, n_auxmap_L2_nodes - n_aux0,
+             stats_ocacheL1_lossage - n_evicted0);
+
+   for (k = 0; k < st.n_areas; k++)
+      MC_(make_mem_noaccess)( st.areas[k], MTS_SZB );
+   VG_(free)( (void*)st.areas[0] );
+}
+
+
 /*------------------------------------------------------------*/
 /*--- Setup and finalisation                               ---*/
 /*------------------------------------------------------------*/
@@ -6419,6 +7365,12 @@ static void mc_post_clo_init ( void )
 
    tl_assert( MC_(clo_mc_level) >= 1 && MC_(clo_mc_level) <= 3 );
 
+   if (MC_(clo_leak_check_incremental)) {
+      /* Everything starts off dirty. */
+      dirty_cards = VG_(malloc)("mc.mpci.1", N_PRIMARY_MAP);
+      VG_(memset)(dirty_cards, 1, N_PRIMARY_MAP);
+   }
+
    if (MC_(clo_mc_level) == 3) {
       /* We're doing origin tracking. */
 #     ifdef PERF_FAST_STACK
@@ -6511,10 +7463,10 @@ static void mc_post_clo_init ( void )
    if (MC_(clo_mc_level) >= 3) {
       init_OCache();
       tl_assert(ocacheL1 != NULL);
-      tl_assert(ocacheL2 != NULL);
+      tl_assert(ocache_shards[0].l2 != NULL);
    } else {
       tl_assert(ocacheL1 == NULL);
-      tl_assert(ocacheL2 == NULL);
+      tl_assert(ocache_shards[0].l2 == NULL);
    }
 
    MC_(chunk_poolalloc) = VG_(newPA)
@@ -6527,6 +7479,13 @@ static void mc_post_clo_init ( void )
    /* Do not check definedness of guest state if --undef-value-errors=no */
    if (MC_(clo_mc_level) >= 2)
       VG_(track_pre_reg_read) ( mc_pre_reg_read );
+
+   if (MC_(clo_mt_shadow_selftest)) {
+      if (!MC_(clo_mt_shadow))
+         VG_(fmsg_bad_option)("--mt-shadow-selftest=yes",
+                              "It needs --mt-shadow=yes.\n");
+      mt_shadow_selftest();
+   }
 }
 
 static void print_SM_info(const HChar* type, Int n_SMs)
@@ -6662,7 +7621,7 @@ static void mc_fini ( Int exitcode )
                       stats__nia_cache_queries, stats__nia_cache_misses);
       } else {
          tl_assert(ocacheL1 == NULL);
-         tl_assert(ocacheL2 == NULL);
+         tl_assert(ocache_shards[0].l2 == NULL);
       }
    }
 
@@ -6740,6 +7699,7 @@ static void mc_pre_clo_init(void)
    MC_(Malloc_Redzone_SzB) = VG_(malloc_effective_client_redzone_size)();
 
    VG_(needs_xml_output)          ();
+   VG_(needs_persistent_translations) ();
 
    VG_(track_new_mem_startup)     ( mc_new_mem_startup );
 
@@ -6808,7 +7768,7 @@ static void mc_pre_clo_init(void)
       if we need to, since the command line args haven't been
       processed yet.  Hence defer it to mc_post_clo_init. */
    tl_assert(ocacheL1 == NULL);
-   tl_assert(ocacheL2 == NULL);
+   tl_assert(ocache_shards[0].l2 == NULL);
 
    /* Check some important stuff.  See extensive comments above
       re UNALIGNED_OR_HIGH for background. */
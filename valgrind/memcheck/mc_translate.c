@@ -209,6 +209,16 @@ typedef
          arguments of type 'HWord' to be passed to helper functions.
          Ity_I32 or Ity_I64 only. */
       IRType hWordTy;
+
+      /* MODIFIED: NULL, except while instrumenting a load or store
+         which is a member of a coalesced access group (see
+         "Coalescing of loads and stores" below).  Then it is an I1
+         atom which is True at run time iff the member's own shadow
+         load or store still needs to be done.  coVMask then points
+         at the group's cache of 1StoN(coNeeded) for N = 8, 16, 32
+         and 64, used for masking the V bits of skipped loads. */
+      IRExpr*  coNeeded;
+      IRExpr** coVMask;
    }
    MCEnv;
 
@@ -2292,6 +2302,15 @@ IRAtom* unary32Fx8 ( MCEnv* mce, IRAtom* vatomX )
    or for the case when OP is unary (Iop_QNarrowUn*)
 
    Vanilla(OP)( PCast-X-to-X-x-Z(vatom) )
+
+   For the V128 binary cases we can often do better than Vanilla(OP).
+   After the PCast every source lane is either all zeroes or all ones,
+   that is, 0 or -1 when viewed as signed.  Saturating signed-to-signed
+   narrowing maps both of those to themselves, exactly as Vanilla(OP)
+   does.  So we may use the signed-to-signed saturating op of the same
+   shape instead; unlike the vanilla ops, those are single
+   instructions (packsswb, packssdw) on x86 and amd64 hosts, where the
+   vanilla narrowing ops are helper calls.
 */
 static
 IROp vanillaNarrowingOpOfShape ( IROp qnarrowOp )
@@ -2333,6 +2352,28 @@ IROp vanillaNarrowingOpOfShape ( IROp qnarrowOp )
    }
 }
 
+/* Return an op which, applied to PCast'd operands, gives the same
+   result as vanillaNarrowingOpOfShape(qnarrowOp) but is cheaper to
+   evaluate on at least some hosts.  See comment above. */
+static
+IROp pcastNarrowingOpOfShape ( IROp qnarrowOp )
+{
+   switch (qnarrowOp) {
+      case Iop_QNarrowBin16Sto8Ux16:
+      case Iop_QNarrowBin16Sto8Sx16:
+      case Iop_QNarrowBin16Uto8Ux16:
+         return Iop_QNarrowBin16Sto8Sx16;
+      case Iop_QNarrowBin32Sto16Ux8:
+      case Iop_QNarrowBin32Sto16Sx8:
+      case Iop_QNarrowBin32Uto16Ux8:
+         return Iop_QNarrowBin32Sto16Sx8;
+      default:
+         /* No signed-to-signed op of this shape is widely
+            supported. */
+         return vanillaNarrowingOpOfShape(qnarrowOp);
+   }
+}
+
 static
 IRAtom* vectorNarrowBinV128 ( MCEnv* mce, IROp narrow_op, 
                               IRAtom* vatom1, IRAtom* vatom2)
@@ -2350,12 +2391,12 @@ IRAtom* vectorNarrowBinV128 ( MCEnv* mce, IROp narrow_op,
       case Iop_QNarrowBin16Sto8Ux16: pcast = mkPCast16x8; break;
       default: VG_(tool_panic)("vectorNarrowBinV128");
    }
-   IROp vanilla_narrow = vanillaNarrowingOpOfShape(narrow_op);
+   IROp pcast_narrow = pcastNarrowingOpOfShape(narrow_op);
    tl_assert(isShadowAtom(mce,vatom1));
    tl_assert(isShadowAtom(mce,vatom2));
    at1 = assignNew('V', mce, Ity_V128, pcast(mce, vatom1));
    at2 = assignNew('V', mce, Ity_V128, pcast(mce, vatom2));
-   at3 = assignNew('V', mce, Ity_V128, binop(vanilla_narrow, at1, at2));
+   at3 = assignNew('V', mce, Ity_V128, binop(pcast_narrow, at1, at2));
    return at3;
 }
 
@@ -4345,8 +4386,31 @@ IRAtom* expr2vbits_Load_WRK ( MCEnv* mce,
          value (0b01 repeating, 0x55 etc) as that'll still look pretty
          undefined if it ever leaks out. */
    }
+   if (mce->coNeeded) {
+      /* The group's range check may already have shown the loaded
+         bytes to be defined, in which case skip the call. */
+      tl_assert(!guard);
+      di->guard = mce->coNeeded;
+   }
    stmt( 'V', mce, IRStmt_Dirty(di) );
 
+   if (mce->coNeeded) {
+      /* If the call was skipped, the load is defined. */
+      Int  k;
+      IROp opWiden, opAnd;
+      switch (ty) {
+         case Ity_I8:  k = 0; opWiden = Iop_1Sto8;  opAnd = Iop_And8;  break;
+         case Ity_I16: k = 1; opWiden = Iop_1Sto16; opAnd = Iop_And16; break;
+         case Ity_I32: k = 2; opWiden = Iop_1Sto32; opAnd = Iop_And32; break;
+         case Ity_I64: k = 3; opWiden = Iop_1Sto64; opAnd = Iop_And64; break;
+         default: VG_(tool_panic)("memcheck:expr2vbits_Load_WRK(coalesced)");
+      }
+      if (!mce->coVMask[k])
+         mce->coVMask[k] = assignNew('V', mce, ty,
+                                     unop(opWiden, mce->coNeeded));
+      return assignNew('V', mce, ty, binop(opAnd, mkexpr(datavbits),
+                                                  mce->coVMask[k]));
+   }
    return mkexpr(datavbits);
 }
 
@@ -4683,9 +4747,36 @@ void do_shadow_Store ( MCEnv* mce,
       those actions are gated on |guard|. */
    complainIfUndefined( mce, addr, guard );
 
+   /* If the store is a member of a coalesced group, the group's range
+      update may already have marked the bytes as defined.  In that
+      case skip the helper calls. */
+   if (mce->coNeeded) {
+      tl_assert(!guard);
+      guard = mce->coNeeded;
+   }
+
    /* Now decide which helper function to call to write the data V
       bits into shadow memory. */
-   if (end == Iend_LE) {
+   if (end == Iend_LE && MC_(clo_leak_check_incremental)) {
+      /* The same, but also marking the card dirty. */
+      switch (ty) {
+         case Ity_V256: /* we'll use the helper four times */
+         case Ity_V128: /* we'll use the helper twice */
+         case Ity_I64: helper = &MC_(helperc_STOREV64le_card);
+                       hname = "MC_(helperc_STOREV64le_card)";
+                       break;
+         case Ity_I32: helper = &MC_(helperc_STOREV32le_card);
+                       hname = "MC_(helperc_STOREV32le_card)";
+                       break;
+         case Ity_I16: helper = &MC_(helperc_STOREV16le_card);
+                       hname = "MC_(helperc_STOREV16le_card)";
+                       break;
+         case Ity_I8:  helper = &MC_(helperc_STOREV8_card);
+                       hname = "MC_(helperc_STOREV8_card)";
+                       break;
+         default:      VG_(tool_panic)("memcheck:do_shadow_Store(LE)");
+      }
+   } else if (end == Iend_LE) {
       switch (ty) {
          case Ity_V256: /* we'll use the helper four times */
          case Ity_V128: /* we'll use the helper twice */
@@ -4703,6 +4794,23 @@ void do_shadow_Store ( MCEnv* mce,
                        break;
          default:      VG_(tool_panic)("memcheck:do_shadow_Store(LE)");
       }
+   } else if (MC_(clo_leak_check_incremental)) {
+      switch (ty) {
+         case Ity_V128: /* we'll use the helper twice */
+         case Ity_I64: helper = &MC_(helperc_STOREV64be_card);
+                       hname = "MC_(helperc_STOREV64be_card)";
+                       break;
+         case Ity_I32: helper = &MC_(helperc_STOREV32be_card);
+                       hname = "MC_(helperc_STOREV32be_card)";
+                       break;
+         case Ity_I16: helper = &MC_(helperc_STOREV16be_card);
+                       hname = "MC_(helperc_STOREV16be_card)";
+                       break;
+         case Ity_I8:  helper = &MC_(helperc_STOREV8_card);
+                       hname = "MC_(helperc_STOREV8_card)";
+                       break;
+         default:      VG_(tool_panic)("memcheck:do_shadow_Store(BE)");
+      }
    } else {
       switch (ty) {
          case Ity_V128: /* we'll use the helper twice */
@@ -5705,6 +5813,932 @@ static void do_shadow_LoadG ( MCEnv* mce, IRLoadG* lg )
 }
 
 
+/*------------------------------------------------------------*/
+/*--- Removal of redundant shadow computations and checks  ---*/
+/*------------------------------------------------------------*/
+
+/* MC_(final_tidy) removes repeated checks only when their guards are
+   identical trees free of Gets and Loads, and VEX's post-
+   instrumentation cleanup does nothing more than constant propagation
+   and dead code removal.  That leaves a lot of redundant shadow code
+   in instrumented superblocks, for example:
+
+   * memory references at different offsets from the same base
+     register each compute the definedness of their own address,
+     CmpNEZ64(Left64(Or64(base#, 0x0))), although it is the same
+     each time;
+
+   * in an unrolled loop, each copy of the body checks the same
+     values again, for the same instruction addresses.
+
+   removeRedundantChecks tidies this up on the flat instrumented
+   superblock, before VEX's cleanup.  It gives temporaries value
+   numbers, so that two temporaries have the same number if
+
+   * they are computed by the same operation from arguments with the
+     same numbers, or
+
+   * they are Gets of the same piece of (shadow) guest state, with no
+     write to it in between, or a Get and the temporary last Put
+     there, or
+
+   * one is an Or with zero of the other -- that is, a UifU with a
+     defined constant.  Also CmpNEZ(Left(x)) is numbered as
+     CmpNEZ(x), since the two are equal.  Hence a check of
+     base+offset is a check of the base.  Similarly 64to1(1Uto64(x))
+     is numbered as x, so that a check of a condition computed by a
+     specialised flag helper is a check of its CmpNEZ.
+
+   A shadow temporary is known to be defined if it is the defined
+   constant, or is computed from defined values by an operation which
+   maps defined to defined (Left, CmpNEZ, widening, narrowing, UifU,
+   DifD, shifts).  VEX would fold these to constants anyway, but only
+   after this pass.  Knowing it here matters in unrolled loops, where
+   the second and later iterations would otherwise recheck loop
+   invariants whose shadows differ from the first iteration's only
+   in the numbering of the defined temporaries feeding them.
+
+   Then:
+
+   * a call to a MC_(helperc_value_check*_fail*) helper is deleted if
+     an earlier call to the same helper, for the same guest
+     instruction address, has a guard with the same number.  A
+     superblock is straight-line code, so the earlier call has always
+     been done when the later one is reached, and reported the same
+     error from the same place.  (The same address can occur more
+     than once in an unrolled loop.)  Checks for different addresses
+     are different errors, so they are all kept.
+
+   * a shadow temporary whose value is already available in an
+     earlier temporary becomes a copy of it, and CmpNEZ(Left(x)) is
+     computed as CmpNEZ(x).
+
+   Original and shadow temporaries are numbered separately, and only
+   shadow computations are changed.  Shadow state Puts are left as they
+   are, so what a superblock leaves in the shadow guest state is what
+   it would have been without this pass.  VEX's constant propagation
+   and dead code removal then get rid of the shadow code made
+   unnecessary: guards of deleted checks, shadow values folded away
+   by the defined constants, and the Left operations looked through.
+   Checks whose guards fold to False are deleted too. */
+
+static Bool is_helperc_value_checkN_fail ( const HChar* name );
+
+typedef
+   struct { IRExpr* e; IRTemp tmp; }
+   VNEnt;
+
+typedef
+   struct { Int offset; Int size; IRType ty; IRTemp tmp; }
+   VNGet;
+
+typedef
+   struct { Addr64 ip; void* entry; IRTemp guard; }
+   VNCheck;
+
+typedef
+   struct {
+      IRTypeEnv* tyenv;
+      IRTemp*    vn;    /* value number (representative tmp) of each tmp */
+      IRExpr**   defs;  /* flat defining expression of representatives */
+      Bool*      dfnd;  /* representatives known to be all-defined */
+      Bool*      shdw;  /* is the tmp a shadow tmp? */
+   }
+   VNEnv;
+
+static UInt hashVNAtom ( IRExpr* a )
+{
+   IRConst* con;
+   if (a->tag == Iex_RdTmp)
+      return 1 + (UInt)a->Iex.RdTmp.tmp;
+   con = a->Iex.Const.con;
+   switch (con->tag) {
+      case Ico_U1:  return 0x51 + (UInt)con->Ico.U1;
+      case Ico_U8:  return 0x52 + (UInt)con->Ico.U8;
+      case Ico_U16: return 0x53 + (UInt)con->Ico.U16;
+      case Ico_U32: return 0x54 + (UInt)con->Ico.U32;
+      case Ico_U64: return 0x55 + (UInt)con->Ico.U64
+                               + (UInt)(con->Ico.U64 >> 32);
+      default:      return 0x56 + (UInt)con->tag;
+   }
+}
+
+static Bool sameVNAtom ( IRExpr* a1, IRExpr* a2 )
+{
+   if (a1->tag != a2->tag)
+      return False;
+   if (a1->tag == Iex_RdTmp)
+      return a1->Iex.RdTmp.tmp == a2->Iex.RdTmp.tmp;
+   return eqIRConst( a1->Iex.Const.con, a2->Iex.Const.con );
+}
+
+/* Hash and compare the flat expressions which get value numbers.
+   Their arguments have already been replaced by the representatives
+   of their value numbers. */
+static UInt hashVNExpr ( IRExpr* e )
+{
+   UInt h = 0x9E3779B9 * (UInt)e->tag;
+   switch (e->tag) {
+      case Iex_Unop:
+         h = 31 * (h + (UInt)e->Iex.Unop.op) + hashVNAtom(e->Iex.Unop.arg);
+         break;
+      case Iex_Binop:
+         h = 31 * (h + (UInt)e->Iex.Binop.op)
+             + hashVNAtom(e->Iex.Binop.arg1);
+         h = 31 * h + hashVNAtom(e->Iex.Binop.arg2);
+         break;
+      case Iex_Triop:
+         h = 31 * (h + (UInt)e->Iex.Triop.details->op)
+             + hashVNAtom(e->Iex.Triop.details->arg1);
+         h = 31 * h + hashVNAtom(e->Iex.Triop.details->arg2);
+         h = 31 * h + hashVNAtom(e->Iex.Triop.details->arg3);
+         break;
+      case Iex_Qop:
+         h = 31 * (h + (UInt)e->Iex.Qop.details->op)
+             + hashVNAtom(e->Iex.Qop.details->arg1);
+         h = 31 * h + hashVNAtom(e->Iex.Qop.details->arg2);
+         h = 31 * h + hashVNAtom(e->Iex.Qop.details->arg3);
+         h = 31 * h + hashVNAtom(e->Iex.Qop.details->arg4);
+         break;
+      case Iex_ITE:
+         h = 31 * h + hashVNAtom(e->Iex.ITE.cond);
+         h = 31 * h + hashVNAtom(e->Iex.ITE.iftrue);
+         h = 31 * h + hashVNAtom(e->Iex.ITE.iffalse);
+         break;
+      default:
+         VG_(tool_panic)("memcheck:hashVNExpr");
+   }
+   return h ^ (h >> 15);
+}
+
+static Bool sameVNExpr ( IRExpr* e1, IRExpr* e2 )
+{
+   if (e1->tag != e2->tag)
+      return False;
+   switch (e1->tag) {
+      case Iex_Unop:
+         return e1->Iex.Unop.op == e2->Iex.Unop.op
+                && sameVNAtom(e1->Iex.Unop.arg, e2->Iex.Unop.arg);
+      case Iex_Binop:
+         return e1->Iex.Binop.op == e2->Iex.Binop.op
+                && sameVNAtom(e1->Iex.Binop.arg1, e2->Iex.Binop.arg1)
+                && sameVNAtom(e1->Iex.Binop.arg2, e2->Iex.Binop.arg2);
+      case Iex_Triop: {
+         IRTriop* t1 = e1->Iex.Triop.details;
+         IRTriop* t2 = e2->Iex.Triop.details;
+         return t1->op == t2->op
+                && sameVNAtom(t1->arg1, t2->arg1)
+                && sameVNAtom(t1->arg2, t2->arg2)
+                && sameVNAtom(t1->arg3, t2->arg3);
+      }
+      case Iex_Qop: {
+         IRQop* q1 = e1->Iex.Qop.details;
+         IRQop* q2 = e2->Iex.Qop.details;
+         return q1->op == q2->op
+                && sameVNAtom(q1->arg1, q2->arg1)
+                && sameVNAtom(q1->arg2, q2->arg2)
+                && sameVNAtom(q1->arg3, q2->arg3)
+                && sameVNAtom(q1->arg4, q2->arg4);
+      }
+      case Iex_ITE:
+         return sameVNAtom(e1->Iex.ITE.cond, e2->Iex.ITE.cond)
+                && sameVNAtom(e1->Iex.ITE.iftrue, e2->Iex.ITE.iftrue)
+                && sameVNAtom(e1->Iex.ITE.iffalse, e2->Iex.ITE.iffalse);
+      default:
+         VG_(tool_panic)("memcheck:sameVNExpr");
+   }
+}
+
+/* If |e| is Left(x) or CmpNEZ(x) with x a tmp, return x, else
+   NULL.  If |isLeft| is non-NULL, say which. */
+static IRExpr* vnLeftOrCmpNEZArg ( IRExpr* e, Bool* isLeft )
+{
+   if (!e || e->tag != Iex_Unop || e->Iex.Unop.arg->tag != Iex_RdTmp)
+      return NULL;
+   switch (e->Iex.Unop.op) {
+      case Iop_Left8: case Iop_Left16: case Iop_Left32: case Iop_Left64:
+         if (isLeft) *isLeft = True;
+         return e->Iex.Unop.arg;
+      case Iop_CmpNEZ8: case Iop_CmpNEZ16:
+      case Iop_CmpNEZ32: case Iop_CmpNEZ64:
+         if (isLeft) *isLeft = False;
+         return e->Iex.Unop.arg;
+      default:
+         return NULL;
+   }
+}
+
+/* Is the value with representative |rep| known to be defined?
+   Left(x) is defined if x is. */
+static Bool vnIsDefined ( VNEnv* env, IRTemp rep )
+{
+   Bool    isLeft;
+   IRExpr* x;
+   if (env->dfnd[rep])
+      return True;
+   x = vnLeftOrCmpNEZArg(env->defs[rep], &isLeft);
+   return x && isLeft && env->dfnd[x->Iex.RdTmp.tmp];
+}
+
+/* Replace a tmp by the representative of its value number, or by the
+   defined value if it is known to be defined. */
+static IRExpr* vnAtom ( VNEnv* env, IRExpr* a )
+{
+   IRTemp rep;
+   if (a->tag != Iex_RdTmp)
+      return a;
+   rep = env->vn[a->Iex.RdTmp.tmp];
+   if (vnIsDefined(env, rep))
+      return definedOfType(env->tyenv->types[a->Iex.RdTmp.tmp]);
+   if (rep != a->Iex.RdTmp.tmp)
+      return IRExpr_RdTmp(rep);
+   return a;
+}
+
+static Bool isZeroU ( IRExpr* a )
+{
+   IRConst* con;
+   if (a->tag != Iex_Const)
+      return False;
+   con = a->Iex.Const.con;
+   switch (con->tag) {
+      case Ico_U1:   return con->Ico.U1  == False;
+      case Ico_U8:   return con->Ico.U8  == 0;
+      case Ico_U16:  return con->Ico.U16 == 0;
+      case Ico_U32:  return con->Ico.U32 == 0;
+      case Ico_U64:  return con->Ico.U64 == 0;
+      case Ico_V128: return con->Ico.V128 == 0;
+      case Ico_V256: return con->Ico.V256 == 0;
+      default:       return False;
+   }
+}
+
+/* If |e| is an Or of a tmp with zero, return the tmp, else NULL. */
+static IRExpr* vnOrZeroArg ( IRExpr* e )
+{
+   IRExpr* x = NULL;
+   if (e->tag != Iex_Binop)
+      return NULL;
+   switch (e->Iex.Binop.op) {
+      case Iop_Or8: case Iop_Or16: case Iop_Or32: case Iop_Or64:
+      case Iop_OrV128: case Iop_OrV256:
+         if (isZeroU(e->Iex.Binop.arg2))
+            x = e->Iex.Binop.arg1;
+         else if (isZeroU(e->Iex.Binop.arg1))
+            x = e->Iex.Binop.arg2;
+         break;
+      default:
+         break;
+   }
+   return x && x->tag == Iex_RdTmp ? x : NULL;
+}
+
+/* Can a shadow tmp of type |ty| be replaced by definedOfType? */
+static Bool vnCanBeDefined ( IRType ty )
+{
+   switch (ty) {
+      case Ity_I1: case Ity_I8: case Ity_I16: case Ity_I32: case Ity_I64:
+      case Ity_V128:
+         return True;
+      default:
+         return False;
+   }
+}
+
+/* Is the flat shadow expression |e|, whose arguments have already
+   been replaced by their representatives or by the defined value,
+   defined because its arguments are? */
+static Bool vnDefinedExpr ( IRExpr* e )
+{
+   if (e->tag == Iex_Unop) {
+      switch (e->Iex.Unop.op) {
+         case Iop_Left8: case Iop_Left16: case Iop_Left32: case Iop_Left64:
+         case Iop_CmpNEZ8: case Iop_CmpNEZ16:
+         case Iop_CmpNEZ32: case Iop_CmpNEZ64:
+         case Iop_CmpwNEZ32: case Iop_CmpwNEZ64:
+         case Iop_1Uto8: case Iop_1Uto32: case Iop_1Uto64:
+         case Iop_1Sto8: case Iop_1Sto16: case Iop_1Sto32: case Iop_1Sto64:
+         case Iop_8Uto16: case Iop_8Uto32: case Iop_8Uto64:
+         case Iop_8Sto16: case Iop_8Sto32: case Iop_8Sto64:
+         case Iop_16Uto32: case Iop_16Uto64:
+         case Iop_16Sto32: case Iop_16Sto64:
+         case Iop_32Uto64: case Iop_32Sto64:
+         case Iop_64to1: case Iop_64to8: case Iop_64to16: case Iop_64to32:
+         case Iop_32to1: case Iop_32to8: case Iop_32to16: case Iop_16to8:
+         case Iop_64HIto32: case Iop_32HIto16: case Iop_16HIto8:
+            return isZeroU(e->Iex.Unop.arg);
+         default:
+            return False;
+      }
+   }
+   if (e->tag == Iex_Binop) {
+      IRExpr* a1 = e->Iex.Binop.arg1;
+      IRExpr* a2 = e->Iex.Binop.arg2;
+      switch (e->Iex.Binop.op) {
+         case Iop_Or8: case Iop_Or16: case Iop_Or32: case Iop_Or64:
+         case Iop_OrV128:
+         case Iop_8HLto16: case Iop_16HLto32: case Iop_32HLto64:
+         case Iop_64HLtoV128:
+            return isZeroU(a1) && isZeroU(a2);
+         case Iop_And8: case Iop_And16: case Iop_And32: case Iop_And64:
+         case Iop_AndV128:
+            return isZeroU(a1) || isZeroU(a2);
+         case Iop_Shl8: case Iop_Shl16: case Iop_Shl32: case Iop_Shl64:
+         case Iop_Shr8: case Iop_Shr16: case Iop_Shr32: case Iop_Shr64:
+         case Iop_Sar8: case Iop_Sar16: case Iop_Sar32: case Iop_Sar64:
+            return isZeroU(a1);
+         default:
+            return False;
+      }
+   }
+   return False;
+}
+
+/* Forget the tracked Gets overlapping [offset, offset+size). */
+static void vnKillGets ( XArray* /* of VNGet */ gets, Int offset, Int size )
+{
+   Word i;
+   for (i = VG_(sizeXA)( gets ) - 1; i >= 0; i--) {
+      VNGet* g = VG_(indexXA)( gets, i );
+      if (g->offset < offset + size && offset < g->offset + g->size)
+         VG_(removeIndexXA)( gets, i );
+   }
+}
+
+static void removeRedundantChecks ( MCEnv* mce )
+{
+   IRSB*    sb      = mce->sb;
+   Int      n_tmps  = sb->tyenv->types_used;
+   Int      n_slots = 64;
+   Int      n_del   = 0;
+   VNEnv    env;
+   VNEnt*   tab;
+   XArray*  gets;
+   XArray*  checks;
+   Addr64   ip      = 0;
+   Int      i, j, k;
+
+   if (n_tmps == 0)
+      return;
+
+   while (n_slots < 2 * sb->stmts_used)
+      n_slots *= 2;
+
+   env.tyenv = sb->tyenv;
+   env.vn    = VG_(malloc)( "mc.rrc.1", n_tmps * sizeof(IRTemp) );
+   env.defs  = VG_(malloc)( "mc.rrc.2", n_tmps * sizeof(IRExpr*) );
+   env.dfnd  = VG_(malloc)( "mc.rrc.3", n_tmps * sizeof(Bool) );
+   env.shdw  = VG_(malloc)( "mc.rrc.7", n_tmps * sizeof(Bool) );
+   tab    = VG_(malloc)( "mc.rrc.4", n_slots * sizeof(VNEnt) );
+   gets   = VG_(newXA)( VG_(malloc), "mc.rrc.5", VG_(free), sizeof(VNGet) );
+   checks = VG_(newXA)( VG_(malloc), "mc.rrc.6", VG_(free),
+                        sizeof(VNCheck) );
+   for (i = 0; i < n_tmps; i++) {
+      TempMapEnt* ent = VG_(indexXA)( mce->tmpMap, (Word)i );
+      env.vn[i]   = i;
+      env.defs[i] = NULL;
+      env.dfnd[i] = False;
+      env.shdw[i] = ent->kind != Orig;
+   }
+   for (i = 0; i < n_slots; i++)
+      tab[i].e = NULL;
+
+   for (i = 0; i < sb->stmts_used; i++) {
+      IRStmt* st = sb->stmts[i];
+      switch (st->tag) {
+
+         case Ist_WrTmp: {
+            IRTemp      dst  = st->Ist.WrTmp.tmp;
+            IRExpr*     e    = st->Ist.WrTmp.data;
+            IRExpr*     ne   = NULL;
+            IRTemp      rep  = IRTemp_INVALID;
+            switch (e->tag) {
+               case Iex_RdTmp:
+                  rep = env.vn[e->Iex.RdTmp.tmp];
+                  break;
+               case Iex_Get:
+                  for (k = 0; k < VG_(sizeXA)( gets ); k++) {
+                     VNGet* g = VG_(indexXA)( gets, k );
+                     if (g->offset == e->Iex.Get.offset
+                         && g->ty == e->Iex.Get.ty) {
+                        rep = g->tmp;
+                        break;
+                     }
+                  }
+                  if (rep == IRTemp_INVALID) {
+                     VNGet g;
+                     g.offset = e->Iex.Get.offset;
+                     g.size   = sizeofIRType(e->Iex.Get.ty);
+                     g.ty     = e->Iex.Get.ty;
+                     g.tmp    = dst;
+                     VG_(addToXA)( gets, &g );
+                  }
+                  break;
+               case Iex_Unop: {
+                  IRExpr* arg = vnAtom(&env, e->Iex.Unop.arg);
+                  IRExpr* x;
+                  Bool    isLeft;
+                  ne = IRExpr_Unop(e->Iex.Unop.op, arg);
+                  /* CmpNEZ(Left(x)) == CmpNEZ(x), for the same width */
+                  if (arg->tag == Iex_RdTmp
+                      && vnLeftOrCmpNEZArg(ne, &isLeft) && !isLeft
+                      && (x = vnLeftOrCmpNEZArg(env.defs[arg->Iex.RdTmp.tmp],
+                                                &isLeft)) && isLeft
+                      && env.tyenv->types[x->Iex.RdTmp.tmp]
+                         == env.tyenv->types[arg->Iex.RdTmp.tmp])
+                     ne = IRExpr_Unop(e->Iex.Unop.op, x);
+                  /* 64to1(1Uto64(x)) == x, and likewise for 32 bits */
+                  if ((e->Iex.Unop.op == Iop_64to1
+                       || e->Iex.Unop.op == Iop_32to1)
+                      && arg->tag == Iex_RdTmp
+                      && (x = env.defs[arg->Iex.RdTmp.tmp]) != NULL
+                      && x->tag == Iex_Unop
+                      && x->Iex.Unop.op == (e->Iex.Unop.op == Iop_64to1
+                                               ? Iop_1Uto64 : Iop_1Uto32)
+                      && x->Iex.Unop.arg->tag == Iex_RdTmp) {
+                     rep = x->Iex.Unop.arg->Iex.RdTmp.tmp;
+                     ne  = NULL;
+                  }
+                  break;
+               }
+               case Iex_Binop:
+                  ne = IRExpr_Binop(e->Iex.Binop.op,
+                                    vnAtom(&env, e->Iex.Binop.arg1),
+                                    vnAtom(&env, e->Iex.Binop.arg2));
+                  if (vnOrZeroArg(ne)) {
+                     rep = vnOrZeroArg(ne)->Iex.RdTmp.tmp;
+                     ne  = NULL;
+                  }
+                  break;
+               case Iex_Triop: {
+                  IRTriop* t = e->Iex.Triop.details;
+                  ne = IRExpr_Triop(t->op, vnAtom(&env, t->arg1),
+                                    vnAtom(&env, t->arg2),
+                                    vnAtom(&env, t->arg3));
+                  break;
+               }
+               case Iex_Qop: {
+                  IRQop* q = e->Iex.Qop.details;
+                  ne = IRExpr_Qop(q->op, vnAtom(&env, q->arg1),
+                                  vnAtom(&env, q->arg2),
+                                  vnAtom(&env, q->arg3),
+                                  vnAtom(&env, q->arg4));
+                  break;
+               }
+               case Iex_ITE:
+                  ne = IRExpr_ITE(vnAtom(&env, e->Iex.ITE.cond),
+                                  vnAtom(&env, e->Iex.ITE.iftrue),
+                                  vnAtom(&env, e->Iex.ITE.iffalse));
+                  break;
+               case Iex_Const:
+                  if (env.shdw[dst] && isZeroU(e)
+                      && vnCanBeDefined(env.tyenv->types[dst]))
+                     env.dfnd[dst] = True;
+                  break;
+               default:
+                  /* Loads, GetIs and CCalls just get their own value
+                     numbers. */
+                  break;
+            }
+            if (ne) {
+               j = hashVNExpr(ne) & (n_slots - 1);
+               while (tab[j].e
+                      && (env.shdw[tab[j].tmp] != env.shdw[dst]
+                          || !sameVNExpr(tab[j].e, ne)))
+                  j = (j + 1) & (n_slots - 1);
+               if (tab[j].e) {
+                  rep = tab[j].tmp;
+               } else {
+                  tab[j].e      = ne;
+                  tab[j].tmp    = dst;
+                  env.defs[dst] = ne;
+                  if (env.shdw[dst] && vnDefinedExpr(ne)
+                      && vnCanBeDefined(env.tyenv->types[dst]))
+                     env.dfnd[dst] = True;
+               }
+            }
+            if (rep != IRTemp_INVALID && env.shdw[rep] != env.shdw[dst])
+               rep = IRTemp_INVALID;
+            if (rep != IRTemp_INVALID)
+               env.vn[dst] = rep;
+
+            /* Only shadow computations are rewritten. */
+            if (!env.shdw[dst] || e->tag == Iex_RdTmp)
+               break;
+            if (vnIsDefined(&env, env.vn[dst]))
+               sb->stmts[i]
+                  = IRStmt_WrTmp(dst, definedOfType(env.tyenv->types[dst]));
+            else if (rep != IRTemp_INVALID && rep != dst)
+               sb->stmts[i] = IRStmt_WrTmp(dst, IRExpr_RdTmp(rep));
+            else if (ne)
+               sb->stmts[i] = IRStmt_WrTmp(dst, ne);
+            break;
+         }
+
+         case Ist_Put: {
+            IRExpr* data = st->Ist.Put.data;
+            IRType  ty   = typeOfIRExpr(sb->tyenv, data);
+            VNGet   g;
+            vnKillGets( gets, st->Ist.Put.offset, sizeofIRType(ty) );
+            if (data->tag != Iex_RdTmp)
+               break;
+            g.offset = st->Ist.Put.offset;
+            g.size   = sizeofIRType(ty);
+            g.ty     = ty;
+            g.tmp    = env.vn[data->Iex.RdTmp.tmp];
+            VG_(addToXA)( gets, &g );
+            break;
+         }
+
+         case Ist_IMark:
+            ip = st->Ist.IMark.addr;
+            break;
+
+         case Ist_PutI:
+            VG_(dropTailXA)( gets, VG_(sizeXA)( gets ) );
+            break;
+
+         case Ist_Dirty: {
+            IRDirty* di = st->Ist.Dirty.details;
+            IRTemp   g;
+            for (k = 0; k < di->nFxState; k++) {
+               if (di->fxState[k].fx == Ifx_Read)
+                  continue;
+               if (di->fxState[k].nRepeats > 0)
+                  VG_(dropTailXA)( gets, VG_(sizeXA)( gets ) );
+               else
+                  vnKillGets( gets, di->fxState[k].offset,
+                              di->fxState[k].size );
+            }
+            if (di->guard->tag != Iex_RdTmp
+                || !is_helperc_value_checkN_fail( di->cee->name ))
+               break;
+            g = env.vn[di->guard->Iex.RdTmp.tmp];
+            for (k = 0; k < VG_(sizeXA)( checks ); k++) {
+               VNCheck* c = VG_(indexXA)( checks, k );
+               if (c->ip == ip && c->entry == di->cee->addr
+                   && c->guard == g)
+                  break;
+            }
+            if (k < VG_(sizeXA)( checks )) {
+               sb->stmts[i] = IRStmt_NoOp();
+               n_del++;
+            } else {
+               VNCheck c;
+               c.ip    = ip;
+               c.entry = di->cee->addr;
+               c.guard = g;
+               VG_(addToXA)( checks, &c );
+            }
+            break;
+         }
+
+         default:
+            break;
+      }
+   }
+
+   if (0) VG_(printf)("removeRedundantChecks: %d checks removed\n", n_del);
+
+   VG_(deleteXA)( checks );
+   VG_(deleteXA)( gets );
+   VG_(free)( tab );
+   VG_(free)( env.shdw );
+   VG_(free)( env.dfnd );
+   VG_(free)( env.defs );
+   VG_(free)( env.vn );
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Coalescing of loads and stores                       ---*/
+/*------------------------------------------------------------*/
+
+/* Code often does several memory accesses at small constant offsets
+   from one base address in a single superblock -- walking the fields
+   of a struct, spilling or reloading registers in a prologue or an
+   epilogue, zeroing a local array.  Each of those normally gets its
+   own LOADV/STOREV helper call, and hence its own secondary map
+   lookup.
+
+   So before instrumenting, the superblock is scanned for groups of
+   accesses whose addresses are (base tmp + constant), all with the
+   same base tmp, where the bytes they touch fit inside a window of
+   MC_RANGE_SPAN bytes.  There are two kinds of group:
+
+   * loads of up to 8 bytes, with no intervening statement that could
+     make memory less defined or less addressable (stores of data not
+     known to be defined, dirty calls, CASs, etc).
+
+   * stores of data known to be defined (constant data, or any data
+     at --undef-value-errors=no), with no intervening statement that
+     could read shadow memory or leave the superblock.
+
+   At the first member of a group, a single call to
+   MC_(helperc_LOADV_range) or MC_(helperc_STOREV_range_defined)
+   handles the bytes touched by all members, described by a base
+   address and a mask.  The former says whether they are all
+   defined.  The latter marks them all as defined, provided that they
+   are all addressable and not partially defined.  When the call
+   succeeds, the members' own helper calls are skipped (they are
+   guarded by the result), and loads get 'all defined' V bits.  When
+   it does not, the members run exactly as they would have without
+   coalescing, so error reporting is unaffected.  Groups with fewer
+   than CO_MIN_MEMBERS members are not worth the extra call.
+
+   The definedness checks on the addresses are left as they are;
+   they are cheap and independent of shadow memory. */
+
+#define CO_N_OPEN       4
+#define CO_MIN_MEMBERS  3
+
+/* Skipping a load's helper call needs a conditional call which
+   returns a value, and not all back ends can do those yet. */
+#if defined(VGA_amd64)
+#  define CO_LOADS  1
+#else
+#  define CO_LOADS  0
+#endif
+
+/* An address, as base tmp plus constant offset.  The base is
+   IRTemp_INVALID for a constant address. */
+typedef
+   struct {
+      IRTemp base;
+      Long   off;
+   }
+   COAddr;
+
+typedef
+   struct {
+      Bool    isStore;
+      IRTemp  base;
+      Long    lo, hi;   /* members touch at most [base+lo, base+hi) */
+      ULong   mask;     /* bit i set: byte base+lo+i is touched */
+      Int     nMembers;
+      IRAtom* needed;   /* see MCEnv.coNeeded; NULL until emitted */
+      IRAtom* vmask[4]; /* see MCEnv.coVMask; NULL until emitted */
+   }
+   COGroup;
+
+static Bool coConstOf ( IRExpr* e, Long* v )
+{
+   if (e->tag != Iex_Const)
+      return False;
+   switch (e->Iex.Const.con->tag) {
+      case Ico_U32: *v = (Long)(Int)e->Iex.Const.con->Ico.U32; return True;
+      case Ico_U64: *v = (Long)e->Iex.Const.con->Ico.U64;      return True;
+      default:      return False;
+   }
+}
+
+static COAddr coAddrOf ( COAddr* tmpAddr, IRExpr* a )
+{
+   COAddr r;
+   if (a->tag == Iex_RdTmp)
+      return tmpAddr[a->Iex.RdTmp.tmp];
+   r.base = IRTemp_INVALID;
+   r.off  = 0;
+   coConstOf(a, &r.off);
+   return r;
+}
+
+/* Remove the open groups of the given kind from the open list. */
+static void coClose ( XArray* groups, Int* open, Int* nOpen, Bool stores )
+{
+   Int i, j;
+   for (i = j = 0; i < *nOpen; i++) {
+      COGroup* g = VG_(indexXA)( groups, open[i] );
+      if (g->isStore != stores)
+         open[j++] = open[i];
+   }
+   *nOpen = j;
+}
+
+/* Add an access of |sz| bytes at |a|, done by statement |ix|, to a
+   suitable open group, or else start a new group for it. */
+static void coAdd ( XArray* groups, Int* open, Int* nOpen, Int* groupOf,
+                    Bool isStore, COAddr a, Int sz, Int ix )
+{
+   COGroup g;
+   Int     i;
+
+   if (sz > (Int)MC_RANGE_SPAN)
+      return;
+
+   for (i = 0; i < *nOpen; i++) {
+      COGroup* og = VG_(indexXA)( groups, open[i] );
+      Long     lo = og->lo < a.off ? og->lo : a.off;
+      Long     hi = og->hi > a.off + sz ? og->hi : a.off + sz;
+      if (og->isStore != isStore || og->base != a.base
+          || hi - lo > (Long)MC_RANGE_SPAN)
+         continue;
+      og->mask <<= og->lo - lo;
+      og->mask  |= ((1ULL << sz) - 1) << (a.off - lo);
+      og->lo     = lo;
+      og->hi     = hi;
+      og->nMembers++;
+      groupOf[ix] = open[i];
+      return;
+   }
+
+   if (*nOpen == CO_N_OPEN) {
+      for (i = 1; i < CO_N_OPEN; i++)
+         open[i-1] = open[i];
+      (*nOpen)--;
+   }
+   g.isStore  = isStore;
+   g.base     = a.base;
+   g.lo       = a.off;
+   g.hi       = a.off + sz;
+   g.mask     = (1ULL << sz) - 1;
+   g.nMembers = 1;
+   g.needed   = NULL;
+   g.vmask[0] = g.vmask[1] = g.vmask[2] = g.vmask[3] = NULL;
+   groupOf[ix]     = VG_(addToXA)( groups, &g );
+   open[(*nOpen)++] = groupOf[ix];
+}
+
+/* Scan |sb_in| for coalescable accesses.  Fills in |groups| and
+   returns an array giving, for each statement, the index of the group
+   it is a member of, or -1. */
+static Int* coFindGroups ( MCEnv* mce, IRSB* sb_in, XArray* groups )
+{
+   IROp    opAdd   = mce->hWordTy == Ity_I32 ? Iop_Add32 : Iop_Add64;
+   IROp    opSub   = mce->hWordTy == Ity_I32 ? Iop_Sub32 : Iop_Sub64;
+   Int     n_tmps  = sb_in->tyenv->types_used;
+   Int*    groupOf = VG_(malloc)( "mc.coFindGroups.1",
+                                  sb_in->stmts_used * sizeof(Int) );
+   COAddr* tmpAddr = VG_(malloc)( "mc.coFindGroups.2",
+                                  (n_tmps ? n_tmps : 1) * sizeof(COAddr) );
+   Int     open[CO_N_OPEN];
+   Int     nOpen   = 0;
+   Int     i, sz;
+
+   for (i = 0; i < n_tmps; i++) {
+      tmpAddr[i].base = i;
+      tmpAddr[i].off  = 0;
+   }
+
+   for (i = 0; i < sb_in->stmts_used; i++) {
+      IRStmt* st = sb_in->stmts[i];
+      IRExpr* e;
+      Long    c;
+      groupOf[i] = -1;
+
+      switch (st->tag) {
+
+         case Ist_WrTmp:
+            e = st->Ist.WrTmp.data;
+            if (e->tag == Iex_Load) {
+               coClose( groups, open, &nOpen, True/*stores*/ );
+               switch (CO_LOADS ? e->Iex.Load.ty : Ity_INVALID) {
+                  case Ity_I8: case Ity_I16: case Ity_I32: case Ity_I64:
+                  case Ity_F32: case Ity_F64:
+                     coAdd( groups, open, &nOpen, groupOf, False,
+                            coAddrOf(tmpAddr, e->Iex.Load.addr),
+                            sizeofIRType(e->Iex.Load.ty), i );
+                     break;
+                  default:
+                     break;
+               }
+            }
+            else if (e->tag == Iex_RdTmp) {
+               tmpAddr[st->Ist.WrTmp.tmp] = tmpAddr[e->Iex.RdTmp.tmp];
+            }
+            else if (e->tag == Iex_Binop
+                     && (e->Iex.Binop.op == opAdd || e->Iex.Binop.op == opSub)
+                     && e->Iex.Binop.arg1->tag == Iex_RdTmp
+                     && coConstOf(e->Iex.Binop.arg2, &c)) {
+               COAddr* d = &tmpAddr[st->Ist.WrTmp.tmp];
+               *d = tmpAddr[e->Iex.Binop.arg1->Iex.RdTmp.tmp];
+               d->off = (Long)((ULong)d->off
+                               + (e->Iex.Binop.op == opAdd ? (ULong)c
+                                                           : -(ULong)c));
+            }
+            else if (e->tag == Iex_Binop && e->Iex.Binop.op == opAdd
+                     && e->Iex.Binop.arg2->tag == Iex_RdTmp
+                     && coConstOf(e->Iex.Binop.arg1, &c)) {
+               COAddr* d = &tmpAddr[st->Ist.WrTmp.tmp];
+               *d = tmpAddr[e->Iex.Binop.arg2->Iex.RdTmp.tmp];
+               d->off = (Long)((ULong)d->off + (ULong)c);
+            }
+            break;
+
+         case Ist_Store:
+            sz = 0;
+            if (st->Ist.Store.data->tag == Iex_Const
+                || MC_(clo_mc_level) == 1) {
+               switch (typeOfIRExpr(sb_in->tyenv, st->Ist.Store.data)) {
+                  case Ity_I8: case Ity_I16: case Ity_I32: case Ity_I64:
+                  case Ity_F32: case Ity_F64: case Ity_V128: case Ity_V256:
+                     sz = sizeofIRType(typeOfIRExpr(sb_in->tyenv,
+                                                    st->Ist.Store.data));
+                     break;
+                  default:
+                     break;
+               }
+            }
+            if (sz > 0) {
+               /* Storing defined data can't invalidate a load group's
+                  conclusion that its bytes are defined. */
+               coAdd( groups, open, &nOpen, groupOf, True,
+                      coAddrOf(tmpAddr, st->Ist.Store.addr), sz, i );
+            } else {
+               nOpen = 0;
+            }
+            break;
+
+         case Ist_LoadG:
+         case Ist_Exit:
+            coClose( groups, open, &nOpen, True/*stores*/ );
+            break;
+
+         case Ist_Put:
+         case Ist_PutI:
+         case Ist_IMark:
+         case Ist_NoOp:
+            break;
+
+         default:
+            /* StoreG, Dirty, CAS, LLSC, MBE, AbiHint: any of these
+               may read or write shadow memory. */
+            nOpen = 0;
+            break;
+      }
+   }
+
+   VG_(free)( tmpAddr );
+   return groupOf;
+}
+
+/* Set mce->coNeeded for instrumenting a member of group |gix| (or for
+   a non-member, if |gix| is -1).  At the group's first member, emit
+   the range call. */
+static void coEnter ( MCEnv* mce, XArray* groups, Int gix )
+{
+   COGroup* g;
+   IRType   tyH = mce->hWordTy;
+   IRAtom*  addr;
+   IRAtom*  vmask;
+   IRTemp   res;
+   IRDirty* di;
+   ULong    vm;
+   Int      i;
+
+   mce->coNeeded = NULL;
+   if (gix < 0)
+      return;
+   g = VG_(indexXA)( groups, gix );
+   if (g->nMembers < CO_MIN_MEMBERS)
+      return;
+
+   if (!g->needed) {
+      if (g->base == IRTemp_INVALID)
+         addr = tyH == Ity_I32 ? mkU32((UInt)g->lo) : mkU64((ULong)g->lo);
+      else if (g->lo == 0)
+         addr = mkexpr(g->base);
+      else
+         addr = assignNew('V', mce, tyH,
+                          tyH == Ity_I32
+                             ? binop(Iop_Add32, mkexpr(g->base),
+                                                mkU32((UInt)g->lo))
+                             : binop(Iop_Add64, mkexpr(g->base),
+                                                mkU64((ULong)g->lo)));
+      /* The helpers take a mask with 2 bits per byte, as in
+         shadow memory. */
+      for (vm = 0, i = 0; i < g->hi - g->lo; i++)
+         if (g->mask & (1ULL << i))
+            vm |= 3ULL << (2 * i);
+      vmask = tyH == Ity_I32 ? mkU32((UInt)vm) : mkU64(vm);
+      res = newTemp(mce, tyH, VSh);
+      if (g->isStore && MC_(clo_leak_check_incremental))
+         di = unsafeIRDirty_1_N(
+                 res, 2/*regparms*/, "MC_(helperc_STOREV_range_defined_card)",
+                 VG_(fnptr_to_fnentry)(
+                    &MC_(helperc_STOREV_range_defined_card) ),
+                 mkIRExprVec_2( addr, vmask ));
+      else if (g->isStore)
+         di = unsafeIRDirty_1_N(
+                 res, 2/*regparms*/, "MC_(helperc_STOREV_range_defined)",
+                 VG_(fnptr_to_fnentry)( &MC_(helperc_STOREV_range_defined) ),
+                 mkIRExprVec_2( addr, vmask ));
+      else
+         di = unsafeIRDirty_1_N(
+                 res, 2/*regparms*/, "MC_(helperc_LOADV_range)",
+                 VG_(fnptr_to_fnentry)( &MC_(helperc_LOADV_range) ),
+                 mkIRExprVec_2( addr, vmask ));
+      stmt( 'V', mce, IRStmt_Dirty(di) );
+      g->needed = assignNew('V', mce, Ity_I1,
+                            tyH == Ity_I32
+                               ? binop(Iop_CmpEQ32, mkexpr(res), mkU32(0))
+                               : binop(Iop_CmpEQ64, mkexpr(res), mkU64(0)));
+   }
+   mce->coNeeded = g->needed;
+   mce->coVMask  = g->vmask;
+}
+
+
 /*------------------------------------------------------------*/
 /*--- Memcheck main                                        ---*/
 /*------------------------------------------------------------*/
@@ -5863,6 +6897,8 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
    IRStmt* st;
    MCEnv   mce;
    IRSB*   sb_out;
+   XArray* coGroups;
+   Int*    coGroupOf;
 
    if (gWordTy != hWordTy) {
       /* We don't currently support this case. */
@@ -5947,6 +6983,12 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
 
    mce.bogusLiterals = bogus;
 
+   /* Find the loads and stores whose shadow accesses can be
+      coalesced. */
+   coGroups  = VG_(newXA)( VG_(malloc), "mc.MC_(instrument).2", VG_(free),
+                           sizeof(COGroup) );
+   coGroupOf = coFindGroups( &mce, sb_in, coGroups );
+
    /* Copy verbatim any IR preamble preceding the first IMark */
 
    tl_assert(mce.sb == sb_out);
@@ -6032,6 +7074,8 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
 
       /* Generate instrumentation code for each stmt ... */
 
+      coEnter( &mce, coGroups, coGroupOf[i] );
+
       switch (st->tag) {
 
          case Ist_WrTmp:
@@ -6113,6 +7157,8 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
 
       } /* switch (st->tag) */
 
+      mce.coNeeded = NULL;
+
       if (0 && verboze) {
          for (j = first_stmt; j < sb_out->stmts_used; j++) {
             VG_(printf)("   ");
@@ -6140,6 +7186,11 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
 
    complainIfUndefined( &mce, sb_in->next, NULL );
 
+   removeRedundantChecks( &mce );
+
+   VG_(free)( coGroupOf );
+   VG_(deleteXA)( coGroups );
+
    if (0 && verboze) {
       for (j = first_stmt; j < sb_out->stmts_used; j++) {
          VG_(printf)("   ");
@@ -6261,7 +7312,9 @@ static Bool is_helperc_value_checkN_fail ( const HChar* name )
       || 0==VG_(strcmp)(name, "MC_(helperc_value_check0_fail_w_o)")
       || 0==VG_(strcmp)(name, "MC_(helperc_value_check1_fail_w_o)")
       || 0==VG_(strcmp)(name, "MC_(helperc_value_check4_fail_w_o)")
-      || 0==VG_(strcmp)(name, "MC_(helperc_value_check8_fail_w_o)");
+      || 0==VG_(strcmp)(name, "MC_(helperc_value_check8_fail_w_o)")
+      || 0==VG_(strcmp)(name, "MC_(helperc_value_checkN_fail_no_o)")
+      || 0==VG_(strcmp)(name, "MC_(helperc_value_checkN_fail_w_o)");
 }
 
 IRSB* MC_(final_tidy) ( IRSB* sb_in )
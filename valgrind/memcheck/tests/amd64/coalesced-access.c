@@ -0,0 +1,70 @@
+
+/* Memcheck handles groups of loads, and of stores of constants, off a
+   common base register in one superblock with a single shadow memory
+   check.  Check that errors and definedness are still exactly as for
+   the individual accesses when that check fails. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../../memcheck.h"
+
+static long sum4 ( long* p )
+{
+   long sum;
+   __asm__ __volatile__(
+      "movq   %1, %%rax\n\t"
+      "movq   0(%%rax), %%rcx\n\t"
+      "addq   8(%%rax), %%rcx\n\t"
+      "addq   16(%%rax), %%rcx\n\t"
+      "addq   24(%%rax), %%rcx\n\t"
+      "movq   %%rcx, %0\n\t"
+      : "=m"(sum) : "m"(p) : "rax", "rcx", "cc", "memory"
+   );
+   return sum;
+}
+
+static void zero3 ( char* p )
+{
+   __asm__ __volatile__(
+      "movq   %0, %%rax\n\t"
+      "movq   $0, 0(%%rax)\n\t"
+      "movq   $0, 8(%%rax)\n\t"
+      "movl   $0, 16(%%rax)\n\t"
+      : : "m"(p) : "rax", "memory"
+   );
+}
+
+int main ( void )
+{
+   long* a = malloc(4 * sizeof(long));
+   char* b = malloc(24);
+   char* c = malloc(18);
+   int   i;
+
+   for (i = 0; i < 4; i++)
+      a[i] = i;
+
+   /* All defined: no complaint. */
+   if (sum4(a) == 6)
+      printf("sum ok\n");
+
+   /* One undefined: one complaint. */
+   (void) VALGRIND_MAKE_MEM_UNDEFINED(&a[2], sizeof(long));
+   if (sum4(a) == 6)
+      printf("sum ok\n");
+
+   /* Only the stored-to bytes become defined. */
+   zero3(b);
+   (void) VALGRIND_CHECK_MEM_IS_DEFINED(b, 20);
+   (void) VALGRIND_CHECK_MEM_IS_DEFINED(b + 20, 4);
+
+   /* Part of the group is unaddressable: one invalid write, and the
+      addressable bytes still become defined. */
+   zero3(c);
+   (void) VALGRIND_CHECK_MEM_IS_DEFINED(c, 18);
+
+   free(a);
+   free(b);
+   free(c);
+   return 0;
+}
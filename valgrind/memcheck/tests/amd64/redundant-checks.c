@@ -0,0 +1,54 @@
+
+/* Memcheck removes address definedness checks which are subsumed by
+   an earlier check in the same superblock.  Check that a check is
+   still done when the base register gets a new value, and that
+   checking a register doesn't make it defined in the next
+   superblock. */
+
+#include <stdio.h>
+#include "../../memcheck.h"
+
+static long buf[8];
+
+int main ( void )
+{
+   long* p = &buf[0];
+   long* q = &buf[4];
+   long  sum;
+
+   (void) VALGRIND_MAKE_MEM_UNDEFINED(&p, sizeof(p));
+   (void) VALGRIND_MAKE_MEM_UNDEFINED(&q, sizeof(q));
+
+   /* One complaint for the accesses through p, and another one for
+      the access through q, although all are in the same superblock. */
+   __asm__ __volatile__(
+      "movq   %1, %%rax\n\t"
+      "movq   8(%%rax), %%rcx\n\t"
+      "addq   16(%%rax), %%rcx\n\t"
+      "leaq   24(%%rax), %%rdx\n\t"
+      "addq   0(%%rdx), %%rcx\n\t"
+      "movq   %2, %%rax\n\t"
+      "addq   8(%%rax), %%rcx\n\t"
+      "movq   %%rcx, %0\n\t"
+      : "=m"(sum) : "m"(p), "m"(q) : "rax", "rcx", "rdx", "cc", "memory"
+   );
+
+   /* One complaint for the access through p, and another one for the
+      comparison, which is in the next superblock. */
+   __asm__ __volatile__(
+      "movq   %1, %%rax\n\t"
+      "movq   8(%%rax), %%rcx\n\t"
+      "leaq   1f(%%rip), %%rdx\n\t"
+      "jmp    *%%rdx\n"
+      "1:\n\t"
+      "cmpq   $0, %%rax\n\t"
+      "je     2f\n\t"
+      "addq   $1, %%rcx\n"
+      "2:\n\t"
+      "movq   %%rcx, %0\n\t"
+      : "=m"(sum) : "m"(p) : "rax", "rcx", "rdx", "cc", "memory"
+   );
+
+   printf("sum %ld\n", sum);
+   return 0;
+}
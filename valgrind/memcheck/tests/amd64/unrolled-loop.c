@@ -0,0 +1,57 @@
+
+/* VEX unrolls small loops, and then removes Puts of loop-invariant
+   values from the second and later iterations, and memcheck removes
+   rechecks of loop-invariant values.  Check that undefinedness which
+   only shows up in a later iteration, or in a loop invariant, is
+   still reported. */
+
+#include <stdio.h>
+#include "../../memcheck.h"
+
+static long  vals[8];
+static long* ptrs[8];
+
+static long sum ( long** p, long** end )
+{
+   long sum;
+   __asm__ __volatile__(
+      "movq   %1, %%rsi\n\t"
+      "movq   %2, %%rdx\n\t"
+      "xorl   %%ecx, %%ecx\n"
+      "1:\n\t"
+      "movq   0(%%rsi), %%rax\n\t"
+      "addq   0(%%rax), %%rcx\n\t"
+      "addq   $8, %%rsi\n\t"
+      "cmpq   %%rsi, %%rdx\n\t"
+      "jne    1b\n\t"
+      "movq   %%rcx, %0\n\t"
+      : "=m"(sum) : "m"(p), "m"(end) : "rax", "rcx", "rdx", "rsi",
+                                       "cc", "memory"
+   );
+   return sum;
+}
+
+int main ( void )
+{
+   long** end = &ptrs[8];
+   int    i;
+
+   for (i = 0; i < 8; i++) {
+      vals[i] = i;
+      ptrs[i] = &vals[i];
+   }
+
+   /* No complaints. */
+   printf("sum %ld\n", sum(ptrs, end));
+
+   /* One complaint, about the use of ptrs[5] as an address. */
+   (void) VALGRIND_MAKE_MEM_UNDEFINED(&ptrs[5], sizeof(ptrs[5]));
+   printf("sum %ld\n", sum(ptrs, end));
+   (void) VALGRIND_MAKE_MEM_DEFINED(&ptrs[5], sizeof(ptrs[5]));
+
+   /* One complaint, about the loop condition. */
+   (void) VALGRIND_MAKE_MEM_UNDEFINED(&end, sizeof(end));
+   printf("sum %ld\n", sum(ptrs, end));
+
+   return 0;
+}
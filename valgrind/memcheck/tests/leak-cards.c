@@ -0,0 +1,70 @@
+/* With --leak-check-incremental=yes, a leak search reuses its summary of
+   each 64k card of memory which hasn't been written since the previous
+   search.  roots is big and not card aligned, and is only written
+   between some of the searches, so most of its cards, including partial
+   ones at its ends, are reused.  The loss records must be the same as
+   if it had all been scanned. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include "../memcheck.h"
+
+#define N_BLOCKS   64
+#define BLOCK_SZB  32
+#define N_ROOTS    (4 * 65536 / sizeof(char*) + 7)
+
+static char  pool[N_BLOCKS * BLOCK_SZB];
+static char* roots[N_ROOTS];
+
+/* Make the blocks, and keep every other one in roots, spread out. */
+__attribute__((noinline))
+static void make_blocks(void)
+{
+   int i;
+   for (i = 0; i < N_BLOCKS; i++) {
+      VALGRIND_MALLOCLIKE_BLOCK(pool + i * BLOCK_SZB, BLOCK_SZB, 0, 0);
+      if (i % 2 == 0)
+         roots[1 + i * (N_ROOTS / N_BLOCKS)] = pool + i * BLOCK_SZB;
+   }
+}
+
+static void count(const char* what)
+{
+   unsigned long leaked, dubious, reachable, suppressed;
+   VALGRIND_COUNT_LEAKS(leaked, dubious, reachable, suppressed);
+   printf("%-18s %lu bytes leaked, %lu reachable\n", what,
+          leaked + dubious, reachable);
+}
+
+int main(void)
+{
+   void* p;
+
+   make_blocks();
+   VALGRIND_DO_LEAK_CHECK;
+   count("first search:");
+
+   VALGRIND_DO_ADDED_LEAK_CHECK;
+   count("roots unchanged:");
+
+   VALGRIND_DO_ADDED_LEAK_CHECK;
+   count("roots unchanged:");
+
+   roots[1] = NULL;
+   VALGRIND_DO_ADDED_LEAK_CHECK;
+   count("one root cleared:");
+
+   /* A mapping outside the memory the summaries were made for makes the
+      next search drop them all.  (This is why the test is amd64 only.) */
+   p = mmap((void*)(uintptr_t)0x10000000000ULL, 65536,
+            PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+   if (p == MAP_FAILED)
+      perror("mmap");
+   VALGRIND_DO_ADDED_LEAK_CHECK;
+   count("after mmap:");
+
+   VALGRIND_DO_ADDED_LEAK_CHECK;
+   count("roots unchanged:");
+   return 0;
+}
@@ -0,0 +1,86 @@
+/* Stress test for Memcheck's shadow memory with --mt-shadow=yes.
+   Many threads fill, copy and free memory all over the address space,
+   including well above the range covered by the main primary map, so
+   that new secondary maps, auxiliary map entries and origin cache
+   lines are created all the time.  Partly undefined data is copied
+   around, but never used, so no errors should be reported.
+
+   The client threads still run one at a time, so this only checks
+   that --mt-shadow=yes gives the same results as usual; it is
+   shadow_mt_selftest which has several threads use the shadow memory
+   at once. */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define N_THREADS   16
+#define N_ROUNDS    10
+#define REGION_SZB  (1024 * 1024)
+
+static unsigned long sums[N_THREADS];
+
+static void* worker ( void* v )
+{
+   long           me = (long)v;
+   unsigned long  sum = 0;
+   unsigned char* region;
+   void*          hint;
+   int            r, i;
+
+   /* Ask for a region high up, so that it is shadowed via the
+      auxiliary primary map on 64-bit targets. */
+   hint = (void*)(sizeof(void*) == 8 ? (0x2000000000UL + me * 0x10000000UL)
+                                     : 0UL);
+   region = mmap(hint, REGION_SZB, PROT_READ|PROT_WRITE,
+                 MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+   if (region == MAP_FAILED) {
+      perror("mmap");
+      exit(1);
+   }
+
+   for (r = 0; r < N_ROUNDS; r++) {
+      size_t         szB   = 1000 + 4096 * ((me + r) % 7);
+      unsigned char* undef = malloc(szB);
+      unsigned char* def   = malloc(szB);
+      unsigned char  stackbuf[1000];
+
+      memset(def, me + r, szB);
+      /* Interleave defined and undefined bytes, on the heap, on the
+         stack and in the high region. */
+      for (i = 0; i < (int)szB; i += 2)
+         undef[i] = def[i];
+      memcpy(stackbuf, undef, sizeof(stackbuf));
+      for (i = 0; i < REGION_SZB; i += 65536 / 4)
+         memcpy(region + ((i + r * 64) % (REGION_SZB - szB)), undef, szB);
+      for (i = 0; i < (int)szB; i++)
+         sum += def[i];
+      for (i = 0; i < (int)sizeof(stackbuf); i += 2)
+         sum += stackbuf[i];
+
+      free(undef);
+      free(def);
+   }
+
+   munmap(region, REGION_SZB);
+   sums[me] = sum;
+   return NULL;
+}
+
+int main ( void )
+{
+   pthread_t     tids[N_THREADS];
+   unsigned long total = 0;
+   long          i;
+
+   for (i = 0; i < N_THREADS; i++)
+      pthread_create(&tids[i], NULL, worker, (void*)i);
+   for (i = 0; i < N_THREADS; i++) {
+      pthread_join(tids[i], NULL);
+      total += sums[i];
+   }
+   printf("total %lu\n", total);
+   return 0;
+}
@@ -0,0 +1,158 @@
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pub_core_basics.h"
+#include "pub_core_libcassert.h"
+
+// Crudely redirect various VG_(foo)() functions to their libc equivalents.
+#undef vg_assert
+#define vg_assert(e)                   assert(e)
+
+#define vgPlain_malloc(cc,sz)          malloc(sz)
+#define vgPlain_calloc(cc,n,sz)        calloc(n,sz)
+#define vgPlain_free                   free
+
+#include "coregrind/m_hashtable.c"
+
+void VG_(debugLog) ( Int level, const HChar* modulename,
+                     const HChar* format, ... )
+{
+}
+
+#define N_KEYS  3000    // Number of different keys
+#define N_OPS   200000  // Number of random operations
+
+
+/* Consistent random number generator, so it produces the
+   same results on all platforms. */
+
+#define random error_do_not_use_libc_random
+
+static UInt seed = 0;
+static UInt myrandom( void )
+{
+  seed = (1103515245 * seed + 12345);
+  return seed;
+}
+
+typedef
+   struct _Node {
+      struct _Node* next;     // for the hash table
+      UWord         key;      // for the hash table
+      struct _Node* older;    // next older node with the same key
+      Bool          seen;
+   }
+   Node;
+
+// For each key, the nodes in the table with that key, most recent first.
+// HT_lookup and HT_remove must find the most recent one.
+static Node* newest[N_KEYS];
+static Int   n_in_table;
+
+// Half the keys look like heap addresses, the others are small numbers.
+static UWord key_of ( Int k )
+{
+   return k % 2 ? 0x4c2a000UL + 16 * (UWord)k : (UWord)k;
+}
+
+static void add ( VgHashTable t, Int k )
+{
+   Node* n  = malloc(sizeof(Node));
+   n->key   = key_of(k);
+   n->older = newest[k];
+   newest[k] = n;
+   VG_(HT_add_node)(t, n);
+   n_in_table++;
+}
+
+static void remove_and_check ( VgHashTable t, Int k )
+{
+   Node* n = VG_(HT_remove)(t, key_of(k));
+   assert(n == newest[k]);
+   if (n) {
+      newest[k] = n->older;
+      n_in_table--;
+      free(n);
+   }
+}
+
+static void check_all ( VgHashTable t )
+{
+   Int    i, n_seen = 0;
+   UInt   n_elems;
+   Node*  n;
+   Node** arr;
+
+   assert(VG_(HT_count_nodes)(t) == n_in_table);
+   for (i = 0; i < N_KEYS; i++) {
+      assert(VG_(HT_lookup)(t, key_of(i)) == newest[i]);
+      for (n = newest[i]; n; n = n->older)
+         n->seen = False;
+   }
+
+   VG_(HT_ResetIter)(t);
+   while ((n = VG_(HT_Next)(t))) {
+      assert(!n->seen);
+      n->seen = True;
+      n_seen++;
+   }
+   assert(n_seen == n_in_table);
+   for (i = 0; i < N_KEYS; i++)
+      for (n = newest[i]; n; n = n->older)
+         assert(n->seen);
+
+   arr = (Node**)VG_(HT_to_array)(t, &n_elems);
+   assert(n_elems == n_in_table);
+   for (i = 0; i < n_elems; i++) {
+      assert(arr[i]->seen);
+      arr[i]->seen = False;
+   }
+   free(arr);
+}
+
+int main(void)
+{
+   VgHashTable t = VG_(HT_construct)("unit_hashtable");
+   Int i, k, n_lookups = 0, n_hits = 0;
+
+   // Grow the table through several resizes, with many duplicate keys.
+   for (i = 0; i < 5 * N_KEYS; i++)
+      add(t, myrandom() % N_KEYS);
+   check_all(t);
+   printf("added %d nodes\n", n_in_table);
+
+   // Mix additions, removals (some of absent keys) and lookups.
+   for (i = 0; i < N_OPS; i++) {
+      k = myrandom() % N_KEYS;
+      switch ((myrandom() >> 8) % 4) {
+         case 0:  add(t, k); break;
+         case 1:
+         case 2:  remove_and_check(t, k); break;
+         default: {
+            Node* n = VG_(HT_lookup)(t, key_of(k));
+            assert(n == newest[k]);
+            n_lookups++;
+            if (n) n_hits++;
+         }
+      }
+      if (i % 20000 == 0)
+         check_all(t);
+   }
+   check_all(t);
+   printf("%d nodes left after %d operations\n", n_in_table, N_OPS);
+   printf("%d of %d lookups found a node\n", n_hits, n_lookups);
+
+   // Empty it again.
+   for (k = 0; k < N_KEYS; k++)
+      while (newest[k])
+         remove_and_check(t, k);
+   check_all(t);
+   assert(VG_(HT_lookup)(t, key_of(1)) == NULL);
+   printf("%d nodes left\n", n_in_table);
+
+   VG_(HT_destruct)(t, free);
+   return 0;
+}
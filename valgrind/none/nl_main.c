@@ -65,7 +65,14 @@ static void nl_pre_clo_init(void)
                                  nl_instrument,
                                  nl_fini);
 
-   /* No needs, no core events to track */
+   /* Translations depend only on the guest code, so may be kept
+      between runs. */
+   VG_(needs_persistent_translations) ();
+
+   /* There is no instrumentation, so threads can run in parallel. */
+   VG_(needs_parallel_execution) ();
+
+   /* No other needs, no core events to track */
 }
 
 VG_DETERMINE_INTERFACE_VERSION(nl_pre_clo_init)
@@ -0,0 +1,148 @@
+/* Keeps all sixteen ymm registers live through one block of AVX2
+   code, so that on an AVX2 host the V256 values it works on can't
+   all stay in host registers and have to be spilled and reloaded.
+   The values are also copied from register to register, and taken
+   apart and put back together 128 bits at a time.  Any value that
+   is damaged along the way shows up in the output. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <malloc.h>
+
+typedef  unsigned char           UChar;
+typedef  unsigned int            UInt;
+typedef  unsigned long int       UWord;
+
+#define IS_32_ALIGNED(_ptr) (0 == (0x1F & (UWord)(_ptr)))
+
+typedef  union { UChar u8[32];  UInt u32[8];  }  YMM;
+
+void showYMM ( YMM* vec )
+{
+   int i;
+   assert(IS_32_ALIGNED(vec));
+   for (i = 31; i >= 0; i--) {
+      printf("%02x", (UInt)vec->u8[i]);
+      if (i > 0 && 0 == ((i+0) & 7)) printf(".");
+   }
+}
+
+UChar randUChar ( void )
+{
+   static UInt seed = 80021;
+   seed = 1103515245 * seed + 12345;
+   return (seed >> 17) & 0xFF;
+}
+
+/* Everything from the loads to the stores is a single superblock. */
+__attribute__ ((noinline)) static void mix ( YMM* regs )
+{
+   __asm__ __volatile__(
+      "vmovdqa    0(%0),%%ymm0"              "\n\t"
+      "vmovdqa   32(%0),%%ymm1"              "\n\t"
+      "vmovdqa   64(%0),%%ymm2"              "\n\t"
+      "vmovdqa   96(%0),%%ymm3"              "\n\t"
+      "vmovdqa  128(%0),%%ymm4"              "\n\t"
+      "vmovdqa  160(%0),%%ymm5"              "\n\t"
+      "vmovdqa  192(%0),%%ymm6"              "\n\t"
+      "vmovdqa  224(%0),%%ymm7"              "\n\t"
+      "vmovdqa  256(%0),%%ymm8"              "\n\t"
+      "vmovdqa  288(%0),%%ymm9"              "\n\t"
+      "vmovdqa  320(%0),%%ymm10"             "\n\t"
+      "vmovdqa  352(%0),%%ymm11"             "\n\t"
+      "vmovdqa  384(%0),%%ymm12"             "\n\t"
+      "vmovdqa  416(%0),%%ymm13"             "\n\t"
+      "vmovdqa  448(%0),%%ymm14"             "\n\t"
+      "vmovdqa  480(%0),%%ymm15"             "\n\t"
+
+      /* one op on each pair, leaving the sources alone */
+      "vpmulld    %%ymm1,%%ymm0,%%ymm0"      "\n\t"
+      "vpminsd    %%ymm3,%%ymm2,%%ymm2"      "\n\t"
+      "vpmaxub    %%ymm5,%%ymm4,%%ymm4"      "\n\t"
+      "vpcmpeqq   %%ymm7,%%ymm6,%%ymm6"      "\n\t"
+      "vpcmpgtq   %%ymm9,%%ymm8,%%ymm8"      "\n\t"
+      "vpermd     %%ymm11,%%ymm10,%%ymm10"   "\n\t"
+      "vpminuw    %%ymm13,%%ymm12,%%ymm12"   "\n\t"
+      "vpmaxsb    %%ymm15,%%ymm14,%%ymm14"   "\n\t"
+
+      /* rotate ymm0 .. ymm14 by one, through ymm15 */
+      "vmovdqa    %%ymm0,%%ymm15"            "\n\t"
+      "vmovdqa    %%ymm1,%%ymm0"             "\n\t"
+      "vmovdqa    %%ymm2,%%ymm1"             "\n\t"
+      "vmovdqa    %%ymm3,%%ymm2"             "\n\t"
+      "vmovdqa    %%ymm4,%%ymm3"             "\n\t"
+      "vmovdqa    %%ymm5,%%ymm4"             "\n\t"
+      "vmovdqa    %%ymm6,%%ymm5"             "\n\t"
+      "vmovdqa    %%ymm7,%%ymm6"             "\n\t"
+      "vmovdqa    %%ymm8,%%ymm7"             "\n\t"
+      "vmovdqa    %%ymm9,%%ymm8"             "\n\t"
+      "vmovdqa    %%ymm10,%%ymm9"            "\n\t"
+      "vmovdqa    %%ymm11,%%ymm10"           "\n\t"
+      "vmovdqa    %%ymm12,%%ymm11"           "\n\t"
+      "vmovdqa    %%ymm13,%%ymm12"           "\n\t"
+      "vmovdqa    %%ymm14,%%ymm13"           "\n\t"
+      "vmovdqa    %%ymm15,%%ymm14"           "\n\t"
+
+      /* swap the halves of some, and rebuild others from halves */
+      "vperm2i128 $0x01,%%ymm1,%%ymm1,%%ymm1"   "\n\t"
+      "vextracti128 $1,%%ymm3,%%xmm15"          "\n\t"
+      "vinserti128 $0,%%xmm15,%%ymm5,%%ymm5"    "\n\t"
+      "vinserti128 $1,%%xmm7,%%ymm9,%%ymm9"     "\n\t"
+
+      /* a second op on each pair, now pairing different values */
+      "vpaddd     %%ymm2,%%ymm1,%%ymm1"      "\n\t"
+      "vpsubq     %%ymm4,%%ymm3,%%ymm3"      "\n\t"
+      "vpmulld    %%ymm6,%%ymm5,%%ymm5"      "\n\t"
+      "vpxor      %%ymm8,%%ymm7,%%ymm7"      "\n\t"
+      "vpcmpgtq   %%ymm10,%%ymm9,%%ymm9"     "\n\t"
+      "vpmaxud    %%ymm12,%%ymm11,%%ymm11"   "\n\t"
+      "vpcmpeqq   %%ymm14,%%ymm13,%%ymm13"   "\n\t"
+      "vpermd     %%ymm0,%%ymm15,%%ymm15"    "\n\t"
+      "vpminsw    %%ymm15,%%ymm0,%%ymm0"     "\n\t"
+
+      "vmovdqa    %%ymm0,    0(%0)"          "\n\t"
+      "vmovdqa    %%ymm1,   32(%0)"          "\n\t"
+      "vmovdqa    %%ymm2,   64(%0)"          "\n\t"
+      "vmovdqa    %%ymm3,   96(%0)"          "\n\t"
+      "vmovdqa    %%ymm4,  128(%0)"          "\n\t"
+      "vmovdqa    %%ymm5,  160(%0)"          "\n\t"
+      "vmovdqa    %%ymm6,  192(%0)"          "\n\t"
+      "vmovdqa    %%ymm7,  224(%0)"          "\n\t"
+      "vmovdqa    %%ymm8,  256(%0)"          "\n\t"
+      "vmovdqa    %%ymm9,  288(%0)"          "\n\t"
+      "vmovdqa    %%ymm10, 320(%0)"          "\n\t"
+      "vmovdqa    %%ymm11, 352(%0)"          "\n\t"
+      "vmovdqa    %%ymm12, 384(%0)"          "\n\t"
+      "vmovdqa    %%ymm13, 416(%0)"          "\n\t"
+      "vmovdqa    %%ymm14, 448(%0)"          "\n\t"
+      "vmovdqa    %%ymm15, 480(%0)"          "\n\t"
+      "vzeroupper"                           "\n"
+      : /*OUT*/
+      : /*IN*/ "r"(regs)
+      : /*TRASH*/ "xmm0","xmm1","xmm2","xmm3","xmm4","xmm5","xmm6",
+                  "xmm7","xmm8","xmm9","xmm10","xmm11","xmm12",
+                  "xmm13","xmm14","xmm15","memory"
+   );
+}
+
+int main ( void )
+{
+   int  i, j, k;
+   YMM* regs = memalign(32, 16 * sizeof(YMM));
+
+   for (i = 0; i < 4; i++) {
+      for (j = 0; j < 16; j++)
+         for (k = 0; k < 32; k++)
+            regs[j].u8[k] = randUChar();
+      mix(regs);
+      printf("round %d\n", i);
+      for (j = 0; j < 16; j++) {
+         printf("  ymm%-2d ", j);
+         showYMM(&regs[j]);
+         printf("\n");
+      }
+   }
+   free(regs);
+   return 0;
+}
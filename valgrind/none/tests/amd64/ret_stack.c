@@ -0,0 +1,176 @@
+/* Calls and returns which don't pair up neatly, to check that
+   --return-stack=yes never sends a return to the wrong place. */
+
+#include <setjmp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+__attribute__((noinline))
+static unsigned long fib ( unsigned long n )
+{
+   return n < 2 ? n : fib(n-1) + fib(n-2);
+}
+
+/* longjmp out of a deep recursion. */
+
+static jmp_buf jb;
+
+__attribute__((noinline))
+static unsigned long dive ( int depth, unsigned long acc )
+{
+   if (depth == 0) {
+      /* acc is never 0 here, as depth was added to it on the way down;
+         the test just stops gcc deciding that dive never returns. */
+      if (acc != 0)
+         longjmp(jb, (int)(acc & 0xFF) | 1);
+      return 0;
+   }
+   return dive(depth-1, acc * 3 + depth) + 1;
+}
+
+static void test_longjmp ( void )
+{
+   int i;
+   unsigned long sum = 0;
+   for (i = 0; i < 1000; i++) {
+      int r = setjmp(jb);
+      if (r == 0)
+         dive(1 + i % 40, i);
+      sum += r + fib(i % 8);
+   }
+   printf("longjmp: %lu\n", sum);
+}
+
+/* Signal handlers which call things, some returning normally and
+   some siglongjmp'ing out. */
+
+static sigjmp_buf sjb;
+static volatile unsigned long handled = 0;
+static volatile int escape = 0;
+
+static void handler ( int sig )
+{
+   handled += fib(10);
+   if (escape)
+      siglongjmp(sjb, 1);
+}
+
+__attribute__((noinline))
+static unsigned long nest_and_raise ( int depth )
+{
+   if (depth == 0) {
+      raise(SIGUSR1);
+      return 1;
+   }
+   return nest_and_raise(depth-1) + 1;
+}
+
+static void test_signals ( void )
+{
+   int i;
+   unsigned long sum = 0;
+   struct sigaction sa;
+   memset(&sa, 0, sizeof sa);
+   sa.sa_handler = handler;
+   sigemptyset(&sa.sa_mask);
+   sigaction(SIGUSR1, &sa, NULL);
+   for (i = 0; i < 200; i++) {
+      escape = i & 1;
+      if (sigsetjmp(sjb, 1) == 0)
+         sum += nest_and_raise(i % 20);
+      sum += fib(5);
+   }
+   printf("signals: %lu handled, sum %lu\n", handled, sum);
+}
+
+/* Switching between stacks in the middle of call chains. */
+
+static ucontext_t uc_main, uc_a, uc_b;
+
+__attribute__((noinline))
+static unsigned long work ( ucontext_t* self, ucontext_t* other,
+                            int depth )
+{
+   if (depth == 0) {
+      swapcontext(self, other);
+      return 1;
+   }
+   return work(self, other, depth-1) + fib(depth % 6);
+}
+
+static unsigned long res_a, res_b;
+
+static void coro_a ( void )
+{
+   int i;
+   for (i = 0; i < 100; i++)
+      res_a += work(&uc_a, &uc_b, i % 10);
+}
+
+static void coro_b ( void )
+{
+   int i;
+   for (i = 0; i < 100; i++)
+      res_b += work(&uc_b, &uc_a, (i * 7) % 13);
+   swapcontext(&uc_b, &uc_a);
+}
+
+static void test_contexts ( void )
+{
+   static char stack_a[65536], stack_b[65536];
+   getcontext(&uc_a);
+   uc_a.uc_stack.ss_sp   = stack_a;
+   uc_a.uc_stack.ss_size = sizeof stack_a;
+   uc_a.uc_link          = &uc_main;
+   makecontext(&uc_a, coro_a, 0);
+   getcontext(&uc_b);
+   uc_b.uc_stack.ss_sp   = stack_b;
+   uc_b.uc_stack.ss_size = sizeof stack_b;
+   uc_b.uc_link          = &uc_main;
+   makecontext(&uc_b, coro_b, 0);
+   swapcontext(&uc_main, &uc_a);
+   printf("contexts: %lu %lu\n", res_a, res_b);
+}
+
+/* Calls which never return, and returns which aren't to the caller. */
+
+static void test_odd_pairs ( void )
+{
+   int i;
+   unsigned long sum = 0, pc, r;
+   for (i = 0; i < 1000; i++) {
+      /* Get the pc by calling the next instruction.  Step over the
+         red zone first. */
+      __asm__ __volatile__(
+         "addq $-128, %%rsp\n\t"
+         "call 1f\n"
+         "1:\tpopq %0\n\t"
+         "subq $-128, %%rsp"
+         : "=r"(pc) : : "memory");
+      /* Jump by returning, to somewhere other than the caller. */
+      __asm__ __volatile__(
+         "addq $-128, %%rsp\n\t"
+         "leaq 2f(%%rip), %%rax\n\t"
+         "pushq %%rax\n\t"
+         "movq $1, %0\n\t"
+         "ret\n\t"
+         "movq $2, %0\n"
+         "2:\tsubq $-128, %%rsp"
+         : "=r"(r) : : "rax", "memory");
+      sum += r + fib(i % 6) + (pc != 0);
+   }
+   printf("odd pairs: %lu\n", sum);
+}
+
+int main ( void )
+{
+   printf("fib: %lu\n", fib(20));
+   test_longjmp();
+   test_signals();
+   test_contexts();
+   test_odd_pairs();
+   return 0;
+}
@@ -0,0 +1,55 @@
+// Translates enough distinct code to make the transtab recycle its
+// sectors, so that --generational-transtab=yes has something to do.
+// Every copy of f() is run often enough to count as hot before its
+// sector is recycled, and then run again so that it gets promoted.
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#if defined(__mips__)
+#include <asm/cachectl.h>
+#include <sys/syscall.h>
+#endif
+#include "tests/sys_mman.h"
+
+#define FN_SIZE   64       // Must be big enough to hold the compiled f()
+#define N_FNS     140000   // Enough to recycle both young sectors
+#define N_HOT     150      // More than the promotion threshold
+
+int f(int x)
+{
+   return x * 3 + 1;
+}
+
+int main(void)
+{
+   int i, j;
+   unsigned sum = 0;
+   char* a = mmap(0, FN_SIZE * N_FNS,
+                     PROT_EXEC|PROT_WRITE,
+                     MAP_PRIVATE|MAP_ANONYMOUS, -1,0);
+   assert(a != (char*)MAP_FAILED);
+
+   for (i = 0; i < N_FNS; i++)
+      memcpy(&a[FN_SIZE*i], f, FN_SIZE);
+
+#if defined(__mips__)
+   syscall(__NR_cacheflush, a, FN_SIZE * N_FNS, ICACHE);
+#endif
+
+   // Make every copy hot, which also fills and recycles the sectors.
+   for (i = 0; i < N_FNS; i++) {
+      int(*g)(int) = (void*)&a[FN_SIZE*i];
+      for (j = 0; j < N_HOT; j++)
+         sum += g(j);
+   }
+   // Run them again; those dumped from a recycled sector come back
+   // into the old generation.
+   for (i = 0; i < N_FNS; i++) {
+      int(*g)(int) = (void*)&a[FN_SIZE*i];
+      sum += g(i);
+   }
+
+   printf("result = %u\n", sum);
+   return 0;
+}
@@ -0,0 +1,55 @@
+// Calls through one indirect call site to several targets, so that its
+// inline cache gets filled and then mostly misses, and then replaces
+// the code of the target it was filled with, so that the cache must be
+// emptied again for the call to reach the new code.
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "tests/sys_mman.h"
+#include "../../include/valgrind.h"
+
+#define FN_SIZE  64     // Must be big enough to hold the compiled fns
+#define N_CALLS  1000
+
+static int add1  ( int x ) { return x + 1; }
+static int times2 ( int x ) { return x * 2; }
+static int minus3 ( int x ) { return x - 3; }
+
+__attribute__((noinline))
+static int call ( int (*fn)(int), int x )
+{
+   return fn(x);
+}
+
+int main ( void )
+{
+   int (*fns[3])(int) = { add1, times2, minus3 };
+   int i, sum;
+   char* a;
+
+   // A polymorphic call site.
+   sum = 0;
+   for (i = 0; i < N_CALLS; i++)
+      sum += call(fns[i % 3], i);
+   printf("polymorphic: %d\n", sum);
+
+   // A monomorphic one, whose target then changes under its feet.
+   a = mmap(0, FN_SIZE, PROT_EXEC|PROT_WRITE,
+                        MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+   assert(a != (char*)MAP_FAILED);
+   memcpy(a, add1, FN_SIZE);
+   sum = 0;
+   for (i = 0; i < N_CALLS; i++)
+      sum += call((void*)a, i);
+   printf("before: %d\n", sum);
+
+   memcpy(a, times2, FN_SIZE);
+   VALGRIND_DISCARD_TRANSLATIONS(a, FN_SIZE);
+   sum = 0;
+   for (i = 0; i < N_CALLS; i++)
+      sum += call((void*)a, i);
+   printf("after: %d\n", sum);
+
+   return 0;
+}
@@ -0,0 +1,55 @@
+// Threads which run guest code at the same time under --parallel-exec=yes,
+// adding into a shared total with atomic instructions.  The total is
+// only right if the atomics stay atomic when the threads really do run
+// concurrently.
+
+#include <pthread.h>
+#include <stdio.h>
+
+#define N_THREADS  4
+#define N_ITERS    500000
+
+static volatile unsigned n_started = 0;
+static unsigned long long total = 0;
+static unsigned results[N_THREADS];
+
+static void* worker ( void* v )
+{
+   unsigned me = (unsigned)(unsigned long)v;
+   unsigned i, x = me + 1;
+
+   // Wait until every thread is running, so that they overlap.
+   __sync_fetch_and_add(&n_started, 1);
+   while (n_started < N_THREADS)
+      ;
+
+   for (i = 0; i < N_ITERS; i++) {
+      x = x * 1103515245u + 12345u;
+      __sync_fetch_and_add(&total, x >> 16);
+   }
+   results[me] = x;
+   return NULL;
+}
+
+int main ( void )
+{
+   pthread_t th[N_THREADS];
+   unsigned long long expected = 0;
+   unsigned i, j, x;
+
+   for (i = 0; i < N_THREADS; i++)
+      pthread_create(&th[i], NULL, worker, (void*)(unsigned long)i);
+   for (i = 0; i < N_THREADS; i++)
+      pthread_join(th[i], NULL);
+
+   for (i = 0; i < N_THREADS; i++) {
+      x = i + 1;
+      for (j = 0; j < N_ITERS; j++) {
+         x = x * 1103515245u + 12345u;
+         expected += x >> 16;
+      }
+      printf("thread %u: %s\n", i, results[i] == x ? "ok" : "wrong");
+   }
+   printf("total: %s\n", total == expected ? "ok" : "wrong");
+   return 0;
+}
@@ -0,0 +1,57 @@
+/* Check that --pretranslate=yes is invisible to the client: its
+   helper process must not show up in wait(), including in the child
+   of a fork(). */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static int work ( int n )
+{
+   char buf[64];
+   int  i, sum = 0;
+   for (i = 0; i < n; i++) {
+      sprintf(buf, "%d %x %o", i, i * 7, i * 13);
+      sum += strlen(buf);
+   }
+   return sum;
+}
+
+static void reap ( const char* who, pid_t expected )
+{
+   int   status;
+   pid_t pid = wait(&status);
+   if (pid != expected)
+      printf("%s: wait returned %d\n", who, (int)pid);
+   else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      printf("%s: bad child status 0x%x\n", who, status);
+   pid = wait(&status);
+   if (pid != -1 || errno != ECHILD)
+      printf("%s: unexpected extra child %d\n", who, (int)pid);
+}
+
+int main ( void )
+{
+   pid_t pid;
+
+   printf("work %d\n", work(1000));
+   fflush(stdout);
+
+   pid = fork();
+   if (pid == 0) {
+      /* Translate some new code in the child, and have a child of
+         our own. */
+      pid_t grandchild = fork();
+      if (grandchild == 0)
+         exit(work(100) == 0);
+      reap("child", grandchild);
+      exit(work(2000) == 0);
+   }
+   reap("parent", pid);
+   printf("done\n");
+   return 0;
+}
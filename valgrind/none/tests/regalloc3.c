@@ -0,0 +1,39 @@
+// Keeps many values live at once, across the helper calls that the
+// translations of some of the operations need, so that the register
+// allocator has to spill, reload and move things around.
+
+#include <stdio.h>
+
+#define N_ITERS  1000
+
+__attribute__((noinline))
+static unsigned long long mix ( unsigned long long* v, int n )
+{
+   unsigned long long a = v[0], b = v[1], c = v[2], d = v[3];
+   unsigned long long e = v[4], f = v[5], g = v[6], h = v[7];
+   unsigned long long i = v[8], j = v[9], k = v[10], l = v[11];
+   int r;
+   for (r = 0; r < n; r++) {
+      a += b * c;   b ^= c + d;   c -= d * e;   d += e ^ f;
+      e += f * g;   f ^= g + h;   g -= h * i;   h += i ^ j;
+      i += j * k;   j ^= k + l;   k -= l * a;   l += a ^ b;
+      // Division and conditions on these go through helper calls on
+      // some platforms.
+      a ^= (b | 1) / (c % 7 + 1);
+      if ((long long)(e - i) < (long long)(f + j))
+         g += k;
+      else
+         h ^= l;
+   }
+   return a ^ b ^ c ^ d ^ e ^ f ^ g ^ h ^ i ^ j ^ k ^ l;
+}
+
+int main ( void )
+{
+   unsigned long long v[12];
+   int i;
+   for (i = 0; i < 12; i++)
+      v[i] = 0x9E3779B97F4A7C15ULL * (i + 1);
+   printf("result = %llx\n", mix(v, N_ITERS));
+   return 0;
+}
@@ -0,0 +1,32 @@
+// A hot loop whose body spans several blocks, with conditional branches
+// that nearly always go the same way, for --trace-formation=yes to
+// form traces along.
+
+#include <stdio.h>
+
+#define N_ITERS  100000
+
+__attribute__((noinline))
+static unsigned step ( unsigned x, unsigned i )
+{
+   if (i % 64 != 0)
+      x += i;
+   else
+      x ^= i;
+   if (x & 0x80000000u)
+      x = x * 3 + 1;
+   if (i % 1000 == 999)
+      x -= 7;
+   else
+      x += 1;
+   return x;
+}
+
+int main ( void )
+{
+   unsigned i, x = 0;
+   for (i = 0; i < N_ITERS; i++)
+      x = step(x, i);
+   printf("x = %u\n", x);
+   return 0;
+}
@@ -7,15 +7,24 @@
 
 char* arr[NLIVE];
 
+// With a non-zero second argument, the block to replace is picked at
+// random rather than in turn, as in a program whose blocks have mixed
+// lifetimes.  malloc and free (and the tool's tables of blocks) then
+// see the live blocks in no particular order.
 int main ( int argc, char* argv[] )
 {
    int i, j, nbytes = 0;
    int pdb = 0;
    int jpdb;
+   int rnd = 0;
+   unsigned seed = 1;
 
    if (argc > 1) {
       pdb = atoi(argv[1]);
    }
+   if (argc > 2) {
+      rnd = atoi(argv[2]);
+   }
 
    printf("initialising\n");
    for (i = 0; i < NLIVE; i++)
@@ -24,8 +33,13 @@ int main ( int argc, char* argv[] )
    printf("running\n");
    j = -1;
    for (i = 0; i < NITERS; i++) {
-      j++;
-      if (j == NLIVE) j = 0;
+      if (rnd) {
+         seed = seed * 1103515245 + 12345;
+         j = (seed >> 4) % NLIVE;
+      } else {
+         j++;
+         if (j == NLIVE) j = 0;
+      }
       if (arr[j]) 
          free(arr[j]);
       arr[j] = malloc(nbytes);
@@ -0,0 +1,291 @@
+// This artificial program runs small SSE2, SSE4 and AVX2 integer kernels,
+// and an AVX floating point one, of the kind found in signal-processing
+// code: lane-wise add/subtract, compares, min/max, saturating packs,
+// shuffles and permutes.  Most of the work is
+// done in registers, so under Memcheck it measures the cost of the
+// vector definedness propagation rather than that of loads and stores.
+//
+// Which kernels run depends on what the assembler and the CPU support.
+// On non-amd64 platforms a plain C kernel of similar shape is used
+// instead, so that the benchmark still does something sensible.
+
+#include <stdio.h>
+#include <string.h>
+
+#define N_ELEMS  4096       // 16-bit elements per buffer
+#define REPS     3000
+
+static short buf_a[N_ELEMS] __attribute__((aligned(32)));
+static short buf_b[N_ELEMS] __attribute__((aligned(32)));
+static short buf_o[N_ELEMS] __attribute__((aligned(32)));
+
+#if defined(__x86_64__)
+
+#if defined(BUILD_SSE42) || defined(BUILD_AVX) || defined(BUILD_AVX2)
+static void cpuid ( unsigned int n, unsigned int m,
+                    unsigned int* a, unsigned int* b,
+                    unsigned int* c, unsigned int* d )
+{
+   __asm__ __volatile__ ( "cpuid"
+                          : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d)
+                          : "0"(n), "2"(m) );
+}
+#endif
+
+#if defined(BUILD_SSE42)
+static int have_sse42 ( void )
+{
+   unsigned int a, b, c, d;
+   cpuid(1, 0, &a, &b, &c, &d);
+   return (c & (1 << 20)) != 0;
+}
+#endif
+
+#if defined(BUILD_AVX) || defined(BUILD_AVX2)
+static int have_avx ( void )
+{
+   unsigned int a, b, c, d, xcr0_lo, xcr0_hi;
+   cpuid(1, 0, &a, &b, &c, &d);
+   // OSXSAVE and AVX
+   if ((c & (1 << 27)) == 0 || (c & (1 << 28)) == 0)
+      return 0;
+   __asm__ __volatile__ ( "xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0) );
+   return (xcr0_lo & 6) == 6;
+}
+#endif
+
+#if defined(BUILD_AVX2)
+static int have_avx2 ( void )
+{
+   unsigned int a, b, c, d;
+   if (!have_avx())
+      return 0;
+   cpuid(0, 0, &a, &b, &c, &d);
+   if (a < 7)
+      return 0;
+   cpuid(7, 0, &a, &b, &c, &d);
+   return (b & (1 << 5)) != 0;
+}
+#endif
+
+// Saturating add/subtract, compare, min/max, pack and unpack of 8 x 16-bit
+// lanes.  SSE2 only.
+__attribute__((noinline))
+static void kernel_sse2 ( short* o, const short* a, const short* b, int n )
+{
+   int i;
+   for (i = 0; i < n; i += 8) {
+      __asm__ __volatile__ (
+         "movdqa    (%1), %%xmm0\n\t"
+         "movdqa    (%2), %%xmm1\n\t"
+         "movdqa    %%xmm0, %%xmm2\n\t"
+         "paddsw    %%xmm1, %%xmm2\n\t"
+         "movdqa    %%xmm0, %%xmm3\n\t"
+         "psubsw    %%xmm1, %%xmm3\n\t"
+         "movdqa    %%xmm2, %%xmm4\n\t"
+         "pcmpgtw   %%xmm3, %%xmm4\n\t"
+         "pmaxsw    %%xmm3, %%xmm2\n\t"
+         "pminsw    %%xmm0, %%xmm3\n\t"
+         "pand      %%xmm4, %%xmm2\n\t"
+         "paddw     %%xmm3, %%xmm2\n\t"
+         "pcmpeqw   %%xmm1, %%xmm0\n\t"
+         "psubw     %%xmm0, %%xmm2\n\t"
+         "movdqa    %%xmm2, %%xmm5\n\t"
+         "packsswb  %%xmm3, %%xmm5\n\t"
+         "pshufd    $0x1b, %%xmm5, %%xmm5\n\t"
+         "punpcklbw %%xmm5, %%xmm2\n\t"
+         "pavgw     %%xmm1, %%xmm2\n\t"
+         "movdqa    %%xmm2, (%0)\n\t"
+         : /*out*/
+         : /*in*/ "r"(&o[i]), "r"(&a[i]), "r"(&b[i])
+         : /*trash*/ "memory", "xmm0", "xmm1", "xmm2", "xmm3",
+                     "xmm4", "xmm5"
+      );
+   }
+}
+
+#if defined(BUILD_SSE42)
+// 32 and 64-bit lane multiply, min/max, compare and packs.  SSE4.1/4.2.
+__attribute__((noinline))
+static void kernel_sse4 ( short* o, const short* a, const short* b, int n )
+{
+   int i;
+   for (i = 0; i < n; i += 8) {
+      __asm__ __volatile__ (
+         "movdqa    (%1), %%xmm0\n\t"
+         "movdqa    (%2), %%xmm1\n\t"
+         "movdqa    %%xmm0, %%xmm2\n\t"
+         "pmulld    %%xmm1, %%xmm2\n\t"
+         "movdqa    %%xmm0, %%xmm3\n\t"
+         "pmaxsd    %%xmm1, %%xmm3\n\t"
+         "pminud    %%xmm2, %%xmm3\n\t"
+         "movdqa    %%xmm3, %%xmm4\n\t"
+         "pcmpgtq   %%xmm2, %%xmm4\n\t"
+         "pcmpeqq   %%xmm0, %%xmm2\n\t"
+         "pxor      %%xmm4, %%xmm2\n\t"
+         "paddd     %%xmm3, %%xmm2\n\t"
+         "pmaxuw    %%xmm1, %%xmm2\n\t"
+         "pminsb    %%xmm0, %%xmm2\n\t"
+         "packusdw  %%xmm3, %%xmm2\n\t"
+         "packssdw  %%xmm1, %%xmm2\n\t"
+         "movdqa    %%xmm2, (%0)\n\t"
+         : /*out*/
+         : /*in*/ "r"(&o[i]), "r"(&a[i]), "r"(&b[i])
+         : /*trash*/ "memory", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4"
+      );
+   }
+}
+#endif
+
+#if defined(BUILD_AVX)
+static float fbuf_a[N_ELEMS] __attribute__((aligned(32)));
+static float fbuf_b[N_ELEMS] __attribute__((aligned(32)));
+static float fbuf_o[N_ELEMS] __attribute__((aligned(32)));
+
+// Single precision add/multiply, compare, min/max, blend and in-lane
+// permute of 8 x 32-bit lanes.  AVX.
+__attribute__((noinline))
+static void kernel_avx ( float* o, const float* a, const float* b, int n )
+{
+   int i;
+   for (i = 0; i < n; i += 8) {
+      __asm__ __volatile__ (
+         "vmovaps   (%1), %%ymm0\n\t"
+         "vmovaps   (%2), %%ymm1\n\t"
+         "vaddps    %%ymm1, %%ymm0, %%ymm2\n\t"
+         "vsubps    %%ymm1, %%ymm0, %%ymm3\n\t"
+         "vmulps    %%ymm3, %%ymm2, %%ymm4\n\t"
+         "vcmpltps  %%ymm3, %%ymm2, %%ymm5\n\t"
+         "vmaxps    %%ymm3, %%ymm2, %%ymm2\n\t"
+         "vminps    %%ymm0, %%ymm3, %%ymm3\n\t"
+         "vblendvps %%ymm5, %%ymm2, %%ymm4, %%ymm4\n\t"
+         "vpermilps $0x1b, %%ymm4, %%ymm4\n\t"
+         "vandps    %%ymm5, %%ymm3, %%ymm3\n\t"
+         "vaddps    %%ymm3, %%ymm4, %%ymm4\n\t"
+         "vshufps   $0x4e, %%ymm1, %%ymm4, %%ymm4\n\t"
+         "vmovaps   %%ymm4, (%0)\n\t"
+         : /*out*/
+         : /*in*/ "r"(&o[i]), "r"(&a[i]), "r"(&b[i])
+         : /*trash*/ "memory", "xmm0", "xmm1", "xmm2", "xmm3",
+                     "xmm4", "xmm5"
+      );
+   }
+   __asm__ __volatile__ ( "vzeroupper" ::: "memory" );
+}
+#endif
+
+#if defined(BUILD_AVX2)
+// The same kind of thing as kernel_sse2, on 16 x 16-bit lanes, plus a
+// cross-lane permute.  AVX2.
+__attribute__((noinline))
+static void kernel_avx2 ( short* o, const short* a, const short* b, int n )
+{
+   int i;
+   for (i = 0; i < n; i += 16) {
+      __asm__ __volatile__ (
+         "vmovdqa   (%1), %%ymm0\n\t"
+         "vmovdqa   (%2), %%ymm1\n\t"
+         "vpaddsw   %%ymm1, %%ymm0, %%ymm2\n\t"
+         "vpsubsw   %%ymm1, %%ymm0, %%ymm3\n\t"
+         "vpcmpgtw  %%ymm3, %%ymm2, %%ymm4\n\t"
+         "vpmaxsw   %%ymm3, %%ymm2, %%ymm2\n\t"
+         "vpminsw   %%ymm0, %%ymm3, %%ymm3\n\t"
+         "vpand     %%ymm4, %%ymm2, %%ymm2\n\t"
+         "vpaddw    %%ymm3, %%ymm2, %%ymm2\n\t"
+         "vpcmpeqw  %%ymm1, %%ymm0, %%ymm0\n\t"
+         "vpsubw    %%ymm0, %%ymm2, %%ymm2\n\t"
+         "vpmulld   %%ymm1, %%ymm2, %%ymm5\n\t"
+         "vpmaxud   %%ymm5, %%ymm3, %%ymm3\n\t"
+         "vpermd    %%ymm3, %%ymm1, %%ymm3\n\t"
+         "vpavgw    %%ymm3, %%ymm2, %%ymm2\n\t"
+         "vmovdqa   %%ymm2, (%0)\n\t"
+         : /*out*/
+         : /*in*/ "r"(&o[i]), "r"(&a[i]), "r"(&b[i])
+         : /*trash*/ "memory", "xmm0", "xmm1", "xmm2", "xmm3",
+                     "xmm4", "xmm5"
+      );
+   }
+   __asm__ __volatile__ ( "vzeroupper" ::: "memory" );
+}
+#endif
+
+#endif /* defined(__x86_64__) */
+
+// Plain C stand-in, of roughly the same shape as kernel_sse2.
+__attribute__((noinline))
+static void kernel_c ( short* o, const short* a, const short* b, int n )
+{
+   int i;
+   for (i = 0; i < n; i++) {
+      int s = a[i] + b[i], d = a[i] - b[i];
+      if (s >  32767) s =  32767;
+      if (s < -32768) s = -32768;
+      if (d >  32767) d =  32767;
+      if (d < -32768) d = -32768;
+      o[i] = (short)((s > d ? s : d) + (a[i] < d ? a[i] : d));
+   }
+}
+
+static unsigned int checksum ( const short* p, int n )
+{
+   unsigned int sum = 0;
+   int i;
+   for (i = 0; i < n; i++)
+      sum = (sum << 1 | sum >> 31) ^ (unsigned short)p[i];
+   return sum;
+}
+
+int main ( void )
+{
+   int i, r;
+   unsigned int sum = 0;
+   int done_simd = 0;
+
+   for (i = 0; i < N_ELEMS; i++) {
+      buf_a[i] = (short)(i * 7919);
+      buf_b[i] = (short)(i * 104729 + 3);
+   }
+   memset(buf_o, 0, sizeof(buf_o));
+
+#  if defined(__x86_64__)
+   for (r = 0; r < REPS; r++)
+      kernel_sse2(buf_o, buf_a, buf_b, N_ELEMS);
+   sum ^= checksum(buf_o, N_ELEMS);
+   done_simd = 1;
+#  if defined(BUILD_SSE42)
+   if (have_sse42()) {
+      for (r = 0; r < REPS; r++)
+         kernel_sse4(buf_o, buf_a, buf_b, N_ELEMS);
+      sum ^= checksum(buf_o, N_ELEMS);
+   }
+#  endif
+#  if defined(BUILD_AVX)
+   if (have_avx()) {
+      for (i = 0; i < N_ELEMS; i++) {
+         fbuf_a[i] = (float)(i % 97) * 0.25f;
+         fbuf_b[i] = (float)(i % 89) * -0.5f;
+      }
+      for (r = 0; r < REPS; r++)
+         kernel_avx(fbuf_o, fbuf_a, fbuf_b, N_ELEMS);
+      for (i = 0; i < N_ELEMS; i++)
+         sum ^= (unsigned int)(int)fbuf_o[i];
+   }
+#  endif
+#  if defined(BUILD_AVX2)
+   if (have_avx2()) {
+      for (r = 0; r < REPS; r++)
+         kernel_avx2(buf_o, buf_a, buf_b, N_ELEMS);
+      sum ^= checksum(buf_o, N_ELEMS);
+   }
+#  endif
+#  endif
+
+   if (!done_simd) {
+      for (r = 0; r < 3 * REPS; r++)
+         kernel_c(buf_o, buf_a, buf_b, N_ELEMS);
+      sum ^= checksum(buf_o, N_ELEMS);
+   }
+
+   printf("checksum %08x\n", sum);
+   return 0;
+}
@@ -0,0 +1,94 @@
+// This artificial program makes many copies of a largish function and
+// runs each copy just once, so that almost all of the time spent under
+// Valgrind goes on translating code rather than running it.  Unlike
+// bigcode, whose copies are small loops run many times, the copies here
+// contain many different blocks of integer, memory and floating point
+// code, which gives the IR optimiser and register allocator something
+// to do.
+//
+// The number of copies can be given on the command line.
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#if defined(__mips__)
+#include <asm/cachectl.h>
+#include <sys/syscall.h>
+#endif
+#include "tests/sys_mman.h"
+
+#define FN_SIZE   4096     // Must be big enough to hold the compiled g()
+#define N_COPIES  3000
+
+// g() must not refer to anything outside itself (no calls, no global
+// data, no floating point literals), since it gets copied.
+__attribute__((noinline))
+long g ( long* p, long x, double d )
+{
+   long   a = p[0], b = p[1], c = p[2];
+   double e = d;
+
+   if (x & 1)   { a += b * 3;  p[3] = a ^ c;   e = e * d; }
+   else         { b -= a >> 2; p[4] = b | c;   e = e - d; }
+   if (x & 2)   { c = (c << 5) - a;  p[5] += c;  e += (double)c; }
+   else         { c = (c >> 3) + b;  p[6] -= c;  e -= (double)b; }
+   if (x & 4)   { a = a * b + c;  p[7] = a;  e = e * e; }
+   else         { a = (a & 0xff) | (b << 8);  p[8] = a;  e = e + d; }
+   if (x & 8)   { b = (unsigned long)b / ((c | 1) & 0xffff); p[9] = b; }
+   else         { b = b % ((a | 1) & 0xfff);  p[10] += b; }
+   if (x & 16)  { c ^= p[a & 7];  e = e / (d + (double)x); }
+   else         { c += p[b & 7];  e = e * (d - (double)a); }
+   if (x & 32)  { a = a < b ? b : a;  p[11] = a + c; }
+   else         { a = a > c ? c : a;  p[12] = a - b; }
+   if (x & 64)  { b = (b << 13) | ((unsigned long)b >> 51);  p[13] ^= b; }
+   else         { b = (b >> 7) ^ (b << 3);  p[14] |= b; }
+   if (x & 128) { c = c * 7 + (a >> 1);  e = e + (double)(a & 0xff); }
+   else         { c = c * 11 - (b >> 1); e = e - (double)(b & 0xff); }
+   if (x & 256) { p[15] = a + b + c;  e *= (double)b; }
+   else         { p[15] = a - b - c;  e /= (double)(c | 1); }
+   if ((long)e > 100) a++;
+   return a + b + c + p[15];
+}
+
+__attribute__((noinline))
+void g_end ( void )
+{
+}
+
+int main(int argc, char* argv[])
+{
+   int   i, n_copies = N_COPIES;
+   long  buf[16], sum = 0;
+   int   fn_size = (char*)g_end - (char*)g;
+
+   if (argc > 1)
+      n_copies = atoi(argv[1]);
+   assert(fn_size > 0 && fn_size <= FN_SIZE);
+   printf("%d copies of g()\n", n_copies);
+
+   char* a = mmap(0, FN_SIZE * n_copies,
+                     PROT_EXEC|PROT_WRITE,
+                     MAP_PRIVATE|MAP_ANONYMOUS, -1,0);
+   assert(a != (char*)MAP_FAILED);
+
+   for (i = 0; i < n_copies; i++) {
+      memcpy(&a[FN_SIZE*i], g, fn_size);
+   }
+
+#if defined(__mips__)
+   syscall(__NR_cacheflush, a, FN_SIZE * n_copies, ICACHE);
+#endif
+
+   for (i = 0; i < 16; i++)
+      buf[i] = i * 12345;
+
+   // Run each copy once, down a different path each time.
+   for (i = 0; i < n_copies; i++) {
+      long (*gi)(long*,long,double) = (void*)&a[FN_SIZE*i];
+      sum += gi(buf, i, (double)i);
+   }
+
+   printf("result = %ld\n", sum);
+   return 0;
+}